@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2015 Red Hat.
+ *
+ * Fetch rate with and without derived metrics over a metric with
+ * an instance domain, to measure the cost of derived metric
+ * evaluation relative to the fetch of the underlying operands.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/impl.h>
+
+static char *exprs[] = {
+    "%s + %s",
+    "%s * 2 - %s",
+    "%s / (2 * %s)",
+    "delta(%s)",
+    "rate(%s)",
+    "sum(%s)",
+};
+#define NEXPR (sizeof(exprs) / sizeof(exprs[0]))
+
+static double
+fetchrate(int numpmid, pmID *pmidlist, int iterations)
+{
+    int			iter;
+    int			sts;
+    pmResult		*result;
+    struct timeval	before, after;
+
+    gettimeofday(&before, (struct timezone *)0);
+    for (iter = 0; iter < iterations; iter++) {
+	if ((sts = pmFetch(numpmid, pmidlist, &result)) < 0) {
+	    printf("%s: iteration %d : %s\n", pmProgname, iter, pmErrStr(sts));
+	    exit(1);
+	}
+	pmFreeResult(result);
+    }
+    gettimeofday(&after, (struct timezone *)0);
+    return (double)iterations / __pmtimevalSub(&after, &before);
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c;
+    int		i;
+    int		j;
+    int		sts;
+    int		errflag = 0;
+    int		verbose = 0;
+    char	*host = "local:";
+    int		type = PM_CONTEXT_HOST;
+    char	*namespace = PM_NS_DEFAULT;
+    int		iterations = 1000;
+    char	*metric;
+    char	*errmsg;
+    char	*names[NEXPR+1];
+    char	buf[1024];
+    pmID	pmids[NEXPR+1];
+    pmDesc	desc;
+    pmResult	*result;
+    double	plain, derived;
+    static char	*usage = "[-v] [-a archive] [-h hostname] [-n namespace] [-i iterations] metric";
+
+    __pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "a:D:h:n:i:v")) != EOF) {
+	switch (c) {
+
+	case 'a':	/* archive name */
+	    type = PM_CONTEXT_ARCHIVE;
+	    host = optarg;
+	    break;
+
+#ifdef PCP_DEBUG
+	case 'D':	/* debug flag */
+	    sts = __pmParseDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug flag specification (%s)\n",
+		    pmProgname, optarg);
+		errflag++;
+	    }
+	    else
+		pmDebug |= sts;
+	    break;
+#endif
+
+	case 'h':	/* hostname for PMCD to contact */
+	    type = PM_CONTEXT_HOST;
+	    host = optarg;
+	    break;
+
+	case 'i':	/* iterations */
+	    iterations = atoi(optarg);
+	    break;
+
+	case 'n':	/* alternative name space file */
+	    namespace = optarg;
+	    break;
+
+	case 'v':	/* report values from the last fetch */
+	    verbose++;
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    /* non-flag args are argv[optind] ... argv[argc-1] */
+    if (errflag || optind != argc-1 || iterations < 2) {
+	fprintf(stderr, "Usage: %s %s\n", pmProgname, usage);
+	exit(1);
+    }
+    metric = argv[optind];
+
+    /* derived metrics must be registered before the context is created */
+    names[0] = metric;
+    for (i = 0; i < NEXPR; i++) {
+	snprintf(buf, sizeof(buf), "derivefetch.m%d", i);
+	names[i+1] = strdup(buf);
+	snprintf(buf, sizeof(buf), exprs[i], metric, metric);
+	if ((errmsg = pmRegisterDerived(names[i+1], buf)) != NULL) {
+	    printf("%s: pmRegisterDerived(%s): %s\n", pmProgname, buf, pmDerivedErrStr());
+	    exit(1);
+	}
+    }
+
+    if (namespace != PM_NS_DEFAULT &&
+	(sts = pmLoadNameSpace(namespace)) < 0) {
+	printf("%s: Cannot load namespace from \"%s\": %s\n", pmProgname, namespace, pmErrStr(sts));
+	exit(1);
+    }
+
+    if ((sts = pmNewContext(type, host)) < 0) {
+	printf("%s: Cannot create context for \"%s\": %s\n", pmProgname, host, pmErrStr(sts));
+	exit(1);
+    }
+
+    if ((sts = pmLookupName(NEXPR+1, names, pmids)) < 0) {
+	printf("%s: pmLookupName: %s\n", pmProgname, pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmLookupDesc(pmids[0], &desc)) < 0) {
+	printf("%s: pmLookupDesc(%s): %s\n", pmProgname, metric, pmErrStr(sts));
+	exit(1);
+    }
+    if (desc.indom == PM_INDOM_NULL)
+	fprintf(stderr, "%s: warning: %s has no instance domain\n", pmProgname, metric);
+
+    plain = fetchrate(1, pmids, iterations);
+    derived = fetchrate(NEXPR+1, pmids, iterations);
+
+    printf("%s: metric %s %.2f fetches/second\n", pmProgname, metric, plain);
+    printf("%s: with %d derived metrics %.2f fetches/second\n",
+	pmProgname, (int)NEXPR, derived);
+    printf("%s: derived metric cost %.1f usec/fetch\n",
+	pmProgname, 1000000 * (1 / derived - 1 / plain));
+
+    if (verbose) {
+	if ((sts = pmFetch(NEXPR+1, pmids, &result)) < 0) {
+	    printf("%s: pmFetch: %s\n", pmProgname, pmErrStr(sts));
+	    exit(1);
+	}
+	for (i = 1; i <= NEXPR; i++) {
+	    pmValueSet	*vsp = result->vset[i];
+
+	    snprintf(buf, sizeof(buf), exprs[i-1], metric, metric);
+	    if (vsp->numval < 0) {
+		printf("%s: %s %s\n", names[i], buf, pmErrStr(vsp->numval));
+		continue;
+	    }
+	    if ((sts = pmLookupDesc(pmids[i], &desc)) < 0) {
+		printf("%s: pmLookupDesc(%s): %s\n", pmProgname, names[i], pmErrStr(sts));
+		exit(1);
+	    }
+	    printf("%s: %s numval %d\n", names[i], buf, vsp->numval);
+	    for (j = 0; j < vsp->numval; j++) {
+		printf("    inst [%d] ", vsp->vlist[j].inst);
+		pmPrintValue(stdout, vsp->valfmt, desc.type, &vsp->vlist[j], 1);
+		putchar('\n');
+	    }
+	}
+	pmFreeResult(result);
+    }
+
+    pmDestroyContext(pmWhichContext());
+    exit(0);
+}
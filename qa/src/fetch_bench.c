@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2015 Red Hat.
+ *
+ * Microbenchmark for pmdaFetch, driving a DSO PMDA directly in the way
+ * dbpmda and pmcd do ... fetches every metric of the PMDA that has an
+ * instance domain, first using the PMDA's batch callback (if it has
+ * one) and then with the batch callback removed so that every value
+ * comes from the per-instance fetch callback, and reports the time per
+ * fetch and per value for each.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/impl.h>
+#include <pcp/pmda.h>
+#include <dlfcn.h>
+
+static pmdaInterface	dispatch;
+static int		passes = 1000;
+static int		cluster = -1;
+static int		numpmid;
+static pmID		*pmidlist;
+static char		*uid;
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+		"Usage: %s [options] domain dso init\n\n"
+		"Options:\n"
+		"  -c cluster  only metrics from this cluster\n"
+		"  -n count    number of fetches (default 1000)\n"
+		"  -U uid      client user and group identifier, as pmcd sends\n",
+	    pmProgname);
+    exit(1);
+}
+
+static double
+now(void)
+{
+    struct timeval tv;
+
+    __pmtimevalNow(&tv);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void
+check(int sts, const char *what)
+{
+    if (sts < 0) {
+	fprintf(stderr, "%s: %s: %s\n", pmProgname, what, pmErrStr(sts));
+	exit(1);
+    }
+}
+
+static void
+opendso(const char *dso, const char *init, int domain)
+{
+    void	(*initp)(pmdaInterface *);
+    void	*handle;
+
+    if ((handle = dlopen(dso, RTLD_LAZY)) == NULL) {
+	fprintf(stderr, "%s: %s\n", pmProgname, dlerror());
+	exit(1);
+    }
+    if ((initp = (void (*)(pmdaInterface *))dlsym(handle, init)) == NULL) {
+	fprintf(stderr, "%s: no \"%s\" in %s\n", pmProgname, init, dso);
+	exit(1);
+    }
+    dispatch.comm.pmda_interface = 0xff;
+    dispatch.comm.pmapi_version = ~PMAPI_VERSION;
+    dispatch.domain = domain;
+    (*initp)(&dispatch);
+    check(dispatch.status, init);
+    if (dispatch.comm.pmda_interface < PMDA_INTERFACE_2 ||
+	dispatch.comm.pmda_interface > PMDA_INTERFACE_LATEST) {
+	fprintf(stderr, "%s: %s: unsupported PMDA interface %d\n",
+		pmProgname, dso, dispatch.comm.pmda_interface);
+	exit(1);
+    }
+    if (dispatch.comm.pmda_interface >= PMDA_INTERFACE_5)
+	dispatch.version.any.ext->e_context = 0;
+    if (uid != NULL && dispatch.comm.pmda_interface >= PMDA_INTERFACE_6) {
+	check(dispatch.version.six.attribute(0, PCP_ATTR_USERID, uid,
+			strlen(uid) + 1, dispatch.version.six.ext), "attribute");
+	check(dispatch.version.six.attribute(0, PCP_ATTR_GROUPID, uid,
+			strlen(uid) + 1, dispatch.version.six.ext), "attribute");
+    }
+}
+
+/* returns the number of values in the result */
+static int
+fetch(void)
+{
+    pmResult	*rp;
+    int		i, n = 0;
+
+    check(dispatch.version.any.fetch(numpmid, pmidlist, &rp,
+				dispatch.version.any.ext), "fetch");
+    for (i = 0; i < rp->numpmid; i++)
+	if (rp->vset[i]->numval > 0)
+	    n += rp->vset[i]->numval;
+    /* the PMDA owns the pmResult, only the values are ours */
+    __pmFreeResultValues(rp);
+    return n;
+}
+
+static void
+bench(const char *how)
+{
+    double	t0, elapsed;
+    int		i, n = 0;
+
+    fetch();	/* first fetch reads everything in, not timed */
+    t0 = now();
+    for (i = 0; i < passes; i++)
+	n += fetch();
+    elapsed = now() - t0;
+    printf("%-9s %6d fetches %8d values %8.3f sec %8.1f usec/fetch %6.3f usec/value\n",
+	    how, passes, n / passes, elapsed, elapsed * 1e6 / passes,
+	    n ? elapsed * 1e6 / n : 0.0);
+}
+
+int
+main(int argc, char *argv[])
+{
+    pmdaExt	*pmda;
+    pmResult	*rp;
+    int		c, i;
+
+    __pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "c:n:U:")) != EOF) {
+	switch (c) {
+	case 'c':
+	    cluster = atoi(optarg);
+	    break;
+	case 'n':
+	    passes = atoi(optarg);
+	    break;
+	case 'U':
+	    uid = optarg;
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (optind != argc - 3 || passes < 1)
+	usage();
+
+    opendso(argv[optind+1], argv[optind+2], atoi(argv[optind]));
+    pmda = dispatch.version.any.ext;
+
+    /* some PMDAs only fill in their metric table on the first fetch */
+    if (pmda->e_nmetrics > 0) {
+	pmID	pmid = pmda->e_metrics[0].m_desc.pmid;
+
+	if (dispatch.version.any.fetch(1, &pmid, &rp, pmda) >= 0)
+	    __pmFreeResultValues(rp);
+    }
+    for (i = 0; i < pmda->e_nmetrics; i++) {
+	pmDesc	*dp = &pmda->e_metrics[i].m_desc;
+
+	if (dp->indom == PM_INDOM_NULL)
+	    continue;
+	if (cluster >= 0 && pmid_cluster(dp->pmid) != cluster)
+	    continue;
+	if ((pmidlist = realloc(pmidlist, (numpmid + 1) * sizeof(pmID))) == NULL) {
+	    perror("realloc");
+	    exit(1);
+	}
+	pmidlist[numpmid++] = dp->pmid;
+    }
+    if (numpmid == 0) {
+	fprintf(stderr, "%s: no metrics with an instance domain\n", pmProgname);
+	exit(1);
+    }
+    printf("%d metrics\n", numpmid);
+
+    bench("batch");
+    pmdaSetFetchBatchCallBack(&dispatch, NULL);
+    bench("instance");
+
+    return 0;
+}
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2015 Red Hat.
+ *
+ * Microbenchmark for libpcp_import, creating the same archive with
+ * pmiPutValueHandle (string values, one pmiWrite per record) and with
+ * pmiWriteColumns (binary columns, all records in one call) ... the
+ * two archives should be identical when reported by pmdumplog.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/impl.h>
+#include <pcp/import.h>
+
+static int types[] = {
+    PM_TYPE_32, PM_TYPE_U32, PM_TYPE_64, PM_TYPE_U64,
+    PM_TYPE_FLOAT, PM_TYPE_DOUBLE, PM_TYPE_STRING
+};
+#define NTYPES (sizeof(types) / sizeof(types[0]))
+
+static int	nmetrics = 14;
+static int	ninsts = 10;
+static int	nrows = 10000;
+static int	ncols;
+static int	*handles;
+static int	*coltype;
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+		"Usage: %s [options] strarchive bulkarchive\n\n"
+		"Options:\n"
+		"  -i count  instances for metrics with an indom (default 10)\n"
+		"  -m count  metrics, cycling through the types (default 14)\n"
+		"  -n count  records (default 10000)\n",
+	    pmProgname);
+    exit(1);
+}
+
+static double
+now(void)
+{
+    struct timeval tv;
+
+    __pmtimevalNow(&tv);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void
+check(int sts, const char *what)
+{
+    if (sts < 0) {
+	fprintf(stderr, "%s: %s: %s\n", pmProgname, what, pmiErrStr(sts));
+	exit(1);
+    }
+}
+
+/* value for row r, column c - exact in binary, so strings convert back */
+static double
+value(int r, int c)
+{
+    return (double)r * 0.5 + c;
+}
+
+/* define the metrics and instances, and a handle for each column */
+static void
+setup(const char *archive)
+{
+    pmInDom	indom = pmiInDom(245, 1);
+    char	name[64];
+    char	inst[32];
+    int		m, i;
+
+    check(pmiStart(archive, 0), "pmiStart");
+    check(pmiSetHostname("bench.localdomain"), "pmiSetHostname");
+    check(pmiSetTimezone("UTC"), "pmiSetTimezone");
+    for (i = 0; i < ninsts; i++) {
+	snprintf(inst, sizeof(inst), "inst%d", i);
+	check(pmiAddInstance(indom, inst, i), "pmiAddInstance");
+    }
+    for (ncols = m = 0; m < nmetrics; m++) {
+	snprintf(name, sizeof(name), "bench.metric%d", m);
+	check(pmiAddMetric(name, pmiID(245, 0, m), types[m % NTYPES],
+		(m & 1) ? indom : PM_INDOM_NULL, PM_SEM_INSTANT,
+		pmiUnits(0, 0, 0, 0, 0, 0)), "pmiAddMetric");
+	if ((m & 1) == 0) {
+	    coltype[ncols] = types[m % NTYPES];
+	    check(handles[ncols++] = pmiGetHandle(name, NULL), "pmiGetHandle");
+	    continue;
+	}
+	for (i = 0; i < ninsts; i++) {
+	    snprintf(inst, sizeof(inst), "inst%d", i);
+	    coltype[ncols] = types[m % NTYPES];
+	    check(handles[ncols++] = pmiGetHandle(name, inst), "pmiGetHandle");
+	}
+    }
+}
+
+static void
+format(char *buf, size_t buflen, int type, double v)
+{
+    if (type == PM_TYPE_FLOAT || type == PM_TYPE_DOUBLE)
+	snprintf(buf, buflen, "%.1f", v);
+    else if (type == PM_TYPE_STRING)
+	snprintf(buf, buflen, "value %.1f", v);
+    else
+	snprintf(buf, buflen, "%d", (int)v);
+}
+
+static double
+strings(const char *archive)
+{
+    char	buf[64];
+    double	start;
+    int		r, c;
+
+    setup(archive);
+    start = now();
+    for (r = 0; r < nrows; r++) {
+	for (c = 0; c < ncols; c++) {
+	    format(buf, sizeof(buf), coltype[c], value(r, c));
+	    check(pmiPutValueHandle(handles[c], buf), "pmiPutValueHandle");
+	}
+	check(pmiWrite(r, 0), "pmiWrite");
+    }
+    check(pmiEnd(), "pmiEnd");
+    return now() - start;
+}
+
+static double
+columns(const char *archive)
+{
+    struct timeval	*stamps;
+    const void		**cols;
+    char		buf[64];
+    double		start, v;
+    int			r, c;
+
+    setup(archive);
+    stamps = (struct timeval *)calloc(nrows, sizeof(struct timeval));
+    cols = (const void **)calloc(ncols, sizeof(void *));
+    if (stamps == NULL || cols == NULL) {
+	perror("calloc");
+	exit(1);
+    }
+    for (r = 0; r < nrows; r++)
+	stamps[r].tv_sec = r;
+
+    /* build the columns as a columnar source would provide them */
+    for (c = 0; c < ncols; c++) {
+	__int32_t	*lp = NULL;
+	__int64_t	*llp = NULL;
+	float		*fp = NULL;
+	double		*dp = NULL;
+	char		**cpp = NULL;
+
+	switch (coltype[c]) {
+	    case PM_TYPE_32:
+	    case PM_TYPE_U32:
+		cols[c] = lp = (__int32_t *)malloc(nrows * sizeof(*lp));
+		break;
+	    case PM_TYPE_64:
+	    case PM_TYPE_U64:
+		cols[c] = llp = (__int64_t *)malloc(nrows * sizeof(*llp));
+		break;
+	    case PM_TYPE_FLOAT:
+		cols[c] = fp = (float *)malloc(nrows * sizeof(*fp));
+		break;
+	    case PM_TYPE_DOUBLE:
+		cols[c] = dp = (double *)malloc(nrows * sizeof(*dp));
+		break;
+	    case PM_TYPE_STRING:
+		cols[c] = cpp = (char **)malloc(nrows * sizeof(*cpp));
+		break;
+	}
+	if (cols[c] == NULL) {
+	    perror("malloc");
+	    exit(1);
+	}
+	for (r = 0; r < nrows; r++) {
+	    v = value(r, c);
+	    if (lp != NULL)
+		lp[r] = (__int32_t)v;
+	    else if (llp != NULL)
+		llp[r] = (__int64_t)v;
+	    else if (fp != NULL)
+		fp[r] = (float)v;
+	    else if (dp != NULL)
+		dp[r] = v;
+	    else {
+		format(buf, sizeof(buf), PM_TYPE_STRING, v);
+		cpp[r] = strdup(buf);
+	    }
+	}
+    }
+
+    start = now();
+    check(pmiWriteColumns(nrows, stamps, ncols, handles, cols),
+	    "pmiWriteColumns");
+    check(pmiEnd(), "pmiEnd");
+    return now() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+    double	elapsed;
+    int		c;
+
+    __pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "i:m:n:")) != EOF) {
+	switch (c) {
+	case 'i':
+	    ninsts = atoi(optarg);
+	    break;
+	case 'm':
+	    nmetrics = atoi(optarg);
+	    break;
+	case 'n':
+	    nrows = atoi(optarg);
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (optind != argc - 2 || ninsts < 1 || nmetrics < 1 || nrows < 1)
+	usage();
+
+    handles = (int *)calloc(nmetrics * ninsts, sizeof(int));
+    coltype = (int *)calloc(nmetrics * ninsts, sizeof(int));
+    if (handles == NULL || coltype == NULL) {
+	perror("calloc");
+	exit(1);
+    }
+
+    elapsed = strings(argv[optind]);
+    printf("%d records x %d values (pmiPutValueHandle): %.3f sec, %.1f nsec/value\n",
+	    nrows, ncols, elapsed, elapsed * 1e9 / ((double)nrows * ncols));
+    elapsed = columns(argv[optind+1]);
+    printf("%d records x %d values (pmiWriteColumns): %.3f sec, %.1f nsec/value\n",
+	    nrows, ncols, elapsed, elapsed * 1e9 / ((double)nrows * ncols));
+
+    return 0;
+}
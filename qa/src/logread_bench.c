@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2015 Red Hat.
+ *
+ * Microbenchmark for archive reads, comparing the mapped read path for
+ * uncompressed volumes with stdio (PCP_ARCHIVE_NOMMAP set) ... reads
+ * every record forwards, then backwards, then fetches every metric in
+ * interpolated mode, and reports the time per record for each.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/impl.h>
+
+static int	passes = 10;
+static int	numpmid;
+static pmID	*pmidlist;
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+		"Usage: %s [options] archive\n\n"
+		"Options:\n"
+		"  -n count  passes over the archive (default 10)\n"
+		"  -t delta  interpolation interval (default 10sec)\n",
+	    pmProgname);
+    exit(1);
+}
+
+static double
+now(void)
+{
+    struct timeval tv;
+
+    __pmtimevalNow(&tv);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void
+check(int sts, const char *what)
+{
+    if (sts < 0) {
+	fprintf(stderr, "%s: %s: %s\n", pmProgname, what, pmErrStr(sts));
+	exit(1);
+    }
+}
+
+static void
+addpmid(const char *name)
+{
+    pmID	pmid;
+
+    if (pmLookupName(1, (char **)&name, &pmid) < 0)
+	return;
+    if ((pmidlist = realloc(pmidlist, (numpmid + 1) * sizeof(pmID))) == NULL) {
+	perror("realloc");
+	exit(1);
+    }
+    pmidlist[numpmid++] = pmid;
+}
+
+/* returns records read, all passes */
+static int
+scan(int mode, struct timeval *origin)
+{
+    pmResult	*rp;
+    int		i, sts, n = 0;
+
+    for (i = 0; i < passes; i++) {
+	check(pmSetMode(mode, origin, 0), "pmSetMode");
+	while ((sts = pmFetchArchive(&rp)) >= 0) {
+	    pmFreeResult(rp);
+	    n++;
+	}
+	if (sts != PM_ERR_EOL)
+	    check(sts, "pmFetchArchive");
+    }
+    return n;
+}
+
+static int
+interp(struct timeval *start, struct timeval *end, struct timeval *delta)
+{
+    pmResult	*rp;
+    int		i, sts, n = 0;
+
+    for (i = 0; i < passes; i++) {
+	check(pmSetMode(PM_MODE_INTERP, start, delta->tv_sec * 1000 +
+		delta->tv_usec / 1000), "pmSetMode");
+	while ((sts = pmFetch(numpmid, pmidlist, &rp)) >= 0) {
+	    if (rp->timestamp.tv_sec > end->tv_sec) {
+		pmFreeResult(rp);
+		break;
+	    }
+	    pmFreeResult(rp);
+	    n++;
+	}
+	if (sts < 0 && sts != PM_ERR_EOL)
+	    check(sts, "pmFetch");
+    }
+    return n;
+}
+
+static void
+report(const char *how, const char *what, int n, double elapsed, int reads)
+{
+    printf("%-6s %-7s %8d results %8.3f sec %8.1f usec/result %8d log reads\n",
+	    how, what, n, elapsed, n ? elapsed * 1e6 / n : 0.0, reads);
+}
+
+static void
+bench(const char *archive, const char *how, struct timeval *delta)
+{
+    struct timeval	start, end;
+    pmLogLabel		label;
+    double		t0;
+    int			ctx, n, reads;
+
+    check(ctx = pmNewContext(PM_CONTEXT_ARCHIVE, archive), "pmNewContext");
+    check(pmGetArchiveLabel(&label), "pmGetArchiveLabel");
+    check(pmGetArchiveEnd(&end), "pmGetArchiveEnd");
+    start = label.ll_start;
+    if (numpmid == 0)
+	check(pmTraversePMNS("", addpmid), "pmTraversePMNS");
+
+    reads = __pmLogReads;
+    t0 = now();
+    n = scan(PM_MODE_FORW, &start);
+    report(how, "forward", n, now() - t0, __pmLogReads - reads);
+
+    reads = __pmLogReads;
+    t0 = now();
+    n = scan(PM_MODE_BACK, &end);
+    report(how, "back", n, now() - t0, __pmLogReads - reads);
+
+    reads = __pmLogReads;
+    t0 = now();
+    n = interp(&start, &end, delta);
+    report(how, "interp", n, now() - t0, __pmLogReads - reads);
+
+    pmDestroyContext(ctx);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct timeval	delta = { 10, 0 };
+    char		*msg;
+    int			c;
+
+    __pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "n:t:")) != EOF) {
+	switch (c) {
+	case 'n':
+	    passes = atoi(optarg);
+	    break;
+	case 't':
+	    if (pmParseInterval(optarg, &delta, &msg) < 0) {
+		fprintf(stderr, "%s", msg);
+		free(msg);
+		usage();
+	    }
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (optind != argc - 1 || passes < 1)
+	usage();
+
+    /* the environment is checked as each volume is opened */
+    setenv("PCP_ARCHIVE_NOMMAP", "1", 1);
+    bench(argv[optind], "stdio", &delta);
+    unsetenv("PCP_ARCHIVE_NOMMAP");
+    bench(argv[optind], "mapped", &delta);
+
+    return 0;
+}
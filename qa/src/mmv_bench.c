@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2015 Red Hat.
+ *
+ * Microbenchmark for libpcp_mmv value lookup and increment, as done by
+ * mmv_stats_inc() on the request path of an instrumented service, for
+ * concurrent increments of one counter from several threads, and for
+ * recording values in a histogram.
+ */
+
+#include <pthread.h>
+#include <inttypes.h>
+#include <pcp/pmapi.h>
+#include <pcp/impl.h>
+#include <pcp/mmv_stats.h>
+#include <pcp/mmv_dev.h>
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+		"Usage: %s [options] file\n\n"
+		"Options:\n"
+		"  -H        also time histogram recording\n"
+		"  -i count  instances per metric (default 1000)\n"
+		"  -l        hide the hash section, timing the linear scan\n"
+		"  -m count  metrics (default 20)\n"
+		"  -n count  number of lookups (default 1000000)\n"
+		"  -s        shard counters (MMV_FLAG_SHARDED)\n"
+		"  -t count  threads incrementing one counter (default 0)\n",
+	    pmProgname);
+    exit(1);
+}
+
+static double
+now(void)
+{
+    struct timeval tv;
+
+    __pmtimevalNow(&tv);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void		*base;
+static pmAtomValue	*hot;
+static int		incs;
+
+static void *
+incrementer(void *arg)
+{
+    int		n;
+
+    for (n = 0; n < incs; n++)
+	mmv_inc_uint(base, hot, 1);
+    return NULL;
+}
+
+/* value of a counter as pmdammv reports it, shards included */
+static __uint64_t
+total(void *addr, pmAtomValue *av)
+{
+    mmv_disk_header_t	*hdr = (mmv_disk_header_t *)addr;
+    mmv_disk_toc_t	*toc;
+    mmv_disk_value_t	*v = (mmv_disk_value_t *)av;
+    mmv_disk_shard_t	*shard;
+    __uint64_t		sum = av->ull;
+    int			i, j;
+
+    toc = (mmv_disk_toc_t *)((char *)addr + sizeof(mmv_disk_header_t));
+    for (i = 0; i < hdr->tocs; i++) {
+	if (toc[i].type != MMV_TOC_SHARDS || v->extra == 0)
+	    continue;
+	shard = (mmv_disk_shard_t *)((char *)addr + v->extra);
+	for (j = 0; j < toc[i].count; j++)
+	    sum += shard[j].value.ull;
+    }
+    return sum;
+}
+
+int
+main(int argc, char *argv[])
+{
+    mmv_disk_header_t	*hdr;
+    mmv_disk_toc_t	*toc;
+    mmv_instances_t	*insts;
+    mmv_metric_t	*metrics;
+    mmv_indom_t		indom;
+    pmAtomValue		*av;
+    mmv_disk_histogram_t *hist;
+    char		**names;
+    pthread_t		*tids;
+    mmv_stats_flags_t	flags = 0;
+    void		*addr;
+    double		start, elapsed;
+    __uint64_t		before, after;
+    int			c, i, m, n;
+    int			histogram = 0, linear = 0, misses = 0, nthreads = 0, sts = 0;
+    int			ninsts = 1000, nmetrics = 20, count = 1000000;
+
+    __pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "Hi:lm:n:st:")) != EOF) {
+	switch (c) {
+	case 'H':
+	    histogram = 1;
+	    break;
+	case 'i':
+	    ninsts = atoi(optarg);
+	    break;
+	case 'l':
+	    linear = 1;
+	    break;
+	case 'm':
+	    nmetrics = atoi(optarg);
+	    break;
+	case 'n':
+	    count = atoi(optarg);
+	    break;
+	case 's':
+	    flags |= MMV_FLAG_SHARDED;
+	    break;
+	case 't':
+	    nthreads = atoi(optarg);
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (optind != argc - 1 || ninsts < 1 || nmetrics < 1 || count < 1 ||
+	nthreads < 0)
+	usage();
+
+    insts = calloc(ninsts, sizeof(mmv_instances_t));
+    names = calloc(ninsts, sizeof(char *));
+    metrics = calloc(nmetrics + 1, sizeof(mmv_metric_t));
+    if (insts == NULL || names == NULL || metrics == NULL) {
+	perror("calloc");
+	exit(1);
+    }
+    for (i = 0; i < ninsts; i++) {
+	insts[i].internal = i;
+	snprintf(insts[i].external, MMV_NAMEMAX, "request/%d", i);
+	names[i] = insts[i].external;
+    }
+    memset(&indom, 0, sizeof(indom));
+    indom.serial = 1;
+    indom.count = ninsts;
+    indom.instances = insts;
+    for (m = 0; m < nmetrics; m++) {
+	snprintf(metrics[m].name, MMV_NAMEMAX, "bench.metric%d", m);
+	metrics[m].item = m + 1;
+	metrics[m].type = MMV_TYPE_U64;
+	metrics[m].semantics = MMV_SEM_COUNTER;
+	metrics[m].indom = 1;
+    }
+    if (histogram) {
+	strcpy(metrics[m].name, "bench.latency");
+	metrics[m].item = m + 1;
+	metrics[m].type = MMV_TYPE_HISTOGRAM;
+	metrics[m].semantics = MMV_SEM_INSTANT;
+    }
+
+    addr = mmv_stats_init(argv[optind], 0, flags,
+			metrics, nmetrics + histogram, &indom, 1);
+    if (addr == NULL) {
+	fprintf(stderr, "%s: mmv_stats_init failed: %s\n",
+		pmProgname, osstrerror());
+	exit(1);
+    }
+
+    if (linear) {
+	hdr = (mmv_disk_header_t *)addr;
+	toc = (mmv_disk_toc_t *)((char *)addr + sizeof(mmv_disk_header_t));
+	for (i = 0; i < hdr->tocs; i++)
+	    if (toc[i].type == MMV_TOC_HASH)
+		toc[i].count = 0;
+    }
+
+    /* stride through instances so consecutive lookups are not adjacent */
+    start = now();
+    for (n = 0; n < count; n++) {
+	m = n % nmetrics;
+	i = (int)(((__uint64_t)n * 7919) % ninsts);
+	av = mmv_lookup_value_desc(addr, metrics[m].name, names[i]);
+	if (av == NULL)
+	    misses++;
+	else
+	    mmv_inc_value(addr, av, 1);
+    }
+    elapsed = now() - start;
+
+    printf("%d values, %d lookups (%s): %.3f sec, %.1f nsec/op, %d misses\n",
+	    nmetrics * ninsts, count, linear ? "linear" : "hashed",
+	    elapsed, elapsed * 1e9 / count, misses);
+    if (misses)
+	sts = 1;
+
+    if (nthreads > 0) {
+	if ((tids = calloc(nthreads, sizeof(pthread_t))) == NULL) {
+	    perror("calloc");
+	    exit(1);
+	}
+	base = addr;
+	hot = mmv_lookup_value_desc(addr, metrics[0].name, names[0]);
+	incs = count;
+	before = total(addr, hot);
+
+	start = now();
+	for (i = 0; i < nthreads; i++)
+	    pthread_create(&tids[i], NULL, incrementer, NULL);
+	for (i = 0; i < nthreads; i++)
+	    pthread_join(tids[i], NULL);
+	elapsed = now() - start;
+	after = total(addr, hot);
+
+	printf("%d threads x %d increments (%s): %.3f sec, %.1f nsec/op, "
+		"%" PRIu64 " lost\n",
+		nthreads, count,
+		(flags & MMV_FLAG_SHARDED) ? "sharded" : "shared",
+		elapsed, elapsed * 1e9 / ((double)nthreads * count),
+		(__uint64_t)nthreads * count - (after - before));
+	if (after - before != (__uint64_t)nthreads * count)
+	    sts = 1;
+	free(tids);
+    }
+
+    if (histogram) {
+	av = mmv_lookup_value_desc(addr, "bench.latency", NULL);
+	start = now();
+	for (n = 0; n < count; n++)
+	    mmv_histogram_record(addr, av, (__uint64_t)n * 7919);
+	elapsed = now() - start;
+
+	hist = (mmv_disk_histogram_t *)
+		((char *)addr + ((mmv_disk_value_t *)av)->extra);
+	for (after = 0, i = 0; i < MMV_HIST_BUCKETS; i++)
+	    after += hist->buckets[i];
+	printf("%d histogram values: %.3f sec, %.1f nsec/op, %" PRIu64 " lost\n",
+		count, elapsed, elapsed * 1e9 / count, count - after);
+	if (after != count || hist->max != (__uint64_t)(count - 1) * 7919)
+	    sts = 1;
+    }
+
+    mmv_stats_stop(argv[optind], addr);
+    return sts;
+}
@@ -19,7 +19,8 @@ usage(void)
 		"Usage: %s: [options] file\n\n"
 		"Options:\n"
 		"  -f flag  set flag in header (none, noprefix, process)\n"
-		"  -p pid   overwrite MMV file PID with given PID\n",
+		"  -p pid   overwrite MMV file PID with given PID\n"
+		"  -v vers  rewrite as given file version (1 drops the hash)\n",
 	    pmProgname);
     exit(1);
 }
@@ -47,15 +48,36 @@ write_pid(int pid)
     hdr->g1 = ++hdr->g2;
 }
 
+void
+write_version(int version)
+{
+    mmv_disk_header_t *hdr = (mmv_disk_header_t *)addr;
+    mmv_disk_toc_t *toc = (mmv_disk_toc_t *)((char *)addr + sizeof(*hdr));
+    int i;
+
+    /* version 1 files have no MMV_TOC_HASH section */
+    if (version == MMV_VERSION1) {
+	for (i = 0; i < hdr->tocs; i++) {
+	    if (toc[i].type != MMV_TOC_HASH)
+		continue;
+	    memmove(&toc[i], &toc[i+1], (hdr->tocs - i - 1) * sizeof(*toc));
+	    hdr->tocs--;
+	    break;
+	}
+    }
+    hdr->version = version;
+    hdr->g1 = ++hdr->g2;
+}
+
 int
 main(int argc, char **argv)
 {
     struct stat sbuf;
     char *file, *flags = NULL;
-    int c, err = 0, pid = 0;
+    int c, err = 0, pid = 0, version = 0;
 
     __pmSetProgname(argv[0]);
-    while ((c = getopt(argc, argv, "f:p:")) != EOF) {
+    while ((c = getopt(argc, argv, "f:p:v:")) != EOF) {
 	switch (c) {
 	case 'f':
 	    flags = optarg;
@@ -63,6 +85,9 @@ main(int argc, char **argv)
 	case 'p':
 	    pid = atoi(optarg);
 	    break;
+	case 'v':
+	    version = atoi(optarg);
+	    break;
 	default:
 	    err++;
 	}
@@ -89,6 +114,9 @@ main(int argc, char **argv)
     if (pid)
 	write_pid(pid);
 
+    if (version)
+	write_version(version);
+
     __pmMemoryUnmap(addr, sbuf.st_size);
     exit(0);
 }
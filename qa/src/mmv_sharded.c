@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2015 Red Hat.
+ *
+ * Write an MMV file with known values for PCPQA - integer counters
+ * incremented from several threads and a histogram.  By default the
+ * counters are sharded (MMV_FLAG_SHARDED) and the file is version 3,
+ * with -p the same counters are written unsharded and without the
+ * histogram, giving a version 2 file with identical values.
+ */
+
+#include <pthread.h>
+#include <pcp/pmapi.h>
+#include <pcp/impl.h>
+#include <pcp/mmv_stats.h>
+
+#define THREADS		4
+#define INCREMENTS	10000
+
+static mmv_instances_t ops_instances[] = {
+    { 0, "read" },
+    { 1, "write" },
+};
+
+static mmv_indom_t indoms[] = {
+    {	.serial = 1,
+	.count = 2,
+	.instances = ops_instances,
+	.shorttext = "I/O operations",
+    },
+};
+
+static mmv_metric_t metrics[] = {
+    {	.name = "hits",
+	.item = 1,
+	.type = MMV_TYPE_U64,
+	.semantics = MMV_SEM_COUNTER,
+	.dimension = MMV_UNITS(0,0,1,0,0,PM_COUNT_ONE),
+	.shorttext = "sharded 64-bit counter",
+    },
+    {	.name = "ops",
+	.item = 2,
+	.type = MMV_TYPE_U32,
+	.semantics = MMV_SEM_COUNTER,
+	.dimension = MMV_UNITS(0,0,1,0,0,PM_COUNT_ONE),
+	.indom = 1,
+	.shorttext = "sharded 32-bit counter with instances",
+    },
+    {	.name = "bytes",
+	.item = 3,
+	.type = MMV_TYPE_I64,
+	.semantics = MMV_SEM_COUNTER,
+	.dimension = MMV_UNITS(1,0,0,PM_SPACE_BYTE,0,0),
+	.shorttext = "sharded signed 64-bit counter",
+    },
+    {	.name = "level",
+	.item = 4,
+	.type = MMV_TYPE_U32,
+	.semantics = MMV_SEM_INSTANT,
+	.dimension = MMV_UNITS(0,0,0,0,0,0),
+	.shorttext = "instant value, never sharded",
+    },
+    {	.name = "latency",
+	.item = 5,
+	.type = MMV_TYPE_HISTOGRAM,
+	.semantics = MMV_SEM_COUNTER,
+	.dimension = MMV_UNITS(0,1,0,0,PM_TIME_USEC,0),
+	.shorttext = "histogram of recorded values",
+    },
+};
+
+static void		*addr;
+static pmAtomValue	*hits, *reads, *writes, *bytes;
+
+static void *
+incrementer(void *arg)
+{
+    int		n;
+
+    for (n = 0; n < INCREMENTS; n++) {
+	mmv_inc_uint(addr, hits, 1);
+	mmv_inc_value(addr, reads, 1);
+	if (n % 10 == 0)
+	    mmv_inc_int(addr, writes, 2);
+	mmv_inc_int(addr, bytes, 4096);
+    }
+    return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+    pthread_t		tid[THREADS];
+    mmv_stats_flags_t	flags = MMV_FLAG_SHARDED;
+    int			nmetrics = sizeof(metrics) / sizeof(metrics[0]);
+    int			c, i, err = 0;
+    static __uint64_t	values[] = { 0, 1, 2, 3, 15, 16, 17, 100, 100, 100,
+				     1000, 1000, 65536, 1000000, 1234567 };
+
+    __pmSetProgname(argv[0]);
+    while ((c = getopt(argc, argv, "p")) != EOF) {
+	switch (c) {
+	case 'p':
+	    flags = 0;
+	    nmetrics--;		/* no histogram, so a version 2 file */
+	    break;
+	default:
+	    err++;
+	}
+    }
+    if (err || argc != optind + 1) {
+	fprintf(stderr, "Usage: %s [-p] file\n", pmProgname);
+	exit(1);
+    }
+
+    addr = mmv_stats_init(argv[optind], 0, flags,
+			metrics, nmetrics, indoms, 1);
+    if (!addr) {
+	fprintf(stderr, "mmv_stats_init failed : %s\n", osstrerror());
+	exit(1);
+    }
+
+    hits = mmv_lookup_value_desc(addr, "hits", NULL);
+    reads = mmv_lookup_value_desc(addr, "ops", "read");
+    writes = mmv_lookup_value_desc(addr, "ops", "write");
+    bytes = mmv_lookup_value_desc(addr, "bytes", NULL);
+
+    for (i = 0; i < THREADS; i++)
+	pthread_create(&tid[i], NULL, incrementer, NULL);
+    for (i = 0; i < THREADS; i++)
+	pthread_join(tid[i], NULL);
+
+    /* and from this thread, via the name lookup interfaces */
+    mmv_stats_add(addr, "hits", NULL, 5);
+    mmv_stats_inc(addr, "ops", "write");
+    mmv_stats_set(addr, "level", NULL, 42);
+    if (flags & MMV_FLAG_SHARDED) {
+	for (i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+	    mmv_stats_record(addr, "latency", values[i]);
+    }
+
+    mmv_stats_stop(argv[optind], addr);
+    return 0;
+}
@@ -12,9 +12,23 @@ main(int argc, char **argv)
 
     __pmSetProgname(argv[0]);
 
-    while ((c = getopt(argc, argv, "Cc:D:dh:LSs:")) != EOF) {
+    while ((c = getopt(argc, argv, "aCc:D:dh:JLSs:")) != EOF) {
 	switch (c) {
 
+	case 'a':
+	    {
+		int	*instlist;
+		int	i;
+
+		sts = pmdaCacheActiveList(indom, &instlist);
+		fprintf(stderr, "active() -> %d", sts);
+		if (sts < 0) fprintf(stderr, " %s", pmErrStr(sts));
+		for (i = 0; i < sts; i++)
+		    fprintf(stderr, " %d", instlist[i]);
+		fputc('\n', stderr);
+	    }
+	    break;
+
 	case 'C':
 	    sts = pmdaCacheOp(indom, PMDA_CACHE_CULL);
 	    fprintf(stderr, "cull() -> %d", sts);
@@ -55,6 +69,13 @@ main(int argc, char **argv)
 	    fputc('\n', stderr);
 	    break;
 
+	case 'J':
+	    sts = pmdaCacheOp(indom, PMDA_CACHE_JOURNAL);
+	    fprintf(stderr, "journal() -> %d", sts);
+	    if (sts < 0) fprintf(stderr, " %s", pmErrStr(sts));
+	    fputc('\n', stderr);
+	    break;
+
 	case 'L':
 	    sts = pmdaCacheOp(indom, PMDA_CACHE_LOAD);
 	    fprintf(stderr, "load() -> %d", sts);
@@ -86,11 +107,13 @@ main(int argc, char **argv)
     if (errflag) {
 	fprintf(stderr, "Usage: %s ...\n", pmProgname);
 	fprintf(stderr, "options:\n");
+	fprintf(stderr, "-a             active instances\n");
 	fprintf(stderr, "-C             cull all\n");
 	fprintf(stderr, "-c inst        cull one\n");
 	fprintf(stderr, "-D debug\n");
 	fprintf(stderr, "-d             dump\n");
 	fprintf(stderr, "-h inst        hide\n");
+	fprintf(stderr, "-J             journal\n");
 	fprintf(stderr, "-L             load\n");
 	fprintf(stderr, "-S             store\n");
 	fprintf(stderr, "-s inst        save\n");
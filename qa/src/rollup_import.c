@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2015 Red Hat.
+ *
+ * Create an archive with known values for the pmlogreduce -R rollup
+ * tests ... one record every 10 seconds, starting 5 seconds after
+ * midnight UTC on 1 Jan 2015, with an instantaneous metric (one
+ * instance missing for part of the time), a counter that is reset,
+ * a string, and a metric whose cluster is too large for the rollup
+ * statistics pmIDs.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/impl.h>
+#include <pcp/import.h>
+
+#define START	1420070400	/* 2015-01-01 00:00:00 UTC */
+#define NRECS	24
+
+static void
+check(int sts, const char *what)
+{
+    if (sts < 0) {
+	fprintf(stderr, "%s: %s: %s\n", pmProgname, what, pmiErrStr(sts));
+	exit(1);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    pmInDom	indom = pmiInDom(245, 1);
+    char	buf[32];
+    __uint64_t	bytes = 0;
+    int		i;
+
+    __pmSetProgname(argv[0]);
+    if (argc != 2) {
+	fprintf(stderr, "Usage: %s archive\n", pmProgname);
+	exit(1);
+    }
+
+    check(pmiStart(argv[1], 0), "pmiStart");
+    check(pmiSetHostname("rollup.qa"), "pmiSetHostname");
+    check(pmiSetTimezone("UTC"), "pmiSetTimezone");
+
+    check(pmiAddMetric("qa.rollup.load", pmiID(245, 0, 1), PM_TYPE_U32,
+		indom, PM_SEM_INSTANT, pmiUnits(0,0,1,0,0,PM_COUNT_ONE)),
+		"pmiAddMetric load");
+    check(pmiAddInstance(indom, "a", 0), "pmiAddInstance a");
+    check(pmiAddInstance(indom, "b", 1), "pmiAddInstance b");
+    check(pmiAddMetric("qa.rollup.bytes", pmiID(245, 0, 2), PM_TYPE_U64,
+		PM_INDOM_NULL, PM_SEM_COUNTER,
+		pmiUnits(1,0,0,PM_SPACE_BYTE,0,0)), "pmiAddMetric bytes");
+    check(pmiAddMetric("qa.rollup.phase", pmiID(245, 0, 3), PM_TYPE_STRING,
+		PM_INDOM_NULL, PM_SEM_DISCRETE, pmiUnits(0,0,0,0,0,0)),
+		"pmiAddMetric phase");
+    /* cluster 1100 - no room for the _min/_max/_count clusters */
+    check(pmiAddMetric("qa.rollup.big", pmiID(245, 1100, 4), PM_TYPE_U32,
+		PM_INDOM_NULL, PM_SEM_INSTANT, pmiUnits(0,0,0,0,0,0)),
+		"pmiAddMetric big");
+
+    for (i = 0; i < NRECS; i++) {
+	snprintf(buf, sizeof(buf), "%d", (i * 7) % 10);
+	check(pmiPutValue("qa.rollup.load", "a", buf), "pmiPutValue load a");
+	if (i < 6 || i > 11) {
+	    snprintf(buf, sizeof(buf), "%d", 100 + i);
+	    check(pmiPutValue("qa.rollup.load", "b", buf), "pmiPutValue load b");
+	}
+	if (i == 15)
+	    bytes = 0;		/* counter reset */
+	else
+	    bytes += 1000 * (i % 3 + 1);
+	snprintf(buf, sizeof(buf), "%llu", (unsigned long long)bytes);
+	check(pmiPutValue("qa.rollup.bytes", "", buf), "pmiPutValue bytes");
+	snprintf(buf, sizeof(buf), "phase%d", i / 6);
+	check(pmiPutValue("qa.rollup.phase", "", buf), "pmiPutValue phase");
+	snprintf(buf, sizeof(buf), "%d", i);
+	check(pmiPutValue("qa.rollup.big", "", buf), "pmiPutValue big");
+	check(pmiWrite(START + 5 + 10 * i, 0), "pmiWrite");
+    }
+
+    check(pmiEnd(), "pmiEnd");
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2015 Red Hat.
+ *
+ * Microbenchmark for libpcp_trace trace points, comparing one PDU per
+ * event sent to pmdatrace with aggregation in shared memory, from one
+ * or more threads.
+ */
+
+#include <pthread.h>
+#include <pcp/pmapi.h>
+#include <pcp/impl.h>
+#include <pcp/trace.h>
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+		"Usage: %s [options]\n\n"
+		"Options:\n"
+		"  -a        use the asynchronous PDU protocol\n"
+		"  -n count  trace points per thread (default 1000000)\n"
+		"  -p count  trace points per thread via PDUs (default 10000)\n"
+		"  -s        shared memory transport only, no pmdatrace needed\n"
+		"  -T count  distinct tags (default 8)\n"
+		"  -t count  threads (default 1)\n",
+	    pmProgname);
+    exit(1);
+}
+
+static double
+now(void)
+{
+    struct timeval tv;
+
+    __pmtimevalNow(&tv);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static char	**tags;
+static int	ntags = 8;
+static int	points;
+static int	errors;
+
+static void *
+tracer(void *arg)
+{
+    int		n, t, sts;
+
+    for (n = t = 0; n < points; n++) {
+	/* cycle through the tags, and the three kinds of trace point */
+	if (++t == ntags)
+	    t = 0;
+	switch (t & 3) {
+	case 0:
+	case 1:
+	    sts = pmtracepoint(tags[t]);
+	    break;
+	case 2:
+	    sts = pmtraceobs(tags[t], (double)n);
+	    break;
+	default:
+	    sts = pmtracecounter(tags[t], (double)n);
+	    break;
+	}
+	if (sts < 0) {
+	    fprintf(stderr, "%s: trace failed: %s\n",
+		    pmProgname, pmtraceerrstr(sts));
+	    __sync_fetch_and_add(&errors, 1);
+	    break;
+	}
+    }
+    return NULL;
+}
+
+static double
+run(int nthreads, int count)
+{
+    pthread_t	*tids;
+    double	start;
+    int		i;
+
+    if ((tids = calloc(nthreads, sizeof(pthread_t))) == NULL) {
+	perror("calloc");
+	exit(1);
+    }
+    points = count;
+    start = now();
+    for (i = 0; i < nthreads; i++)
+	pthread_create(&tids[i], NULL, tracer, NULL);
+    for (i = 0; i < nthreads; i++)
+	pthread_join(tids[i], NULL);
+    free(tids);
+    return now() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+    double	elapsed;
+    int		c, i, state = PMTRACE_STATE_NONE;
+    int		shmonly = 0, nthreads = 1;
+    int		count = 1000000, pducount = 10000;
+
+    __pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "an:p:sT:t:")) != EOF) {
+	switch (c) {
+	case 'a':
+	    state |= PMTRACE_STATE_ASYNC;
+	    break;
+	case 'n':
+	    count = atoi(optarg);
+	    break;
+	case 'p':
+	    pducount = atoi(optarg);
+	    break;
+	case 's':
+	    shmonly = 1;
+	    break;
+	case 'T':
+	    ntags = atoi(optarg);
+	    break;
+	case 't':
+	    nthreads = atoi(optarg);
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (optind != argc || count < 1 || pducount < 1 || ntags < 1 ||
+	nthreads < 1)
+	usage();
+
+    if ((tags = calloc(ntags, sizeof(char *))) == NULL) {
+	perror("calloc");
+	exit(1);
+    }
+    for (i = 0; i < ntags; i++) {
+	tags[i] = malloc(32);
+	snprintf(tags[i], 32, "bench.tag%d", i);
+    }
+
+    if (!shmonly) {
+	pmtracestate(state);
+	elapsed = run(nthreads, pducount);
+	printf("%d threads x %d points (%s PDUs): %.3f sec, %.1f nsec/op\n",
+		nthreads, pducount, (state & PMTRACE_STATE_ASYNC) ? "async" : "sync",
+		elapsed, elapsed * 1e9 / ((double)nthreads * pducount));
+    }
+
+    pmtracestate(state | PMTRACE_STATE_SHM);
+    elapsed = run(nthreads, count);
+    printf("%d threads x %d points (shared memory): %.3f sec, %.1f nsec/op\n",
+	    nthreads, count, elapsed,
+	    elapsed * 1e9 / ((double)nthreads * count));
+
+    return errors != 0;
+}
@@ -415,6 +415,10 @@ typedef struct {
     int		l_numti;	/* (when reading) no. temporal index entries */
     __pmLogTI	*l_ti;		/* (when reading) temporal index */
     __pmnsTree	*l_pmns;        /* namespace from meta data */
+    char	*l_mapaddr;	/* (when reading) current volume, if mapped */
+    size_t	l_mapsize;	/* (when reading) size of the mapping */
+    __pm_off_t	l_mapoff;	/* (when reading) offset, if mapped */
+    int		l_mapseq;	/* (when reading) forward reads in a row */
 } __pmLogCtl;
 
 /* l_state values */
@@ -1059,6 +1063,8 @@ extern void __pmLogResetInterp(__pmContext *);
 extern void __pmFreeInterpData(__pmContext *);
 
 extern int __pmLogChangeVol(__pmLogCtl *, int);
+extern long __pmLogTell(__pmLogCtl *);
+extern void __pmLogSeek(__pmLogCtl *, long, int);
 extern int __pmLogChkLabel(__pmLogCtl *, FILE *, __pmLogLabel *, int);
 extern int __pmGetArchiveEnd(__pmLogCtl *, struct timeval *);
 
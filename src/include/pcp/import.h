@@ -33,6 +33,10 @@ extern int pmiPutValueHandle(int, const char *);
 extern int pmiWrite(int, int);
 extern int pmiPutResult(const pmResult *);
 
+/* bulk value routines, binary values of the metric's type */
+extern int pmiPutAtomValues(int, const int *, const pmAtomValue *);
+extern int pmiWriteColumns(int, const struct timeval *, int, const int *, const void **);
+
 /* helper routines */
 extern pmID pmiID(int, int, int);
 extern pmInDom pmiInDom(int, int);
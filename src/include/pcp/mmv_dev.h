@@ -15,7 +15,12 @@
 #ifndef _MMV_DEV_H
 #define _MMV_DEV_H
 
-#define MMV_VERSION	1
+#define MMV_VERSION	3	/* as for 2, plus shards and histograms */
+#define MMV_VERSION2	2	/* as for 1, plus the MMV_TOC_HASH section */
+#define MMV_VERSION1	1	/* oldest version still understood */
+
+#define MMV_CACHELINE	64	/* alignment and size of a value shard */
+#define MMV_SHARDMAX	64	/* upper limit on shards per value */
 
 typedef enum {
     MMV_TOC_INDOMS	= 1,	/* mmv_disk_indom_t */
@@ -23,6 +28,9 @@ typedef enum {
     MMV_TOC_METRICS	= 3,	/* mmv_disk_metric_t */
     MMV_TOC_VALUES	= 4,	/* mmv_disk_value_t */
     MMV_TOC_STRINGS	= 5,	/* mmv_disk_string_t */
+    MMV_TOC_HASH	= 6,	/* mmv_disk_hash_t */
+    MMV_TOC_SHARDS	= 7,	/* mmv_disk_shard_t */
+    MMV_TOC_HISTOGRAMS	= 8,	/* mmv_disk_histogram_t */
 } mmv_toc_type_t;
 
 /* The way the Table Of Contents is written into the file */
@@ -70,6 +78,86 @@ typedef struct {
     __uint64_t		instance;	/* Offset into the instance section */
 } mmv_disk_value_t;
 
+/*
+ * Open addressing hash table over the values section, keyed on metric
+ * and instance names, for client-side lookups.  The number of buckets
+ * (TOC count) is a power of two, and collisions are resolved by linear
+ * probing.  Readers are free to ignore this section.
+ */
+typedef struct {
+    __uint32_t		hash;		/* Hash of metric and instance names */
+    __uint32_t		value;		/* Index into values section, plus one */
+} mmv_disk_hash_t;
+
+/*
+ * Sharded counters (MMV_FLAG_SHARDED) have a block of per-thread shards,
+ * each on its own cache line, found via the extra field of the value.
+ * The TOC count is the number of shards in each block (a power of two)
+ * and the metric value is the sum of the value itself and its shards.
+ */
+typedef struct {
+    pmAtomValue		value;		/* This shard's part of the value */
+    char		padding[MMV_CACHELINE - sizeof(pmAtomValue)];
+} mmv_disk_shard_t;
+
+/*
+ * Histogram values (MMV_TYPE_HISTOGRAM) have log-linear buckets: exact
+ * below MMV_HIST_SUBBUCKETS, then MMV_HIST_SUBBUCKETS equal divisions
+ * of each power of two above that, for a relative error of 1/16.  The
+ * extra field of the value is the offset of its histogram, and the TOC
+ * count is the number of histograms.
+ */
+#define MMV_HIST_SUBBITS	4
+#define MMV_HIST_SUBBUCKETS	(1 << MMV_HIST_SUBBITS)
+#define MMV_HIST_BUCKETS	((64 - MMV_HIST_SUBBITS + 1) * MMV_HIST_SUBBUCKETS)
+
+typedef struct {
+    __uint64_t		max;		/* Largest value recorded */
+    __uint64_t		padding;	/* zero filled, alignment bits */
+    __uint64_t		buckets[MMV_HIST_BUCKETS];	/* Values recorded */
+} mmv_disk_histogram_t;
+
+/* bucket holding a given value */
+static inline int
+mmv_histogram_bucket(__uint64_t value)
+{
+    int		log2;
+
+    if (value < MMV_HIST_SUBBUCKETS)
+	return (int)value;
+#if defined(__GNUC__)
+    log2 = 63 - __builtin_clzll(value);
+#else
+    for (log2 = MMV_HIST_SUBBITS; value >> (log2 + 1); log2++)
+	;
+#endif
+    return (log2 - MMV_HIST_SUBBITS + 1) * MMV_HIST_SUBBUCKETS +
+	   (int)(value >> (log2 - MMV_HIST_SUBBITS)) - MMV_HIST_SUBBUCKETS;
+}
+
+/* smallest value held by a given bucket */
+static inline __uint64_t
+mmv_histogram_lower(int bucket)
+{
+    int		group = bucket / MMV_HIST_SUBBUCKETS;
+
+    if (group == 0)
+	return (__uint64_t)bucket;
+    return (__uint64_t)(MMV_HIST_SUBBUCKETS + bucket % MMV_HIST_SUBBUCKETS)
+		<< (group - 1);
+}
+
+/* largest value held by a given bucket */
+static inline __uint64_t
+mmv_histogram_upper(int bucket)
+{
+    int		group = bucket / MMV_HIST_SUBBUCKETS;
+
+    if (group == 0)
+	return (__uint64_t)bucket;
+    return mmv_histogram_lower(bucket) + ((__uint64_t)1 << (group - 1)) - 1;
+}
+
 typedef struct {
     char		magic[4];	/* MMV\0 */
     __int32_t		version;	/* version */
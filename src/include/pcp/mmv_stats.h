@@ -33,6 +33,7 @@ typedef enum mmv_metric_type {
     MMV_TYPE_DOUBLE    = PM_TYPE_DOUBLE,/* 64-bit floating point */
     MMV_TYPE_STRING    = PM_TYPE_STRING,/* NULL-terminate string */
     MMV_TYPE_ELAPSED   = 9,		/* 64-bit elapsed time */
+    MMV_TYPE_HISTOGRAM = 10,		/* distribution of 64-bit values */
 } mmv_metric_type_t;
 
 typedef enum mmv_metric_sem {
@@ -74,6 +75,7 @@ typedef struct mmv_metric {
 typedef enum mmv_stats_flags {
     MMV_FLAG_NOPREFIX	= 0x1,	/* Don't prefix metric names by filename */
     MMV_FLAG_PROCESS	= 0x2,	/* Indicates process check on PID needed */
+    MMV_FLAG_SHARDED	= 0x4,	/* Per-thread slots for integer counters */
 } mmv_stats_flags_t;
 
 extern void * mmv_stats_init(const char *, int, mmv_stats_flags_t,
@@ -83,8 +85,11 @@ extern void mmv_stats_stop(const char *, void *);
 
 extern pmAtomValue * mmv_lookup_value_desc(void *, const char *, const char *);
 extern void mmv_inc_value(void *, pmAtomValue *, double);
+extern void mmv_inc_int(void *, pmAtomValue *, __int64_t);
+extern void mmv_inc_uint(void *, pmAtomValue *, __uint64_t);
 extern void mmv_set_value(void *, pmAtomValue *, double);
 extern void mmv_set_string(void *, pmAtomValue *, const char *, int);
+extern void mmv_histogram_record(void *, pmAtomValue *, __uint64_t);
 
 extern void mmv_stats_add(void *, const char *, const char *, double);
 extern void mmv_stats_inc(void *, const char *, const char *);
@@ -100,6 +105,7 @@ extern void mmv_stats_set_string(void *, const char *,
 				const char *, const char *);
 extern void mmv_stats_set_strlen(void *, const char *,
 				const char *, const char *, size_t);
+extern void mmv_stats_record(void *, const char *, __uint64_t);
 
 #ifdef __cplusplus
 }
@@ -75,6 +75,13 @@ typedef int (*pmdaFetchCallBack)(pmdaMetric *, unsigned int, pmAtomValue *);
 #define PMDA_FETCH_STATIC	1
 #define PMDA_FETCH_DYNAMIC	2	/* free avp->vp after __pmStuffValue */
 
+/*
+ * Type of optional function call back used by pmdaFetch to fill in the
+ * values of a metric for an array of instances in one call, the status
+ * for each instance is one of the pmdaFetchCallBack return values.
+ */
+typedef int (*pmdaFetchBatchCallBack)(pmdaMetric *, int, const int *, pmAtomValue *, int *);
+
 /*
  * Type of function call back used by pmdaMain to clean up a pmResult structure
  * after a fetch.
@@ -390,6 +397,12 @@ typedef struct __pmdaOptions {
  *      pmAtom structure with a metrics value. This must be set if pmdaFetch is
  *      used as the fetch callback.
  *
+ * pmdaSetFetchBatchCallBack
+ *      Allows an application specific routine to be specified for completing
+ *      the pmAtom structures for all the instances of a metric in one call.
+ *      Optional, pmdaFetch uses the fetch callback for any metric where this
+ *      callback returns a value less than zero.
+ *
  * pmdaSetCheckCallBack
  *      Allows an application specific routine to be called upon receipt of any
  *      PDU. For all PDUs except PDU_PROFILE, a result less than zero
@@ -422,6 +435,7 @@ extern void pmdaMain(pmdaInterface *);
 
 extern void pmdaSetResultCallBack(pmdaInterface *, pmdaResultCallBack);
 extern void pmdaSetFetchCallBack(pmdaInterface *, pmdaFetchCallBack);
+extern void pmdaSetFetchBatchCallBack(pmdaInterface *, pmdaFetchBatchCallBack);
 extern void pmdaSetCheckCallBack(pmdaInterface *, pmdaCheckCallBack);
 extern void pmdaSetDoneCallBack(pmdaInterface *, pmdaDoneCallBack);
 extern void pmdaSetEndContextCallBack(pmdaInterface *, pmdaEndContextCallBack);
@@ -592,6 +606,9 @@ extern pmnsNode * pmdaNodeLookup(pmnsNode *, const char *);
  * 
  * pmdaCachePurge
  *	cull inactive entries
+ *
+ * pmdaCacheActiveList
+ *	sorted array of the active instance identifiers
  */
 extern int pmdaCacheStore(pmInDom, int, const char *, void *);
 extern int pmdaCacheStoreKey(pmInDom, int, const char *, int, const void *, void *);
@@ -600,6 +617,7 @@ extern int pmdaCacheLookupName(pmInDom, const char *, int *, void **);
 extern int pmdaCacheLookupKey(pmInDom, const char *, int, const void *, char **, int *, void **);
 extern int pmdaCacheOp(pmInDom, int);
 extern int pmdaCachePurge(pmInDom, time_t);
+extern int pmdaCacheActiveList(pmInDom, int **);
 
 #define PMDA_CACHE_LOAD			1
 #define PMDA_CACHE_ADD			2
@@ -621,6 +639,7 @@ extern int pmdaCachePurge(pmInDom, time_t);
 #define PMDA_CACHE_SYNC			18
 #define PMDA_CACHE_DUMP			19
 #define PMDA_CACHE_DUMP_ALL		20
+#define PMDA_CACHE_JOURNAL		21
 
 /*
  * Internal libpcp_pmda routines.
@@ -31,6 +31,7 @@ extern "C" {
 #define TRACE_ENV_NOAGENT	"PCP_TRACE_NOAGENT"
 #define TRACE_ENV_REQTIMEOUT	"PCP_TRACE_REQTIMEOUT"
 #define TRACE_ENV_RECTIMEOUT	"PCP_TRACE_RECONNECT"
+#define TRACE_ENV_SHM		"PCP_TRACE_SHM"
 #define TRACE_PORT		4323
 #define TRACE_PDU_VERSION	1
 
@@ -88,6 +89,66 @@ extern int __pmtraceprotocol(int);
 
 extern int __pmstate;
 
+/*
+ * Shared memory transport - points, counters, observations and completed
+ * transactions are aggregated per tag within the application, and the
+ * running totals are drained by pmdatrace rather than being sent as one
+ * PDU per event.
+ *
+ * Each process maps $PCP_TMP_DIR/pmdatrace/<pid>, which holds a header
+ * and TRACE_SHM_SLOTS per-thread slots.  A slot is written only by the
+ * thread that has claimed it, so updates need no locking; pmdatrace reads
+ * each tag using the seq field (odd while an update is in progress) to
+ * obtain a consistent copy.  Totals are never reset, pmdatrace keeps the
+ * previous values and folds in the difference.
+ *
+ * The minimum and maximum restart whenever pmdatrace advances the epoch
+ * in $PCP_TMP_DIR/pmdatrace/epoch, which it does after every drain.
+ */
+#define TRACE_SHM_DIR		"pmdatrace"
+#define TRACE_SHM_EPOCH		"epoch"
+#define TRACE_SHM_MAGIC		0x54524143	/* "TRAC" */
+#define TRACE_SHM_VERSION	1
+#define TRACE_SHM_SLOTS		64	/* threads per process */
+#define TRACE_SHM_TAGS		128	/* tags per thread, power of two */
+
+typedef struct {
+    __uint32_t		magic;		/* TRACE_SHM_MAGIC, set last */
+    __uint32_t		version;
+    __int32_t		pid;
+    __uint32_t		nslots;
+    __uint32_t		ntags;
+    __uint32_t		padding;
+} __pmTraceShmHdr;
+
+typedef struct {
+    __uint32_t		seq;		/* odd while being updated */
+    __uint32_t		epoch;		/* epoch when min and max restarted */
+    __uint32_t		hash;		/* of tag */
+    __uint16_t		type;		/* TRACE_TYPE_*, zero if unused */
+    __uint16_t		taglength;	/* including the terminating null */
+    __uint64_t		count;		/* running total of events */
+    double		sum;		/* running total of values */
+    double		last;		/* most recent value */
+    double		min;		/* since epoch */
+    double		max;		/* since epoch */
+    char		tag[MAXTAGNAMELEN];
+} __pmTraceShmTag;
+
+typedef struct {
+    __uint32_t		owner;		/* non-zero while claimed by a thread */
+    __uint32_t		used;		/* non-zero once ever claimed */
+    __pmTraceShmTag	tags[TRACE_SHM_TAGS];
+} __pmTraceShmSlot;
+
+typedef struct {
+    __uint32_t		magic;		/* TRACE_SHM_MAGIC */
+    __uint32_t		epoch;		/* advanced by pmdatrace */
+} __pmTraceShmEpoch;
+
+extern int __pmtraceshmmode(void);
+extern int __pmtraceshmrecord(const char *, int, int, double);
+
 #ifdef __cplusplus
 }
 #endif
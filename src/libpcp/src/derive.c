@@ -416,7 +416,7 @@ free_expr(node_t *np)
     if (np->right != NULL) free_expr(np->right);
     /* value is only allocated once for the static nodes */
     if (np->info == NULL && np->value != NULL) free(np->value);
-    if (np->info != NULL) free(np->info);
+    if (np->info != NULL) __dmfreeinfo(np);
     free(np);
 }
 
@@ -454,13 +454,21 @@ bind_expr(int n, node_t *np)
     new->info->numval = 0;
     new->info->mul_scale = new->info->div_scale = 1;
     new->info->ivlist = NULL;
+    new->info->maxval = 0;
     new->info->stamp.tv_sec = 0;
     new->info->stamp.tv_usec = 0;
     new->info->time_scale = -1;		/* one-trip initialization if needed */
     new->info->last_numval = 0;
     new->info->last_ivlist = NULL;
+    new->info->last_maxval = 0;
     new->info->last_stamp.tv_sec = 0;
     new->info->last_stamp.tv_usec = 0;
+    new->info->vsetidx = 0;
+    new->info->binop = NULL;		/* set in __dmcompile() */
+    new->info->maxjoin = 0;
+    new->info->lidx = new->info->ridx = NULL;
+    new->info->lconv = new->info->rconv = NULL;
+    new->info->rsort = NULL;
 
     /* need info to be non-null to protect copy of value in free_expr */
     new->value = np->value;
@@ -1792,6 +1800,8 @@ __dmopencontext(__pmContext *ctxp)
 	    else {
 		/* set correct PMID in pmDesc at the top level */
 		cp->mlist[i].expr->desc.pmid = cp->mlist[i].pmid;
+		/* and choose the typed evaluation for each operator */
+		__dmcompile(cp->mlist[i].expr);
 	    }
 	}
 #ifdef PCP_DEBUG
@@ -24,17 +24,40 @@ typedef struct {		/* one value in the expression tree */
     int		vlen;		/* from vlen of pmValueBlock for string and aggregates */
 } val_t;
 
+typedef struct {		/* instance and position in an ivlist[] */
+    int		inst;
+    int		idx;
+} instidx_t;
+
+/*
+ * Binary operator over instance-aligned operand values, selected at
+ * bind time from the result type and the operator ... result[k] =
+ * left[k*lstride] <op> right[k*rstride] for k = 0 ... n-1, where a
+ * stride of 0 is used for a singular operand.
+ */
+typedef void (*binop_t)(val_t *, const val_t *, int, const val_t *, int, int);
+
 typedef struct {		/* dynamic information for an expression node */
     pmID		pmid;
     int			numval;		/* length of ivlist[] */
     int			mul_scale;	/* scale multiplier */
     int			div_scale;	/* scale divisor */
     val_t		*ivlist;	/* instance-value pairs */
+    int			maxval;		/* allocated length of ivlist[] */
     struct timeval	stamp;		/* timestamp from current fetch */
     double		time_scale;	/* time utilization scaling for rate() */
     int			last_numval;	/* length of last_ivlist[] */
     val_t		*last_ivlist;	/* values from previous fetch for delta() or rate() */
+    int			last_maxval;	/* allocated length of last_ivlist[] */
     struct timeval	last_stamp;	/* timestamp from previous fetch for rate() */
+    int			vsetidx;	/* hint, vset[] index of pmid in pmResult */
+    binop_t		binop;		/* compiled binary operator */
+    int			maxjoin;	/* allocated length of join arrays below */
+    int			*lidx;		/* matched instances in left operand */
+    int			*ridx;		/* matched instances in right operand */
+    val_t		*lconv;		/* left operand values, promoted */
+    val_t		*rconv;		/* right operand values, promoted */
+    instidx_t		*rsort;		/* right operand, sorted by instance */
 } info_t;
 
 typedef struct node {		/* expression tree node */
@@ -97,5 +120,7 @@ extern int __dmdesc(__pmContext *, pmID, pmDesc *) _PCP_HIDDEN;
 extern int __dmprefetch(__pmContext *, int, const pmID *, pmID **) _PCP_HIDDEN;
 extern void __dmpostfetch(__pmContext *, pmResult **) _PCP_HIDDEN;
 extern void __dmdumpexpr(node_t *, int) _PCP_HIDDEN;
+extern void __dmcompile(node_t *) _PCP_HIDDEN;
+extern void __dmfreeinfo(node_t *) _PCP_HIDDEN;
 
 #endif	/* _DERIVE_H */
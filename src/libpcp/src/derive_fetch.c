@@ -151,33 +151,36 @@ __dmprefetch(__pmContext *ctxp, int numpmid, const pmID *pmidlist, pmID **newlis
 }
 
 /*
- * Free the old ivlist[] (if any) ... may need to walk the list because
- * the pmAtomValues may have buffers attached in the type STRING,
- * type AGGREGATE* and type EVENT cases.
+ * Free the values in ivlist[] (if any) ... may need to walk the list
+ * because the pmAtomValues may have buffers attached in the type STRING,
+ * type AGGREGATE* and type EVENT cases.  The ivlist[] buffer itself is
+ * kept, and reused for the next fetch.
  * Includes logic to save one history sample (for delta() and rate()).
  */
 static void
 free_ivlist(node_t *np)
 {
+    val_t	*tmp;
+    int		max;
     int		i;
 
     assert(np->info != NULL);
 
     if (np->save_last) {
 	/*
-	 * saving history for delta() or rate() ... release previous
-	 * sample, and save this sample
+	 * saving history for delta() or rate() ... this sample becomes
+	 * the previous sample, and the buffer of the previous sample is
+	 * recycled for the next one, so nothing is copied or freed
+	 * (no STRING, AGGREGATE or EVENT types for delta() or rate())
 	 */
-	if (np->info->last_ivlist != NULL) {
-	    /*
-	     * no STRING, AGGREGATE or EVENT types for delta() or rate()
-	     * so simple free()
-	     */
-	    free(np->info->last_ivlist);
-	}
+	tmp = np->info->last_ivlist;
+	max = np->info->last_maxval;
 	np->info->last_numval = np->info->numval;
 	np->info->last_ivlist = np->info->ivlist;
-	np->info->ivlist = NULL;
+	np->info->last_maxval = np->info->maxval;
+	np->info->ivlist = tmp;
+	np->info->maxval = max;
+	np->info->numval = 0;
     }
     else {
 	/* no history */
@@ -198,279 +201,375 @@ free_ivlist(node_t *np)
 		}
 	    }
 	}
-	free(np->info->ivlist);
 	np->info->numval = 0;
-	np->info->ivlist = NULL;
     }
 }
 
 /*
- * Binary arithmetic.
+ * Make sure ivlist[] has room for at least need values.
+ */
+static void
+size_ivlist(node_t *np, int need, const char *what)
+{
+    val_t	*tmp;
+
+    if (need <= np->info->maxval)
+	return;
+    if ((tmp = (val_t *)realloc(np->info->ivlist, need*sizeof(val_t))) == NULL) {
+	__pmNoMem(what, need*sizeof(val_t), PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    np->info->ivlist = tmp;
+    np->info->maxval = need;
+}
+
+/*
+ * Make sure the instance join and operand conversion arrays have room
+ * for at least need values.
+ */
+static void
+size_join(info_t *ip, int need)
+{
+    if (need <= ip->maxjoin)
+	return;
+    if ((ip->lidx = (int *)realloc(ip->lidx, need*sizeof(int))) == NULL ||
+	(ip->ridx = (int *)realloc(ip->ridx, need*sizeof(int))) == NULL) {
+	__pmNoMem("size_join: index", need*sizeof(int), PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    if ((ip->lconv = (val_t *)realloc(ip->lconv, need*sizeof(val_t))) == NULL ||
+	(ip->rconv = (val_t *)realloc(ip->rconv, need*sizeof(val_t))) == NULL) {
+	__pmNoMem("size_join: values", need*sizeof(val_t), PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    if ((ip->rsort = (instidx_t *)realloc(ip->rsort, need*sizeof(instidx_t))) == NULL) {
+	__pmNoMem("size_join: sort", need*sizeof(instidx_t), PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    ip->maxjoin = need;
+}
+
+/*
+ * Release all of the dynamic information for an expression node,
+ * including the buffers kept from one fetch to the next.
+ */
+void
+__dmfreeinfo(node_t *np)
+{
+    info_t	*ip = np->info;
+
+    if (!np->save_last)
+	free_ivlist(np);
+    if (ip->ivlist != NULL) free(ip->ivlist);
+    if (ip->last_ivlist != NULL) free(ip->last_ivlist);
+    if (ip->lidx != NULL) free(ip->lidx);
+    if (ip->ridx != NULL) free(ip->ridx);
+    if (ip->lconv != NULL) free(ip->lconv);
+    if (ip->rconv != NULL) free(ip->rconv);
+    if (ip->rsort != NULL) free(ip->rsort);
+    free(ip);
+    np->info = NULL;
+}
+
+static int
+compare_inst(const void *a, const void *b)
+{
+    const instidx_t	*ia = (const instidx_t *)a;
+    const instidx_t	*ib = (const instidx_t *)b;
+
+    return ia->inst < ib->inst ? -1 : (ia->inst > ib->inst);
+}
+
+/*
+ * Match the instances of l[0 ... nl-1] and r[0 ... nr-1], values for the
+ * same instance domain.
+ *
+ * Generally both were fetched with the same profile, so the instances
+ * are the same and in the same order ... then -1 is returned and no
+ * index is needed.
+ *
+ * Otherwise the matched pairs are returned in ip->lidx[] and ip->ridx[],
+ * in the instance order of l[], and the number of pairs is returned.
+ * The instances of r[] are sorted (if need be) and each instance of l[]
+ * is found by binary search, so this is O((nl + nr) log nr) rather than
+ * O(nl * nr) for a linear search.
+ */
+static int
+join_inst(info_t *ip, const val_t *l, int nl, const val_t *r, int nr)
+{
+    int		i;
+    int		k;
+    int		lo;
+    int		hi;
+    int		mid = 0;
+    int		sorted = 1;
+
+    if (nl == nr) {
+	for (i = 0; i < nl; i++) {
+	    if (l[i].inst != r[i].inst)
+		break;
+	}
+	if (i == nl)
+	    return -1;
+    }
+#ifdef PCP_DEBUG
+    if ((pmDebug & DBG_TRACE_DERIVE) && (pmDebug & DBG_TRACE_APPL2)) {
+	fprintf(stderr, "join_inst: instance mismatch, %d left %d right\n", nl, nr);
+    }
+#endif
+
+    size_join(ip, nl > nr ? nl : nr);
+    for (i = 0; i < nr; i++) {
+	ip->rsort[i].inst = r[i].inst;
+	ip->rsort[i].idx = i;
+	if (i > 0 && r[i].inst < r[i-1].inst)
+	    sorted = 0;
+    }
+    if (!sorted)
+	qsort(ip->rsort, nr, sizeof(instidx_t), compare_inst);
+
+    for (i = k = 0; i < nl; i++) {
+	lo = 0;
+	hi = nr - 1;
+	while (lo <= hi) {
+	    mid = (lo + hi) / 2;
+	    if (ip->rsort[mid].inst < l[i].inst)
+		lo = mid + 1;
+	    else if (ip->rsort[mid].inst > l[i].inst)
+		hi = mid - 1;
+	    else
+		break;
+	}
+	if (lo > hi) {
+	    /* no match, skip this instance from the result */
+	    continue;
+	}
+	ip->lidx[k] = i;
+	ip->ridx[k] = ip->rsort[mid].idx;
+	k++;
+    }
+    return k;
+}
+
+/* operand values already in the representation of the result type */
+#define SAME_REP(a, b) ((a) == (b) || \
+	(((a) == PM_TYPE_32 || (a) == PM_TYPE_U32) && \
+	 ((b) == PM_TYPE_32 || (b) == PM_TYPE_U32)) || \
+	(((a) == PM_TYPE_64 || (a) == PM_TYPE_U64) && \
+	 ((b) == PM_TYPE_64 || (b) == PM_TYPE_U64)))
+
+#define GATHER(to, from) \
+    for (k = 0; k < n; k++) \
+	conv[k].value.to = src[idx == NULL ? k : idx[k]].value.from
+
+/*
+ * Gather the values of an operand for instances idx[0 ... n-1] (or the
+ * first n instances if idx is NULL) into conv[], promoted to the type
+ * of the result ... there are limited cases to be considered here, see
+ * promote[][] and map_desc().
  *
- * result = <a> <op> <b>
- * ltype, rtype and type are the types of <a>, <b> and the result
- * respectively
+ * If type is PM_TYPE_DOUBLE then the operand's mul_scale and div_scale
+ * are applied for units scale conversion, so mul*<a>/div ... both are
+ * 1 in the common cases.
  *
- * If type is PM_TYPE_DOUBLE then lmul, ldiv, rmul and rdiv are
- * the scale factors for units scale conversion of <a> and <b>
- * respectively, so lmul*<a>/ldiv ... all are 1 in the common cases.
+ * Returns the values to use, which is the operand's own ivlist[] when
+ * neither a gather nor a conversion is needed.
  */
-static pmAtomValue
-bin_op(int type, int op, pmAtomValue a, int ltype, int lmul, int ldiv, pmAtomValue b, int rtype, int rmul, int rdiv)
+static const val_t *
+promote(node_t *op, int type, const int *idx, int n, val_t *conv)
 {
-    pmAtomValue	res;
-    pmAtomValue	l;
-    pmAtomValue	r;
+    const val_t	*src = op->info->ivlist;
+    int		mul = op->info->mul_scale;
+    int		div = op->info->div_scale;
+    int		k;
 
-    l = a;	/* struct assignments */
-    r = b;
+    if (idx == NULL && SAME_REP(type, op->desc.type) &&
+	(type != PM_TYPE_DOUBLE || (mul == 1 && div == 1)))
+	return src;
 
-    /* 
-     * Promote each operand to the type of the result ... there are limited
-     * cases to be considered here, see promote[][] and map_desc().
-     */
     switch (type) {
 	case PM_TYPE_32:
 	case PM_TYPE_U32:
-	    /* do nothing */
+	    GATHER(l, l);
 	    break;
 	case PM_TYPE_64:
-	    switch (ltype) {
-		case PM_TYPE_32:
-		    l.ll = a.l;
-		    break;
-		case PM_TYPE_U32:
-		    l.ll = a.ul;
-		    break;
-		case PM_TYPE_64:
-		case PM_TYPE_U64:
-		    /* do nothing */
-		    break;
-	    }
-	    switch (rtype) {
-		case PM_TYPE_32:
-		    r.ll = b.l;
-		    break;
-		case PM_TYPE_U32:
-		    r.ll = b.ul;
-		    break;
-		case PM_TYPE_64:
-		case PM_TYPE_U64:
-		    /* do nothing */
-		    break;
-	    }
-	    break;
 	case PM_TYPE_U64:
-	    switch (ltype) {
-		case PM_TYPE_32:
-		    l.ull = a.l;
-		    break;
-		case PM_TYPE_U32:
-		    l.ull = a.ul;
-		    break;
-		case PM_TYPE_64:
-		case PM_TYPE_U64:
-		    /* do nothing */
-		    break;
-	    }
-	    switch (rtype) {
-		case PM_TYPE_32:
-		    r.ull = b.l;
-		    break;
-		case PM_TYPE_U32:
-		    r.ull = b.ul;
-		    break;
-		case PM_TYPE_64:
-		case PM_TYPE_U64:
-		    /* do nothing */
-		    break;
-	    }
+	    /* same bits for ll and ull after conversion */
+	    if (op->desc.type == PM_TYPE_32)
+		GATHER(ll, l);
+	    else if (op->desc.type == PM_TYPE_U32)
+		GATHER(ll, ul);
+	    else
+		GATHER(ll, ll);
 	    break;
 	case PM_TYPE_FLOAT:
-	    switch (ltype) {
+	    switch (op->desc.type) {
 		case PM_TYPE_32:
-		    l.f = a.l;
+		    GATHER(f, l);
 		    break;
 		case PM_TYPE_U32:
-		    l.f = a.ul;
+		    GATHER(f, ul);
 		    break;
 		case PM_TYPE_64:
-		    l.f = a.ll;
+		    GATHER(f, ll);
 		    break;
 		case PM_TYPE_U64:
-		    l.f = a.ull;
+		    GATHER(f, ull);
 		    break;
 		case PM_TYPE_FLOAT:
-		    /* do nothing */
-		    break;
-	    }
-	    switch (rtype) {
-		case PM_TYPE_32:
-		    r.f = b.l;
-		    break;
-		case PM_TYPE_U32:
-		    r.f = b.ul;
-		    break;
-		case PM_TYPE_64:
-		    r.f = b.ll;
-		    break;
-		case PM_TYPE_U64:
-		    r.f = b.ull;
-		    break;
-		case PM_TYPE_FLOAT:
-		    /* do nothing */
+		    GATHER(f, f);
 		    break;
 	    }
 	    break;
 	case PM_TYPE_DOUBLE:
-	    switch (ltype) {
+	    switch (op->desc.type) {
 		case PM_TYPE_32:
-		    l.d = a.l;
+		    GATHER(d, l);
 		    break;
 		case PM_TYPE_U32:
-		    l.d = a.ul;
+		    GATHER(d, ul);
 		    break;
 		case PM_TYPE_64:
-		    l.d = a.ll;
+		    GATHER(d, ll);
 		    break;
 		case PM_TYPE_U64:
-		    l.d = a.ull;
+		    GATHER(d, ull);
 		    break;
 		case PM_TYPE_FLOAT:
-		    l.d = a.f;
+		    GATHER(d, f);
 		    break;
 		case PM_TYPE_DOUBLE:
-		    /* do nothing */
+		    GATHER(d, d);
 		    break;
 	    }
-	    l.d = (l.d / ldiv) * lmul;
-	    switch (rtype) {
-		case PM_TYPE_32:
-		    r.d = b.l;
-		    break;
-		case PM_TYPE_U32:
-		    r.d = b.ul;
-		    break;
-		case PM_TYPE_64:
-		    r.d = b.ll;
-		    break;
-		case PM_TYPE_U64:
-		    r.d = b.ull;
-		    break;
-		case PM_TYPE_FLOAT:
-		    r.d = b.f;
-		    break;
-		case PM_TYPE_DOUBLE:
-		    /* do nothing */
-		    break;
+	    if (mul != 1 || div != 1) {
+		for (k = 0; k < n; k++)
+		    conv[k].value.d = (conv[k].value.d / div) * mul;
 	    }
-	    r.d = (r.d / rdiv) * rmul;
 	    break;
     }
+    return conv;
+}
 
-    /*
-     * Do the aritmetic ... messy!
-     */
-    switch (type) {
-	case PM_TYPE_32:
-	    switch (op) {
-		case L_PLUS:
-		    res.l = l.l + r.l;
-		    break;
-		case L_MINUS:
-		    res.l = l.l - r.l;
-		    break;
-		case L_STAR:
-		    res.l = l.l * r.l;
-		    break;
-		/* semantics enforce no L_SLASH for integer results */
-	    }
-	    break;
-	case PM_TYPE_U32:
-	    switch (op) {
-		case L_PLUS:
-		    res.ul = l.ul + r.ul;
-		    break;
-		case L_MINUS:
-		    res.ul = l.ul - r.ul;
-		    break;
-		case L_STAR:
-		    res.ul = l.ul * r.ul;
-		    break;
-		/* semantics enforce no L_SLASH for integer results */
-	    }
-	    break;
-	case PM_TYPE_64:
-	    switch (op) {
-		case L_PLUS:
-		    res.ll = l.ll + r.ll;
-		    break;
-		case L_MINUS:
-		    res.ll = l.ll - r.ll;
-		    break;
-		case L_STAR:
-		    res.ll = l.ll * r.ll;
-		    break;
-		/* semantics enforce no L_SLASH for integer results */
-	    }
-	    break;
-	case PM_TYPE_U64:
-	    switch (op) {
-		case L_PLUS:
-		    res.ull = l.ull + r.ull;
-		    break;
-		case L_MINUS:
-		    res.ull = l.ull - r.ull;
-		    break;
-		case L_STAR:
-		    res.ull = l.ull * r.ull;
-		    break;
-		/* semantics enforce no L_SLASH for integer results */
-	    }
-	    break;
-	case PM_TYPE_FLOAT:
-	    switch (op) {
-		case L_PLUS:
-		    res.f = l.f + r.f;
-		    break;
-		case L_MINUS:
-		    res.f = l.f - r.f;
-		    break;
-		case L_STAR:
-		    res.f = l.f * r.f;
-		    break;
-		/* semantics enforce no L_SLASH for float results */
-	    }
-	    break;
-	case PM_TYPE_DOUBLE:
-	    switch (op) {
-		case L_PLUS:
-		    res.d = l.d + r.d;
-		    break;
-		case L_MINUS:
-		    res.d = l.d - r.d;
-		    break;
-		case L_STAR:
-		    res.d = l.d * r.d;
-		    break;
-		case L_SLASH:
-		    if (l.d == 0)
-			res.d = 0;
-		    else
-			res.d = l.d / r.d;
-		    break;
-	    }
-	    break;
+/*
+ * Binary arithmetic over instance-aligned values, one function for each
+ * result type and operator.
+ *
+ * res[k] = <a>[k*sa] <op> <b>[k*sb]
+ * where a stride of 0 repeats the one value of a singular operand.
+ */
+#define BINOP(name, fld, op) \
+static void \
+name(val_t *res, const val_t *a, int sa, const val_t *b, int sb, int n) \
+{ \
+    int		k; \
+    for (k = 0; k < n; k++) \
+	res[k].value.fld = a[k*sa].value.fld op b[k*sb].value.fld; \
+}
+
+BINOP(add_l, l, +)
+BINOP(sub_l, l, -)
+BINOP(mul_l, l, *)
+BINOP(add_ul, ul, +)
+BINOP(sub_ul, ul, -)
+BINOP(mul_ul, ul, *)
+BINOP(add_ll, ll, +)
+BINOP(sub_ll, ll, -)
+BINOP(mul_ll, ll, *)
+BINOP(add_ull, ull, +)
+BINOP(sub_ull, ull, -)
+BINOP(mul_ull, ull, *)
+BINOP(add_f, f, +)
+BINOP(sub_f, f, -)
+BINOP(mul_f, f, *)
+BINOP(add_d, d, +)
+BINOP(sub_d, d, -)
+BINOP(mul_d, d, *)
+
+static void
+div_d(val_t *res, const val_t *a, int sa, const val_t *b, int sb, int n)
+{
+    int		k;
+
+    for (k = 0; k < n; k++) {
+	if (a[k*sa].value.d == 0)
+	    res[k].value.d = 0;
+	else
+	    res[k].value.d = a[k*sa].value.d / b[k*sb].value.d;
     }
+}
+
+/*
+ * Indexed by result type and operator (from L_PLUS) ... semantics
+ * enforce no L_SLASH for integer or float results.
+ */
+static const binop_t binops[][4] = {
+    { add_l, sub_l, mul_l, NULL },		/* PM_TYPE_32 */
+    { add_ul, sub_ul, mul_ul, NULL },		/* PM_TYPE_U32 */
+    { add_ll, sub_ll, mul_ll, NULL },		/* PM_TYPE_64 */
+    { add_ull, sub_ull, mul_ull, NULL },	/* PM_TYPE_U64 */
+    { add_f, sub_f, mul_f, NULL },		/* PM_TYPE_FLOAT */
+    { add_d, sub_d, mul_d, div_d },		/* PM_TYPE_DOUBLE */
+};
+
+/*
+ * Compile an expression after binding and semantic checks ... choose
+ * the typed array operation for each binary operator, so there is no
+ * per-value switching on types or operators when values are fetched.
+ */
+void
+__dmcompile(node_t *np)
+{
+    if (np == NULL)
+	return;
+    __dmcompile(np->left);
+    __dmcompile(np->right);
+    if (np->info == NULL)
+	return;
 
-    return res;
+    switch (np->type) {
+	case L_PLUS:
+	case L_MINUS:
+	case L_STAR:
+	case L_SLASH:
+	    if (np->desc.type >= PM_TYPE_32 && np->desc.type <= PM_TYPE_DOUBLE)
+		np->info->binop = binops[np->desc.type][np->type - L_PLUS];
+	    break;
+    }
 }
 
+/*
+ * delta() and rate() ... res[k] = cur[i] - last[j] for the kth
+ * matched pair of instances
+ */
+#define DIFF(to, from, cast) \
+    for (k = 0; k < n; k++) { \
+	i = lidx == NULL ? k : lidx[k]; \
+	j = ridx == NULL ? k : ridx[k]; \
+	res[k].inst = cur[i].inst; \
+	res[k].value.to = cast(cur[i].value.from - last[j].value.from); \
+    }
+
+/* extract values for a metric operand from a pmValueSet */
+#define EXTRACT(to, from) \
+    for (i = 0; i < n; i++) { \
+	res[i].inst = vsp->vlist[i].inst; \
+	res[i].value.to = vsp->vlist[i].value.from; \
+    }
+#define EXTRACT_BUF(to, size) \
+    for (i = 0; i < n; i++) { \
+	res[i].inst = vsp->vlist[i].inst; \
+	memcpy((void *)&res[i].value.to, (void *)vsp->vlist[i].value.pval->vbuf, size); \
+    }
 
 /*
  * Walk an expression tree, filling in operand values from the
  * pmResult at the leaf nodes and propagating the computed values
  * towards the root node of the tree.
+ *
+ * Each operator works on whole arrays of instance-values at a time,
+ * using the typed operations chosen in __dmcompile(), and the ivlist[]
+ * buffers are reused from one fetch to the next.
  */
 static int
 eval_expr(node_t *np, pmResult *rp, int level)
@@ -479,7 +578,17 @@ eval_expr(node_t *np, pmResult *rp, int level)
     int		i;
     int		j;
     int		k;
+    int		n;
     size_t	need;
+    info_t	*ip;
+    val_t	*res;
+    const val_t	*cur;
+    const val_t	*last;
+    const val_t	*a;
+    const val_t	*b;
+    const int	*lidx;
+    const int	*ridx;
+    pmValueSet	*vsp;
 
     assert(np != NULL);
     if (np->left != NULL) {
@@ -499,11 +608,8 @@ eval_expr(node_t *np, pmResult *rp, int level)
 	case L_NUMBER:
 	    if (np->info->numval == 0) {
 		/* initialize ivlist[] for singular instance first time through */
+		size_ivlist(np, 1, "eval_expr: number ivlist");
 		np->info->numval = 1;
-		if ((np->info->ivlist = (val_t *)malloc(sizeof(val_t))) == NULL) {
-		    __pmNoMem("eval_expr: number ivlist", sizeof(val_t), PM_FATAL_ERR);
-		    /*NOTREACHED*/
-		}
 		np->info->ivlist[0].inst = PM_INDOM_NULL;
 		/* don't need error checking, done in the lexical scanner */
 		np->info->ivlist[0].value.l = atoi(np->value);
@@ -519,13 +625,23 @@ eval_expr(node_t *np, pmResult *rp, int level)
 	    np->info->last_stamp = np->info->stamp;
 	    np->info->stamp = rp->timestamp;
 	    free_ivlist(np);
-	    np->info->numval = np->left->info->numval <= np->left->info->last_numval ? np->left->info->numval : np->left->info->last_numval;
-	    if (np->info->numval <= 0)
-		return np->info->numval;
-	    if ((np->info->ivlist = (val_t *)malloc(np->info->numval*sizeof(val_t))) == NULL) {
-		__pmNoMem("eval_expr: delta()/rate() ivlist", np->info->numval*sizeof(val_t), PM_FATAL_ERR);
-		/*NOTREACHED*/
+	    ip = np->left->info;
+	    n = ip->numval <= ip->last_numval ? ip->numval : ip->last_numval;
+	    if (n <= 0) {
+		np->info->numval = n;
+		return n;
 	    }
+	    cur = ip->ivlist;
+	    last = ip->last_ivlist;
+	    lidx = ridx = NULL;
+	    if ((n = join_inst(np->info, cur, ip->numval, last, ip->last_numval)) < 0)
+		n = ip->numval;
+	    else {
+		lidx = np->info->lidx;
+		ridx = np->info->ridx;
+	    }
+	    size_ivlist(np, n, "eval_expr: delta()/rate() ivlist");
+	    res = np->info->ivlist;
 	    /*
 	     * delta()
 	     * ivlist[k] = left->ivlist[i] - left->last_ivlist[j]
@@ -533,125 +649,99 @@ eval_expr(node_t *np, pmResult *rp, int level)
 	     * ivlist[k] = (left->ivlist[i] - left->last_ivlist[j]) /
 	     *             (timestamp - left->last_stamp)
 	     */
-	    for (i = k = 0; i < np->left->info->numval; i++) {
-		j = i;
-		if (j >= np->left->info->last_numval)
-		    j = 0;
-		if (np->left->info->ivlist[i].inst != np->left->info->last_ivlist[j].inst) {
-		    /* current ith inst != last jth inst ... search in last */
-#ifdef PCP_DEBUG
-		    if ((pmDebug & DBG_TRACE_DERIVE) && (pmDebug & DBG_TRACE_APPL2)) {
-			fprintf(stderr, "eval_expr: inst[%d] mismatch left [%d]=%d last [%d]=%d\n", k, i, np->left->info->ivlist[i].inst, j, np->left->info->last_ivlist[j].inst);
-		    }
-#endif
-		    for (j = 0; j < np->left->info->last_numval; j++) {
-			if (np->left->info->ivlist[i].inst == np->left->info->last_ivlist[j].inst)
-			    break;
-		    }
-		    if (j == np->left->info->last_numval) {
-			/* no match, skip this instance from this result */
-			continue;
-		    }
-#ifdef PCP_DEBUG
-		    else {
-			if ((pmDebug & DBG_TRACE_DERIVE) && (pmDebug & DBG_TRACE_APPL2)) {
-			    fprintf(stderr, "eval_expr: recover @ last [%d]=%d\n", j, np->left->info->last_ivlist[j].inst);
-			}
-		    }
-#endif
+	    if (np->type == L_DELTA) {
+		/* for delta() result type == operand type */
+		switch (np->left->desc.type) {
+		    case PM_TYPE_32:
+			DIFF(l, l, );
+			break;
+		    case PM_TYPE_U32:
+			DIFF(ul, ul, );
+			break;
+		    case PM_TYPE_64:
+			DIFF(ll, ll, );
+			break;
+		    case PM_TYPE_U64:
+			DIFF(ull, ull, );
+			break;
+		    case PM_TYPE_FLOAT:
+			DIFF(f, f, );
+			break;
+		    case PM_TYPE_DOUBLE:
+			DIFF(d, d, );
+			break;
+		    default:
+			/*
+			 * Nothing should end up here as check_expr() checks
+			 * for numeric data type at bind time
+			 */
+			return PM_ERR_CONV;
 		}
-		np->info->ivlist[k].inst = np->left->info->ivlist[i].inst;
-		if (np->type == L_DELTA) {
-		    /* for delta() result type == operand type */
-		    switch (np->left->desc.type) {
-			case PM_TYPE_32:
-			    np->info->ivlist[k].value.l = np->left->info->ivlist[i].value.l - np->left->info->last_ivlist[j].value.l;
-			    break;
-			case PM_TYPE_U32:
-			    np->info->ivlist[k].value.ul = np->left->info->ivlist[i].value.ul - np->left->info->last_ivlist[j].value.ul;
-			    break;
-			case PM_TYPE_64:
-			    np->info->ivlist[k].value.ll = np->left->info->ivlist[i].value.ll - np->left->info->last_ivlist[j].value.ll;
-			    break;
-			case PM_TYPE_U64:
-			    np->info->ivlist[k].value.ull = np->left->info->ivlist[i].value.ull - np->left->info->last_ivlist[j].value.ull;
-			    break;
-			case PM_TYPE_FLOAT:
-			    np->info->ivlist[k].value.f = np->left->info->ivlist[i].value.f - np->left->info->last_ivlist[j].value.f;
-			    break;
-			case PM_TYPE_DOUBLE:
-			    np->info->ivlist[k].value.d = np->left->info->ivlist[i].value.d - np->left->info->last_ivlist[j].value.d;
-			    break;
-			default:
-			    /*
-			     * Nothing should end up here as check_expr() checks
-			     * for numeric data type at bind time
-			     */
-			    return PM_ERR_CONV;
-		    }
+	    }
+	    else {
+		/* rate() conversion, type will be DOUBLE */
+		struct timeval	stampdiff;
+		double		interval;
+
+		switch (np->left->desc.type) {
+		    case PM_TYPE_32:
+			DIFF(d, l, (double));
+			break;
+		    case PM_TYPE_U32:
+			DIFF(d, ul, (double));
+			break;
+		    case PM_TYPE_64:
+			DIFF(d, ll, (double));
+			break;
+		    case PM_TYPE_U64:
+			DIFF(d, ull, (double));
+			break;
+		    case PM_TYPE_FLOAT:
+			DIFF(d, f, (double));
+			break;
+		    case PM_TYPE_DOUBLE:
+			DIFF(d, d, );
+			break;
+		    default:
+			/*
+			 * Nothing should end up here as check_expr() checks
+			 * for numeric data type at bind time
+			 */
+			return PM_ERR_CONV;
 		}
-		else {
-		    /* rate() conversion, type will be DOUBLE */
-		    struct timeval	stampdiff;
-		    stampdiff = np->info->stamp;
-		    __pmtimevalDec(&stampdiff, &np->info->last_stamp);
-		    switch (np->left->desc.type) {
-			case PM_TYPE_32:
-			    np->info->ivlist[k].value.d = (double)(np->left->info->ivlist[i].value.l - np->left->info->last_ivlist[j].value.l);
-			    break;
-			case PM_TYPE_U32:
-			    np->info->ivlist[k].value.d = (double)(np->left->info->ivlist[i].value.ul - np->left->info->last_ivlist[j].value.ul);
-			    break;
-			case PM_TYPE_64:
-			    np->info->ivlist[k].value.d = (double)(np->left->info->ivlist[i].value.ll - np->left->info->last_ivlist[j].value.ll);
-			    break;
-			case PM_TYPE_U64:
-			    np->info->ivlist[k].value.d = (double)(np->left->info->ivlist[i].value.ull - np->left->info->last_ivlist[j].value.ull);
-			    break;
-			case PM_TYPE_FLOAT:
-			    np->info->ivlist[k].value.d = (double)(np->left->info->ivlist[i].value.f - np->left->info->last_ivlist[j].value.f);
-			    break;
-			case PM_TYPE_DOUBLE:
-			    np->info->ivlist[k].value.d = np->left->info->ivlist[i].value.d - np->left->info->last_ivlist[j].value.d;
-			    break;
-			default:
-			    /*
-			     * Nothing should end up here as check_expr() checks
-			     * for numeric data type at bind time
-			     */
-			    return PM_ERR_CONV;
-		    }
-		    np->info->ivlist[k].value.d /= __pmtimevalToReal(&stampdiff);
-		    /*
-		     * check_expr() ensures dimTime is 0 or 1 at bind time
-		     */
-		    if (np->left->desc.units.dimTime == 1) {
-			/* scale rate(time counter) -> time utilization */
-			if (np->info->time_scale < 0) {
-			    /*
-			     * one trip initialization for time utilization
-			     * scaling factor (to scale metric from counter
-			     * units into seconds)
-			     */
-			    int		i;
-			    np->info->time_scale = 1;
-			    if (np->left->desc.units.scaleTime > PM_TIME_SEC) {
-
-				for (i = PM_TIME_SEC; i < np->left->desc.units.scaleTime; i++)
-
-				    np->info->time_scale *= 60;
-			    }
-			    else {
-				for (i = np->left->desc.units.scaleTime; i < PM_TIME_SEC; i++)
-				    np->info->time_scale /= 1000;
-			    }
+		stampdiff = np->info->stamp;
+		__pmtimevalDec(&stampdiff, &np->info->last_stamp);
+		interval = __pmtimevalToReal(&stampdiff);
+		/*
+		 * check_expr() ensures dimTime is 0 or 1 at bind time
+		 */
+		if (np->left->desc.units.dimTime == 1) {
+		    /* scale rate(time counter) -> time utilization */
+		    if (np->info->time_scale < 0) {
+			/*
+			 * one trip initialization for time utilization
+			 * scaling factor (to scale metric from counter
+			 * units into seconds)
+			 */
+			np->info->time_scale = 1;
+			if (np->left->desc.units.scaleTime > PM_TIME_SEC) {
+			    for (i = PM_TIME_SEC; i < np->left->desc.units.scaleTime; i++)
+				np->info->time_scale *= 60;
+			}
+			else {
+			    for (i = np->left->desc.units.scaleTime; i < PM_TIME_SEC; i++)
+				np->info->time_scale /= 1000;
 			}
-			np->info->ivlist[k].value.d *= np->info->time_scale;
 		    }
+		    for (k = 0; k < n; k++)
+			res[k].value.d = (res[k].value.d / interval) * np->info->time_scale;
+		}
+		else {
+		    for (k = 0; k < n; k++)
+			res[k].value.d /= interval;
 		}
-		k++;
 	    }
-	    np->info->numval = k;
+	    np->info->numval = n;
 	    return np->info->numval;
 	    break;
 
@@ -660,14 +750,10 @@ eval_expr(node_t *np, pmResult *rp, int level)
 	case L_SUM:
 	case L_MAX:
 	case L_MIN:
-	    if (np->info->ivlist == NULL) {
-		/* initialize ivlist[] for singular instance first time through */
-		if ((np->info->ivlist = (val_t *)malloc(sizeof(val_t))) == NULL) {
-		    __pmNoMem("eval_expr: aggr ivlist", sizeof(val_t), PM_FATAL_ERR);
-		    /*NOTREACHED*/
-		}
-		np->info->ivlist[0].inst = PM_IN_NULL;
-	    }
+	    /* singular instance, and ivlist[] saved if need be */
+	    free_ivlist(np);
+	    size_ivlist(np, 1, "eval_expr: aggr ivlist");
+	    np->info->ivlist[0].inst = PM_IN_NULL;
 	    /*
 	     * values are in the left expr
 	     */
@@ -853,87 +939,99 @@ eval_expr(node_t *np, pmResult *rp, int level)
 	case L_NAME:
 	    /*
 	     * Extract instance-values from pmResult and store them in
-	     * ivlist[] as <int, pmAtomValue> pairs
+	     * ivlist[] as <int, pmAtomValue> pairs ... the operand is
+	     * usually in the same place in the pmResult from one fetch
+	     * to the next, so look there first
 	     */
-	    for (j = 0; j < rp->numpmid; j++) {
-		if (np->info->pmid == rp->vset[j]->pmid) {
-		    free_ivlist(np);
-		    np->info->numval = rp->vset[j]->numval;
-		    if (np->info->numval <= 0)
-			return np->info->numval;
-		    if ((np->info->ivlist = (val_t *)malloc(np->info->numval*sizeof(val_t))) == NULL) {
-			__pmNoMem("eval_expr: metric ivlist", np->info->numval*sizeof(val_t), PM_FATAL_ERR);
-			/*NOTREACHED*/
-		    }
-		    for (i = 0; i < np->info->numval; i++) {
-			np->info->ivlist[i].inst = rp->vset[j]->vlist[i].inst;
-			switch (np->desc.type) {
-			    case PM_TYPE_32:
-			    case PM_TYPE_U32:
-				np->info->ivlist[i].value.l = rp->vset[j]->vlist[i].value.lval;
-				break;
-
-			    case PM_TYPE_64:
-			    case PM_TYPE_U64:
-				memcpy((void *)&np->info->ivlist[i].value.ll, (void *)rp->vset[j]->vlist[i].value.pval->vbuf, sizeof(__int64_t));
-				break;
-
-			    case PM_TYPE_FLOAT:
-				if (rp->vset[j]->valfmt == PM_VAL_INSITU) {
-				    /* old style insitu float */
-				    np->info->ivlist[i].value.l = rp->vset[j]->vlist[i].value.lval;
-				}
-				else {
-				    assert(rp->vset[j]->vlist[i].value.pval->vtype == PM_TYPE_FLOAT);
-				    memcpy((void *)&np->info->ivlist[i].value.f, (void *)rp->vset[j]->vlist[i].value.pval->vbuf, sizeof(float));
-				}
-				break;
-
-			    case PM_TYPE_DOUBLE:
-				memcpy((void *)&np->info->ivlist[i].value.d, (void *)rp->vset[j]->vlist[i].value.pval->vbuf, sizeof(double));
-				break;
-
-			    case PM_TYPE_STRING:
-				need = rp->vset[j]->vlist[i].value.pval->vlen-PM_VAL_HDR_SIZE;
-				if ((np->info->ivlist[i].value.cp = (char *)malloc(need)) == NULL) {
-				    __pmNoMem("eval_expr: string value", rp->vset[j]->vlist[i].value.pval->vlen, PM_FATAL_ERR);
-				    /*NOTREACHED*/
-				}
-				memcpy((void *)np->info->ivlist[i].value.cp, (void *)rp->vset[j]->vlist[i].value.pval->vbuf, need);
-				np->info->ivlist[i].vlen = need;
-				break;
-
-			    case PM_TYPE_AGGREGATE:
-			    case PM_TYPE_AGGREGATE_STATIC:
-			    case PM_TYPE_EVENT:
-			    case PM_TYPE_HIGHRES_EVENT:
-				if ((np->info->ivlist[i].value.vbp = (pmValueBlock *)malloc(rp->vset[j]->vlist[i].value.pval->vlen)) == NULL) {
-				    __pmNoMem("eval_expr: aggregate value", rp->vset[j]->vlist[i].value.pval->vlen, PM_FATAL_ERR);
-				    /*NOTREACHED*/
-				}
-				memcpy(np->info->ivlist[i].value.vbp, (void *)rp->vset[j]->vlist[i].value.pval, rp->vset[j]->vlist[i].value.pval->vlen);
-				np->info->ivlist[i].vlen = rp->vset[j]->vlist[i].value.pval->vlen;
-				break;
-
-			    default:
-				/*
-				 * really only PM_TYPE_NOSUPPORT should
-				 * end up here
-				 */
-				return PM_ERR_TYPE;
-			}
+	    j = np->info->vsetidx;
+	    if (j >= rp->numpmid || rp->vset[j]->pmid != np->info->pmid) {
+		for (j = 0; j < rp->numpmid; j++) {
+		    if (np->info->pmid == rp->vset[j]->pmid)
+			break;
+		}
+		if (j == rp->numpmid) {
+#ifdef PCP_DEBUG
+		    if (pmDebug & DBG_TRACE_DERIVE) {
+			char	strbuf[20];
+			fprintf(stderr, "eval_expr: botch: operand %s not in the extended pmResult\n", pmIDStr_r(np->info->pmid, strbuf, sizeof(strbuf)));
+			__pmDumpResult(stderr, rp);
 		    }
-		    return np->info->numval;
+#endif
+		    return PM_ERR_PMID;
 		}
+		np->info->vsetidx = j;
 	    }
-#ifdef PCP_DEBUG
-	    if (pmDebug & DBG_TRACE_DERIVE) {
-		char	strbuf[20];
-		fprintf(stderr, "eval_expr: botch: operand %s not in the extended pmResult\n", pmIDStr_r(np->info->pmid, strbuf, sizeof(strbuf)));
-		__pmDumpResult(stderr, rp);
+	    vsp = rp->vset[j];
+	    free_ivlist(np);
+	    np->info->numval = n = vsp->numval;
+	    if (n <= 0)
+		return n;
+	    size_ivlist(np, n, "eval_expr: metric ivlist");
+	    res = np->info->ivlist;
+	    switch (np->desc.type) {
+		case PM_TYPE_32:
+		case PM_TYPE_U32:
+		    EXTRACT(l, lval);
+		    break;
+
+		case PM_TYPE_64:
+		case PM_TYPE_U64:
+		    EXTRACT_BUF(ll, sizeof(__int64_t));
+		    break;
+
+		case PM_TYPE_FLOAT:
+		    if (vsp->valfmt == PM_VAL_INSITU) {
+			/* old style insitu float */
+			EXTRACT(l, lval);
+		    }
+		    else {
+			for (i = 0; i < n; i++)
+			    assert(vsp->vlist[i].value.pval->vtype == PM_TYPE_FLOAT);
+			EXTRACT_BUF(f, sizeof(float));
+		    }
+		    break;
+
+		case PM_TYPE_DOUBLE:
+		    EXTRACT_BUF(d, sizeof(double));
+		    break;
+
+		case PM_TYPE_STRING:
+		    for (i = 0; i < n; i++) {
+			res[i].inst = vsp->vlist[i].inst;
+			need = vsp->vlist[i].value.pval->vlen-PM_VAL_HDR_SIZE;
+			if ((res[i].value.cp = (char *)malloc(need)) == NULL) {
+			    __pmNoMem("eval_expr: string value", vsp->vlist[i].value.pval->vlen, PM_FATAL_ERR);
+			    /*NOTREACHED*/
+			}
+			memcpy((void *)res[i].value.cp, (void *)vsp->vlist[i].value.pval->vbuf, need);
+			res[i].vlen = need;
+		    }
+		    break;
+
+		case PM_TYPE_AGGREGATE:
+		case PM_TYPE_AGGREGATE_STATIC:
+		case PM_TYPE_EVENT:
+		case PM_TYPE_HIGHRES_EVENT:
+		    for (i = 0; i < n; i++) {
+			res[i].inst = vsp->vlist[i].inst;
+			if ((res[i].value.vbp = (pmValueBlock *)malloc(vsp->vlist[i].value.pval->vlen)) == NULL) {
+			    __pmNoMem("eval_expr: aggregate value", vsp->vlist[i].value.pval->vlen, PM_FATAL_ERR);
+			    /*NOTREACHED*/
+			}
+			memcpy(res[i].value.vbp, (void *)vsp->vlist[i].value.pval, vsp->vlist[i].value.pval->vlen);
+			res[i].vlen = vsp->vlist[i].value.pval->vlen;
+		    }
+		    break;
+
+		default:
+		    /*
+		     * really only PM_TYPE_NOSUPPORT should
+		     * end up here
+		     */
+		    np->info->numval = 0;
+		    return PM_ERR_TYPE;
 	    }
-#endif
-	    return PM_ERR_PMID;
+	    return np->info->numval;
 
 	case L_ANON:
 	    /* no values available for anonymous metrics */
@@ -953,102 +1051,61 @@ eval_expr(node_t *np, pmResult *rp, int level)
 	    /*
 	     * empty result cases first
 	     */
-	    if (np->left->info->numval == 0) {
-		np->info->numval = 0;
-		return np->info->numval;
-	    }
-	    if (np->right->info->numval == 0) {
-		np->info->numval = 0;
+	    if (np->left->info->numval == 0 || np->right->info->numval == 0)
 		return np->info->numval;
+	    if (np->info->binop == NULL) {
+		/* check_expr() and __dmcompile() at bind time, botch! */
+		return PM_ERR_CONV;
 	    }
 	    /*
-	     * really got some work to do ...
+	     * really got some work to do ... first line up the instances
+	     * of the operands, a singular operand is used for all of the
+	     * instances of the other operand
 	     */
+	    lidx = ridx = NULL;
 	    if (np->left->desc.indom == PM_INDOM_NULL)
-		np->info->numval = np->right->info->numval;
+		n = np->right->info->numval;
 	    else if (np->right->desc.indom == PM_INDOM_NULL)
-		np->info->numval = np->left->info->numval;
+		n = np->left->info->numval;
+	    else if ((n = join_inst(np->info,
+				np->left->info->ivlist, np->left->info->numval,
+				np->right->info->ivlist, np->right->info->numval)) < 0)
+		n = np->left->info->numval;
 	    else {
-		/*
-		 * Generally have the same number of instances because
-		 * both operands are over the same instance domain,
-		 * fetched with the same profile.  When not the case,
-		 * the result can contain no more instances than in
-		 * the smaller of the operands.
-		 */
-		if (np->left->info->numval <= np->right->info->numval)
-		    np->info->numval = np->left->info->numval;
-		else
-		    np->info->numval = np->right->info->numval;
-	    }
-	    if ((np->info->ivlist = (val_t *)malloc(np->info->numval*sizeof(val_t))) == NULL) {
-		__pmNoMem("eval_expr: expr ivlist", np->info->numval*sizeof(val_t), PM_FATAL_ERR);
-		/*NOTREACHED*/
+		lidx = np->info->lidx;
+		ridx = np->info->ridx;
 	    }
+	    if (n == 0)
+		return np->info->numval;
+	    size_ivlist(np, n, "eval_expr: expr ivlist");
+	    size_join(np->info, n);
+	    res = np->info->ivlist;
+
 	    /*
 	     * ivlist[k] = left-ivlist[i] <op> right-ivlist[j]
 	     */
-	    for (i = j = k = 0; k < np->info->numval; ) {
-		if (i >= np->left->info->numval || j >= np->right->info->numval) {
-		    /* run out of operand instances, quit */
-		    np->info->numval = k;
-		    break;
-		}
-		if (np->left->desc.indom != PM_INDOM_NULL &&
-		    np->right->desc.indom != PM_INDOM_NULL) {
-		    if (np->left->info->ivlist[i].inst != np->right->info->ivlist[j].inst) {
-			/* left ith inst != right jth inst ... search in right */
-#ifdef PCP_DEBUG
-			if ((pmDebug & DBG_TRACE_DERIVE) && (pmDebug & DBG_TRACE_APPL2)) {
-			    fprintf(stderr, "eval_expr: inst[%d] mismatch left [%d]=%d right [%d]=%d\n", k, i, np->left->info->ivlist[i].inst, j, np->right->info->ivlist[j].inst);
-			}
-#endif
-			for (j = 0; j < np->right->info->numval; j++) {
-			    if (np->left->info->ivlist[i].inst == np->right->info->ivlist[j].inst)
-				break;
-			}
-			if (j == np->right->info->numval) {
-			    /*
-			     * no match, so next instance on left operand,
-			     * and reset to start from first instance of
-			     * right operand
-			     */
-			    i++;
-			    j = 0;
-			    continue;
-			}
-#ifdef PCP_DEBUG
-			else {
-			    if ((pmDebug & DBG_TRACE_DERIVE) && (pmDebug & DBG_TRACE_APPL2)) {
-				fprintf(stderr, "eval_expr: recover @ right [%d]=%d\n", j, np->right->info->ivlist[j].inst);
-			    }
-			}
-#endif
-		    }
-		}
-		np->info->ivlist[k].value =
-		    bin_op(np->desc.type, np->type,
-			   np->left->info->ivlist[i].value, np->left->desc.type, np->left->info->mul_scale, np->left->info->div_scale,
-			   np->right->info->ivlist[j].value, np->right->desc.type, np->right->info->mul_scale, np->right->info->div_scale);
-		if (np->left->desc.indom != PM_INDOM_NULL)
-		    np->info->ivlist[k].inst = np->left->info->ivlist[i].inst;
-		else
-		    np->info->ivlist[k].inst = np->right->info->ivlist[j].inst;
-		k++;
-		if (np->left->desc.indom != PM_INDOM_NULL) {
-		    i++;
-		    if (np->right->desc.indom != PM_INDOM_NULL) {
-			j++;
-			if (j >= np->right->info->numval) {
-			    /* rescan if need be */
-			    j = 0;
-			}
-		    }
-		}
-		else if (np->right->desc.indom != PM_INDOM_NULL) {
-		    j++;
-		}
+	    if (np->left->desc.indom == PM_INDOM_NULL) {
+		a = promote(np->left, np->desc.type, NULL, 1, np->info->lconv);
+		b = promote(np->right, np->desc.type, NULL, n, np->info->rconv);
+		np->info->binop(res, a, 0, b, 1, n);
+		for (k = 0; k < n; k++)
+		    res[k].inst = np->right->info->ivlist[k].inst;
+	    }
+	    else if (np->right->desc.indom == PM_INDOM_NULL) {
+		a = promote(np->left, np->desc.type, NULL, n, np->info->lconv);
+		b = promote(np->right, np->desc.type, NULL, 1, np->info->rconv);
+		np->info->binop(res, a, 1, b, 0, n);
+		for (k = 0; k < n; k++)
+		    res[k].inst = np->left->info->ivlist[k].inst;
+	    }
+	    else {
+		a = promote(np->left, np->desc.type, lidx, n, np->info->lconv);
+		b = promote(np->right, np->desc.type, ridx, n, np->info->rconv);
+		np->info->binop(res, a, 1, b, 1, n);
+		for (k = 0; k < n; k++)
+		    res[k].inst = np->left->info->ivlist[lidx == NULL ? k : lidx[k]].inst;
 	    }
+	    np->info->numval = n;
 	    return np->info->numval;
     }
     /*NOTREACHED*/
@@ -132,7 +132,7 @@ cache_read(__pmArchCtl *acp, int mode, pmResult **rp)
     int		save_curvol;
 
     if (acp->ac_vol == acp->ac_log->l_curvol) {
-	posn = ftell(acp->ac_log->l_mfp);
+	posn = __pmLogTell(acp->ac_log);
 	assert(posn >= 0);
     }
     else
@@ -173,9 +173,9 @@ cache_read(__pmArchCtl *acp, int mode, pmResult **rp)
 	    *rp = cp->rp;
 	    cp->used++;
 	    if (mode == PM_MODE_FORW)
-		fseek(acp->ac_log->l_mfp, cp->tail_posn, SEEK_SET);
+		__pmLogSeek(acp->ac_log, cp->tail_posn, SEEK_SET);
 	    else
-		fseek(acp->ac_log->l_mfp, cp->head_posn, SEEK_SET);
+		__pmLogSeek(acp->ac_log, cp->head_posn, SEEK_SET);
 #ifdef PCP_DEBUG
 	    if ((pmDebug & DBG_TRACE_LOG) && (pmDebug & DBG_TRACE_DESPERATE)) {
 		__pmTimeval	tmp;
@@ -229,12 +229,12 @@ cache_read(__pmArchCtl *acp, int mode, pmResult **rp)
 	lfup->used = 1;
 	if (mode == PM_MODE_FORW) {
 	    lfup->head_posn = posn;
-	    lfup->tail_posn = ftell(acp->ac_log->l_mfp);
+	    lfup->tail_posn = __pmLogTell(acp->ac_log);
 	    assert(lfup->tail_posn >= 0);
 	}
 	else {
 	    lfup->tail_posn = posn;
-	    lfup->head_posn = ftell(acp->ac_log->l_mfp);
+	    lfup->head_posn = __pmLogTell(acp->ac_log);
 	    assert(lfup->head_posn >= 0);
 	}
 #ifdef PCP_DEBUG
@@ -559,7 +559,7 @@ do_roll(__pmContext *ctxp, double t_req)
 		fprintf(stderr, "do_roll: forw to t=%.6f%s\n",
 		    t_this, logrp->numpmid == 0 ? " <mark>" : "");
 #endif
-	    ctxp->c_archctl->ac_offset = ftell(ctxp->c_archctl->ac_log->l_mfp);
+	    ctxp->c_archctl->ac_offset = __pmLogTell(ctxp->c_archctl->ac_log);
 	    assert(ctxp->c_archctl->ac_offset >= 0);
 	    ctxp->c_archctl->ac_vol = ctxp->c_archctl->ac_log->l_curvol;
 	    update_bounds(ctxp, t_req, logrp, UPD_MARK_FORW, NULL);
@@ -578,7 +578,7 @@ do_roll(__pmContext *ctxp, double t_req)
 		fprintf(stderr, "do_roll: back to t=%.6f%s\n",
 		    t_this, logrp->numpmid == 0 ? " <mark>" : "");
 #endif
-	    ctxp->c_archctl->ac_offset = ftell(ctxp->c_archctl->ac_log->l_mfp);
+	    ctxp->c_archctl->ac_offset = __pmLogTell(ctxp->c_archctl->ac_log);
 	    assert(ctxp->c_archctl->ac_offset >= 0);
 	    ctxp->c_archctl->ac_vol = ctxp->c_archctl->ac_log->l_curvol;
 	    update_bounds(ctxp, t_req, logrp, UPD_MARK_BACK, NULL);
@@ -795,7 +795,7 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
     if (ctxp->c_archctl->ac_serial == 0) {
 	/* need gross positioning from temporal index */
 	__pmLogSetTime(ctxp);
-	ctxp->c_archctl->ac_offset = ftell(ctxp->c_archctl->ac_log->l_mfp);
+	ctxp->c_archctl->ac_offset = __pmLogTell(ctxp->c_archctl->ac_log);
 	assert(ctxp->c_archctl->ac_offset >= 0);
 	ctxp->c_archctl->ac_vol = ctxp->c_archctl->ac_log->l_curvol;
 
@@ -812,7 +812,7 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
 		if (t_this <= t_req) {
 		    break;
 		}
-		ctxp->c_archctl->ac_offset = ftell(ctxp->c_archctl->ac_log->l_mfp);
+		ctxp->c_archctl->ac_offset = __pmLogTell(ctxp->c_archctl->ac_log);
 		assert(ctxp->c_archctl->ac_offset >= 0);
 		ctxp->c_archctl->ac_vol = ctxp->c_archctl->ac_log->l_curvol;
 		update_bounds(ctxp, t_req, logrp, UPD_MARK_NONE, NULL);
@@ -826,7 +826,7 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
 		if (t_this > t_req) {
 		    break;
 		}
-		ctxp->c_archctl->ac_offset = ftell(ctxp->c_archctl->ac_log->l_mfp);
+		ctxp->c_archctl->ac_offset = __pmLogTell(ctxp->c_archctl->ac_log);
 		assert(ctxp->c_archctl->ac_offset >= 0);
 		ctxp->c_archctl->ac_vol = ctxp->c_archctl->ac_log->l_curvol;
 		update_bounds(ctxp, t_req, logrp, UPD_MARK_NONE, NULL);
@@ -837,7 +837,7 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
 
     /* get to the last remembered place */
     __pmLogChangeVol(ctxp->c_archctl->ac_log, ctxp->c_archctl->ac_vol);
-    fseek(ctxp->c_archctl->ac_log->l_mfp, ctxp->c_archctl->ac_offset, SEEK_SET);
+    __pmLogSeek(ctxp->c_archctl->ac_log, ctxp->c_archctl->ac_offset, SEEK_SET);
 
     /*
      * optimization to supress roll forwards unless really needed ...
@@ -910,7 +910,7 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
 	 * position ourselves, ... and search
 	 */
 	__pmLogChangeVol(ctxp->c_archctl->ac_log, ctxp->c_archctl->ac_vol);
-	fseek(ctxp->c_archctl->ac_log->l_mfp, ctxp->c_archctl->ac_offset, SEEK_SET);
+	__pmLogSeek(ctxp->c_archctl->ac_log, ctxp->c_archctl->ac_offset, SEEK_SET);
 	done = 0;
 
 	while (done < back) {
@@ -929,7 +929,7 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
 	    t_this = __pmTimevalSub(&tmp, &ctxp->c_archctl->ac_log->l_label.ill_start);
 	    if (ctxp->c_delta < 0 && t_this >= t_req) {
 		/* going backwards, and not up to t_req yet */
-		ctxp->c_archctl->ac_offset = ftell(ctxp->c_archctl->ac_log->l_mfp);
+		ctxp->c_archctl->ac_offset = __pmLogTell(ctxp->c_archctl->ac_log);
 		assert(ctxp->c_archctl->ac_offset >= 0);
 		ctxp->c_archctl->ac_vol = ctxp->c_archctl->ac_log->l_curvol;
 	    }
@@ -1023,7 +1023,7 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
 	 * position ourselves ... and search
 	 */
 	__pmLogChangeVol(ctxp->c_archctl->ac_log, ctxp->c_archctl->ac_vol);
-	fseek(ctxp->c_archctl->ac_log->l_mfp, ctxp->c_archctl->ac_offset, SEEK_SET);
+	__pmLogSeek(ctxp->c_archctl->ac_log, ctxp->c_archctl->ac_offset, SEEK_SET);
 	done = 0;
 
 	while (done < forw) {
@@ -1042,7 +1042,7 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
 	    t_this = __pmTimevalSub(&tmp, &ctxp->c_archctl->ac_log->l_label.ill_start);
 	    if (ctxp->c_delta > 0 && t_this <= t_req) {
 		/* going forwards, and not up to t_req yet */
-		ctxp->c_archctl->ac_offset = ftell(ctxp->c_archctl->ac_log->l_mfp);
+		ctxp->c_archctl->ac_offset = __pmLogTell(ctxp->c_archctl->ac_log);
 		assert(ctxp->c_archctl->ac_offset >= 0);
 		ctxp->c_archctl->ac_vol = ctxp->c_archctl->ac_log->l_curvol;
 	    }
@@ -28,6 +28,9 @@
 #if defined(HAVE_SYS_WAIT_H)
 #include <sys/wait.h>
 #endif
+#if defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#endif
 
 INTERN int	__pmLogReads;
 
@@ -380,15 +383,112 @@ _logpeek(__pmLogCtl *lcp, int vol)
     return f;
 }
 
+/*
+ * Uncompressed volumes are mapped when opened for reading, and then
+ * __pmLogRead() takes records straight from the mapping - no stdio
+ * buffer copies, and no seeking back and forth for backward reads.
+ * The stdio stream stays open (for the label, fstat and peeking) but
+ * the read offset is then l_mapoff, so use __pmLogTell and __pmLogSeek
+ * rather than ftell and fseek on l_mfp.
+ *
+ * Volumes that are compressed, or still being written (they grow past
+ * the mapping), are read through stdio as before.  Setting
+ * PCP_ARCHIVE_NOMMAP in the environment disables the mapping.
+ */
+static void
+logunmap(__pmLogCtl *lcp)
+{
+    if (lcp->l_mapaddr != NULL) {
+	__pmMemoryUnmap(lcp->l_mapaddr, lcp->l_mapsize);
+	lcp->l_mapaddr = NULL;
+	lcp->l_mapsize = 0;
+    }
+}
+
+static void
+logmap(__pmLogCtl *lcp)
+{
+    struct stat	sbuf;
+    long	offset;
+    void	*addr;
+
+    if (getenv("PCP_ARCHIVE_NOMMAP") != NULL)
+	return;
+    if (fstat(fileno(lcp->l_mfp), &sbuf) < 0 || !S_ISREG(sbuf.st_mode))
+	return;
+    if (sbuf.st_size <= (off_t)(sizeof(__pmLogLabel) + 2*sizeof(int)) ||
+	(off_t)(size_t)sbuf.st_size != sbuf.st_size)
+	return;
+    if ((offset = ftell(lcp->l_mfp)) < 0)
+	return;
+    if ((addr = __pmMemoryMap(fileno(lcp->l_mfp), sbuf.st_size, 0)) == NULL)
+	return;
+    lcp->l_mapaddr = (char *)addr;
+    lcp->l_mapsize = (size_t)sbuf.st_size;
+    lcp->l_mapoff = (__pm_off_t)offset;
+    lcp->l_mapseq = 0;
+#ifdef PCP_DEBUG
+    if (pmDebug & DBG_TRACE_LOG)
+	fprintf(stderr, "logmap: fd=%d mapped %ld bytes\n",
+		fileno(lcp->l_mfp), (long)lcp->l_mapsize);
+#endif
+}
+
+/*
+ * The volume has grown beyond the mapping (being written by pmlogger),
+ * switch back to stdio at the same offset.  Returns 1 if so.
+ */
+static int
+loggrown(__pmLogCtl *lcp)
+{
+    struct stat	sbuf;
+
+    if (fstat(fileno(lcp->l_mfp), &sbuf) < 0 || sbuf.st_size == lcp->l_mapsize)
+	return 0;
+#ifdef PCP_DEBUG
+    if (pmDebug & DBG_TRACE_LOG)
+	fprintf(stderr, "loggrown: fd=%d now %ld bytes, was %ld, using stdio\n",
+		fileno(lcp->l_mfp), (long)sbuf.st_size, (long)lcp->l_mapsize);
+#endif
+    fseek(lcp->l_mfp, (long)lcp->l_mapoff, SEEK_SET);
+    logunmap(lcp);
+    return 1;
+}
+
+long
+__pmLogTell(__pmLogCtl *lcp)
+{
+    if (lcp->l_mapaddr != NULL)
+	return (long)lcp->l_mapoff;
+    return ftell(lcp->l_mfp);
+}
+
+void
+__pmLogSeek(__pmLogCtl *lcp, long offset, int whence)
+{
+    if (lcp->l_mapaddr != NULL) {
+	if (whence == SEEK_END && loggrown(lcp) == 0)
+	    offset += (long)lcp->l_mapsize;
+	if (lcp->l_mapaddr != NULL) {
+	    lcp->l_mapoff = (__pm_off_t)offset;
+	    lcp->l_mapseq = 0;
+	    return;
+	}
+    }
+    fseek(lcp->l_mfp, offset, whence);
+}
+
 int
 __pmLogChangeVol(__pmLogCtl *lcp, int vol)
 {
     char	name[MAXPATHLEN];
     int		sts;
+    int		compressed = 0;
 
     if (lcp->l_curvol == vol)
 	return 0;
 
+    logunmap(lcp);
     if (lcp->l_mfp != NULL) {
 	__pmResetIPC(fileno(lcp->l_mfp));
 	fclose(lcp->l_mfp);
@@ -398,11 +498,14 @@ __pmLogChangeVol(__pmLogCtl *lcp, int vol)
 	/* try for a compressed file */
 	if ((lcp->l_mfp = fopen_compress(name)) == NULL)
 	    return -oserror();
+	compressed = 1;
     }
 
     if ((sts = __pmLogChkLabel(lcp, lcp->l_mfp, &lcp->l_label, vol)) < 0)
 	return sts;
 
+    if (!compressed)
+	logmap(lcp);
     lcp->l_curvol = vol;
 #ifdef PCP_DEBUG
     if (pmDebug & DBG_TRACE_LOG)
@@ -588,6 +691,7 @@ __pmLogCreate(const char *host, const char *base, int log_version,
     lcp->l_hashpmid.nodes = lcp->l_hashpmid.hsize = 0;
     lcp->l_hashindom.nodes = lcp->l_hashindom.hsize = 0;
     lcp->l_tifp = lcp->l_mdfp = lcp->l_mfp = NULL;
+    lcp->l_mapaddr = NULL;
 
     if ((lcp->l_tifp = __pmLogNewFile(base, PM_LOG_VOL_TI)) != NULL) {
 	if ((lcp->l_mdfp = __pmLogNewFile(base, PM_LOG_VOL_META)) != NULL) {
@@ -661,6 +765,7 @@ __pmLogClose(__pmLogCtl *lcp)
 	fclose(lcp->l_mdfp);
 	lcp->l_mdfp = NULL;
     }
+    logunmap(lcp);
     if (lcp->l_mfp != NULL) {
 	__pmResetIPC(fileno(lcp->l_mfp));
 	fclose(lcp->l_mfp);
@@ -853,6 +958,7 @@ done:
     lcp->l_hashindom.nodes = lcp->l_hashindom.hsize = 0;
     lcp->l_numseen = 0; lcp->l_seen = NULL;
     lcp->l_pmns = NULL;
+    lcp->l_mapaddr = NULL;
 
     blen = (int)strlen(base);
     PM_LOCK(__pmLock_libpcp);
@@ -1395,6 +1501,235 @@ paranoidLogRead(__pmLogCtl *lcp, int mode, FILE *peekf, pmResult **result)
     return __pmLogRead(lcp, mode, peekf, result, PMLOGREAD_TO_EOF);
 }
 
+/*
+ * decode a log record, read into pb[3] onwards - common to the stdio
+ * and mapped reads below
+ */
+static int
+logdecode(__pmLogCtl *lcp, int fd, __pmPDU *pb, int head, pmResult **result)
+{
+    int		sts;
+#ifdef PCP_DEBUG
+    int		rlen = head - 2 * (int)sizeof(head);
+#endif
+
+    __pmOverrideLastFd(fd);
+    sts = __pmDecodeResult(pb, result); /* also swabs the result */
+
+#ifdef PCP_DEBUG
+    if (pmDebug & DBG_TRACE_LOG) {
+	head -= 2 * sizeof(head);
+	if (sts >= 0) {
+	    __pmTimeval	tmp;
+	    fprintf(stderr, "@");
+	    __pmPrintStamp(stderr, &(*result)->timestamp);
+	    tmp.tv_sec = (__int32_t)(*result)->timestamp.tv_sec;
+	    tmp.tv_usec = (__int32_t)(*result)->timestamp.tv_usec;
+	    fprintf(stderr, " (t=%.6f)", __pmTimevalSub(&tmp, &lcp->l_label.ill_start));
+	}
+	else {
+	    char	errmsg[PM_MAXERRMSGLEN];
+	    fprintf(stderr, "__pmLogRead: __pmDecodeResult failed: %s\n", pmErrStr_r(sts, errmsg, sizeof(errmsg)));
+	    fprintf(stderr, "@unknown time");
+	}
+	fprintf(stderr, " len=header+%d+trailer\n", head);
+    }
+#endif
+
+    /* exported to indicate how efficient we are ... */
+    __pmLogReads++;
+
+    if (sts < 0) {
+	__pmUnpinPDUBuf(pb);
+	return PM_ERR_LOGREC;
+    }
+
+#ifdef PCP_DEBUG
+    if (pmDebug & DBG_TRACE_PDU) {
+	fprintf(stderr, "__pmLogRead timestamp=");
+	__pmPrintStamp(stderr, &(*result)->timestamp);
+	fprintf(stderr, " " PRINTF_P_PFX "%p ... " PRINTF_P_PFX "%p", &pb[3], &pb[head/sizeof(__pmPDU)+3]);
+	fputc('\n', stderr);
+	dumpbuf(rlen, &pb[3]);		/* see above to explain "3" */
+    }
+#endif
+
+    __pmUnpinPDUBuf(pb);
+
+    return 0;
+}
+
+#define LOG_STDIO	1	/* from logreadmap(), use stdio instead */
+#define LOG_SEQRUN	16	/* forward reads before MADV_SEQUENTIAL */
+
+/*
+ * Long forward runs (pmlogsummary, pmlogextract, pmFetchArchive loops)
+ * get aggressive readahead.  Backward and interpolated reads move to and
+ * fro around one point, where the default read-around is better than
+ * either sequential or random advice.
+ */
+static void
+logadvise(__pmLogCtl *lcp, int mode)
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(MADV_SEQUENTIAL)
+    if (mode == PM_MODE_FORW) {
+	if (++lcp->l_mapseq == LOG_SEQRUN)
+	    madvise(lcp->l_mapaddr, lcp->l_mapsize, MADV_SEQUENTIAL);
+    }
+    else {
+	if (lcp->l_mapseq >= LOG_SEQRUN)
+	    madvise(lcp->l_mapaddr, lcp->l_mapsize, MADV_NORMAL);
+	lcp->l_mapseq = 0;
+    }
+#endif
+}
+
+/*
+ * __pmLogRead() for a mapped volume - the record is checked and copied
+ * straight from the mapping into a PDU buffer.  Returns LOG_STDIO if
+ * the current volume is not (or is no longer) mapped and the caller
+ * should continue with stdio.
+ */
+static int
+logreadmap(__pmLogCtl *lcp, int mode, pmResult **result, int option)
+{
+    __pmPDUHdr	*header;
+    __pmPDU	*pb;
+    off_t	offset;		/* signed, unlike __pm_off_t */
+    off_t	start;
+    int		head;
+    int		trail;
+    int		rlen;
+    int		vol;
+
+again:
+    offset = lcp->l_mapoff;
+#ifdef PCP_DEBUG
+    if (pmDebug & DBG_TRACE_LOG) {
+	fprintf(stderr, "__pmLogRead: fd=%d (mapped) mode=%s vol=%d posn=%ld ",
+	    fileno(lcp->l_mfp), mode == PM_MODE_FORW ? "forw" : "back",
+	    lcp->l_curvol, (long)offset);
+    }
+#endif
+
+    if (mode == PM_MODE_BACK) {
+	if (offset <= (off_t)(sizeof(__pmLogLabel) + 2 * sizeof(int))) {
+#ifdef PCP_DEBUG
+	    if (pmDebug & DBG_TRACE_LOG)
+		fprintf(stderr, "BEFORE start\n");
+#endif
+	    for (vol = lcp->l_curvol-1; vol >= lcp->l_minvol; vol--) {
+		if (__pmLogChangeVol(lcp, vol) >= 0) {
+		    __pmLogSeek(lcp, 0L, SEEK_END);
+		    if (lcp->l_mapaddr == NULL)
+			return LOG_STDIO;
+		    goto again;
+		}
+	    }
+	    return PM_ERR_EOL;
+	}
+	if (offset > (off_t)lcp->l_mapsize)
+	    return loggrown(lcp) ? LOG_STDIO : PM_ERR_LOGREC;
+	memcpy(&head, lcp->l_mapaddr + offset - sizeof(head), sizeof(head));
+	head = ntohl(head);
+	if (head < 2 * (int)sizeof(head) || head > offset) {
+	    /* damaged trailer, the record cannot start before the file */
+#ifdef PCP_DEBUG
+	    if (pmDebug & DBG_TRACE_LOG)
+		fprintf(stderr, "\nError: bad record length %d (offset %ld)\n",
+		    head, (long)offset);
+#endif
+	    return PM_ERR_LOGREC;
+	}
+	start = offset - head;
+    }
+    else {
+	if (offset + (off_t)sizeof(head) > (off_t)lcp->l_mapsize) {
+	    /* no more data ... End of Archive volume, or still growing */
+	    if (loggrown(lcp))
+		return LOG_STDIO;
+#ifdef PCP_DEBUG
+	    if (pmDebug & DBG_TRACE_LOG)
+		fprintf(stderr, "AFTER end\n");
+#endif
+	    for (vol = lcp->l_curvol+1; vol <= lcp->l_maxvol; vol++) {
+		if (__pmLogChangeVol(lcp, vol) >= 0) {
+		    if (lcp->l_mapaddr == NULL)
+			return LOG_STDIO;
+		    goto again;
+		}
+	    }
+	    return PM_ERR_EOL;
+	}
+	memcpy(&head, lcp->l_mapaddr + offset, sizeof(head));
+	head = ntohl(head);
+	start = offset;
+    }
+
+    rlen = head - 2 * (int)sizeof(head);
+    if (rlen < 0 || start < 0) {
+#ifdef PCP_DEBUG
+	if (pmDebug & DBG_TRACE_LOG)
+	    fprintf(stderr, "\nError: truncated log? rlen=%d (offset %d)\n",
+		rlen, (int)offset);
+#endif
+	return PM_ERR_LOGREC;
+    }
+    if (start + head > (off_t)lcp->l_mapsize) {
+	/* last record is incomplete, or still being written */
+	if (loggrown(lcp))
+	    return LOG_STDIO;
+#ifdef PCP_DEBUG
+	if (pmDebug & DBG_TRACE_LOG)
+	    fprintf(stderr, "\nError: record of %d bytes at %d beyond end\n",
+		head, (int)start);
+#endif
+	return PM_ERR_LOGREC;
+    }
+
+    /* the other copy of the length, header if reading backwards */
+    if (mode == PM_MODE_BACK)
+	memcpy(&trail, lcp->l_mapaddr + start, sizeof(trail));
+    else
+	memcpy(&trail, lcp->l_mapaddr + start + head - sizeof(trail), sizeof(trail));
+    trail = ntohl(trail);
+    if (trail != head) {
+#ifdef PCP_DEBUG
+	if (pmDebug & DBG_TRACE_LOG)
+	    fprintf(stderr, "\nError: record length mismatch: header (%d) != trailer (%d)\n", head, trail);
+#endif
+	return PM_ERR_LOGREC;
+    }
+
+    /* see __pmLogRead() for the layout, and the extra int at the end */
+    if ((pb = __pmFindPDUBuf(rlen + (int)sizeof(__pmPDUHdr) + (int)sizeof(int))) == NULL) {
+#ifdef PCP_DEBUG
+	if (pmDebug & DBG_TRACE_LOG) {
+	    char	errmsg[PM_MAXERRMSGLEN];
+	    fprintf(stderr, "\nError: __pmFindPDUBuf(%d) %s\n",
+		(int)(rlen + sizeof(__pmPDUHdr)),
+		osstrerror_r(errmsg, sizeof(errmsg)));
+	}
+#endif
+	return -oserror();
+    }
+    memcpy(&pb[3], lcp->l_mapaddr + start + sizeof(head), rlen);
+    header = (__pmPDUHdr *)pb;
+    header->len = sizeof(*header) + rlen;
+    header->type = PDU_RESULT;
+    header->from = FROM_ANON;
+
+    if (option == PMLOGREAD_TO_EOF && paranoidCheck(head, pb) == -1) {
+	__pmUnpinPDUBuf(pb);
+	return PM_ERR_LOGREC;
+    }
+
+    lcp->l_mapoff = (mode == PM_MODE_FORW) ? start + head : start;
+    logadvise(lcp, mode);
+
+    return logdecode(lcp, fileno(lcp->l_mfp), pb, head, result);
+}
+
 /*
  * read next forward or backward from the log
  *
@@ -1420,6 +1755,12 @@ __pmLogRead(__pmLogCtl *lcp, int mode, FILE *peekf, pmResult **result, int optio
      */
     mode &= __PM_MODE_MASK;
 
+    if (peekf == NULL && lcp->l_mapaddr != NULL) {
+	if ((sts = logreadmap(lcp, mode, result, option)) != LOG_STDIO)
+	    return sts;
+	/* this volume is not mapped (any more), carry on with stdio */
+    }
+
     if (peekf != NULL)
 	f = peekf;
     else
@@ -1658,50 +1999,7 @@ again:
     if (mode == PM_MODE_BACK)
 	fseek(f, -(long)sizeof(trail), SEEK_CUR);
 
-    __pmOverrideLastFd(fileno(f));
-    sts = __pmDecodeResult(pb, result); /* also swabs the result */
-
-#ifdef PCP_DEBUG
-    if (pmDebug & DBG_TRACE_LOG) {
-	head -= sizeof(head) + sizeof(trail);
-	if (sts >= 0) {
-	    __pmTimeval	tmp;
-	    fprintf(stderr, "@");
-	    __pmPrintStamp(stderr, &(*result)->timestamp);
-	    tmp.tv_sec = (__int32_t)(*result)->timestamp.tv_sec;
-	    tmp.tv_usec = (__int32_t)(*result)->timestamp.tv_usec;
-	    fprintf(stderr, " (t=%.6f)", __pmTimevalSub(&tmp, &lcp->l_label.ill_start));
-	}
-	else {
-	    char	errmsg[PM_MAXERRMSGLEN];
-	    fprintf(stderr, "__pmLogRead: __pmDecodeResult failed: %s\n", pmErrStr_r(sts, errmsg, sizeof(errmsg)));
-	    fprintf(stderr, "@unknown time");
-	}
-	fprintf(stderr, " len=header+%d+trailer\n", head);
-    }
-#endif
-
-    /* exported to indicate how efficient we are ... */
-    __pmLogReads++;
-
-    if (sts < 0) {
-	__pmUnpinPDUBuf(pb);
-	return PM_ERR_LOGREC;
-    }
-
-#ifdef PCP_DEBUG
-    if (pmDebug & DBG_TRACE_PDU) {
-	fprintf(stderr, "__pmLogRead timestamp=");
-	__pmPrintStamp(stderr, &(*result)->timestamp);
-	fprintf(stderr, " " PRINTF_P_PFX "%p ... " PRINTF_P_PFX "%p", &pb[3], &pb[head/sizeof(__pmPDU)+3]);
-	fputc('\n', stderr);
-	dumpbuf(rlen, &pb[3]);		/* see above to explain "3" */
-    }
-#endif
-
-    __pmUnpinPDUBuf(pb);
-
-    return 0;
+    return logdecode(lcp, fileno(f), pb, head, result);
 }
 
 static int
@@ -1753,7 +2051,7 @@ __pmLogFetch(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **result)
 
     /* re-establish position */
     __pmLogChangeVol(ctxp->c_archctl->ac_log, ctxp->c_archctl->ac_vol);
-    fseek(ctxp->c_archctl->ac_log->l_mfp, 
+    __pmLogSeek(ctxp->c_archctl->ac_log,
 	    (long)ctxp->c_archctl->ac_offset, SEEK_SET);
 
 more:
@@ -1997,7 +2295,7 @@ more:
     }
 
     /* remember your position in this context */
-    ctxp->c_archctl->ac_offset = ftell(ctxp->c_archctl->ac_log->l_mfp);
+    ctxp->c_archctl->ac_offset = __pmLogTell(ctxp->c_archctl->ac_log);
     assert(ctxp->c_archctl->ac_offset >= 0);
     ctxp->c_archctl->ac_vol = ctxp->c_archctl->ac_log->l_curvol;
 
@@ -2116,7 +2414,7 @@ __pmLogSetTime(__pmContext *ctxp)
 	    j = VolSkip(lcp, mode, j);
 	    if (j < 0)
 		return;
-	    fseek(lcp->l_mfp, (long)lcp->l_ti[j].ti_log, SEEK_SET);
+	    __pmLogSeek(lcp, (long)lcp->l_ti[j].ti_log, SEEK_SET);
 	    if (mode == PM_MODE_BACK)
 		ctxp->c_archctl->ac_serial = 0;
 #ifdef PCP_DEBUG
@@ -2130,7 +2428,7 @@ __pmLogSetTime(__pmContext *ctxp)
 	    j = VolSkip(lcp, PM_MODE_FORW, 0);
 	    if (j < 0)
 		return;
-	    fseek(lcp->l_mfp, (long)lcp->l_ti[j].ti_log, SEEK_SET);
+	    __pmLogSeek(lcp, (long)lcp->l_ti[j].ti_log, SEEK_SET);
 #ifdef PCP_DEBUG
 	    if (pmDebug & DBG_TRACE_LOG) {
 		fprintf(stderr, " before start ti@");
@@ -2142,7 +2440,7 @@ __pmLogSetTime(__pmContext *ctxp)
 	    j = VolSkip(lcp, PM_MODE_BACK, numti-1);
 	    if (j < 0)
 		return;
-	    fseek(lcp->l_mfp, (long)lcp->l_ti[j].ti_log, SEEK_SET);
+	    __pmLogSeek(lcp, (long)lcp->l_ti[j].ti_log, SEEK_SET);
 	    if (mode == PM_MODE_BACK)
 		ctxp->c_archctl->ac_serial = 0;
 #ifdef PCP_DEBUG
@@ -2166,7 +2464,7 @@ __pmLogSetTime(__pmContext *ctxp)
 		j = VolSkip(lcp, mode, j);
 		if (j < 0)
 		    return;
-		fseek(lcp->l_mfp, (long)lcp->l_ti[j].ti_log, SEEK_SET);
+		__pmLogSeek(lcp, (long)lcp->l_ti[j].ti_log, SEEK_SET);
 		if (mode == PM_MODE_FORW)
 		    ctxp->c_archctl->ac_serial = 0;
 #ifdef PCP_DEBUG
@@ -2180,7 +2478,7 @@ __pmLogSetTime(__pmContext *ctxp)
 		j = VolSkip(lcp, mode, j-1);
 		if (j < 0)
 		    return;
-		fseek(lcp->l_mfp, (long)lcp->l_ti[j].ti_log, SEEK_SET);
+		__pmLogSeek(lcp, (long)lcp->l_ti[j].ti_log, SEEK_SET);
 		if (mode == PM_MODE_BACK)
 		    ctxp->c_archctl->ac_serial = 0;
 #ifdef PCP_DEBUG
@@ -2213,11 +2511,11 @@ __pmLogSetTime(__pmContext *ctxp)
 	/* index either not available, or not useful */
 	if (mode == PM_MODE_FORW) {
 	    __pmLogChangeVol(lcp, lcp->l_minvol);
-	    fseek(lcp->l_mfp, (long)(sizeof(__pmLogLabel) + 2*sizeof(int)), SEEK_SET);
+	    __pmLogSeek(lcp, (long)(sizeof(__pmLogLabel) + 2*sizeof(int)), SEEK_SET);
 	}
 	else if (mode == PM_MODE_BACK) {
 	    __pmLogChangeVol(lcp, lcp->l_maxvol);
-	    fseek(lcp->l_mfp, (long)0, SEEK_END);
+	    __pmLogSeek(lcp, (long)0, SEEK_END);
 	}
 
 #ifdef PCP_DEBUG
@@ -2229,11 +2527,11 @@ __pmLogSetTime(__pmContext *ctxp)
 #ifdef PCP_DEBUG
     if (pmDebug & DBG_TRACE_LOG)
 	fprintf(stderr, " vol=%d posn=%ld serial=%d\n",
-	    lcp->l_curvol, (long)ftell(lcp->l_mfp), ctxp->c_archctl->ac_serial);
+	    lcp->l_curvol, __pmLogTell(lcp), ctxp->c_archctl->ac_serial);
 #endif
 
     /* remember your position in this context */
-    ctxp->c_archctl->ac_offset = ftell(lcp->l_mfp);
+    ctxp->c_archctl->ac_offset = __pmLogTell(lcp);
     assert(ctxp->c_archctl->ac_offset >= 0);
     ctxp->c_archctl->ac_vol = ctxp->c_archctl->ac_log->l_curvol;
 }
@@ -29,7 +29,6 @@ _pmi_put_result(pmi_context *current, pmResult *result)
     __pmLogCtl	*lcp = &current->logctl;
     int		k;
     int		i;
-    int		m;
     int		needti;
 
     /*
@@ -88,34 +87,36 @@ _pmi_put_result(pmi_context *current, pmResult *result)
 
     needti = 0;
     for (k = 0; k < result->numpmid; k++) {
-	for (m = 0; m < current->nmetric; m++) {
-	    if (result->vset[k]->pmid != current->metric[m].pmid)
-		continue;
-	    if (current->metric[m].meta_done == 0) {
-		char	**namelist = &current->metric[m].name;
-
-		if ((sts = __pmLogPutDesc(lcp, &current->metric[m].desc, 1, namelist)) < 0) {
-		    __pmUnpinPDUBuf(pb);
-		    return sts;
-		}
-		current->metric[m].meta_done = 1;
-		needti = 1;
+	__pmHashNode	*hp;
+	pmi_metric	*mp;
+
+	if ((hp = __pmHashSearch(result->vset[k]->pmid, &current->metric_hash)) == NULL)
+	    continue;
+	mp = &current->metric[(int)(__psint_t)hp->data];
+	if (mp->meta_done == 0) {
+	    char	**namelist = &mp->name;
+
+	    if ((sts = __pmLogPutDesc(lcp, &mp->desc, 1, namelist)) < 0) {
+		__pmUnpinPDUBuf(pb);
+		return sts;
 	    }
-	    if (current->metric[m].desc.indom != PM_INDOM_NULL) {
-		for (i = 0; i < current->nindom; i++) {
-		    if (current->metric[m].desc.indom == current->indom[i].indom) {
-			if (current->indom[i].meta_done == 0) {
-			    if ((sts = __pmLogPutInDom(lcp, current->indom[i].indom, &stamp, current->indom[i].ninstance, current->indom[i].inst, current->indom[i].name)) < 0) {
-				__pmUnpinPDUBuf(pb);
-				return sts;
-			    }
-			    current->indom[i].meta_done = 1;
-			    needti = 1;
+	    mp->meta_done = 1;
+	    needti = 1;
+	}
+	if (mp->desc.indom != PM_INDOM_NULL) {
+	    for (i = 0; i < current->nindom; i++) {
+		if (mp->desc.indom == current->indom[i].indom) {
+		    if (current->indom[i].meta_done == 0) {
+			if ((sts = __pmLogPutInDom(lcp, current->indom[i].indom, &stamp, current->indom[i].ninstance, current->indom[i].inst, current->indom[i].name)) < 0) {
+			    __pmUnpinPDUBuf(pb);
+			    return sts;
 			}
+			current->indom[i].meta_done = 1;
+			needti = 1;
 		    }
+		    break;
 		}
 	    }
-	    break;
 	}
     }
     if (needti) {
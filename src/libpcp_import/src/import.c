@@ -115,7 +115,7 @@ pmiDump(void)
 		current->handle[h].inst);
 	}
     }
-    if (current->result == NULL)
+    if (current->result == NULL || current->result->numpmid == 0)
 	fprintf(f, "  No pmResult.\n");
     else
 	__pmDumpResult(f, current->result);
@@ -209,6 +209,12 @@ pmiErrStr_r(int code, char *buf, int buflen)
     return buf;
 }
 
+static unsigned int
+handle_key(const pmi_handle *hp)
+{
+    return (unsigned int)hp->midx * 2654435761U ^ (unsigned int)hp->inst;
+}
+
 int
 pmiStart(const char *archive, int inherit)
 {
@@ -232,6 +238,11 @@ pmiStart(const char *archive, int inherit)
     current->hostname = NULL;
     current->timezone = NULL;
     current->result = NULL;
+    current->maxpmid = 0;
+    current->rmidx = NULL;
+    current->gen = 1;
+    __pmHashInit(&current->metric_hash);
+    __pmHashInit(&current->handle_hash);
     memset((void *)&current->logctl, 0, sizeof(current->logctl));
     if (inherit && old_current != NULL) {
 	current->nmetric = old_current->nmetric;
@@ -246,6 +257,12 @@ pmiStart(const char *archive, int inherit)
 		current->metric[m].pmid = old_current->metric[m].pmid;
 		current->metric[m].desc = old_current->metric[m].desc;
 		current->metric[m].meta_done = 0;
+		current->metric[m].vset = NULL;
+		current->metric[m].maxval = 0;
+		current->metric[m].vbuf = NULL;
+		current->metric[m].ridx = -1;
+		current->metric[m].mixed = 0;
+		__pmHashAdd(current->metric[m].pmid, (void *)(__psint_t)m, &current->metric_hash);
 	    }
 	}
 	else
@@ -304,6 +321,8 @@ pmiStart(const char *archive, int inherit)
 	    for (h = 0; h < current->nhandle; h++) {
 		current->handle[h].midx = old_current->handle[h].midx;
 		current->handle[h].inst = old_current->handle[h].inst;
+		current->handle[h].gen = old_current->handle[h].gen < 0 ? -1 : 0;
+		__pmHashAdd(handle_key(&current->handle[h]), (void *)(__psint_t)h, &current->handle_hash);
 	    }
 	}
 	else
@@ -478,6 +497,12 @@ pmiAddMetric(const char *name, pmID pmid, int type, pmInDom indom, int sem, pmUn
     mp->desc.sem = sem;
     mp->desc.units = units;
     mp->meta_done = 0;
+    mp->vset = NULL;
+    mp->maxval = 0;
+    mp->vbuf = NULL;
+    mp->ridx = -1;
+    mp->mixed = 0;
+    __pmHashAdd(mp->pmid, (void *)(__psint_t)(current->nmetric-1), &current->metric_hash);
 
     return current->last_sts = 0;
 }
@@ -637,6 +662,7 @@ pmiPutValue(const char *name, const char *instance, const char *value)
     sts = make_handle(name, instance, &tmp);
     if (sts != 0)
 	return current->last_sts = sts;
+    tmp.gen = -1;
 
     return current->last_sts = _pmi_stuff_value(current, &tmp, value);
 }
@@ -645,8 +671,11 @@ int
 pmiGetHandle(const char *name, const char *instance)
 {
     int		sts;
+    int		h;
+    unsigned int	key;
     pmi_handle	tmp;
     pmi_handle	*hp;
+    __pmHashNode	*node;
 
     if (current == NULL)
 	return PM_ERR_NOCONTEXT;
@@ -663,6 +692,22 @@ pmiGetHandle(const char *name, const char *instance)
     hp = &current->handle[current->nhandle-1];
     hp->midx = tmp.midx;
     hp->inst = tmp.inst;
+    hp->gen = 0;
+
+    key = handle_key(hp);
+    for (node = __pmHashSearch(key, &current->handle_hash); node != NULL; node = node->next) {
+	if (node->key != key)
+	    continue;
+	h = (int)(__psint_t)node->data;
+	if (current->handle[h].midx == hp->midx && current->handle[h].inst == hp->inst) {
+	    /*
+	     * another handle for the same metric-instance, so checking for
+	     * duplicate values has to search the values already stuffed
+	     */
+	    current->handle[h].gen = hp->gen = -1;
+	}
+    }
+    __pmHashAdd(key, (void *)(__psint_t)(current->nhandle-1), &current->handle_hash);
 
     return current->last_sts = current->nhandle;
 }
@@ -679,41 +724,149 @@ pmiPutValueHandle(int handle, const char *value)
 }
 
 int
-pmiWrite(int sec, int usec)
+pmiPutAtomValues(int count, const int *handles, const pmAtomValue *values)
 {
+    int		n;
     int		sts;
 
     if (current == NULL)
 	return PM_ERR_NOCONTEXT;
-    if (current->result == NULL)
-	return current->last_sts = PMI_ERR_NODATA;
 
-    if (sec < 0) {
-	__pmtimevalNow(&current->result->timestamp);
+    for (n = 0; n < count; n++) {
+	if (handles[n] <= 0 || handles[n] > current->nhandle)
+	    return current->last_sts = PMI_ERR_BADHANDLE;
+	sts = _pmi_stuff_atom(current, &current->handle[handles[n]-1], &values[n]);
+	if (sts < 0)
+	    return current->last_sts = sts;
+    }
+
+    return current->last_sts = 0;
+}
+
+/*
+ * Output the current record with timestamp *tp (or now, if tp is NULL),
+ * then empty the record ready for the next one.
+ */
+static int
+write_result(const struct timeval *tp)
+{
+    pmResult	*rp = current->result;
+    int		sts;
+
+    if (tp == NULL) {
+	__pmtimevalNow(&rp->timestamp);
     }
     else {
-	current->result->timestamp.tv_sec = sec;
-	current->result->timestamp.tv_usec = usec;
+	rp->timestamp = *tp;
     }
-    if (current->result->timestamp.tv_sec < current->last_stamp.tv_sec ||
-        (current->result->timestamp.tv_sec == current->last_stamp.tv_sec &&
-	 current->result->timestamp.tv_usec < current->last_stamp.tv_usec)) {
+    if (rp->timestamp.tv_sec < current->last_stamp.tv_sec ||
+        (rp->timestamp.tv_sec == current->last_stamp.tv_sec &&
+	 rp->timestamp.tv_usec < current->last_stamp.tv_usec)) {
 	fprintf(stderr, "Fatal Error: timestamp ");
-	printstamp(stderr, &current->result->timestamp);
+	printstamp(stderr, &rp->timestamp);
 	fprintf(stderr, " not greater than previous valid timestamp ");
 	printstamp(stderr, &current->last_stamp);
 	fputc('\n', stderr);
 	sts = PMI_ERR_BADTIMESTAMP;
     }
     else {
-	sts = _pmi_put_result(current, current->result);
-	current->last_stamp = current->result->timestamp;
+	sts = _pmi_put_result(current, rp);
+	current->last_stamp = rp->timestamp;
     }
 
-    pmFreeResult(current->result);
-    current->result = NULL;
+    _pmi_reset_result(current);
+
+    return sts;
+}
+
+int
+pmiWrite(int sec, int usec)
+{
+    struct timeval	stamp;
+
+    if (current == NULL)
+	return PM_ERR_NOCONTEXT;
+    if (current->result == NULL || current->result->numpmid == 0)
+	return current->last_sts = PMI_ERR_NODATA;
+
+    if (sec < 0)
+	return current->last_sts = write_result(NULL);
+    stamp.tv_sec = sec;
+    stamp.tv_usec = usec;
+    return current->last_sts = write_result(&stamp);
+}
+
+int
+pmiWriteColumns(int nrow, const struct timeval *stamps, int ncol, const int *handles, const void **columns)
+{
+    pmi_handle	*hp;
+    pmAtomValue	atom;
+    const struct timeval *prev;
+    int		r;
+    int		c;
+    int		sts;
+
+    if (current == NULL)
+	return PM_ERR_NOCONTEXT;
+    for (c = 0; c < ncol; c++) {
+	if (handles[c] <= 0 || handles[c] > current->nhandle)
+	    return current->last_sts = PMI_ERR_BADHANDLE;
+    }
+    if (ncol <= 0 && nrow > 0)
+	return current->last_sts = PMI_ERR_NODATA;
+
+    /*
+     * check the timestamps before anything is written, so the values
+     * already in the current record are not lost to a bad argument
+     */
+    for (prev = &current->last_stamp, r = 0; r < nrow; prev = &stamps[r++]) {
+	if (stamps[r].tv_sec < prev->tv_sec ||
+	    (stamps[r].tv_sec == prev->tv_sec &&
+	     stamps[r].tv_usec < prev->tv_usec))
+	    return current->last_sts = PMI_ERR_BADTIMESTAMP;
+    }
+
+    for (r = 0; r < nrow; r++) {
+	for (c = 0; c < ncol; c++) {
+	    hp = &current->handle[handles[c]-1];
+	    switch (current->metric[hp->midx].desc.type) {
+		case PM_TYPE_32:
+		    atom.l = ((const __int32_t *)columns[c])[r];
+		    break;
+		case PM_TYPE_U32:
+		    atom.ul = ((const __uint32_t *)columns[c])[r];
+		    break;
+		case PM_TYPE_64:
+		    atom.ll = ((const __int64_t *)columns[c])[r];
+		    break;
+		case PM_TYPE_U64:
+		    atom.ull = ((const __uint64_t *)columns[c])[r];
+		    break;
+		case PM_TYPE_FLOAT:
+		    atom.f = ((const float *)columns[c])[r];
+		    break;
+		case PM_TYPE_DOUBLE:
+		    atom.d = ((const double *)columns[c])[r];
+		    break;
+		case PM_TYPE_STRING:
+		    atom.cp = ((char * const *)columns[c])[r];
+		    if (atom.cp == NULL)
+			/* no value for this metric-instance in this row */
+			continue;
+		    break;
+	    }
+	    if ((sts = _pmi_stuff_atom(current, hp, &atom)) < 0) {
+		_pmi_reset_result(current);
+		return current->last_sts = sts;
+	    }
+	}
+	if (current->result == NULL || current->result->numpmid == 0)
+	    continue;
+	if ((sts = write_result(&stamps[r])) < 0)
+	    return current->last_sts = sts;
+    }
 
-    return current->last_sts = sts;
+    return current->last_sts = 0;
 }
 
 int
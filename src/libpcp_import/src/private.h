@@ -20,6 +20,11 @@ typedef struct {
     pmID	pmid;
     pmDesc	desc;
     int		meta_done;
+    pmValueSet	*vset;		// values in the current record, reused
+    int		maxval;		// vset has space for this many values
+    char	*vbuf;		// pmValueBlocks for vset (64-bit & float)
+    int		ridx;		// index into result->vset[], -1 if not there
+    int		mixed;		// value not from a handle in this record
 } pmi_metric;
 
 typedef struct {
@@ -35,6 +40,7 @@ typedef struct {
 typedef struct {
     int		midx;		// index into metric[]
     int		inst;		// internal instance identifier
+    int		gen;		// record last used in, -1 to always check
 } pmi_handle;
 
 typedef struct {
@@ -52,6 +58,11 @@ typedef struct {
     pmi_handle	*handle;
     int		last_sts;
     struct timeval	last_stamp;
+    int		maxpmid;	// result has space for this many vsets
+    int		*rmidx;		// metric[] index for each result->vset[]
+    int		gen;		// current record, see pmi_handle.gen
+    __pmHashCtl	metric_hash;	// pmid -> metric[] index
+    __pmHashCtl	handle_hash;	// metric-instance -> handle[] index
 } pmi_context;
 
 #define CONTEXT_START	1
@@ -65,6 +76,8 @@ typedef struct {
 #endif
 
 extern int _pmi_stuff_value(pmi_context *, pmi_handle *, const char *) _PMI_HIDDEN;
+extern int _pmi_stuff_atom(pmi_context *, pmi_handle *, const pmAtomValue *) _PMI_HIDDEN;
+extern void _pmi_reset_result(pmi_context *) _PMI_HIDDEN;
 extern int _pmi_put_result(pmi_context *, pmResult *) _PMI_HIDDEN;
 extern int _pmi_end(pmi_context *) _PMI_HIDDEN;
 
@@ -17,162 +17,289 @@
 #include "import.h"
 #include "private.h"
 
-int
-_pmi_stuff_value(pmi_context *current, pmi_handle *hp, const char *value)
+/*
+ * Values for the current record are accumulated in a pmValueSet owned
+ * by each metric, and these (along with the pmResult itself and the
+ * pmValueBlocks for 64-bit and floating point values) are reused from
+ * one record to the next, so there is no allocation per value once the
+ * buffers have grown to fit.
+ */
+#define BLOCK_SIZE	16	/* room for a pmValueBlock of any fixed size type */
+
+static int
+is_insitu(int type)
 {
-    pmResult	*rp;
-    int		i;
-    pmID	pmid;
-    pmValueSet	*vsp;
-    pmValue	*vp;
-    pmi_metric	*mp;
-    char	*end;
-    int		dsize;
-    void	*data;
-    __int64_t	ll;
-    __uint64_t	ull;
-    float	f;
-    double	d;
+    return type == PM_TYPE_32 || type == PM_TYPE_U32;
+}
 
-    mp = &current->metric[hp->midx];
+/*
+ * Find (or add) the pmValueSet for metric mp in the current record.
+ */
+static pmValueSet *
+get_vset(pmi_context *current, int midx)
+{
+    pmi_metric	*mp = &current->metric[midx];
+    pmResult	*rp = current->result;
+    size_t	size;
+
+    if (mp->ridx >= 0)
+	return mp->vset;
 
-    if (current->result == NULL) {
-	/* first time */
-	current->result = (pmResult *)malloc(sizeof(pmResult));
+    if (rp == NULL || rp->numpmid == current->maxpmid) {
+	current->maxpmid = current->maxpmid == 0 ? 4 : 2 * current->maxpmid;
+	size = sizeof(pmResult) + (current->maxpmid - 1) * sizeof(pmValueSet *);
+	current->result = (pmResult *)realloc(rp, size);
 	if (current->result == NULL) {
-	    __pmNoMem("_pmi_stuff_value: result malloc:", sizeof(pmResult), PM_FATAL_ERR);
-	}
-	current->result->numpmid = 0;
-	current->result->timestamp.tv_sec = 0;
-	current->result->timestamp.tv_usec = 0;
-    }
-    rp = current->result;
-
-    pmid = current->metric[hp->midx].pmid;
-    for (i = 0; i < rp->numpmid; i++) {
-	if (pmid == rp->vset[i]->pmid) {
-	    if (mp->desc.indom == PM_INDOM_NULL)
-		/* singular metric, cannot have more than one value */
-		return PMI_ERR_DUPVALUE;
-	    break;
+	    __pmNoMem("get_vset: result realloc:", size, PM_FATAL_ERR);
 	}
-    }
-    if (i == rp->numpmid) {
-	rp->numpmid++;
-	rp = current->result = (pmResult *)realloc(current->result, sizeof(pmResult) + (rp->numpmid - 1)*sizeof(pmValueSet *));
-	if (current->result == NULL) {
-	    __pmNoMem("_pmi_stuff_value: result realloc:", sizeof(pmResult) + (rp->numpmid - 1)*sizeof(pmValueSet *), PM_FATAL_ERR);
+	if (rp == NULL) {
+	    /* first time */
+	    current->result->numpmid = 0;
+	    current->result->timestamp.tv_sec = 0;
+	    current->result->timestamp.tv_usec = 0;
 	}
-	rp->vset[rp->numpmid-1] = (pmValueSet *)malloc(sizeof(pmValueSet));
-	if (rp->vset[rp->numpmid-1] == NULL) {
-	    __pmNoMem("_pmi_stuff_value: vset alloc:", sizeof(pmValueSet), PM_FATAL_ERR);
+	rp = current->result;
+	size = current->maxpmid * sizeof(int);
+	current->rmidx = (int *)realloc(current->rmidx, size);
+	if (current->rmidx == NULL) {
+	    __pmNoMem("get_vset: rmidx realloc:", size, PM_FATAL_ERR);
 	}
-	vsp = rp->vset[rp->numpmid-1];
-	vsp->pmid = pmid;
-	vsp->numval = 1;
     }
-    else {
-	int		j;
-	for (j = 0; j < rp->vset[i]->numval; j++) {
-	    if (rp->vset[i]->vlist[j].inst == hp->inst)
-		/* each metric-instance can appear at most once per pmResult */
-		return PMI_ERR_DUPVALUE;
+    if (mp->vset == NULL) {
+	mp->vset = (pmValueSet *)malloc(sizeof(pmValueSet));
+	if (mp->vset == NULL) {
+	    __pmNoMem("get_vset: vset alloc:", sizeof(pmValueSet), PM_FATAL_ERR);
 	}
-	rp->vset[i]->numval++;
-	vsp = rp->vset[i] = (pmValueSet *)realloc(rp->vset[i], sizeof(pmValueSet) + (rp->vset[i]->numval-1)*sizeof(pmValue));
-	if (rp->vset[i] == NULL) {
-	    __pmNoMem("_pmi_stuff_value: vset realloc:", sizeof(pmValueSet) + (rp->vset[i]->numval-1)*sizeof(pmValue), PM_FATAL_ERR);
+	mp->maxval = 1;
+    }
+    mp->vset->pmid = mp->pmid;
+    mp->vset->numval = 0;
+    mp->vset->valfmt = is_insitu(mp->desc.type) ? PM_VAL_INSITU : PM_VAL_DPTR;
+    mp->ridx = rp->numpmid;
+    current->rmidx[rp->numpmid] = midx;
+    rp->vset[rp->numpmid++] = mp->vset;
+    return mp->vset;
+}
+
+/*
+ * Make room for another value in the pmValueSet for metric mp.
+ */
+static void
+grow_vset(pmi_context *current, pmi_metric *mp)
+{
+    pmValueSet	*vsp;
+    size_t	size;
+    int		j;
+
+    mp->maxval *= 2;
+    size = sizeof(pmValueSet) + (mp->maxval - 1) * sizeof(pmValue);
+    vsp = (pmValueSet *)realloc(mp->vset, size);
+    if (vsp == NULL) {
+	__pmNoMem("grow_vset: vset realloc:", size, PM_FATAL_ERR);
+    }
+    mp->vset = current->result->vset[mp->ridx] = vsp;
+    if (!is_insitu(mp->desc.type) && mp->desc.type != PM_TYPE_STRING) {
+	size = mp->maxval * BLOCK_SIZE;
+	mp->vbuf = (char *)realloc(mp->vbuf, size);
+	if (mp->vbuf == NULL) {
+	    __pmNoMem("grow_vset: vbuf realloc:", size, PM_FATAL_ERR);
 	}
+	/* in case vbuf moves, need to redo pval pointers */
+	for (j = 0; j < vsp->numval; j++)
+	    vsp->vlist[j].value.pval = (pmValueBlock *)&mp->vbuf[j * BLOCK_SIZE];
+    }
+}
+
+static void
+free_values(pmi_metric *mp)
+{
+    int		j;
+
+    if (mp->desc.type == PM_TYPE_STRING) {
+	for (j = 0; j < mp->vset->numval; j++)
+	    free(mp->vset->vlist[j].value.pval);
+    }
+}
+
+/*
+ * Empty the current record, keeping the buffers for the next one.
+ */
+void
+_pmi_reset_result(pmi_context *current)
+{
+    pmi_metric	*mp;
+    int		k;
+
+    if (current->result == NULL)
+	return;
+    for (k = 0; k < current->result->numpmid; k++) {
+	mp = &current->metric[current->rmidx[k]];
+	free_values(mp);
+	mp->vset->numval = 0;
+	mp->ridx = -1;
+	mp->mixed = 0;
     }
-    vp = &vsp->vlist[vsp->numval-1];
+    current->result->numpmid = 0;
+    current->gen++;
+}
+
+/*
+ * Check that the metric-instance for handle hp does not yet have a value
+ * in the current record.  Handles remember the record they were last
+ * used in, falling back to a search of the values when this is not
+ * enough (values from pmiPutValue, or more than one handle for the same
+ * metric-instance).
+ */
+static int
+check_dup(pmi_context *current, pmi_handle *hp, pmi_metric *mp)
+{
+    pmValueSet	*vsp = mp->vset;
+    int		j;
+
+    if (vsp->numval < 0)
+	/* earlier conversion error for this metric */
+	return vsp->numval;
+    if (vsp->numval == 0)
+	return 0;
+    if (mp->desc.indom == PM_INDOM_NULL)
+	/* singular metric, cannot have more than one value */
+	return PMI_ERR_DUPVALUE;
+    if (hp->gen >= 0 && !mp->mixed)
+	return hp->gen == current->gen ? PMI_ERR_DUPVALUE : 0;
+    for (j = 0; j < vsp->numval; j++) {
+	if (vsp->vlist[j].inst == hp->inst)
+	    /* each metric-instance can appear at most once per pmResult */
+	    return PMI_ERR_DUPVALUE;
+    }
+    return 0;
+}
+
+int
+_pmi_stuff_atom(pmi_context *current, pmi_handle *hp, const pmAtomValue *atom)
+{
+    pmi_metric	*mp = &current->metric[hp->midx];
+    pmValueSet	*vsp;
+    pmValue	*vp;
+    int		sts;
+    int		need;
+    int		dsize;
+
+    vsp = get_vset(current, hp->midx);
+    if ((sts = check_dup(current, hp, mp)) < 0)
+	return sts;
+    if (hp->gen >= 0)
+	hp->gen = current->gen;
+    else
+	mp->mixed = 1;
+
+    if (vsp->numval == mp->maxval) {
+	grow_vset(current, mp);
+	vsp = mp->vset;
+    }
+    vp = &vsp->vlist[vsp->numval];
     vp->inst = hp->inst;
-    dsize = -1;
     switch (mp->desc.type) {
 	case PM_TYPE_32:
-	    if (vsp->numval == 1) vsp->valfmt = PM_VAL_INSITU;
-	    vp->value.lval = strtol(value, &end, 10);
-	    if (*end != '\0') {
-		vsp->numval = PM_ERR_CONV;
-		return PM_ERR_CONV;
-	    }
+	    vp->value.lval = atom->l;
 	    break;
 
 	case PM_TYPE_U32:
-	    if (vsp->numval == 1) vsp->valfmt = PM_VAL_INSITU;
-	    vp->value.lval = strtoul(value, &end, 10);
-	    if (*end != '\0') {
-		vsp->numval = PM_ERR_CONV;
-		return PM_ERR_CONV;
+	    vp->value.lval = atom->ul;
+	    break;
+
+	case PM_TYPE_STRING:
+	    /* logic copied from stuffvalue.c in libpcp */
+	    dsize = strlen(atom->cp) + 1;
+	    need = dsize + PM_VAL_HDR_SIZE;
+	    if (need < sizeof(pmValueBlock))
+		need = sizeof(pmValueBlock);
+	    vp->value.pval = (pmValueBlock *)malloc(need);
+	    if (vp->value.pval == NULL) {
+		__pmNoMem("_pmi_stuff_atom: pmValueBlock:", need, PM_FATAL_ERR);
 	    }
+	    vp->value.pval->vlen = dsize + PM_VAL_HDR_SIZE;
+	    vp->value.pval->vtype = PM_TYPE_STRING;
+	    memcpy((void *)vp->value.pval->vbuf, atom->cp, dsize);
 	    break;
 
-	case PM_TYPE_64:
-	    if (vsp->numval == 1) vsp->valfmt = PM_VAL_DPTR;
-	    ll = strtoll(value, &end, 10);
-	    if (*end != '\0') {
-		vsp->numval = PM_ERR_CONV;
-		return PM_ERR_CONV;
+	default:
+	    /* fixed size, use the next block in vbuf */
+	    if (mp->vbuf == NULL) {
+		mp->vbuf = (char *)malloc(mp->maxval * BLOCK_SIZE);
+		if (mp->vbuf == NULL) {
+		    __pmNoMem("_pmi_stuff_atom: vbuf:", mp->maxval * BLOCK_SIZE, PM_FATAL_ERR);
+		}
 	    }
-	    dsize = sizeof(ll);
-	    data = (void *)&ll;
+	    if (mp->desc.type == PM_TYPE_FLOAT)
+		dsize = sizeof(atom->f);
+	    else
+		dsize = sizeof(atom->ll);
+	    vp->value.pval = (pmValueBlock *)&mp->vbuf[vsp->numval * BLOCK_SIZE];
+	    vp->value.pval->vlen = dsize + PM_VAL_HDR_SIZE;
+	    vp->value.pval->vtype = mp->desc.type;
+	    memcpy((void *)vp->value.pval->vbuf, (void *)atom, dsize);
+	    break;
+    }
+    vsp->numval++;
+
+    return 0;
+}
+
+int
+_pmi_stuff_value(pmi_context *current, pmi_handle *hp, const char *value)
+{
+    pmi_metric	*mp;
+    pmValueSet	*vsp;
+    pmAtomValue	atom;
+    char	*end;
+    int		sts;
+
+    mp = &current->metric[hp->midx];
+
+    end = "";
+    switch (mp->desc.type) {
+	case PM_TYPE_32:
+	    atom.l = strtol(value, &end, 10);
+	    break;
+
+	case PM_TYPE_U32:
+	    atom.ul = strtoul(value, &end, 10);
+	    break;
+
+	case PM_TYPE_64:
+	    atom.ll = strtoll(value, &end, 10);
 	    break;
 
 	case PM_TYPE_U64:
-	    if (vsp->numval == 1) vsp->valfmt = PM_VAL_DPTR;
-	    ull = strtoull(value, &end, 10);
-	    if (*end != '\0') {
-		vsp->numval = PM_ERR_CONV;
-		return PM_ERR_CONV;
-	    }
-	    dsize = sizeof(ull);
-	    data = (void *)&ull;
+	    atom.ull = strtoull(value, &end, 10);
 	    break;
 
 	case PM_TYPE_FLOAT:
-	    if (vsp->numval == 1) vsp->valfmt = PM_VAL_DPTR;
-	    f = strtof(value, &end);
-	    if (*end != '\0') {
-		vsp->numval = PM_ERR_CONV;
-		return PM_ERR_CONV;
-	    }
-	    dsize = sizeof(f);
-	    data = (void *)&f;
+	    atom.f = strtof(value, &end);
 	    break;
 
 	case PM_TYPE_DOUBLE:
-	    if (vsp->numval == 1) vsp->valfmt = PM_VAL_DPTR;
-	    d = strtod(value, &end);
-	    if (*end != '\0') {
-		vsp->numval = PM_ERR_CONV;
-		return PM_ERR_CONV;
-	    }
-	    dsize = sizeof(d);
-	    data = (void *)&d;
+	    atom.d = strtod(value, &end);
 	    break;
 
 	case PM_TYPE_STRING:
-	    if (vsp->numval == 1) vsp->valfmt = PM_VAL_DPTR;
-	    dsize = strlen(value)+1;
-	    data = (void *)value;
+	    atom.cp = (char *)value;
 	    break;
 
 	default:
+	    vsp = get_vset(current, hp->midx);
+	    free_values(mp);
 	    vsp->numval = PM_ERR_TYPE;
 	    return PM_ERR_TYPE;
     }
-
-    if (dsize != -1) {
-	/* logic copied from stuffvalue.c in libpcp */
-	int	need = dsize + PM_VAL_HDR_SIZE;
-
-	vp->value.pval = (pmValueBlock *)malloc(need < sizeof(pmValueBlock) ? sizeof(pmValueBlock) : need);
-	if (vp->value.pval == NULL) {
-	    __pmNoMem("_pmi_stuff_value: pmValueBlock:", need < sizeof(pmValueBlock) ? sizeof(pmValueBlock) : need, PM_FATAL_ERR);
-	}
-	vp->value.pval->vlen = (int)need;
-	vp->value.pval->vtype = mp->desc.type;
-	memcpy((void *)vp->value.pval->vbuf, data, dsize);
+    if (*end != '\0') {
+	vsp = get_vset(current, hp->midx);
+	if ((sts = check_dup(current, hp, mp)) < 0)
+	    return sts;
+	free_values(mp);
+	vsp->numval = PM_ERR_CONV;
+	return PM_ERR_CONV;
     }
 
-    return 0;
+    return _pmi_stuff_atom(current, hp, &atom);
 }
@@ -20,6 +20,113 @@
 #include "mmv_dev.h"
 #include "impl.h"
 
+/*
+ * Integer values are updated with atomic fetch-and-add, so concurrent
+ * updates from several threads are not lost.
+ */
+#if defined(__GNUC__)
+#define mmv_add32(p, n)		__sync_fetch_and_add((p), (n))
+#define mmv_add64(p, n)		__sync_fetch_and_add((p), (n))
+#define mmv_cas64(p, o, n)	__sync_val_compare_and_swap((p), (o), (n))
+#else
+#ifdef PM_MULTI_THREAD
+static pthread_mutex_t	mmv_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static __uint32_t
+mmv_add32(__uint32_t *p, __uint32_t n)
+{
+    __uint32_t old;
+
+#ifdef PM_MULTI_THREAD
+    pthread_mutex_lock(&mmv_lock);
+#endif
+    old = *p;
+    *p = old + n;
+#ifdef PM_MULTI_THREAD
+    pthread_mutex_unlock(&mmv_lock);
+#endif
+    return old;
+}
+
+static __uint64_t
+mmv_add64(__uint64_t *p, __uint64_t n)
+{
+    __uint64_t old;
+
+#ifdef PM_MULTI_THREAD
+    pthread_mutex_lock(&mmv_lock);
+#endif
+    old = *p;
+    *p = old + n;
+#ifdef PM_MULTI_THREAD
+    pthread_mutex_unlock(&mmv_lock);
+#endif
+    return old;
+}
+
+static __uint64_t
+mmv_cas64(__uint64_t *p, __uint64_t o, __uint64_t n)
+{
+    __uint64_t old;
+
+#ifdef PM_MULTI_THREAD
+    pthread_mutex_lock(&mmv_lock);
+#endif
+    if ((old = *p) == o)
+	*p = n;
+#ifdef PM_MULTI_THREAD
+    pthread_mutex_unlock(&mmv_lock);
+#endif
+    return old;
+}
+#endif
+
+/*
+ * Each thread updates its own shard of a sharded value - threads are
+ * given shards round robin, on first use.
+ */
+#ifdef HAVE___THREAD
+static __thread int	mmv_shard = -1;
+static __uint32_t	mmv_nextshard;
+#endif
+
+static __uint32_t
+mmv_thread_shard(void)
+{
+#ifdef HAVE___THREAD
+    if (mmv_shard < 0)
+	mmv_shard = mmv_add32(&mmv_nextshard, 1) & 0x7fffffff;
+    return mmv_shard;
+#else
+    int		here;	/* thread stacks are distinct, hash this address */
+
+    return ((__uint32_t)((__psint_t)&here >> 12) * 2654435761U) >> 16;
+#endif
+}
+
+static int
+mmv_shard_count(void)
+{
+    int		nshards = 1;
+#ifdef _SC_NPROCESSORS_CONF
+    long	ncpus = sysconf(_SC_NPROCESSORS_CONF);
+
+    while (nshards < ncpus && nshards < MMV_SHARDMAX)
+	nshards <<= 1;
+#endif
+    return nshards;
+}
+
+static int
+mmv_sharded(mmv_stats_flags_t fl, const mmv_metric_t *mp)
+{
+    if (!(fl & MMV_FLAG_SHARDED) || mp->semantics != MMV_SEM_COUNTER)
+	return 0;
+    return (mp->type == MMV_TYPE_I32 || mp->type == MMV_TYPE_U32 ||
+	    mp->type == MMV_TYPE_I64 || mp->type == MMV_TYPE_U64);
+}
+
 static void
 mmv_stats_path(const char *fname, char *fullpath, size_t pathlen)
 {
@@ -84,6 +191,36 @@ mmv_lookup_indom(__int32_t indom, const mmv_indom_t *in, int nindoms)
     return NULL;
 }
 
+/*
+ * FNV-1a hash over the metric name, then a marker separating singular
+ * values from per-instance values, then the instance name (if any).
+ */
+static __uint32_t
+mmv_hash(const char *metric, const char *inst)
+{
+    const unsigned char *p;
+    __uint32_t h = 2166136261U;
+
+    for (p = (const unsigned char *)metric; *p; p++)
+	h = (h ^ *p) * 16777619U;
+    h = (h ^ (inst != NULL)) * 16777619U;
+    if (inst != NULL)
+	for (p = (const unsigned char *)inst; *p; p++)
+	    h = (h ^ *p) * 16777619U;
+    return h;
+}
+
+static __uint32_t
+mmv_hash_buckets(int nvalues)
+{
+    __uint32_t nbuckets = 8;
+
+    /* keep the table at most half full, so probe sequences stay short */
+    while (nbuckets < 2 * (__uint32_t)nvalues)
+	nbuckets <<= 1;
+    return nbuckets;
+}
+
 static __uint64_t
 mmv_generation(void)
 {
@@ -114,9 +251,16 @@ mmv_stats_init(const char *fname,
     __uint64_t metrics_offset;		/* anchor start of metrics section */
     __uint64_t values_offset;		/* anchor start of values section */
     __uint64_t strings_offset;		/* anchor start of any/all strings */
+    __uint64_t hash_offset;		/* anchor start of value hash table */
+    __uint64_t shards_offset;		/* anchor start of value shards */
+    __uint64_t histograms_offset;	/* anchor start of histograms */
+    __uint32_t nbuckets = 0;
+    int nshards = 0;
+    int nsharded = 0;
+    int nhistograms = 0;
     void *addr;
     size_t size;
-    int i, j, k, tocidx, stridx;
+    int i, j, k, tocidx, stridx, shardidx, histidx;
     int ninstances = 0;
     int nstrings = 0;
     int nvalues = 0;
@@ -135,7 +279,12 @@ mmv_stats_init(const char *fname,
 
     for (i = 0; i < nmetrics; i++) {
 	if ((st[i].type < MMV_TYPE_NOSUPPORT) || 
-	    (st[i].type > MMV_TYPE_ELAPSED) || strlen(st[i].name) == 0) {
+	    (st[i].type > MMV_TYPE_HISTOGRAM) || strlen(st[i].name) == 0) {
+	    setoserror(EINVAL);
+	    return NULL;
+	}
+	/* histogram buckets are the instances, so these are singular */
+	if (st[i].type == MMV_TYPE_HISTOGRAM && !mmv_singular(st[i].indom)) {
 	    setoserror(EINVAL);
 	    return NULL;
 	}
@@ -154,13 +303,21 @@ mmv_stats_init(const char *fname,
 	    }
 	    if (st[i].type == MMV_TYPE_STRING)
 		nstrings += mi->count;
+	    if (mmv_sharded(fl, &st[i]))
+		nsharded += mi->count;
 	    nvalues += mi->count;
 	} else {
 	    if (st[i].type == MMV_TYPE_STRING)
 		nstrings++;
+	    if (mmv_sharded(fl, &st[i]))
+		nsharded++;
+	    if (st[i].type == MMV_TYPE_HISTOGRAM)
+		nhistograms++;
 	    nvalues++;
 	}
     }
+    if (nsharded)
+	nshards = mmv_shard_count();
 
     /* TOC follows header, with enough entries to hold */
     /* indoms, instances, metrics, values, and strings */
@@ -169,6 +326,14 @@ mmv_stats_init(const char *fname,
 	size += sizeof(mmv_disk_toc_t) * 2;
     if (nstrings)
 	size += sizeof(mmv_disk_toc_t) * 1;
+    if (nvalues) {
+	nbuckets = mmv_hash_buckets(nvalues);
+	size += sizeof(mmv_disk_toc_t) * 1;
+    }
+    if (nshards)
+	size += sizeof(mmv_disk_toc_t) * 1;
+    if (nhistograms)
+	size += sizeof(mmv_disk_toc_t) * 1;
     indoms_offset = sizeof(mmv_disk_header_t) + size;
 
     /* Following the indom definitions are the actual instances */
@@ -188,8 +353,20 @@ mmv_stats_init(const char *fname,
     size = nvalues * sizeof(mmv_disk_value_t);
     strings_offset = values_offset + size;
 
-    /* End of file follows all of the actual strings */
-    size = strings_offset + nstrings * sizeof(mmv_disk_string_t);
+    /* Following the strings is the hash table over the values */
+    size = nstrings * sizeof(mmv_disk_string_t);
+    hash_offset = strings_offset + size;
+
+    /* Following the hash table are the value shards, cache aligned */
+    size = hash_offset + nbuckets * sizeof(mmv_disk_hash_t);
+    shards_offset = (size + MMV_CACHELINE - 1) & ~(MMV_CACHELINE - 1);
+
+    /* Following the shards are the histograms, also cache aligned */
+    histograms_offset = shards_offset +
+			nsharded * nshards * sizeof(mmv_disk_shard_t);
+
+    /* End of file follows the histograms */
+    size = histograms_offset + nhistograms * sizeof(mmv_disk_histogram_t);
 
     if ((addr = mmv_mapping_init(fname, size)) == NULL)
 	return NULL;
@@ -207,7 +384,7 @@ mmv_stats_init(const char *fname,
 
     hdr = (mmv_disk_header_t *) addr;
     strncpy(hdr->magic, "MMV", 4);
-    hdr->version = MMV_VERSION;
+    hdr->version = (nshards || nhistograms) ? MMV_VERSION : MMV_VERSION2;
     hdr->g1 = mmv_generation();
     hdr->g2 = 0;
     hdr->tocs = 2;
@@ -215,6 +392,12 @@ mmv_stats_init(const char *fname,
 	hdr->tocs += 2;
     if (nstrings)
 	hdr->tocs += 1;
+    if (nbuckets)
+	hdr->tocs += 1;
+    if (nshards)
+	hdr->tocs += 1;
+    if (nhistograms)
+	hdr->tocs += 1;
     hdr->flags = fl;
     hdr->cluster = cluster;
     hdr->process = (__int32_t)getpid();
@@ -246,6 +429,24 @@ mmv_stats_init(const char *fname,
 	toc[tocidx].offset = strings_offset;
 	tocidx++;
     }
+    if (nbuckets) {
+	toc[tocidx].type = MMV_TOC_HASH;
+	toc[tocidx].count = nbuckets;
+	toc[tocidx].offset = hash_offset;
+	tocidx++;
+    }
+    if (nshards) {
+	toc[tocidx].type = MMV_TOC_SHARDS;
+	toc[tocidx].count = nshards;
+	toc[tocidx].offset = shards_offset;
+	tocidx++;
+    }
+    if (nhistograms) {
+	toc[tocidx].type = MMV_TOC_HISTOGRAMS;
+	toc[tocidx].count = nhistograms;
+	toc[tocidx].offset = histograms_offset;
+	tocidx++;
+    }
 
     /* Indom section */
     domlist = (mmv_disk_indom_t *)((char *)addr + indoms_offset);
@@ -287,14 +488,21 @@ mmv_stats_init(const char *fname,
 	mlist[i].padding = 0;
     }
 
-    /* Values section */
+    /* Values section, and the shards or histograms of those values */
     vlist = (mmv_disk_value_t *)((char *)addr + values_offset);
-    for (i = j = 0; i < nmetrics; i++) {
+    for (i = j = shardidx = histidx = 0; i < nmetrics; i++) {
 	__uint64_t off = metrics_offset + i * sizeof(mmv_disk_metric_t);
+	int sharded = mmv_sharded(fl, &st[i]);
 
 	if (mmv_singular(st[i].indom)) {
 	    memset(&vlist[j], 0, sizeof(mmv_disk_value_t));
 	    vlist[j].metric = off;
+	    if (sharded)
+		vlist[j].extra = shards_offset +
+			(shardidx++ * nshards * sizeof(mmv_disk_shard_t));
+	    else if (st[i].type == MMV_TYPE_HISTOGRAM)
+		vlist[j].extra = histograms_offset +
+			(histidx++ * sizeof(mmv_disk_histogram_t));
 	    j++;
 	} else {
 	    __uint64_t ioff;
@@ -306,6 +514,9 @@ mmv_stats_init(const char *fname,
 		memset(&vlist[j], 0, sizeof(mmv_disk_value_t));
 		vlist[j].metric = off;
 		vlist[j].instance = ioff;
+		if (sharded)
+		    vlist[j].extra = shards_offset +
+			(shardidx++ * nshards * sizeof(mmv_disk_shard_t));
 		j++;
 	    }
 	}
@@ -360,6 +571,26 @@ mmv_stats_init(const char *fname,
 	}
     }
 
+    /* Hash section - the file is zero filled, so all buckets are empty */
+    if (nbuckets) {
+	mmv_disk_hash_t *hlist = (mmv_disk_hash_t *)((char *)addr + hash_offset);
+	__uint32_t h, b, mask = nbuckets - 1;
+
+	for (i = 0; i < nvalues; i++) {
+	    mmv_disk_metric_t *m = (mmv_disk_metric_t *)
+				((char *)addr + vlist[i].metric);
+	    mmv_disk_instance_t *ip = NULL;
+
+	    if (!mmv_singular(m->indom))
+		ip = (mmv_disk_instance_t *)((char *)addr + vlist[i].instance);
+	    h = mmv_hash(m->name, ip ? ip->external : NULL);
+	    for (b = h & mask; hlist[b].value != 0; b = (b + 1) & mask)
+		;
+	    hlist[b].hash = h;
+	    hlist[b].value = i + 1;
+	}
+    }
+
     /* Complete - unlock the header, PMDA can read now */
     hdr->g2 = hdr->g1;
 
@@ -381,42 +612,88 @@ mmv_stats_stop(const char *fname, void *addr)
     __pmMemoryUnmap(addr, sbuf.st_size);
 }
 
+static mmv_disk_value_t *
+mmv_hash_lookup(void *addr, const mmv_disk_toc_t *hash,
+		const mmv_disk_toc_t *values, const char *metric, const char *inst)
+{
+    mmv_disk_hash_t *hlist = (mmv_disk_hash_t *)((char *)addr + hash->offset);
+    mmv_disk_value_t *vlist = (mmv_disk_value_t *)((char *)addr + values->offset);
+    __uint32_t h = mmv_hash(metric, inst);
+    __uint32_t b, mask = hash->count - 1;
+
+    for (b = h & mask; hlist[b].value != 0; b = (b + 1) & mask) {
+	mmv_disk_value_t *v;
+	mmv_disk_metric_t *m;
+	mmv_disk_instance_t *in;
+
+	if (hlist[b].hash != h || hlist[b].value > values->count)
+	    continue;
+	v = &vlist[hlist[b].value - 1];
+	m = (mmv_disk_metric_t *)((char *)addr + v->metric);
+	if (strcmp(m->name, metric) != 0)
+	    continue;
+	if (mmv_singular(m->indom)) {
+	    if (inst == NULL)
+		return v;
+	} else if (inst != NULL) {
+	    in = (mmv_disk_instance_t *)((char *)addr + v->instance);
+	    if (strcmp(in->external, inst) == 0)
+		return v;
+	}
+    }
+    return NULL;
+}
+
 pmAtomValue *
 mmv_lookup_value_desc(void *addr, const char *metric, const char *inst)
 {
     if (addr != NULL && metric != NULL) {
-	int i;
+	int i, j;
 	mmv_disk_header_t *hdr = (mmv_disk_header_t *)addr;
 	mmv_disk_toc_t *toc = (mmv_disk_toc_t *)
 			((char *)addr + sizeof(mmv_disk_header_t));
+	mmv_disk_toc_t *hash = NULL, *values = NULL;
+	mmv_disk_value_t *v;
 
 	for (i = 0; i < hdr->tocs; i++) {
-	    if (toc[i].type == MMV_TOC_VALUES) {
-		int j;
-		mmv_disk_value_t *v = (mmv_disk_value_t *)
-				((char *)addr + toc[i].offset);
-
-		for (j = 0; j < toc[i].count; j++) {
-		    mmv_disk_metric_t *m = (mmv_disk_metric_t *)
-					((char *)addr + v[j].metric);
-		    if (strcmp(m->name, metric) == 0) {
-			if (mmv_singular(m->indom)) {  /* Singular metric */
+	    if (toc[i].type == MMV_TOC_VALUES)
+		values = &toc[i];
+	    else if (toc[i].type == MMV_TOC_HASH)
+		hash = &toc[i];
+	}
+	if (values == NULL)
+	    return NULL;
+
+	if (hash != NULL && hash->count > 0) {
+	    /* singular metrics ignore any instance name, as below */
+	    if (inst != NULL &&
+		(v = mmv_hash_lookup(addr, hash, values, metric, inst)) != NULL)
+		return &v->value;
+	    if ((v = mmv_hash_lookup(addr, hash, values, metric, NULL)) != NULL)
+		return &v->value;
+	    return NULL;
+	}
+
+	v = (mmv_disk_value_t *)((char *)addr + values->offset);
+	for (j = 0; j < values->count; j++) {
+	    mmv_disk_metric_t *m = (mmv_disk_metric_t *)
+				((char *)addr + v[j].metric);
+	    if (strcmp(m->name, metric) == 0) {
+		if (mmv_singular(m->indom)) {  /* Singular metric */
+		    return &v[j].value;
+		} else {
+		    if (inst == NULL) {
+			/* Metric has multiple instances, but
+			 * we don't know which one to return,
+			 * so return an error
+			 */
+			return NULL;
+		    } else {
+			mmv_disk_instance_t * in = 
+			    (mmv_disk_instance_t *)
+				((char *)addr + v[j].instance);
+			if (strcmp(in->external, inst) == 0)
 			    return &v[j].value;
- 			} else {
-			    if (inst == NULL) {
-				/* Metric has multiple instances, but
-				 * we don't know which one to return,
-				 * so return an error
-				 */
-				return NULL;
-			    } else {
-				mmv_disk_instance_t * in = 
-				    (mmv_disk_instance_t *)
-					((char *)addr + v[j].instance);
-				if (strcmp(in->external, inst) == 0)
-				    return &v[j].value;
-			    }
-			}
 		    }
 		}
 	    }
@@ -426,6 +703,69 @@ mmv_lookup_value_desc(void *addr, const char *metric, const char *inst)
     return NULL;
 }
 
+/*
+ * The part of an integer value to be updated by this thread - the value
+ * itself, or one of its shards.
+ */
+static pmAtomValue *
+mmv_value_slot(void *addr, mmv_disk_value_t *v)
+{
+    mmv_disk_header_t *hdr = (mmv_disk_header_t *)addr;
+    mmv_disk_toc_t *toc = (mmv_disk_toc_t *)
+			((char *)addr + sizeof(mmv_disk_header_t));
+    mmv_disk_shard_t *shard;
+    int i;
+
+    if (v->extra == 0)
+	return &v->value;
+    for (i = 0; i < hdr->tocs; i++) {
+	if (toc[i].type == MMV_TOC_SHARDS && toc[i].count > 0) {
+	    shard = (mmv_disk_shard_t *)((char *)addr + v->extra);
+	    return &shard[mmv_thread_shard() & (toc[i].count - 1)].value;
+	}
+    }
+    return &v->value;
+}
+
+static int
+mmv_inc_integer(void *addr, mmv_disk_value_t *v, __uint64_t inc)
+{
+    mmv_disk_metric_t * m = (mmv_disk_metric_t *)
+				((char *)addr + v->metric);
+
+    switch (m->type) {
+    case MMV_TYPE_I32:
+    case MMV_TYPE_U32:
+	mmv_add32(&mmv_value_slot(addr, v)->ul, (__uint32_t)inc);
+	return 1;
+    case MMV_TYPE_I64:
+    case MMV_TYPE_U64:
+	mmv_add64(&mmv_value_slot(addr, v)->ull, inc);
+	return 1;
+    default:
+	break;
+    }
+    return 0;
+}
+
+void
+mmv_inc_int(void *addr, pmAtomValue *av, __int64_t inc)
+{
+    if (av != NULL && addr != NULL) {
+	if (!mmv_inc_integer(addr, (mmv_disk_value_t *)av, (__uint64_t)inc))
+	    mmv_inc_value(addr, av, (double)inc);
+    }
+}
+
+void
+mmv_inc_uint(void *addr, pmAtomValue *av, __uint64_t inc)
+{
+    if (av != NULL && addr != NULL) {
+	if (!mmv_inc_integer(addr, (mmv_disk_value_t *)av, inc))
+	    mmv_inc_value(addr, av, (double)inc);
+    }
+}
+
 void
 mmv_inc_value(void *addr, pmAtomValue *av, double inc)
 {
@@ -435,16 +775,18 @@ mmv_inc_value(void *addr, pmAtomValue *av, double inc)
 					((char *)addr + v->metric);
 	switch (m->type) {
 	case MMV_TYPE_I32:
-	    v->value.l += (__int32_t)inc;
+	    mmv_add32(&mmv_value_slot(addr, v)->ul,
+			(__uint32_t)(__int32_t)inc);
 	    break;
 	case MMV_TYPE_U32:
-	    v->value.ul += (__uint32_t)inc;
+	    mmv_add32(&mmv_value_slot(addr, v)->ul, (__uint32_t)inc);
 	    break;
 	case MMV_TYPE_I64:
-	    v->value.ll += (__int64_t)inc;
+	    mmv_add64(&mmv_value_slot(addr, v)->ull,
+			(__uint64_t)(__int64_t)inc);
 	    break;
 	case MMV_TYPE_U64:
-	    v->value.ull += (__uint64_t)inc;
+	    mmv_add64(&mmv_value_slot(addr, v)->ull, (__uint64_t)inc);
 	    break;
 	case MMV_TYPE_FLOAT:
 	    v->value.f += (float)inc;
@@ -466,6 +808,26 @@ mmv_inc_value(void *addr, pmAtomValue *av, double inc)
     }
 }
 
+/*
+ * Setting a sharded value clears its shards - updates made by other
+ * threads at the same time may be lost.
+ */
+static void
+mmv_clear_shards(void *addr, mmv_disk_value_t *v)
+{
+    mmv_disk_header_t *hdr = (mmv_disk_header_t *)addr;
+    mmv_disk_toc_t *toc = (mmv_disk_toc_t *)
+			((char *)addr + sizeof(mmv_disk_header_t));
+    int i;
+
+    if (v->extra == 0)
+	return;
+    for (i = 0; i < hdr->tocs; i++)
+	if (toc[i].type == MMV_TOC_SHARDS)
+	    memset((char *)addr + v->extra, 0,
+			toc[i].count * sizeof(mmv_disk_shard_t));
+}
+
 void
 mmv_set_value(void *addr, pmAtomValue *av, double val)
 {
@@ -474,6 +836,16 @@ mmv_set_value(void *addr, pmAtomValue *av, double val)
 	mmv_disk_metric_t * m = (mmv_disk_metric_t *)
 					((char *)addr + v->metric);
 	switch (m->type) {
+	case MMV_TYPE_I32:
+	case MMV_TYPE_U32:
+	case MMV_TYPE_I64:
+	case MMV_TYPE_U64:
+	    mmv_clear_shards(addr, v);
+	    break;
+	default:
+	    break;
+	}
+	switch (m->type) {
 	case MMV_TYPE_I32:
 	    v->value.l = (__int32_t)val;
 	    break;
@@ -502,6 +874,30 @@ mmv_set_value(void *addr, pmAtomValue *av, double val)
     }
 }
 
+/*
+ * Lock-free: one atomic add to the bucket, and a compare-and-swap loop
+ * for the maximum which only spins while the maximum is being raised.
+ */
+void
+mmv_histogram_record(void *addr, pmAtomValue *av, __uint64_t value)
+{
+    if (av != NULL && addr != NULL) {
+	mmv_disk_value_t * v = (mmv_disk_value_t *) av;
+	mmv_disk_metric_t * m = (mmv_disk_metric_t *)
+					((char *)addr + v->metric);
+	mmv_disk_histogram_t * h;
+	__uint64_t max;
+
+	if (m->type != MMV_TYPE_HISTOGRAM || v->extra == 0)
+	    return;
+	h = (mmv_disk_histogram_t *)((char *)addr + v->extra);
+	mmv_add64(&h->buckets[mmv_histogram_bucket(value)], 1);
+	for (max = h->max; value > max; max = h->max)
+	    if (mmv_cas64(&h->max, max, value) == max)
+		break;
+    }
+}
+
 void
 mmv_set_string(void *addr, pmAtomValue *av, const char *string, int size)
 {
@@ -626,3 +1022,13 @@ mmv_stats_set_strlen(void *addr, const char *metric,
 	mmv_set_string(addr, mmv_metric, string, len);
     }
 }
+
+void
+mmv_stats_record(void *addr, const char *metric, __uint64_t value)
+{
+    if (addr) {
+	pmAtomValue *mmv_metric;
+	mmv_metric = mmv_lookup_value_desc(addr, metric, NULL);
+	mmv_histogram_record(addr, mmv_metric, value);
+    }
+}
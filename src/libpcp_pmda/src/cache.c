@@ -59,14 +59,65 @@ typedef struct hdr {
     int			ins_mode;	/* see insert_cache() */
     int			hstate;		/* dirty/clean/string state */
     int			keyhash_cnt[MAX_HASH_TRY];
+    int			jfd;		/* journal, -1 if not attached */
+    int			jmode;		/* ins_mode last journalled */
+    off_t		jbytes;		/* size of journal file */
+    off_t		snapbytes;	/* size of last snapshot */
+    __uint32_t		snapgen;	/* generation of last snapshot */
+    char		*jbuf;		/* records pending for next save */
+    int			jlen;		/* bytes used in jbuf[] */
+    int			jsize;		/* bytes allocated for jbuf[] */
+    int			*actlist;	/* active insts, in inst order */
+    int			nactive;	/* number of insts in actlist[] */
+    int			maxactive;	/* size of actlist[] */
+    int			actvalid;	/* actlist[] is up to date */
 } hdr_t;
 
 /* bitfields for hstate */
 #define DIRTY_INSTANCE	0x1
 #define DIRTY_STAMP	0x2
 #define CACHE_STRINGS	0x4
+#define CACHE_JOURNAL	0x8
+
+/*
+ * Journal of changes since the last snapshot (the external file),
+ * kept in <indom>.journal ... a header, then a sequence of records
+ * each protected by a length and a checksum so a torn tail left by
+ * a crash is detected and discarded on replay.
+ * The journal only applies to the snapshot it follows ... compaction
+ * writes a new generation number on the first line of the snapshot
+ * and in the journal header, so an old journal that survives a crash
+ * between the rename of the new snapshot and the journal reset is not
+ * replayed (its culls could remove entries the snapshot re-added).
+ */
+typedef struct {
+    __uint32_t	magic;
+    __uint32_t	version;
+    __uint32_t	gen;		/* snapshot generation */
+} jhdr_t;
+
+typedef struct {
+    __uint32_t	len;		/* bytes, including this header */
+    __uint32_t	sum;		/* hash() of the rest of the record */
+    __int32_t	type;		/* JOURNAL_ADD, ... */
+    __int32_t	inst;		/* or ins_mode, or number of stamps */
+    __int32_t	stamp;
+    __int32_t	keylen;		/* bytes of key[] in the payload */
+    /* payload: key[keylen] then name[] for JOURNAL_ADD, else inst[] */
+} jrec_t;
+
+#define JOURNAL_MAGIC	0x504d434a
+#define JOURNAL_VERSION	2
+#define JOURNAL_ADD	1	/* new entry, or new key for an entry */
+#define JOURNAL_CULL	2	/* one entry culled */
+#define JOURNAL_CLEAR	3	/* all entries culled */
+#define JOURNAL_STAMP	4	/* stamp for a list of entries */
+#define JOURNAL_MODE	5	/* ins_mode changed */
+#define JOURNAL_MIN	65536	/* no compaction for smaller journals */
 
 static hdr_t	*base;		/* start of cache headers */
+static __pmHashCtl	hashindom;	/* cache headers hashed by indom */
+static hdr_t	*lasthdr;	/* most recent find_cache() result */
 static char 	filename[MAXPATHLEN];
 				/* for load/save ops */
 static char	*vdp;		/* first trip mkdir for load/save */
@@ -156,27 +207,44 @@ key_eq(entry_t *e, int keylen, const char *key)
     return 1;
 }
 
+/*
+ * find the cache header for an indom, NULL if there is none
+ */
+static hdr_t *
+lookup_cache(pmInDom indom)
+{
+    __pmHashNode	*hp;
+
+    if (lasthdr != NULL && lasthdr->indom == indom)
+	return lasthdr;
+    if ((hp = __pmHashSearch((unsigned int)indom, &hashindom)) == NULL)
+	return NULL;
+    return lasthdr = (hdr_t *)hp->data;
+}
+
 static hdr_t *
 find_cache(pmInDom indom, int *sts)
 {
     hdr_t	*h;
     int		i;
 
-    for (h = base; h != NULL; h = h->next) {
-	if (h->indom == indom)
-	    return h;
-    }
+    if ((h = lookup_cache(indom)) != NULL)
+	return h;
 
-    if ((h = (hdr_t *)malloc(sizeof(hdr_t))) == NULL) {
+    if ((h = (hdr_t *)malloc(sizeof(hdr_t))) == NULL ||
+	__pmHashAdd((unsigned int)indom, (void *)h, &hashindom) < 0) {
 	char	strbuf[20];
 	__pmNotifyErr(LOG_ERR, 
 	     "find_cache: indom %s: unable to allocate memory for hdr_t",
 	     pmInDomStr_r(indom, strbuf, sizeof(strbuf)));
+	if (h != NULL)
+	    free(h);
 	*sts = PM_ERR_GENERIC;
 	return NULL;
     }
     h->next = base;
     base = h;
+    lasthdr = h;
     h->first = NULL;
     h->last = NULL;
     h->hsize = 16;
@@ -189,6 +257,18 @@ find_cache(pmInDom indom, int *sts)
     h->hstate = 0;
     for (i = 0; i < MAX_HASH_TRY; i++)
 	h->keyhash_cnt[i] = 0;
+    h->jfd = -1;
+    h->jmode = 0;
+    h->jbytes = 0;
+    h->snapbytes = 0;
+    h->snapgen = 0;
+    h->jbuf = NULL;
+    h->jlen = 0;
+    h->jsize = 0;
+    h->actlist = NULL;
+    h->nactive = 0;
+    h->maxactive = 0;
+    h->actvalid = 0;
     return h;
 }
 
@@ -708,6 +788,280 @@ retry:
     return e;
 }
 
+/*
+ * path to the external file for an indom, with an optional suffix
+ */
+static void
+cache_path(hdr_t *h, const char *suffix, char *path, size_t len)
+{
+    int		sep = __pmPathSeparator();
+    char	strbuf[20];
+
+    if (vdp == NULL) {
+	vdp = pmGetConfig("PCP_VAR_DIR");
+	snprintf(path, len,
+		"%s%c" "config" "%c" "pmda", vdp, sep, sep);
+	mkdir2(path, 0755);
+    }
+
+    snprintf(path, len, "%s%cconfig%cpmda%c%s%s",
+		vdp, sep, sep, sep, pmInDomStr_r(h->indom, strbuf, sizeof(strbuf)),
+		suffix);
+}
+
+/*
+ * stop journalling changes ... the next save writes a snapshot
+ */
+static void
+journal_detach(hdr_t *h)
+{
+    if (h->jfd >= 0)
+	close(h->jfd);
+    h->jfd = -1;
+    if (h->jbuf != NULL)
+	free(h->jbuf);
+    h->jbuf = NULL;
+    h->jlen = h->jsize = 0;
+}
+
+/*
+ * reserve a zero-filled record with paylen bytes of payload at the
+ * end of the pending records, the caller fills in the payload and
+ * then calls journal_sum()
+ */
+static jrec_t *
+journal_rec(hdr_t *h, int type, int inst, int stamp, int paylen)
+{
+    jrec_t	*rec;
+    char	*p;
+    int		len = (sizeof(jrec_t) + paylen + 3) & ~3;
+
+    if (h->jfd < 0)
+	/* not attached, nothing to do until the next snapshot */
+	return NULL;
+
+    if (h->jlen + len > h->jsize) {
+	int	size = h->jsize == 0 ? 1024 : h->jsize;
+
+	while (size < h->jlen + len)
+	    size *= 2;
+	if ((p = (char *)realloc(h->jbuf, size)) == NULL) {
+	    char	strbuf[20];
+	    __pmNotifyErr(LOG_ERR, 
+		 "journal_rec: indom %s: unable to allocate %d bytes for journal",
+		 pmInDomStr_r(h->indom, strbuf, sizeof(strbuf)), size);
+	    journal_detach(h);
+	    return NULL;
+	}
+	h->jbuf = p;
+	h->jsize = size;
+    }
+    rec = (jrec_t *)&h->jbuf[h->jlen];
+    memset(rec, 0, len);
+    rec->len = len;
+    rec->type = type;
+    rec->inst = inst;
+    rec->stamp = stamp;
+    h->jlen += len;
+    return rec;
+}
+
+static __uint32_t
+journal_hash(const jrec_t *rec)
+{
+    const char	*p = (const char *)rec;
+    int		skip = 2 * sizeof(__uint32_t);
+
+    return hash(&p[skip], rec->len - skip, 0);
+}
+
+static void
+journal_sum(jrec_t *rec)
+{
+    rec->sum = journal_hash(rec);
+}
+
+static void
+journal_add(hdr_t *h, entry_t *e)
+{
+    jrec_t	*rec;
+    char	*p;
+    int		namelen = strlen(e->name) + 1;
+
+    rec = journal_rec(h, JOURNAL_ADD, e->inst, (int)e->stamp, e->keylen + namelen);
+    if (rec == NULL)
+	return;
+    rec->keylen = e->keylen;
+    p = (char *)&rec[1];
+    if (e->keylen > 0)
+	memcpy(p, e->key, e->keylen);
+    memcpy(&p[e->keylen], e->name, namelen);
+    journal_sum(rec);
+}
+
+static void
+journal_op(hdr_t *h, int type, int inst)
+{
+    jrec_t	*rec;
+
+    if ((rec = journal_rec(h, type, inst, 0, 0)) != NULL)
+	journal_sum(rec);
+}
+
+/*
+ * Apply the journal records to the cache, stopping at the first
+ * record that is incomplete or fails the checksum.  *end is set to
+ * the offset of the end of the last good record.
+ */
+static int
+journal_replay(hdr_t *h, int fd, const char *path, off_t *end)
+{
+    struct stat	sbuf;
+    jhdr_t	*jh;
+    jrec_t	*rec;
+    entry_t	*e;
+    char	*buf;
+    char	*p;
+    char	*name;
+    off_t	off;
+    ssize_t	n;
+    int		paylen;
+    int		culled = 0;
+    int		cnt = 0;
+    int		sts;
+    int		i;
+
+    *end = 0;
+    if (fstat(fd, &sbuf) < 0)
+	return -oserror();
+    if (sbuf.st_size < sizeof(jhdr_t))
+	/* empty, or crashed before the header was written */
+	return 0;
+    if ((buf = (char *)malloc(sbuf.st_size)) == NULL)
+	return -oserror();
+    for (off = 0; off < sbuf.st_size; off += n) {
+	if ((n = read(fd, &buf[off], sbuf.st_size - off)) <= 0) {
+	    sts = n < 0 ? -oserror() : PM_ERR_GENERIC;
+	    free(buf);
+	    return sts;
+	}
+    }
+
+    jh = (jhdr_t *)buf;
+    if (jh->magic != JOURNAL_MAGIC || jh->version != JOURNAL_VERSION) {
+	__pmNotifyErr(LOG_WARNING,
+	     "pmdaCacheOp: %s: unknown journal format, ignored", path);
+	free(buf);
+	return PM_ERR_GENERIC;
+    }
+    if (jh->gen != h->snapgen) {
+	__pmNotifyErr(LOG_WARNING,
+	     "pmdaCacheOp: %s: journal for another snapshot, ignored", path);
+	free(buf);
+	return 0;
+    }
+
+    for (off = sizeof(jhdr_t); off + sizeof(jrec_t) <= sbuf.st_size; off += rec->len) {
+	rec = (jrec_t *)&buf[off];
+	if (rec->len < sizeof(jrec_t) || (rec->len & 3) != 0 ||
+	    rec->len > sbuf.st_size - off || rec->sum != journal_hash(rec))
+	    break;
+	p = (char *)&rec[1];
+	paylen = rec->len - sizeof(jrec_t);
+
+	switch (rec->type) {
+	    case JOURNAL_ADD:
+		if (rec->keylen < 0 || rec->keylen >= paylen ||
+		    memchr(&p[rec->keylen], '\0', paylen - rec->keylen) == NULL)
+		    goto done;
+		name = &p[rec->keylen];
+		/*
+		 * the journal wins over any conflicting entry, which
+		 * can only come from an older snapshot or journal record
+		 */
+		e = find_entry(h, NULL, rec->inst, &sts);
+		if (e != NULL && strcmp(e->name, name) != 0) {
+		    e->state = PMDA_CACHE_EMPTY;
+		    culled++;
+		    e = NULL;
+		}
+		if (e == NULL) {
+		    if ((e = find_entry(h, name, PM_IN_NULL, &sts)) != NULL) {
+			e->state = PMDA_CACHE_EMPTY;
+			culled++;
+		    }
+		    if ((e = insert_cache(h, name, rec->inst, &sts)) == NULL) {
+			free(buf);
+			return sts;
+		    }
+		}
+		if (e->key != NULL)
+		    free(e->key);
+		e->key = NULL;
+		e->keylen = rec->keylen;
+		if (rec->keylen > 0) {
+		    if ((e->key = malloc(rec->keylen)) == NULL) {
+			__pmNotifyErr(LOG_ERR, 
+			     "journal_replay: indom %s: unable to allocate memory for keylen=%d",
+			     pmInDomStr(h->indom), rec->keylen);
+			free(buf);
+			return PM_ERR_GENERIC;
+		    }
+		    memcpy(e->key, p, rec->keylen);
+		}
+		e->stamp = rec->stamp;
+		break;
+
+	    case JOURNAL_CULL:
+		if ((e = find_entry(h, NULL, rec->inst, &sts)) != NULL) {
+		    e->state = PMDA_CACHE_EMPTY;
+		    culled++;
+		}
+		break;
+
+	    case JOURNAL_CLEAR:
+		for (e = h->first; e != NULL; e = e->next) {
+		    if (e->state != PMDA_CACHE_EMPTY) {
+			e->state = PMDA_CACHE_EMPTY;
+			culled++;
+		    }
+		}
+		break;
+
+	    case JOURNAL_STAMP:
+		if (rec->inst < 0 || rec->inst > paylen / sizeof(__int32_t))
+		    goto done;
+		for (i = 0; i < rec->inst; i++) {
+		    if ((e = find_entry(h, NULL, ((__int32_t *)p)[i], &sts)) != NULL)
+			e->stamp = rec->stamp;
+		}
+		break;
+
+	    case JOURNAL_MODE:
+		if (rec->inst < 0 || rec->inst > 1)
+		    goto done;
+		h->ins_mode = rec->inst;
+		break;
+
+	    default:
+		goto done;
+	}
+	cnt++;
+    }
+
+done:
+    if (off < sbuf.st_size)
+	__pmNotifyErr(LOG_WARNING,
+	     "pmdaCacheOp: %s: discarding %d bytes of incomplete journal",
+	     path, (int)(sbuf.st_size - off));
+    *end = off;
+    free(buf);
+    if (culled > 0)
+	redo_hash(h, 0);
+
+    return cnt;
+}
+
 static int
 load_cache(hdr_t *h)
 {
@@ -719,21 +1073,17 @@ load_cache(hdr_t *h)
     int		keylen = 0;
     void	*key = NULL;
     int		s;
+    unsigned int gen;
     char	buf[1024];	/* input line buffer, is this big enough? */
     char	*p;
     int		sts;
-    int		sep = __pmPathSeparator();
-    char	strbuf[20];
-
-    if (vdp == NULL) {
-	vdp = pmGetConfig("PCP_VAR_DIR");
-	snprintf(filename, sizeof(filename),
-		"%s%c" "config" "%c" "pmda", vdp, sep, sep);
-	mkdir2(filename, 0755);
-    }
+    int		fd;
+    int		nentry = h->nentry;
+    off_t	snapbytes;
+    off_t	end;
+    char	path[MAXPATHLEN];
 
-    snprintf(filename, sizeof(filename), "%s%cconfig%cpmda%c%s",
-		vdp, sep, sep, sep, pmInDomStr_r(h->indom, strbuf, sizeof(strbuf)));
+    cache_path(h, "", filename, sizeof(filename));
     if ((fp = fopen(filename, "r")) == NULL)
 	return -oserror();
     if (fgets(buf, sizeof(buf), fp) == NULL) {
@@ -742,14 +1092,16 @@ load_cache(hdr_t *h)
 	fclose(fp);
 	return PM_ERR_GENERIC;
     }
-    s = sscanf(buf, "%d %d", &x, &h->ins_mode);
-    if (s != 2 || x != 1 || h->ins_mode < 0 || h->ins_mode > 1) {
+    /* snapshots written by journal compaction have a generation too */
+    s = sscanf(buf, "%d %d %u", &x, &h->ins_mode, &gen);
+    if (s < 2 || x != 1 || h->ins_mode < 0 || h->ins_mode > 1) {
 	__pmNotifyErr(LOG_ERR, 
 	     "pmdaCacheOp: %s: illegal first record: %s",
 	     filename, buf);
 	fclose(fp);
 	return PM_ERR_GENERIC;
     }
+    h->snapgen = s == 3 ? gen : 0;
 
     for (cnt = 0; ; cnt++) {
 	if (fgets(buf, sizeof(buf), fp) == NULL)
@@ -835,8 +1187,53 @@ bad:
 	e->key = key;
 	e->stamp = x;
     }
+    snapbytes = ftell(fp);
     fclose(fp);
 
+    /*
+     * Changes since the snapshot was written ... replayed even if this
+     * cache is not journalled, in case the PMDA has stopped using the
+     * journal since the snapshot was written.
+     */
+    journal_detach(h);
+    h->actvalid = 0;
+    cache_path(h, ".journal", path, sizeof(path));
+    if ((h->hstate & CACHE_JOURNAL) != 0)
+	fd = open(path, O_RDWR | O_APPEND);
+    else
+	fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+	if ((sts = journal_replay(h, fd, path, &end)) > 0) {
+	    /* recount, replay may have added or culled entries */
+	    cnt = 0;
+	    for (e = h->first; e != NULL; e = e->next) {
+		if (e->state != PMDA_CACHE_EMPTY)
+		    cnt++;
+	    }
+	}
+	/*
+	 * Only append to this journal if the snapshot and journal
+	 * describe the whole cache, i.e. nothing was added to the cache
+	 * before the load, else the next save writes a new snapshot
+	 */
+	if ((h->hstate & CACHE_JOURNAL) != 0 && sts >= 0 && nentry == 0 &&
+	    end >= sizeof(jhdr_t) && ftruncate(fd, end) == 0) {
+	    h->jfd = fd;
+	    h->jbytes = end;
+	    h->snapbytes = snapbytes;
+	    h->jmode = h->ins_mode;
+	}
+	else {
+	    /* stale, or for another snapshot, start again at the next save */
+	    if ((h->hstate & CACHE_JOURNAL) != 0 && sts == 0 && end == 0 &&
+		ftruncate(fd, 0) < 0)
+		__pmNotifyErr(LOG_WARNING,
+		     "pmdaCacheOp: %s: cannot reset journal: %s",
+		     path, osstrerror());
+	    close(fd);
+	}
+    }
+
 #ifdef PCP_DEBUG
     if (pmDebug & DBG_TRACE_INDOM) {
 	fprintf(stderr, "After PMDA_CACHE_LOAD\n");
@@ -847,35 +1244,20 @@ bad:
     return cnt;
 }
 
+/*
+ * the external file, aka the snapshot
+ */
 static int
-save_cache(hdr_t *h, int hstate)
+write_cache(hdr_t *h, FILE *fp, time_t now)
 {
-    FILE	*fp;
     entry_t	*e;
     int		cnt;
-    time_t	now;
-    int		sep = __pmPathSeparator();
-    char	strbuf[20];
-
-    if ((h->hstate & hstate) == 0 || (h->hstate & CACHE_STRINGS) != 0) {
-	/* nothing to be done */
-	return 0;
-    }
-
-    if (vdp == NULL) {
-	vdp = pmGetConfig("PCP_VAR_DIR");
-	snprintf(filename, sizeof(filename),
-		"%s%c" "config" "%c" "pmda", vdp, sep, sep);
-	mkdir2(filename, 0755);
-    }
 
-    snprintf(filename, sizeof(filename), "%s%cconfig%cpmda%c%s",
-		vdp, sep, sep, sep, pmInDomStr_r(h->indom, strbuf, sizeof(strbuf)));
-    if ((fp = fopen(filename, "w")) == NULL)
-	return -oserror();
-    fprintf(fp, "%d %d\n", VERSION, h->ins_mode);
+    if (h->snapgen != 0)
+	fprintf(fp, "%d %d %u\n", VERSION, h->ins_mode, h->snapgen);
+    else
+	fprintf(fp, "%d %d\n", VERSION, h->ins_mode);
 
-    now = time(NULL);
     cnt = 0;
     for (e = h->first; e != NULL; e = e->next) {
 	if (e->state == PMDA_CACHE_EMPTY)
@@ -894,8 +1276,169 @@ save_cache(hdr_t *h, int hstate)
 	fprintf(fp, " %s\n", e->name);
 	cnt++;
     }
-    fclose(fp);
-    h->hstate = 0;
+    return cnt;
+}
+
+/*
+ * Write a new snapshot and start a new journal.  The snapshot is
+ * written to a temporary file and renamed, so a crash leaves either
+ * the old snapshot and journal, or the new snapshot and the old
+ * journal (which replays harmlessly over the new snapshot).
+ */
+static int
+journal_compact(hdr_t *h, time_t now)
+{
+    FILE	*fp;
+    int		cnt;
+    int		sts;
+    jhdr_t	jh;
+    __uint32_t	oldgen = h->snapgen;
+    char	tmppath[MAXPATHLEN];
+    char	path[MAXPATHLEN];
+
+    cache_path(h, "", filename, sizeof(filename));
+    cache_path(h, ".new", tmppath, sizeof(tmppath));
+    if ((fp = fopen(tmppath, "w")) == NULL)
+	return -oserror();
+    /* a new generation, never 0 (no generation) nor a recent one */
+    h->snapgen = (__uint32_t)now > oldgen ? (__uint32_t)now : oldgen + 1;
+    if (h->snapgen == 0)
+	h->snapgen = 1;
+    cnt = write_cache(h, fp, now);
+    fflush(fp);
+#ifndef IS_MINGW
+    fsync(fileno(fp));
+#endif
+    h->snapbytes = ftell(fp);
+    if (ferror(fp) || fclose(fp) != 0) {
+	sts = -oserror();
+	unlink(tmppath);
+	h->snapgen = oldgen;
+	return sts < 0 ? sts : PM_ERR_GENERIC;
+    }
+#ifdef IS_MINGW
+    unlink(filename);
+#endif
+    if (rename(tmppath, filename) < 0) {
+	sts = -oserror();
+	unlink(tmppath);
+	h->snapgen = oldgen;
+	return sts;
+    }
+
+    /*
+     * snapshot is complete, so any pending records can go ... failure
+     * from here on just means the next save writes a snapshot again
+     */
+    h->jlen = 0;
+    cache_path(h, ".journal", path, sizeof(path));
+    if (h->jfd < 0 && (h->jfd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644)) < 0) {
+	unlink(path);
+	journal_detach(h);
+	return cnt;
+    }
+    jh.magic = JOURNAL_MAGIC;
+    jh.version = JOURNAL_VERSION;
+    jh.gen = h->snapgen;
+    if (ftruncate(h->jfd, 0) < 0 || write(h->jfd, &jh, sizeof(jh)) != sizeof(jh)) {
+	unlink(path);
+	journal_detach(h);
+	return cnt;
+    }
+    h->jbytes = sizeof(jh);
+    h->jmode = h->ins_mode;
+    return cnt;
+}
+
+/*
+ * Append the changes since the last save to the journal, unless the
+ * journal has grown bigger than the snapshot in which case compact
+ */
+static int
+journal_save(hdr_t *h)
+{
+    entry_t	*e;
+    jrec_t	*rec = NULL;
+    __int32_t	*ip = NULL;
+    time_t	now = time(NULL);
+    off_t	limit;
+    ssize_t	n;
+    int		cnt = 0;
+    int		nstamp = 0;
+    int		sts;
+
+    if (h->jfd >= 0 && h->ins_mode != h->jmode)
+	journal_op(h, JOURNAL_MODE, h->ins_mode);
+
+    for (e = h->first; e != NULL; e = e->next) {
+	if (e->state == PMDA_CACHE_EMPTY)
+	    continue;
+	cnt++;
+	if (e->stamp == 0)
+	    nstamp++;
+    }
+    if (nstamp > 0 &&
+	(rec = journal_rec(h, JOURNAL_STAMP, nstamp, (int)now, nstamp * sizeof(__int32_t))) != NULL)
+	ip = (__int32_t *)&rec[1];
+    for (e = h->first; nstamp > 0 && e != NULL; e = e->next) {
+	if (e->state == PMDA_CACHE_EMPTY || e->stamp != 0)
+	    continue;
+	e->stamp = now;
+	if (ip != NULL)
+	    *ip++ = e->inst;
+    }
+    if (rec != NULL)
+	journal_sum(rec);
+
+    limit = h->snapbytes > JOURNAL_MIN ? h->snapbytes : JOURNAL_MIN;
+    if (h->jfd < 0 || h->jbytes + h->jlen > limit)
+	return journal_compact(h, now);
+
+    if (h->jlen > 0) {
+	if ((n = write(h->jfd, h->jbuf, h->jlen)) != h->jlen) {
+	    /*
+	     * a short write leaves a torn record that replay will
+	     * discard, and the next save writes a snapshot
+	     */
+	    sts = n < 0 ? -oserror() : -ENOSPC;
+	    journal_detach(h);
+	    return sts;
+	}
+	h->jbytes += h->jlen;
+	h->jlen = 0;
+    }
+    h->jmode = h->ins_mode;
+    return cnt;
+}
+
+static int
+save_cache(hdr_t *h, int hstate)
+{
+    FILE	*fp;
+    int		cnt;
+    char	path[MAXPATHLEN];
+
+    if ((h->hstate & hstate) == 0 || (h->hstate & CACHE_STRINGS) != 0) {
+	/* nothing to be done */
+	return 0;
+    }
+
+    if ((h->hstate & CACHE_JOURNAL) != 0) {
+	if ((cnt = journal_save(h)) < 0)
+	    return cnt;
+    }
+    else {
+	cache_path(h, "", filename, sizeof(filename));
+	if ((fp = fopen(filename, "w")) == NULL)
+	    return -oserror();
+	h->snapgen = 0;
+	cnt = write_cache(h, fp, time(NULL));
+	fclose(fp);
+	/* any journal is now out of date */
+	cache_path(h, ".journal", path, sizeof(path));
+	unlink(path);
+    }
+    h->hstate &= ~(DIRTY_INSTANCE|DIRTY_STAMP);
 
 #ifdef PCP_DEBUG
     if (pmDebug & DBG_TRACE_INDOM) {
@@ -938,6 +1481,7 @@ store(pmInDom indom, int flags, const char *name, pmInDom inst, int keylen, cons
     hdr_t	*h;
     entry_t	*e;
     int		sts;
+    int		added = 0;
 
     if ((h = find_cache(indom, &sts)) == NULL)
 	return sts;
@@ -959,6 +1503,7 @@ store(pmInDom indom, int flags, const char *name, pmInDom inst, int keylen, cons
 	if ((e = insert_cache(h, name, inst, &sts)) == NULL)
 	    return sts;
 	h->hstate |= DIRTY_INSTANCE;	/* added a new entry */
+	added = 1;
     }
     else {
 	if (sts == -1)
@@ -973,6 +1518,10 @@ store(pmInDom indom, int flags, const char *name, pmInDom inst, int keylen, cons
 
     switch (flags) {
 	case PMDA_CACHE_ADD:
+	    if (!added && key_eq(e, keylen, key) == 0) {
+		/* new key for an existing entry */
+		added = 1;
+	    }
 	    e->keylen = keylen;
 	    if (keylen > 0) {
 		if ((e->key = malloc(keylen)) == NULL) {
@@ -985,17 +1534,25 @@ store(pmInDom indom, int flags, const char *name, pmInDom inst, int keylen, cons
 	    }
 	    else
 		e->key = NULL;
+	    if (e->state != PMDA_CACHE_ACTIVE)
+		h->actvalid = 0;
 	    e->state = PMDA_CACHE_ACTIVE;
 	    e->private = private;
 	    e->stamp = 0;		/* flag, updated at next cache_save() */
 	    h->hstate |= DIRTY_STAMP;	/* timestamp needs updating */
+	    if (added)
+		journal_add(h, e);
 	    break;
 
 	case PMDA_CACHE_HIDE:
+	    if (e->state == PMDA_CACHE_ACTIVE)
+		h->actvalid = 0;
 	    e->state = PMDA_CACHE_INACTIVE;
 	    break;
 
 	case PMDA_CACHE_CULL:
+	    if (e->state == PMDA_CACHE_ACTIVE)
+		h->actvalid = 0;
 	    e->state = PMDA_CACHE_EMPTY;
 	    /*
 	     * we don't clean anything up, which may be a problem in the
@@ -1003,6 +1560,7 @@ store(pmInDom indom, int flags, const char *name, pmInDom inst, int keylen, cons
 	     * the culled entries can be reclaimed
 	     */
 	    h->hstate |= DIRTY_INSTANCE;	/* entry will not be saved */
+	    journal_op(h, JOURNAL_CULL, e->inst);
 	    break;
 
 	default:
@@ -1163,11 +1721,7 @@ int pmdaCacheOp(pmInDom indom, int op)
 
     if (op == PMDA_CACHE_CHECK) {
 	/* is there a cache for this one? */
-	for (h = base; h != NULL; h = h->next) {
-	    if (h->indom == indom)
-		return 1;
-	}
-	return 0;
+	return lookup_cache(indom) != NULL;
     }
 
     if ((h = find_cache(indom, &sts)) == NULL)
@@ -1198,6 +1752,8 @@ int pmdaCacheOp(pmInDom indom, int op)
 		    sts++;
 		}
 	    }
+	    if (sts > 0)
+		h->actvalid = 0;
 	    /* no instances added or deleted, so no need to save */
 	    return sts;
 
@@ -1209,6 +1765,8 @@ int pmdaCacheOp(pmInDom indom, int op)
 		    sts++;
 		}
 	    }
+	    if (sts > 0)
+		h->actvalid = 0;
 	    /* no instances added or deleted, so no need to save */
 	    return sts;
 
@@ -1220,14 +1778,19 @@ int pmdaCacheOp(pmInDom indom, int op)
 		    sts++;
 		}
 	    }
-	    if (sts > 0)
+	    if (sts > 0) {
 		h->hstate |= DIRTY_INSTANCE;	/* entries culled */
+		h->actvalid = 0;
+		journal_op(h, JOURNAL_CLEAR, 0);
+	    }
 	    return sts;
 
 	case PMDA_CACHE_SIZE:
 	    return h->nentry;
 
 	case PMDA_CACHE_SIZE_ACTIVE:
+	    if (h->actvalid)
+		return h->nactive;
 	    sts = 0;
 	    for (e = h->first; e != NULL; e = e->next) {
 		if (e->state == PMDA_CACHE_ACTIVE)
@@ -1247,6 +1810,11 @@ int pmdaCacheOp(pmInDom indom, int op)
 	    h->ins_mode = 1;
 	    return 0;
 
+	case PMDA_CACHE_JOURNAL:
+	    /* takes effect at the next load or save */
+	    h->hstate |= CACHE_JOURNAL;
+	    return 0;
+
 	case PMDA_CACHE_REORG:
 	    redo_hash(h, 0);
 	    return 0;
@@ -1401,6 +1969,10 @@ int pmdaCachePurge(pmInDom indom, time_t recent)
 	 * keep these ones
 	 */
 	if (e->stamp != 0 && e->stamp < epoch) {
+	    if (e->state != PMDA_CACHE_EMPTY)
+		journal_op(h, JOURNAL_CULL, e->inst);
+	    if (e->state == PMDA_CACHE_ACTIVE)
+		h->actvalid = 0;
 	    e->state = PMDA_CACHE_EMPTY;
 	    cnt++;
 	}
@@ -1411,6 +1983,57 @@ int pmdaCachePurge(pmInDom indom, time_t recent)
     return cnt;
 }
 
+/*
+ * Dense array of the active instances, in ascending inst order ...
+ * rebuilt only when the set of active instances has changed since the
+ * last call, so for a stable indom this is O(1).  The array belongs to
+ * the cache and is valid until the next call for the same indom.
+ */
+int
+pmdaCacheActiveList(pmInDom indom, int **instlist)
+{
+    hdr_t	*h;
+    entry_t	*e;
+    int		*list;
+    int		n;
+    int		sts;
+
+    if (indom == PM_INDOM_NULL)
+	return PM_ERR_INDOM;
+
+    if ((h = find_cache(indom, &sts)) == NULL)
+	return sts;
+
+    if (!h->actvalid) {
+	n = 0;
+	for (e = h->first; e != NULL; e = e->next) {
+	    if (e->state == PMDA_CACHE_ACTIVE)
+		n++;
+	}
+	if (n > h->maxactive) {
+	    if ((list = (int *)realloc(h->actlist, n * sizeof(int))) == NULL) {
+		char	strbuf[20];
+		__pmNotifyErr(LOG_ERR, 
+		     "pmdaCacheActiveList: indom %s: unable to allocate memory for %d instances",
+		     pmInDomStr_r(indom, strbuf, sizeof(strbuf)), n);
+		return -oserror();
+	    }
+	    h->actlist = list;
+	    h->maxactive = n;
+	}
+	n = 0;
+	for (e = h->first; e != NULL; e = e->next) {
+	    if (e->state == PMDA_CACHE_ACTIVE)
+		h->actlist[n++] = e->inst;
+	}
+	h->nactive = n;
+	h->actvalid = 1;
+    }
+
+    *instlist = h->actlist;
+    return h->nactive;
+}
+
 /*
 --------------------------------------------------------------------
 lookup2.c, by Bob Jenkins, December 1996, Public Domain.
@@ -61,6 +61,8 @@ __pmdaCntInst(pmInDom indom, pmdaExt *pmda)
  */
 
 static pmdaIndom	last;
+static int		*lastlist;	/* active instances, for last */
+static int		nlast;
 
 /*
  * State between here and __pmdaNextInst is a little strange
@@ -72,7 +74,8 @@ static pmdaIndom	last;
  * for the cache method
  *    - pmda->e_idp is set here (points into last) which is also set
  *      up with the it_indom field (other fields in last are not used),
- *      and pmda->e_idp->it_indom in __pmdaNextInst
+ *      and pmda->e_idp->it_indom in __pmdaNextInst, and lastlist[]
+ *      is the cache's array of active instances
  *
  * In both cases, pmda->e_ordinal and pmda->e_singular are set here
  * and updated in __pmdaNextInst.
@@ -96,7 +99,8 @@ __pmdaStartInst(pmInDom indom, pmdaExt *pmda)
     }
     else {
 	if (pmdaCacheOp(indom, PMDA_CACHE_CHECK)) {
-	    pmdaCacheOp(indom, PMDA_CACHE_WALK_REWIND);
+	    if ((nlast = pmdaCacheActiveList(indom, &lastlist)) < 0)
+		nlast = 0;
 	    last.it_indom = indom;
 	    pmda->e_idp = &last;
 	    pmda->e_ordinal = 0;
@@ -143,8 +147,8 @@ __pmdaNextInst(int *inst, pmdaExt *pmda)
 	/* scan for next value in the profile */
 	if (pmda->e_idp == &last) {
 	    /* cache-driven */
-	    while ((myinst = pmdaCacheOp(pmda->e_idp->it_indom, PMDA_CACHE_WALK_NEXT)) != -1) {
-		pmda->e_ordinal++;
+	    while (pmda->e_ordinal < nlast) {
+		myinst = lastlist[pmda->e_ordinal++];
 		if (__pmInProfile(pmda->e_idp->it_indom, pmda->e_prof, myinst)) {
 		    *inst = myinst;
 #ifdef PCP_DEBUG
@@ -439,14 +443,103 @@ pmdaInstance(pmInDom indom, int inst, char *name, __pmInResult **result, pmdaExt
  * required in the profile.
  */
 
+/*
+ * The instances of indom selected by the profile for a pmdaFetch.
+ * For a cache-driven indom when the profile selects all instances
+ * (the usual case) this is the cache's own array of active instances,
+ * otherwise the instances are copied into extp->instlist[].
+ */
+static int
+__pmdaFetchInsts(pmInDom indom, int **instlist, pmdaExt *pmda)
+{
+    e_ext_t		*extp = (e_ext_t *)pmda->e_ext;
+    __pmInDomProfile	*prof;
+    pmdaIndom		*idp = NULL;
+    int			*list = NULL;
+    int			*tmp;
+    int			numinst = 0;
+    int			n;
+    int			i;
+
+    if (pmdaCacheOp(indom, PMDA_CACHE_CHECK)) {
+	if ((numinst = pmdaCacheActiveList(indom, &list)) < 0)
+	    return numinst;
+	if (pmda->e_prof == NULL) {
+	    *instlist = list;
+	    return numinst;
+	}
+	prof = __pmFindProfile(indom, pmda->e_prof);
+	if ((prof == NULL && pmda->e_prof->state == PM_PROFILE_INCLUDE) ||
+	    (prof != NULL && prof->state == PM_PROFILE_INCLUDE &&
+	     prof->instances_len == 0)) {
+	    *instlist = list;
+	    return numinst;
+	}
+    }
+    else {
+	for (i = 0; i < pmda->e_nindoms; i++) {
+	    if (pmda->e_indoms[i].it_indom == indom) {
+		idp = &pmda->e_indoms[i];
+		numinst = idp->it_numinst;
+		break;
+	    }
+	}
+    }
+
+    if (numinst > extp->maxninst) {
+	if ((tmp = (int *)realloc(extp->instlist, numinst * sizeof(int))) == NULL)
+	    return -oserror();
+	extp->instlist = tmp;
+	extp->maxninst = numinst;
+    }
+    for (i = n = 0; i < numinst; i++) {
+	int	inst = (idp == NULL) ? list[i] : idp->it_set[i].i_inst;
+
+	if (__pmInProfile(indom, pmda->e_prof, inst))
+	    extp->instlist[n++] = inst;
+    }
+    *instlist = extp->instlist;
+    return n;
+}
+
+/*
+ * Values for all the instances of a metric from the batch callback,
+ * into extp->atoms[] and extp->status[].  Returns 0 if the caller
+ * should use the fetch callback for each instance instead.
+ */
+static int
+__pmdaFetchBatch(pmdaMetric *metap, int numinst, const int *instlist, pmdaExt *pmda)
+{
+    e_ext_t		*extp = (e_ext_t *)pmda->e_ext;
+    pmAtomValue		*atoms;
+    int			*status;
+    int			i;
+
+    if (numinst > extp->maxnbatch) {
+	if ((atoms = (pmAtomValue *)realloc(extp->atoms, numinst * sizeof(pmAtomValue))) == NULL)
+	    return 0;
+	extp->atoms = atoms;
+	if ((status = (int *)realloc(extp->status, numinst * sizeof(int))) == NULL)
+	    return 0;
+	extp->status = status;
+	extp->maxnbatch = numinst;
+    }
+    for (i = 0; i < numinst; i++)
+	extp->status[i] = PM_ERR_INST;
+    return (*(extp->batchCallBack))(metap, numinst, instlist, extp->atoms, extp->status) >= 0;
+}
+
 int
 pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 {
     int			i;		/* over pmidlist[] */
     int			j;		/* over metatab and vset->vlist[] */
+    int			k;		/* over instlist[] */
+    int			batched;
     int			sts;
     int			need;
     int			inst;
+    int			*instlist = NULL;
     int			numval;
     pmValueSet		*vset;
     pmDesc		*dp;
@@ -507,12 +600,10 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 
 	if (dp != NULL) {
 	    if (dp->indom != PM_INDOM_NULL) {
-		/* count instances in the profile */
-		numval = 0;
-		/* count instances in indom */
-		__pmdaStartInst(dp->indom, pmda);
-		while (__pmdaNextInst(&inst, pmda)) {
-		    numval++;
+		/* instances in the profile */
+		if ((numval = __pmdaFetchInsts(dp->indom, &instlist, pmda)) < 0) {
+		    sts = numval;
+		    goto error;
 		}
 	    }
 	    else {
@@ -549,28 +640,28 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 	if (vset->numval <= 0)
 	    continue;
 
-	if (dp->indom == PM_INDOM_NULL)
-	    inst = PM_IN_NULL;
-	else {
-	    __pmdaStartInst(dp->indom, pmda);
-	    __pmdaNextInst(&inst, pmda);
-	}
 	type = dp->type;
 	j = 0;
-	do {
-	    if (j == numval) {
-		/* more instances than expected! */
-		numval++;
-		extp->res->vset[i] = vset = (pmValueSet *)realloc(vset,
-			    sizeof(pmValueSet) + (numval - 1)*sizeof(pmValue));
-		if (vset == NULL) {
-		    sts = -oserror();
-		    goto error;
-		}
-	    }
+	batched = 0;
+	if (extp->batchCallBack != NULL && dp->indom != PM_INDOM_NULL)
+	    batched = __pmdaFetchBatch(metap, numval, instlist, pmda);
+	for (k = 0; k < numval; k++) {
+	    inst = (dp->indom == PM_INDOM_NULL) ? PM_IN_NULL : instlist[k];
 	    vset->vlist[j].inst = inst;
 
-	    if ((sts = (*(pmda->e_fetchCallBack))(metap, inst, &atom)) < 0) {
+	    if (batched) {
+		sts = extp->status[k];
+		if (sts == PMDA_FETCH_STATIC &&
+		    (type == PM_TYPE_32 || type == PM_TYPE_U32)) {
+		    /* the common case, no need for __pmStuffValue */
+		    vset->vlist[j++].value.lval = extp->atoms[k].l;
+		    continue;
+		}
+		atom = extp->atoms[k];
+	    }
+	    else
+		sts = (*(pmda->e_fetchCallBack))(metap, inst, &atom);
+	    if (sts < 0) {
 		char	strbuf[20];
 
 		pmIDStr_r(dp->pmid, strbuf, sizeof(strbuf));
@@ -653,7 +744,7 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 			sts = lsts;
 		}
 	    }
-	} while (dp->indom != PM_INDOM_NULL && __pmdaNextInst(&inst, pmda));
+	}
 
 	if (j == 0)
 	    vset->numval = sts;
@@ -31,6 +31,12 @@ typedef struct {
     pmResult		*res;		/* high-water allocation for */
     int			maxnpmids;	/* pmResult for each PMDA */
     __pmHashCtl		hashpmids;	/* hashed metrictab lookups */
+    int			*instlist;	/* high-water allocation for */
+    int			maxninst;	/* instances in a pmdaFetch */
+    pmdaFetchBatchCallBack batchCallBack; /* optional, see pmdaFetch */
+    pmAtomValue		*atoms;		/* high-water allocation for */
+    int			*status;	/* batch callback values and */
+    int			maxnbatch;	/* status */
 } e_ext_t;
 
 #endif /* LIBDEFS_H */
@@ -24,6 +24,10 @@ QmcContext::QmcContext(QmcSource* source)
     my.context = -1;
     my.source = source;
     my.needReconnect = false;
+    my.fetchResult = NULL;
+    my.fetchStatus = 0;
+    my.fetchTried = false;
+    my.late = false;
 
     if (my.source->status() >= 0)
 	my.context = my.source->dupContext();
@@ -44,6 +48,7 @@ QmcContext::~QmcContext()
     while (my.indoms.isEmpty() == false) {
 	delete my.indoms.takeFirst();
     }
+    fetchDiscard();
     if (my.context >= 0)
 	my.source->delContext(my.context);
 }
@@ -254,11 +259,12 @@ QmcContext::addMetric(QmcMetric *metric)
     my.metrics.append(metric);
     if (metric->status() >= 0) {
 	pmid = metric->desc().desc().pmid;
-	for (i = 0; i < my.pmids.size(); i++)
-	    if (my.pmids[i] == pmid)
-		break;
-	if (i == my.pmids.size())
+	i = my.pmidIndex.value(pmid, -1);
+	if (i < 0) {
+	    i = my.pmids.size();
 	    my.pmids.append(pmid);
+	    my.pmidIndex.insert(pmid, i);
+	}
 	metric->setIdIndex(i);
     }
 }
@@ -266,20 +272,22 @@ QmcContext::addMetric(QmcMetric *metric)
 int
 QmcContext::fetch(bool update)
 {
-    int i, sts;
-    pmResult *result;
+    fetchSetup();
+    fetchValues();
+    return fetchFinish(update);
+}
 
-    for (i = 0; i < my.metrics.size(); i++) {
-	QmcMetric *metric = my.metrics[i];
-	if (metric->status() < 0)
-	    continue;
-	metric->shiftValues();
-    }
+int
+QmcContext::fetchSetup(bool ahead)
+{
+    int i, sts;
 
     // Inform each indom that we are about to do a new fetch so any
-    // indom changes are now irrelevant
-    for (i = 0; i < my.indoms.size(); i++)
-	my.indoms[i]->newFetch();
+    // indom changes are now irrelevant - unless fetching ahead, when
+    // the changes from the last fetch have yet to be seen by anyone
+    if (!ahead)
+	for (i = 0; i < my.indoms.size(); i++)
+	    my.indoms[i]->newFetch();
 
     sts = pmUseContext(my.context);
     if (sts >= 0) {
@@ -294,6 +302,23 @@ QmcContext::fetch(bool update)
 	     << pmErrStr(sts) << endl;
     }
 
+    // implicitly shared, so no copy unless metrics are added mid-fetch
+    my.fetchIDs = my.pmids;
+    my.fetchResult = NULL;
+    my.fetchTried = false;
+    my.fetchStatus = sts;
+    return sts;
+}
+
+int
+QmcContext::fetchValues()
+{
+    int sts = my.fetchStatus;
+
+    // the current context is per-thread, so switch to it once more here
+    if (sts >= 0)
+	sts = pmUseContext(my.context);
+
     if (sts >= 0 && my.needReconnect) {
 	sts = pmReconnectContext(my.context);
 	if (sts >= 0) {
@@ -311,63 +336,159 @@ QmcContext::fetch(bool update)
 	}
     }
 
-    if (sts >= 0 && my.pmids.size()) {
+    if (sts >= 0 && my.fetchIDs.size()) {
 	if (pmDebug & DBG_TRACE_OPTFETCH) {
 	    QTextStream cerr(stderr);
 	    cerr << "QmcContext::fetch: fetching context " << *this << endl;
 	}
 
-	sts = pmFetch(my.pmids.size(), 
-		      (pmID *)(my.pmids.toVector().data()), &result);
-	if (sts >= 0) {
-	    my.previousTime = my.currentTime;
-	    my.currentTime = result->timestamp;
-	    my.delta = __pmtimevalSub(&my.currentTime, &my.previousTime);
-	    for (i = 0; i < my.metrics.size(); i++) {
-		QmcMetric *metric = my.metrics[i];
-		if (metric->status() < 0)
-		    continue;
-		Q_ASSERT((int)metric->idIndex() < result->numpmid);
-		metric->extractValues(result->vset[metric->idIndex()]);
-	    }
-	    pmFreeResult(result);
-	}
-	else {
+	my.fetchTried = true;
+	sts = pmFetch(my.fetchIDs.size(), my.fetchIDs.data(), &my.fetchResult);
+	if (sts < 0) {
 	    if (pmDebug & DBG_TRACE_OPTFETCH) {
 		QTextStream cerr(stderr);
 		cerr << "QmcContext::fetch: pmFetch: " << pmErrStr(sts) << endl;
 	    }
-	    for (i = 0; i < my.metrics.size(); i++) {
-		QmcMetric *metric = my.metrics[i];
-		if (metric->status() < 0)
-		    continue;
-		metric->setError(sts);
-	    }
+	    my.fetchResult = NULL;
 	    if (sts == PM_ERR_IPC || sts == PM_ERR_TIMEOUT)
 		my.needReconnect = true;
 	}
-
-	if (update) {
-	    if (pmDebug & DBG_TRACE_OPTFETCH) {
-		QTextStream cerr(stderr);
-		cerr << "QmcContext::fetch: Updating metrics" << endl;
-	    }
-	    for (i = 0; i < my.metrics.size(); i++) {
-		QmcMetric *metric = my.metrics[i];
-		if (metric->status() < 0)
-		    continue;
-		metric->update();
-	    }
-	}
     }
     else if (pmDebug & DBG_TRACE_OPTFETCH) {
 	QTextStream cerr(stderr);
 	cerr << "QmcContext::fetch: nothing to fetch" << endl;
     }
 
+    my.fetchStatus = sts;
+    return sts;
+}
+
+int
+QmcContext::fetchFinish(bool update)
+{
+    pmResult *result = my.fetchResult;
+    int i, sts = my.fetchStatus;
+
+    for (i = 0; i < my.metrics.size(); i++) {
+	QmcMetric *metric = my.metrics[i];
+	if (metric->status() < 0)
+	    continue;
+	metric->shiftValues();
+    }
+    my.late = false;
+
+    if (my.fetchTried == false)
+	return sts;
+
+    if (sts >= 0) {
+	my.previousTime = my.currentTime;
+	my.currentTime = result->timestamp;
+	my.delta = __pmtimevalSub(&my.currentTime, &my.previousTime);
+	for (i = 0; i < my.metrics.size(); i++) {
+	    QmcMetric *metric = my.metrics[i];
+	    if (metric->status() < 0)
+		continue;
+	    // metrics added since fetchSetup() have to wait for the next one
+	    if ((int)metric->idIndex() >= result->numpmid)
+		continue;
+	    metric->extractValues(result->vset[metric->idIndex()]);
+	}
+	pmFreeResult(result);
+	my.fetchResult = NULL;
+    }
+    else {
+	for (i = 0; i < my.metrics.size(); i++) {
+	    QmcMetric *metric = my.metrics[i];
+	    if (metric->status() < 0)
+		continue;
+	    metric->setError(sts);
+	}
+    }
+
+    if (update) {
+	if (pmDebug & DBG_TRACE_OPTFETCH) {
+	    QTextStream cerr(stderr);
+	    cerr << "QmcContext::fetch: Updating metrics" << endl;
+	}
+	for (i = 0; i < my.metrics.size(); i++) {
+	    QmcMetric *metric = my.metrics[i];
+	    if (metric->status() < 0)
+		continue;
+	    metric->update();
+	}
+    }
+    my.fetchTried = false;
+    return sts;
+}
+
+void
+QmcContext::fetchDiscard()
+{
+    if (my.fetchResult != NULL)
+	pmFreeResult(my.fetchResult);
+    my.fetchResult = NULL;
+    my.fetchTried = false;
+}
+
+bool
+QmcContext::fetchAdopt()
+{
+    int i;
+
+    if (my.fetchIDs.size() != my.pmids.size())
+	return false;		// metrics added since
+    for (i = 0; i < my.indoms.size(); i++)
+	if (my.indoms[i]->diffProfile())
+	    return false;	// instances added or removed since
+
+    for (i = 0; i < my.indoms.size(); i++)
+	my.indoms[i]->newFetch();
+    return true;
+}
+
+int
+QmcContext::fetchRewind(int mode, int interval)
+{
+    struct timeval when;
+    int sts = 0;
+
+    // without a result the archive position is unchanged
+    if (my.fetchResult != NULL) {
+	when = my.fetchResult->timestamp;
+	if ((sts = pmUseContext(my.context)) >= 0)
+	    sts = pmSetMode(mode, &when, interval);
+	if (sts < 0 && (pmDebug & DBG_TRACE_PMC)) {
+	    QTextStream cerr(stderr);
+	    cerr << "QmcContext::fetchRewind: " << pmErrStr(sts) << endl;
+	}
+    }
+    fetchDiscard();
     return sts;
 }
 
+void
+QmcContext::fetchMissed(bool update)
+{
+    int i;
+
+    if (pmDebug & DBG_TRACE_PMC) {
+	QTextStream cerr(stderr);
+	cerr << "QmcContext::fetch: no reply in time from context "
+	     << *this << endl;
+    }
+
+    for (i = 0; i < my.metrics.size(); i++) {
+	QmcMetric *metric = my.metrics[i];
+	if (metric->status() < 0)
+	    continue;
+	metric->shiftValues();
+	metric->setError(PM_ERR_TIMEOUT);
+	if (update)
+	    metric->update();
+    }
+    my.late = true;
+}
+
 void
 QmcContext::dometric(const char *name)
 {
@@ -20,6 +20,7 @@
 #include <qlist.h>
 #include <qstring.h>
 #include <qtextstream.h>
+#include <qvector.h>
 
 class QmcContext
 {
@@ -80,6 +81,25 @@ public:
 
     int fetch(bool update);		// Fetch metrics using this context
 
+    // The phases of fetch(), for asynchronous use by QmcGroup - only
+    // fetchValues() may be called from another (worker) thread, and it
+    // touches no QmcMetric or QmcIndom state.
+    int fetchSetup(bool ahead = false);	// Prepare profiles and pmID list
+    int fetchValues();			// The pmFetch itself
+    int fetchFinish(bool update);	// Apply the result to the metrics
+    void fetchDiscard();		// Drop an unwanted result
+    void fetchMissed(bool update);	// No result in time, mark metrics
+
+    // An archive context may be fetched one sample ahead of time, with
+    // fetchSetup(true).  The result is only applied by the next fetch,
+    // if fetchAdopt() finds it still matches the metrics and profiles;
+    // otherwise fetchRewind() returns the archive to that sample.
+    bool fetchAdopt();
+    int fetchRewind(int mode, int interval);
+
+    bool late() const			// Last fetch missed its deadline
+	{ return my.late; }
+
     struct timeval const& timeStamp() const
 	{ return my.currentTime; }
 
@@ -100,12 +120,18 @@ private:
 	QHash<QString, pmID> nameCache;	// Reverse map from names to PMIDs
 	QHash<pmID, QString*> pmidCache;// Mapping between PMIDs and names
 	QHash<pmID, QmcDesc*> descCache;// Mapping between PMIDs and descs
-	QList<pmID> pmids;		// List of valid PMIDs to be fetched
+	QVector<pmID> pmids;		// List of valid PMIDs to be fetched
+	QHash<pmID, int> pmidIndex;	// Position of each PMID in pmids
 	QList<QmcIndom*> indoms;	// List of requested indoms 
 	QList<QmcMetric*> metrics;	// List of metrics using this context
 	struct timeval currentTime;	// Time of current fetch
 	struct timeval previousTime;	// Time of previous fetch
 	double delta;			// Time between fetches
+	QVector<pmID> fetchIDs;		// Shared copy of pmids for fetch
+	pmResult *fetchResult;		// Result of current fetch
+	int fetchStatus;		// Status of current fetch
+	bool fetchTried;		// pmFetch was called
+	bool late;			// Result did not arrive in time
     } my;
 
     static QStringList *theStringList;	// List of metric names in traversal
@@ -20,6 +20,9 @@
 #include "qmc_context.h"
 #include "qmc_metric.h"
 
+#include <qrunnable.h>
+#include <qthreadpool.h>
+
 int QmcGroup::tzLocal = -1;
 bool QmcGroup::tzLocalInit = false;
 QString	QmcGroup::tzLocalString;
@@ -36,6 +39,18 @@ QmcGroup::QmcGroup(bool restrictArchives)
     my.tzUser = -1;
     my.tzGroupIndex = 0;
     my.timeEndReal = 0.0;
+    my.notifier = new QmcGroupNotifier(this);
+    my.pool = NULL;
+    my.fetchGeneration = 0;
+    my.fetchWaiting = 0;
+    my.fetchTimeout = 0;
+    my.fetchUpdate = true;
+    my.archiveModeSet = false;
+    my.archiveMode = PM_MODE_INTERP;
+    my.archiveInterval = 0;
+    my.archiveSteps = 0;
+    my.archivePrefetch = true;
+    my.prefetched = 0;
 
     // Get timezone from environment
     if (tzLocalInit == false) {
@@ -65,9 +80,31 @@ QmcGroup::QmcGroup(bool restrictArchives)
 
 QmcGroup::~QmcGroup()
 {
-    for (int i = 0; i < my.contexts.size(); i++)
-	if (my.contexts[i])
+    int busy = 0;
+
+    prefetchCancel();
+    fetchCancel();
+
+    // contexts still blocked in an asynchronous fetch cannot be deleted
+    // from under their worker threads, so they are handed to the notifier
+    // which deletes each one (and then itself and the pool) once its
+    // worker has finished, rather than waiting on a slow host here
+    for (int i = 0; i < my.contexts.size(); i++) {
+	if (my.contexts[i] == NULL)
+	    continue;
+	if (i < my.pending.size() && my.pending[i]) {
+	    my.notifier->my_orphans.insert(i, my.contexts[i]);
+	    busy++;
+	}
+	else
 	    delete my.contexts[i];
+    }
+    if (busy)
+	my.notifier->orphan(my.pool);
+    else {
+	delete my.pool;
+	delete my.notifier;
+    }
 }
 
 int
@@ -475,25 +512,348 @@ QmcGroup::fetch(bool update)
 	cerr << "QmcGroup::fetch: " << numContexts() << " contexts" << endl;
     }
 
-    for (unsigned int i = 0; i < numContexts(); i++)
-	my.contexts[i]->fetch(update);
+    // a synchronous fetch supersedes any asynchronous one in progress
+    fetchCancel();
+
+    if (my.mode == PM_CONTEXT_ARCHIVE)
+	sts = fetchArchive(update);
+    else {
+	for (unsigned int i = 0; i < numContexts(); i++) {
+	    // still blocked in an asynchronous fetch, do not wait on it
+	    if (i < (unsigned int)my.pending.size() && my.pending[i])
+		my.contexts[i]->fetchMissed(update);
+	    else
+		my.contexts[i]->fetch(update);
+	}
+	if (numContexts())
+	    sts = useContext();
+    }
+
+    if (pmDebug & DBG_TRACE_PMC) {
+	QTextStream cerr(stderr);
+	cerr << "QmcGroup::fetch: Done" << endl;
+    }
+
+    return sts;
+}
+
+//
+// One context fetched on a worker thread.  Only the pmFetch happens
+// here, the result is applied to the metrics back in the group thread.
+// Without a notifier, the group thread waits on the pool instead.
+//
+class QmcFetchTask : public QRunnable
+{
+public:
+    QmcFetchTask(QmcGroupNotifier *notifier, QmcContext *context,
+		 int index, int generation)
+    {
+	my.notifier = notifier;
+	my.context = context;
+	my.index = index;
+	my.generation = generation;
+    }
+
+    void run()
+    {
+	my.context->fetchValues();
+	if (my.notifier == NULL)
+	    return;
+	QMetaObject::invokeMethod(my.notifier, "contextFetched",
+				  Qt::QueuedConnection,
+				  Q_ARG(int, my.index),
+				  Q_ARG(int, my.generation));
+    }
+
+private:
+    struct {
+	QmcGroupNotifier *notifier;
+	QmcContext *context;
+	int index;
+	int generation;
+    } my;
+};
+
+int
+QmcGroup::fetchAsync(bool update)
+{
+    int count = 0;
+
+    if (pmDebug & DBG_TRACE_PMC) {
+	QTextStream cerr(stderr);
+	cerr << "QmcGroup::fetchAsync: " << numContexts() << " contexts" << endl;
+    }
+
+    prefetchCancel();
 
+    // previous fetch still outstanding, mark those contexts late now
+    if (my.fetchWaiting > 0)
+	fetchExpired();
+
+    // live contexts spend their time waiting on pmcd, so use a thread
+    // for each rather than one per CPU
+    threadPool();
+    if (my.pool->maxThreadCount() < (int)numContexts())
+	my.pool->setMaxThreadCount(numContexts());
+
+    my.fetchGeneration++;
+    my.fetchUpdate = update;
+    my.pending.resize(numContexts());
+
+    for (unsigned int i = 0; i < numContexts(); i++) {
+	QmcContext *cp = my.contexts[i];
+
+	// still blocked in an earlier fetch, do not queue up behind it
+	if (my.pending[i]) {
+	    cp->fetchMissed(update);
+	    continue;
+	}
+	cp->fetchSetup();
+	my.pending[i] = my.fetchGeneration;
+	my.pool->start(new QmcFetchTask(my.notifier, cp, i, my.fetchGeneration));
+	count++;
+    }
+
+    my.fetchWaiting = count;
+    if (count == 0)
+	QMetaObject::invokeMethod(my.notifier, "complete", Qt::QueuedConnection);
+    else if (my.fetchTimeout > 0)
+	my.notifier->my_timer.start(my.fetchTimeout);
+
+    return count;
+}
+
+void
+QmcGroup::fetchDone(int index, int generation)
+{
+    if (index >= my.pending.size() || my.pending[index] != generation)
+	return;		// cancelled, see fetchCancel()
+    my.pending[index] = 0;
+
+    QmcContext *cp = my.contexts[index];
+    if (generation != my.fetchGeneration || my.fetchWaiting == 0) {
+	// arrived too late, the context has already been marked as such
+	if (pmDebug & DBG_TRACE_PMC) {
+	    QTextStream cerr(stderr);
+	    cerr << "QmcGroup::fetchDone: discarding late result for context "
+		 << index << endl;
+	}
+	cp->fetchDiscard();
+	return;
+    }
+
+    cp->fetchFinish(my.fetchUpdate);
+    if (--my.fetchWaiting == 0)
+	fetchComplete();
+}
+
+void
+QmcGroup::fetchExpired()
+{
+    for (int i = 0; i < my.pending.size(); i++)
+	if (my.pending[i] == my.fetchGeneration)
+	    my.contexts[i]->fetchMissed(my.fetchUpdate);
+    fetchComplete();
+}
+
+void
+QmcGroup::fetchComplete()
+{
+    int sts = 0;
+
+    my.notifier->my_timer.stop();
+    my.fetchWaiting = 0;
     if (numContexts())
 	sts = useContext();
 
     if (pmDebug & DBG_TRACE_PMC) {
 	QTextStream cerr(stderr);
-	cerr << "QmcGroup::fetch: Done" << endl;
+	cerr << "QmcGroup::fetchAsync: Done" << endl;
     }
 
+    my.notifier->finish(sts);
+}
+
+//
+// Abandon any asynchronous fetch in progress, without waiting for it.
+// Contexts still being fetched stay pending until their worker threads
+// return, and as the fetch generation has moved on their results are
+// then discarded by fetchDone().
+//
+void
+QmcGroup::fetchCancel()
+{
+    my.notifier->my_timer.stop();
+    if (my.fetchWaiting > 0)
+	my.fetchGeneration++;
+    my.fetchWaiting = 0;
+}
+
+QThreadPool *
+QmcGroup::threadPool()
+{
+    if (my.pool == NULL)
+	my.pool = new QThreadPool();
+    return my.pool;
+}
+
+//
+// Archive replay.  Each archive context is positioned independently,
+// so the pmFetch calls (log reads and interpolation) for all contexts
+// run side by side, and the results - all for the same sample time -
+// are then applied in context order as for a serial fetch.
+//
+int
+QmcGroup::fetchArchive(bool update)
+{
+    unsigned int i, start = 0;
+    int sts = 0;
+
+    if (my.prefetched > 0) {
+	my.pool->waitForDone();
+	for (i = 0; i < (unsigned int)my.prefetched; i++) {
+	    QmcContext *cp = my.contexts[i];
+	    if (cp->fetchAdopt())
+		continue;
+	    if (pmDebug & DBG_TRACE_PMC) {
+		QTextStream cerr(stderr);
+		cerr << "QmcGroup::fetch: prefetch for context " << i
+		     << " is stale, fetching again" << endl;
+	    }
+	    cp->fetchRewind(my.archiveMode, my.archiveInterval);
+	    cp->fetchSetup();
+	    cp->fetchValues();
+	}
+	start = my.prefetched;
+	my.prefetched = 0;
+    }
+
+    // any contexts not fetched ahead of time (possibly all of them)
+    for (i = start; i < numContexts(); i++)
+	my.contexts[i]->fetchSetup();
+    if (numContexts() - start == 1)
+	my.contexts[start]->fetchValues();
+    else if (numContexts() > start) {
+	QThreadPool *pool = threadPool();
+	for (i = start; i < numContexts(); i++)
+	    pool->start(new QmcFetchTask(NULL, my.contexts[i], i, 0));
+	pool->waitForDone();
+    }
+
+    for (i = 0; i < numContexts(); i++)
+	my.contexts[i]->fetchFinish(update);
+    if (numContexts())
+	sts = useContext();
+
+    // stepping through the archives, so start on the next sample
+    if (my.archivePrefetch && my.archiveModeSet && my.archiveSteps++ > 0)
+	prefetchStart();
+
     return sts;
 }
 
+void
+QmcGroup::prefetchStart()
+{
+    QThreadPool *pool = threadPool();
+
+    for (unsigned int i = 0; i < numContexts(); i++) {
+	QmcContext *cp = my.contexts[i];
+	cp->fetchSetup(true);
+	pool->start(new QmcFetchTask(NULL, cp, i, 0));
+    }
+    my.prefetched = numContexts();
+
+    if (pmDebug & DBG_TRACE_PMC) {
+	QTextStream cerr(stderr);
+	cerr << "QmcGroup::prefetchStart: " << my.prefetched
+	     << " contexts" << endl;
+    }
+}
+
+void
+QmcGroup::prefetchCancel()
+{
+    if (my.prefetched == 0)
+	return;
+    my.pool->waitForDone();
+    for (int i = 0; i < my.prefetched; i++)
+	my.contexts[i]->fetchRewind(my.archiveMode, my.archiveInterval);
+    my.prefetched = 0;
+}
+
+void
+QmcGroup::setArchivePrefetch(bool prefetch)
+{
+    my.archivePrefetch = prefetch;
+    if (!prefetch)
+	prefetchCancel();
+}
+
+QmcGroupNotifier::QmcGroupNotifier(QmcGroup *group) : QObject()
+{
+    my_group = group;
+    my_pool = NULL;
+    my_timer.setSingleShot(true);
+    connect(&my_timer, SIGNAL(timeout()), this, SLOT(timeout()));
+}
+
+void
+QmcGroupNotifier::contextFetched(int index, int generation)
+{
+    if (my_group != NULL) {
+	my_group->fetchDone(index, generation);
+	return;
+    }
+
+    // the group has gone, tidy up after the last of its workers
+    delete my_orphans.take(index);
+    if (my_orphans.isEmpty()) {
+	if (my_pool != NULL)
+	    my_pool->deleteLater();
+	deleteLater();
+    }
+}
+
+void
+QmcGroupNotifier::timeout()
+{
+    if (my_group != NULL && my_group->my.fetchWaiting > 0)
+	my_group->fetchExpired();
+}
+
+void
+QmcGroupNotifier::complete()
+{
+    if (my_group != NULL && my_group->my.fetchWaiting == 0)
+	my_group->fetchComplete();
+}
+
+void
+QmcGroupNotifier::orphan(QThreadPool *pool)
+{
+    my_group = NULL;
+    my_pool = pool;
+    my_timer.stop();
+}
+
 int
 QmcGroup::setArchiveMode(int mode, const struct timeval *when, int interval)
 {
     int sts, result = 0;
 
+    // the sample fetched ahead is no longer the next one wanted
+    if (my.prefetched > 0) {
+	my.pool->waitForDone();
+	for (int i = 0; i < my.prefetched; i++)
+	    my.contexts[i]->fetchDiscard();
+	my.prefetched = 0;
+    }
+    my.archiveModeSet = true;
+    my.archiveMode = mode;
+    my.archiveInterval = interval;
+    my.archiveSteps = 0;
+
     for (unsigned int i = 0; i < numContexts(); i++) {
 	if (my.contexts[i]->source().type() != PM_CONTEXT_ARCHIVE)
 	    continue;
@@ -15,8 +15,49 @@
 #include "qmc_context.h"
 
 #include <qlist.h>
+#include <qmap.h>
+#include <qobject.h>
 #include <qstring.h>
 #include <qtextstream.h>
+#include <qtimer.h>
+#include <qvector.h>
+
+class QThreadPool;
+class QmcGroup;
+
+//
+// Delivers completion of asynchronous group fetches (QmcGroup::fetchAsync)
+// back to the thread owning the group, normally the GUI thread.
+//
+class QmcGroupNotifier : public QObject
+{
+    Q_OBJECT
+
+public:
+    QmcGroupNotifier(QmcGroup *group);
+
+    void finish(int sts) { emit fetched(sts); }
+
+Q_SIGNALS:
+    // Every context has either been fetched or marked late
+    void fetched(int sts);
+
+private Q_SLOTS:
+    void contextFetched(int index, int generation);
+    void timeout();
+    void complete();
+
+private:
+    // Group destroyed while some of its contexts were still being fetched
+    void orphan(QThreadPool *pool);
+
+    QmcGroup *my_group;
+    QTimer my_timer;
+    QThreadPool *my_pool;		// Owned once orphaned
+    QMap<int, QmcContext *> my_orphans;	// Contexts awaiting their workers
+
+    friend class QmcGroup;
+};
 
 class QmcGroup
 {
@@ -53,7 +94,25 @@ public:
 
     // Fetch all the metrics in this group
     // By default, do all rate conversions and counter wraps
+    // Archive contexts are fetched in parallel, on worker threads, and
+    // once fetches follow one another with no change of archive mode
+    // the next sample is fetched ahead while the caller uses this one.
+    // Live contexts still busy with an asynchronous fetch are marked
+    // late rather than waited on.
     int fetch(bool update = true);
+    void setArchivePrefetch(bool prefetch);
+
+    // Fetch all the metrics in this group without blocking the caller.
+    // Each context is fetched on a worker thread and the results are
+    // applied in the calling thread (via its event loop), after which
+    // notifier() emits fetched().  Contexts still outstanding when the
+    // fetch timeout (msec, zero for none) expires, or when the next
+    // asynchronous fetch starts, are marked late rather than waited on.
+    // Returns the number of contexts being fetched.
+    int fetchAsync(bool update = true);
+    bool fetchPending() const { return my.fetchWaiting > 0; }
+    void setFetchTimeout(int msec) { my.fetchTimeout = msec; }
+    QmcGroupNotifier *notifier() const { return my.notifier; }
 
     // Set the archive position and mode
     int setArchiveMode(int mode, const struct timeval *when, int interval);
@@ -89,6 +148,21 @@ private:
 	struct timeval timeStart;	// Start of first archive
 	struct timeval timeEnd;		// End of last archive
 	double timeEndReal;		// End of last archive
+
+	QmcGroupNotifier *notifier;	// Async fetch completion signals
+	QThreadPool *pool;		// Async fetch worker threads
+	QVector<int> pending;		// Fetch generation in flight, per context
+	int fetchGeneration;		// Current async fetch
+	int fetchWaiting;		// Contexts yet to report back
+	int fetchTimeout;		// msec before contexts are marked late
+	bool fetchUpdate;		// Rate conversion for async fetch
+
+	bool archiveModeSet;		// setArchiveMode() has been called
+	int archiveMode;		// Arguments to the last setArchiveMode()
+	int archiveInterval;
+	int archiveSteps;		// Fetches since setArchiveMode()
+	bool archivePrefetch;		// Fetch ahead when stepping
+	int prefetched;			// Contexts fetched ahead, if any
     } my;
 
     // Timezone for localhost from environment
@@ -98,6 +172,18 @@ private:
     static QString localHost;	// name of localhost
 
     int useContext();
+
+    void fetchDone(int index, int generation);
+    void fetchExpired();
+    void fetchComplete();
+    void fetchCancel();
+
+    QThreadPool *threadPool();
+    int fetchArchive(bool update);
+    void prefetchStart();
+    void prefetchCancel();
+
+    friend class QmcGroupNotifier;
 };
 
 #endif	// QMC_GROUP_H
@@ -621,6 +621,7 @@ QmcMetric::extractValues(pmValueSet const* set)
     pmValue const *value = NULL;
     bool found;
     QmcIndom *indomPtr = indom();
+    QHash<int, int> positions;	// instance to vlist index, if needed
 
     Q_ASSERT(set->pmid == desc().id());
 
@@ -655,9 +656,18 @@ QmcMetric::extractValues(pmValueSet const* set)
 			found = true;
 		}
 
-		// Search for it from the top
-		for (j = 0; found == false && j < set->numval; j++) {
-		    if (set->vlist[j].inst == indomPtr->inst(inst)) {
+		// Otherwise look it up by instance, hashing the result
+		// instances the first time one is out of place - result
+		// order need not match the indom, so searching from the
+		// top each time would be quadratic in the instance count
+		if (found == false) {
+		    if (positions.isEmpty()) {
+			positions.reserve(set->numval);
+			for (j = set->numval - 1; j >= 0; j--)	// first wins
+			    positions.insert(set->vlist[j].inst, j);
+		    }
+		    j = positions.value(indomPtr->inst(inst), -1);
+		    if (j >= 0) {
 			index = j;
 			value = &(set->vlist[j]);
 			indomPtr->setIndex(inst, j);
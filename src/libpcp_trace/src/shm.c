@@ -0,0 +1,306 @@
+/*
+ * shm.c - shared memory transport for trace points
+ *
+ * Copyright (c) 2015 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <sys/stat.h>
+#include "pmapi.h"
+#include "impl.h"
+#include "trace.h"
+#include "trace_dev.h"
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE___THREAD) && \
+    defined(__GNUC__) && !defined(IS_MINGW)
+#include <pthread.h>
+
+/*
+ * Writers only need their stores to become visible in order, readers
+ * (pmdatrace) pair these with acquire ordering on the seq field.
+ */
+#if defined(__ATOMIC_RELEASE)
+#define SHM_STORE_RELEASE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define SHM_FENCE_RELEASE()	__atomic_thread_fence(__ATOMIC_RELEASE)
+#else
+#define SHM_STORE_RELEASE(p, v)	(__sync_synchronize(), *(p) = (v))
+#define SHM_FENCE_RELEASE()	__sync_synchronize()
+#endif
+
+static int			shmenv = -1;	/* PCP_TRACE_SHM set? */
+static int			shmfailed;	/* setup failed, use PDUs */
+static int			shmgen;		/* bumped in fork children */
+static char			*shmaddr;
+static size_t			shmsize;
+static char			shmpath[MAXPATHLEN];
+static const __pmTraceShmEpoch	*shmepoch;
+static const __pmTraceShmEpoch	noepoch;
+static pthread_key_t		shmkey;
+static pthread_mutex_t		shmlock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Initial-exec avoids a __tls_get_addr call per trace point - the few
+ * bytes needed fit in the static TLS surplus even when dlopen'd.
+ */
+#define SHM_TLS	__thread __attribute__((tls_model("initial-exec")))
+static SHM_TLS __pmTraceShmSlot	*myslot;
+static SHM_TLS int		mygen = -1;
+
+static void
+shmepochmap(void)
+{
+    struct stat		sbuf;
+    char		path[MAXPATHLEN];
+    void		*addr;
+    int			fd, sep = __pmPathSeparator();
+
+    snprintf(path, sizeof(path), "%s%c" TRACE_SHM_DIR "%c" TRACE_SHM_EPOCH,
+		pmGetConfig("PCP_TMP_DIR"), sep, sep);
+    if ((fd = open(path, O_RDONLY)) < 0)
+	return;
+    if (fstat(fd, &sbuf) == 0 && sbuf.st_size >= sizeof(__pmTraceShmEpoch) &&
+	(addr = __pmMemoryMap(fd, sizeof(__pmTraceShmEpoch), 0)) != NULL) {
+	if (((__pmTraceShmEpoch *)addr)->magic == TRACE_SHM_MAGIC)
+	    shmepoch = (__pmTraceShmEpoch *)addr;
+	else
+	    __pmMemoryUnmap(addr, sizeof(__pmTraceShmEpoch));
+    }
+    close(fd);
+}
+
+/* release the slot of an exiting thread, for reuse by the next one */
+static void
+shmrelease(void *arg)
+{
+    __pmTraceShmSlot	*slot = (__pmTraceShmSlot *)arg;
+
+    if (slot != NULL)
+	SHM_STORE_RELEASE(&slot->owner, 0);
+}
+
+/*
+ * pmdatrace drains the final totals of exited processes and removes
+ * their files, so only clean up here if pmdatrace has never run.
+ */
+static void
+shmexit(void)
+{
+    if (shmaddr != NULL && shmepoch == &noepoch)
+	unlink(shmpath);
+}
+
+/*
+ * The child must not share the parent's slots - forget the mapping and
+ * start afresh (with a file of its own) on the next trace call.
+ */
+static void
+shmchild(void)
+{
+    pthread_setspecific(shmkey, NULL);
+    if (shmaddr != NULL)
+	__pmMemoryUnmap(shmaddr, shmsize);
+    shmaddr = NULL;
+    shmgen++;
+    pthread_mutex_init(&shmlock, NULL);
+}
+
+static int
+shmcreate(void)
+{
+    static int		once;
+    __pmTraceShmHdr	*hdr;
+    mode_t		cur_umask;
+    void		*addr = NULL;
+    int			fd, sep = __pmPathSeparator();
+
+    if (!once) {
+	if (pthread_key_create(&shmkey, shmrelease) != 0)
+	    return -oserror();
+	pthread_atfork(NULL, NULL, shmchild);
+	atexit(shmexit);
+	once = 1;
+    }
+
+    shmsize = sizeof(__pmTraceShmHdr) +
+		TRACE_SHM_SLOTS * sizeof(__pmTraceShmSlot);
+    snprintf(shmpath, sizeof(shmpath), "%s%c" TRACE_SHM_DIR "%c%" FMT_PID,
+		pmGetConfig("PCP_TMP_DIR"), sep, sep, getpid());
+    unlink(shmpath);
+    cur_umask = umask(S_IWGRP | S_IWOTH);
+    fd = open(shmpath, O_RDWR | O_CREAT | O_EXCL, 0644);
+    umask(cur_umask);
+    if (fd < 0)
+	return -oserror();
+    if (ftruncate(fd, shmsize) == 0)
+	addr = __pmMemoryMap(fd, shmsize, 1);
+    close(fd);
+    if (addr == NULL) {
+	unlink(shmpath);
+	return -oserror();
+    }
+
+    hdr = (__pmTraceShmHdr *)addr;
+    hdr->version = TRACE_SHM_VERSION;
+    hdr->pid = getpid();
+    hdr->nslots = TRACE_SHM_SLOTS;
+    hdr->ntags = TRACE_SHM_TAGS;
+    SHM_STORE_RELEASE(&hdr->magic, TRACE_SHM_MAGIC);
+
+    if (shmepoch == NULL) {
+	shmepochmap();
+	if (shmepoch == NULL)
+	    shmepoch = &noepoch;
+    }
+
+    shmaddr = (char *)addr;
+    return 0;
+}
+
+/* find a free slot for the calling thread, mapping our file if needed */
+static __pmTraceShmSlot *
+shmclaim(void)
+{
+    __pmTraceShmSlot	*slot;
+    int			i, sts;
+
+    pthread_mutex_lock(&shmlock);
+    if (shmaddr == NULL && !shmfailed && (sts = shmcreate()) < 0) {
+#ifdef PMTRACE_DEBUG
+	if (__pmstate & PMTRACE_STATE_COMMS)
+	    fprintf(stderr, "shmclaim: cannot create %s: %s\n",
+			shmpath, pmtraceerrstr(sts));
+#endif
+	shmfailed = 1;
+    }
+    pthread_mutex_unlock(&shmlock);
+    if (shmaddr == NULL) {
+	mygen = shmgen;		/* no retry by this thread until a fork */
+	return NULL;
+    }
+
+    /* a late starting pmdatrace, else min and max never restart */
+    if (shmepoch == &noepoch)
+	shmepochmap();
+
+    mygen = shmgen;
+    slot = (__pmTraceShmSlot *)(shmaddr + sizeof(__pmTraceShmHdr));
+    for (i = 0; i < TRACE_SHM_SLOTS; i++, slot++) {
+	if (slot->owner == 0 &&
+	    __sync_bool_compare_and_swap(&slot->owner, 0, 1)) {
+	    slot->used = 1;
+	    pthread_setspecific(shmkey, slot);
+#ifdef PMTRACE_DEBUG
+	    if (__pmstate & PMTRACE_STATE_COMMS)
+		fprintf(stderr, "shmclaim: thread uses slot %d\n", i);
+#endif
+	    return myslot = slot;
+	}
+    }
+#ifdef PMTRACE_DEBUG
+    if (__pmstate & PMTRACE_STATE_COMMS)
+	fprintf(stderr, "shmclaim: all %d slots in use\n", TRACE_SHM_SLOTS);
+#endif
+    return myslot = NULL;
+}
+
+/* shared memory transport requested, via environment or pmtracestate */
+int
+__pmtraceshmmode(void)
+{
+    if (shmenv < 0)
+	shmenv = (getenv(TRACE_ENV_SHM) != NULL);
+    return shmenv || (__pmstate & PMTRACE_STATE_SHM);
+}
+
+/*
+ * Aggregate one event into the calling thread's slot.  Returns zero
+ * on success, else a negative value and the caller sends a PDU instead
+ * (shared memory transport not enabled or not available, all slots in
+ * use, or no room for another tag in this thread's slot).
+ */
+int
+__pmtraceshmrecord(const char *tag, int taglength, int type, double value)
+{
+    __pmTraceShmSlot	*slot;
+    __pmTraceShmTag	*tp;
+    __uint32_t		hash = 2166136261U, epoch;
+    int			i, probe;
+
+    if (!__pmtraceshmmode())
+	return -ENOTSUP;
+
+    if ((slot = myslot) == NULL || mygen != shmgen) {
+	if (mygen == shmgen)	/* already failed for this thread */
+	    return -ENOSPC;
+	if ((slot = shmclaim()) == NULL)
+	    return -ENOSPC;
+    }
+
+    for (i = 0; i < taglength - 1; i++) {
+	hash ^= (unsigned char)tag[i];
+	hash *= 16777619U;
+    }
+
+    i = hash & (TRACE_SHM_TAGS - 1);
+    for (probe = 0; probe < TRACE_SHM_TAGS; probe++) {
+	tp = &slot->tags[i];
+	if (tp->type == 0) {
+	    /* new tag - name before type, pmdatrace skips unused entries */
+	    memcpy(tp->tag, tag, taglength);
+	    tp->taglength = taglength;
+	    tp->hash = hash;
+	    tp->epoch = shmepoch->epoch;
+	    tp->min = tp->max = value;
+	    SHM_STORE_RELEASE(&tp->type, type);
+	    break;
+	}
+	if (tp->hash == hash && tp->type == type &&
+	    tp->taglength == taglength && memcmp(tp->tag, tag, taglength) == 0)
+	    break;
+	i = (i + 1) & (TRACE_SHM_TAGS - 1);
+    }
+    if (probe == TRACE_SHM_TAGS)
+	return -ENOSPC;
+
+    epoch = shmepoch->epoch;
+    tp->seq++;
+    SHM_FENCE_RELEASE();
+    if (tp->epoch != epoch) {
+	tp->epoch = epoch;
+	tp->min = tp->max = value;
+    }
+    else if (value < tp->min)
+	tp->min = value;
+    else if (value > tp->max)
+	tp->max = value;
+    tp->count++;
+    tp->sum += value;
+    tp->last = value;
+    SHM_STORE_RELEASE(&tp->seq, tp->seq + 1);
+    return 0;
+}
+
+#else
+
+int
+__pmtraceshmmode(void)
+{
+    return 0;
+}
+
+int
+__pmtraceshmrecord(const char *tag, int taglength, int type, double value)
+{
+    return -ENOTSUP;
+}
+
+#endif
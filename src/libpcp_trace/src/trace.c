@@ -138,7 +138,9 @@ pmtracebegin(const char *tag)
 
     protocol = __pmtraceprotocol(TRACE_PROTOCOL_QUERY);
 
-    if (_pmtimedout && (a_sts = _pmtraceconnect(1)) < 0) {
+    /* no connection needed (yet) if pmtraceend uses shared memory */
+    if (_pmtimedout &&
+	(a_sts = _pmtraceconnect(!__pmtraceshmmode())) < 0) {
 	if (first || protocol == TRACE_PROTOCOL_ASYNC)
 	    return a_sts;	/* exception to the rule */
 	a_sts = _pmtraceremaperr(a_sts);
@@ -232,6 +234,10 @@ pmtraceend(const char *tag)
 	hptr->inprogress = 0;
 	hptr->data = __pmtimevalSub(&now, &hptr->start);
 
+	if (__pmtraceshmrecord(hptr->tag, hptr->taglength,
+				TRACE_TYPE_TRANSACT, hptr->data) == 0)
+	    goto done;
+
 	if (sts >= 0 && _pmtimedout) {
 	    sts = _pmtracereconnect();
 	    sts = _pmtraceremaperr(sts);
@@ -254,6 +260,7 @@ pmtraceend(const char *tag)
 	}
     }
 
+done:
     if (TRACE_UNLOCK != 0)
 	return -oserror();
 
@@ -322,6 +329,10 @@ _pmtracecommon(const char *label, double value, int type)
 		label, type, value);
 #endif
 
+    /* aggregated in shared memory, no PDU and no lock needed */
+    if (__pmtraceshmrecord(label, taglength, type, value) == 0)
+	return 0;
+
     protocol = __pmtraceprotocol(TRACE_PROTOCOL_QUERY);
 
     if (_pmtimedout && (sts = _pmtraceconnect(1)) < 0) {
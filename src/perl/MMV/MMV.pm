@@ -22,7 +22,7 @@ require DynaLoader;
     MMV_TYPE_I32 MMV_TYPE_U32
     MMV_TYPE_I64 MMV_TYPE_U64
     MMV_TYPE_FLOAT MMV_TYPE_DOUBLE
-    MMV_TYPE_STRING MMV_TYPE_ELAPSED
+    MMV_TYPE_STRING MMV_TYPE_ELAPSED MMV_TYPE_HISTOGRAM
     MMV_COUNT_ONE
     MMV_SEM_COUNTER MMV_SEM_INSTANT MMV_SEM_DISCRETE
     MMV_SPACE_BYTE MMV_SPACE_KBYTE MMV_SPACE_MBYTE
@@ -48,7 +48,8 @@ sub MMV_TYPE_U64	{ 3; }	# 64-bit signed integer
 sub MMV_TYPE_FLOAT	{ 4; }	# 32-bit floating point
 sub MMV_TYPE_DOUBLE	{ 5; }	# 64-bit floating point
 sub MMV_TYPE_STRING	{ 6; }	# null-terminated string
-sub MMV_TYPE_ELAPSED	{ 10; }	# 64-bit elapsed time
+sub MMV_TYPE_ELAPSED	{ 9; }	# 64-bit elapsed time
+sub MMV_TYPE_HISTOGRAM	{ 10; }	# distribution of 64-bit values
 
 # units - space scale
 sub MMV_SPACE_BYTE	{ 0; }  # bytes
@@ -30,6 +30,9 @@ GroupControl::GroupControl()
     my.pmtimeState = QmcTime::StoppedState;
     memset(&my.delta, 0, sizeof(struct timeval));
     memset(&my.position, 0, sizeof(struct timeval));
+    my.fetchActive = false;
+
+    connect(notifier(), SIGNAL(fetched(int)), this, SLOT(fetched()));
 }
 
 void
@@ -326,6 +329,12 @@ GroupControl::adjustLiveWorldViewForward(QmcTime::Packet *packet)
     double tolerance = my.realDelta;
     double position = my.realPosition - (my.realDelta * my.samples);
 
+    // The current sample is fetched in the background, as for step(),
+    // and started before the time axis moves; fetched() refreshes the
+    // gadgets once it is done.
+    setFetchTimeout((int)(my.realDelta * 1000.0));
+    fetchAsync();
+
     for (i = oi = last; i >= 0; i--, position += my.realDelta) {
 	while (i > 0 && my.timeData[oi] < position + my.realDelta && oi > 0) {
 	    if (fuzzyTimeMatch(my.timeData[oi], position, tolerance) == false) {
@@ -348,10 +357,9 @@ GroupControl::adjustLiveWorldViewForward(QmcTime::Packet *packet)
 	    break;
 	}
 
-	if (i == 0) {	// refreshGadgets() finishes up last one
+	if (i == 0) {	// fetched() finishes up last one
 	    console->post("Fetching data[%d] at %s", i, timeString(position));
 	    my.timeData[i] = position;
-	    fetch();
 	}
 	else if (preserve == false) {
 #if DESPERATE
@@ -373,7 +381,7 @@ GroupControl::adjustLiveWorldViewForward(QmcTime::Packet *packet)
     bool active = isActive(packet);
     if (active)
 	newButtonState(packet->state, packet->mode, pmchart->isTabRecording());
-    refreshGadgets(active);
+    my.fetchActive = active;
 }
 
 void
@@ -548,6 +556,20 @@ GroupControl::step(QmcTime::Packet *packet)
     my.position = packet->position;
     my.realPosition = stepPosition;
 
+    //
+    // Live hosts are fetched in the background, so that a slow or
+    // unreachable host cannot stall the user interface; any that have
+    // not answered within one sample interval are marked as late and
+    // show up as missing samples.  Gadgets are refreshed from fetched()
+    // once all hosts are done.  Note that this must be started before
+    // the time axis shifts, as it will complete any previous fetch.
+    //
+    bool async = (packet->source == QmcTime::HostSource);
+    if (async) {
+	setFetchTimeout((int)(my.realDelta * 1000.0));
+	fetchAsync();
+    }
+
     int last = my.samples - 1;
     if (packet->state == QmcTime::ForwardState) { // left-to-right (all but 1st)
 	if (my.samples > 1)
@@ -560,12 +582,23 @@ GroupControl::step(QmcTime::Packet *packet)
 	my.timeData[last] = my.realPosition - torange(my.delta, last);
     }
 
-    fetch();
+    if (!async)
+	fetch();
 
     bool active = isActive(packet);
     if (isActive(packet))
 	newButtonState(packet->state, packet->mode, pmchart->isTabRecording());
-    refreshGadgets(active);
+    if (async)
+	my.fetchActive = active;
+    else
+	refreshGadgets(active);
+}
+
+void
+GroupControl::fetched()
+{
+    console->post(PmChart::DebugProtocol, "GroupControl::fetched");
+    refreshGadgets(my.fetchActive);
 }
 
 void
@@ -66,6 +66,9 @@ public Q_SLOTS:
     void timeSelectionReactive(Gadget *, int);
     void timeSelectionInactive(Gadget *);
 
+private Q_SLOTS:
+    void fetched();
+
 private:
     typedef enum {
 	StartState,
@@ -101,6 +104,7 @@ private:
 	QmcTime::Source pmtimeSource;	// reliable archive/host test
 	QmcTime::State pmtimeState;
 	State timeState;
+	bool fetchActive;		// refresh pending async fetch
     } my;
 };
 
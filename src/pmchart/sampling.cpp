@@ -18,6 +18,7 @@
 #include "main.h"
 #include <qnumeric.h>
 #include <qwt_picker_machine.h>
+#include <qwt_scale_map.h>
 
 SamplingItem::SamplingItem(Chart *parent,
 	QmcMetric *mp, pmMetricSpec *msp, pmDesc *dp,
@@ -29,10 +30,7 @@ SamplingItem::SamplingItem(Chart *parent,
     my.chart = parent;
     my.info = QString::null;
 
-    // initialize the pcp data and item data arrays
-    my.dataCount = 0;
-    my.data = NULL;
-    my.itemData = NULL;
+    // initialize the pcp data and item data store
     resetValues(samples, 0.0, 0.0);
 
     // set base scale, then tweak if value to plot is time / time
@@ -47,6 +45,8 @@ SamplingItem::SamplingItem(Chart *parent,
 
     // create and attach the plot right here
     my.curve = new SamplingCurve(label());
+    my.series = new SamplingData(&my.store);
+    my.curve->setSamplingData(my.series);	// curve owns the series from here
     my.curve->attach(parent);
 
     // the 1000 is arbitrary ... just want numbers to be monotonic
@@ -56,10 +56,6 @@ SamplingItem::SamplingItem(Chart *parent,
 
 SamplingItem::~SamplingItem(void)
 {
-    if (my.data != NULL)
-	free(my.data);
-    if (my.itemData != NULL)
-	free(my.itemData);
 }
 
 QwtPlotItem *
@@ -77,43 +73,33 @@ SamplingItem::curve(void)
 void
 SamplingItem::resetValues(int values, double, double)
 {
-    size_t size;
-
-    // Reset sizes of pcp data array and the plot data array
-    size = values * sizeof(my.data[0]);
-    if ((my.data = (double *)realloc(my.data, size)) == NULL)
-	nomem();
-    size = values * sizeof(my.itemData[0]);
-    if ((my.itemData = (double *)realloc(my.itemData, size)) == NULL)
-	nomem();
-    if (my.dataCount > values)
-	my.dataCount = values;
+    // Reset size of the pcp data and plot data store
+    my.store.resize(values);
 }
 
 void
 SamplingItem::preserveSample(int index, int oldindex)
 {
-    if (my.dataCount > oldindex)
-	my.itemData[index] = my.data[index] = my.data[oldindex];
+    if (my.store.count() > oldindex)
+	my.store.itemData(index) = my.store.data(index) = my.store.data(oldindex);
     else
-	my.itemData[index] = my.data[index] = qQNaN();
+	my.store.itemData(index) = my.store.data(index) = qQNaN();
 }
 
 void
 SamplingItem::punchoutSample(int index)
 {
-    my.data[index] = my.itemData[index] = qQNaN();
+    my.store.data(index) = my.store.itemData(index) = qQNaN();
 }
 
 void
 SamplingItem::updateValues(bool forward,
-		bool rateConvert, pmUnits *units, int sampleHistory, int,
+		bool rateConvert, pmUnits *units, int, int,
 		double, double, double)
 {
     pmAtomValue	scaled, raw;
     QmcMetric	*metric = ChartItem::my.metric;
     double	value;
-    int		sz;
 
     if (metric->numValues() < 1 || metric->error(0)) {
 	value = qQNaN();
@@ -124,23 +110,11 @@ SamplingItem::updateValues(bool forward,
 	value = scaled.d * my.scale;
     }
 
-    if (my.dataCount < sampleHistory)
-	sz = qMax(0, (int)(my.dataCount * sizeof(double)));
+    // the store holds sampleHistory values, see resetValues()
+    if (forward)
+	my.store.addFirst(value);
     else
-	sz = qMax(0, (int)((my.dataCount - 1) * sizeof(double)));
-
-    if (forward) {
-	memmove(&my.data[1], &my.data[0], sz);
-	memmove(&my.itemData[1], &my.itemData[0], sz);
-	my.data[0] = value;
-    } else {
-	memmove(&my.data[0], &my.data[1], sz);
-	memmove(&my.itemData[0], &my.itemData[1], sz);
-	my.data[my.dataCount - 1] = value;
-    }
-
-    if (my.dataCount < sampleHistory)
-	my.dataCount++;
+	my.store.addLast(value);
 }
 
 void
@@ -152,16 +126,16 @@ SamplingItem::rescaleValues(pmUnits *new_units)
     console->post("Chart::update change units from %s to %s",
 			pmUnitsStr(old_units), pmUnitsStr(new_units));
 
-    for (int i = my.dataCount - 1; i >= 0; i--) {
-	if (my.data[i] != qQNaN()) {
-	    old_av.d = my.data[i];
+    for (int i = my.store.count() - 1; i >= 0; i--) {
+	if (my.store.data(i) != qQNaN()) {
+	    old_av.d = my.store.data(i);
 	    pmConvScale(PM_TYPE_DOUBLE, &old_av, old_units, &new_av, new_units);
-	    my.data[i] = new_av.d;
+	    my.store.data(i) = new_av.d;
 	}
-	if (my.itemData[i] != qQNaN()) {
-	    old_av.d = my.itemData[i];
+	if (my.store.itemData(i) != qQNaN()) {
+	    old_av.d = my.store.itemData(i);
 	    pmConvScale(PM_TYPE_DOUBLE, &old_av, old_units, &new_av, new_units);
-	    my.itemData[i] = new_av.d;
+	    my.store.itemData(i) = new_av.d;
 	}
     }
 }
@@ -169,8 +143,9 @@ SamplingItem::rescaleValues(pmUnits *new_units)
 void
 SamplingItem::replot(int history, double *timeData)
 {
-    int count = qMin(history, my.dataCount);
-    my.curve->setRawSamples(timeData, my.itemData, count);
+    int count = qMin(history, my.store.count());
+    my.series->setSamples(timeData, count);
+    my.curve->itemChanged();
 }
 
 void
@@ -284,21 +259,21 @@ void
 SamplingItem::copyRawDataPoint(int index)
 {
     if (index < 0)
-	index = my.dataCount - 1;
-    my.itemData[index] = my.data[index];
+	index = my.store.count() - 1;
+    my.store.itemData(index) = my.store.data(index);
 }
 
 int
 SamplingItem::maximumDataCount(int maximum)
 {
-    return qMax(maximum, my.dataCount);
+    return qMax(maximum, my.store.count());
 }
 
 void
 SamplingItem::truncateData(int offset)
 {
-    for (int index = my.dataCount + 1; index < offset; index++) {
-	my.data[index] = 0;
+    for (int index = my.store.count() + 1; index < offset; index++) {
+	my.store.data(index) = 0;
 	// don't re-set dataCount ... so we don't plot these values,
 	// we just want them to count 0 towards any Stack aggregation
     }
@@ -308,48 +283,49 @@ double
 SamplingItem::sumData(int index, double sum)
 {
     if (index < 0)
-	index = my.dataCount - 1;
-    if (index < my.dataCount && !qIsNaN(my.data[index]))
-	sum += my.data[index];
+	index = my.store.count() - 1;
+    if (index < my.store.count() && !qIsNaN(my.store.data(index)))
+	sum += my.store.data(index);
     return sum;
 }
 
 void
-SamplingItem::copyRawDataArray(void)
+SamplingItem::copyRawDataArray(int count)
 {
-    for (int index = 0; index < my.dataCount; index++)
-	my.itemData[index] = my.data[index];
+    count = qMin(count, my.store.count());
+    for (int index = 0; index < count; index++)
+	my.store.itemData(index) = my.store.data(index);
 }
 
 void
 SamplingItem::copyDataPoint(int index)
 {
-    if (hidden() || index >= my.dataCount)
-	my.itemData[index] = qQNaN();
+    if (hidden() || index >= my.store.count())
+	my.store.itemData(index) = qQNaN();
     else
-	my.itemData[index] = my.data[index];
+	my.store.itemData(index) = my.store.data(index);
 }
 
 void
 SamplingItem::setPlotUtil(int index, double sum)
 {
     if (index < 0)
-	index = my.dataCount - 1;
+	index = my.store.count() - 1;
     if (hidden() || sum == 0.0 ||
-	index >= my.dataCount || qIsNaN(my.data[index]))
-	my.itemData[index] = qQNaN();
+	index >= my.store.count() || qIsNaN(my.store.data(index)))
+	my.store.itemData(index) = qQNaN();
     else
-	my.itemData[index] = 100.0 * my.data[index] / sum;
+	my.store.itemData(index) = 100.0 * my.store.data(index) / sum;
 }
 
 double
 SamplingItem::setPlotStack(int index, double sum)
 {
     if (index < 0)
-	index = my.dataCount - 1;
-    if (!hidden() && !qIsNaN(my.itemData[index])) {
-	sum += my.itemData[index];
-	my.itemData[index] = sum;
+	index = my.store.count() - 1;
+    if (!hidden() && !qIsNaN(my.store.itemData(index))) {
+	sum += my.store.itemData(index);
+	my.store.itemData(index) = sum;
     }
     return sum;
 }
@@ -358,17 +334,240 @@ double
 SamplingItem::setDataStack(int index, double sum)
 {
     if (index < 0)
-	index = my.dataCount - 1;
-    if (hidden() || qIsNaN(my.data[index])) {
-	my.itemData[index] = qQNaN();
+	index = my.store.count() - 1;
+    if (hidden() || qIsNaN(my.store.data(index))) {
+	my.store.itemData(index) = qQNaN();
     } else {
-	sum += my.data[index];
-	my.itemData[index] = sum;
+	sum += my.store.data(index);
+	my.store.itemData(index) = sum;
     }
     return sum;
 }
 
 
+//
+// SamplingStore keeps sample history in a ring, rather than shifting
+// every value along by one position as each new sample arrives.
+//
+
+SamplingStore::SamplingStore()
+{
+    my.data = NULL;
+    my.itemData = NULL;
+    my.size = 0;
+    my.head = 0;
+    my.count = 0;
+}
+
+SamplingStore::~SamplingStore()
+{
+    if (my.data != NULL)
+	free(my.data);
+    if (my.itemData != NULL)
+	free(my.itemData);
+}
+
+void
+SamplingStore::resize(int size)
+{
+    double	*raw, *plot;
+    int		keep = qMin(size, my.size);
+
+    if (size == my.size)
+	return;
+
+    // unwind the ring into new arrays, most recent sample first
+    if ((raw = (double *)malloc(size * sizeof(double))) == NULL)
+	nomem();
+    if ((plot = (double *)malloc(size * sizeof(double))) == NULL)
+	nomem();
+    for (int i = 0; i < keep; i++) {
+	raw[i] = my.data[offset(i)];
+	plot[i] = my.itemData[offset(i)];
+    }
+    for (int i = keep; i < size; i++)
+	raw[i] = plot[i] = qQNaN();
+
+    if (my.data != NULL)
+	free(my.data);
+    if (my.itemData != NULL)
+	free(my.itemData);
+    my.data = raw;
+    my.itemData = plot;
+    my.size = size;
+    my.head = 0;
+    if (my.count > size)
+	my.count = size;
+}
+
+//
+// New most recent sample (time moving forward) - once the store is
+// full, the oldest sample is overwritten.
+//
+void
+SamplingStore::addFirst(double value)
+{
+    if (my.size == 0)
+	return;
+    my.head = (my.head == 0) ? my.size - 1 : my.head - 1;
+    my.data[my.head] = value;
+    if (my.count < my.size)
+	my.count++;
+}
+
+//
+// New oldest sample (time moving backward) - the most recent sample
+// is dropped, and the new value becomes the last one.
+//
+void
+SamplingStore::addLast(double value)
+{
+    if (my.size == 0)
+	return;
+    if (my.count == 0) {
+	addFirst(value);
+	return;
+    }
+    my.head = (my.head == my.size - 1) ? 0 : my.head + 1;
+    data(my.count - 1) = value;
+    if (my.count < my.size)
+	my.count++;
+}
+
+
+//
+// SamplingData points the Qwt curve at the visible part of the store.
+//
+
+SamplingData::SamplingData(const SamplingStore *store)
+{
+    my.store = store;
+    my.x = NULL;
+    my.count = 0;
+    my.drawing = false;
+    my.decimated = false;
+    my.valid = false;
+    my.s1 = my.s2 = my.p1 = my.p2 = 0.0;
+    my.pixels = 0;
+}
+
+void
+SamplingData::setSamples(const double *timeData, int count)
+{
+    my.x = timeData;
+    my.count = count;
+    my.decimated = false;
+    my.valid = false;
+    d_boundingRect = QRectF(0.0, 0.0, -1.0, -1.0);	// recalculate
+}
+
+//
+// Reduce the samples to at most four points per pixel column, if there
+// are enough of them to make it worthwhile.  Columns holding no values
+// at all become a single NaN point, so gaps in the data still show.
+// Returns true if the decimated points should be drawn.
+//
+bool
+SamplingData::decimate(const QwtScaleMap &xMap, int pixels) const
+{
+    if (my.valid && my.pixels == pixels &&
+	my.s1 == xMap.s1() && my.s2 == xMap.s2() &&
+	my.p1 == xMap.p1() && my.p2 == xMap.p2())
+	return my.decimated;
+
+    my.valid = true;
+    my.pixels = pixels;
+    my.s1 = xMap.s1();
+    my.s2 = xMap.s2();
+    my.p1 = xMap.p1();
+    my.p2 = xMap.p2();
+
+    if (pixels <= 0 || my.count <= pixels * 4) {
+	my.decimated = false;
+	my.points.clear();
+	my.index.clear();
+	return false;
+    }
+
+    my.points.resize(0);
+    my.points.reserve(pixels * 4 + 8);
+    my.index.resize(0);
+    my.index.reserve(pixels * 4 + 8);
+
+    int first = 0;
+    while (first < my.count) {
+	// extent of this column, off-canvas samples share the edge columns
+	double column = floor(xMap.transform(my.x[first]));
+	column = qBound(my.p1 - 1.0, column, my.p2 + 1.0);
+
+	int last = first, lo = -1, hi = -1, start = -1, end = -1;
+	double min = 0.0, max = 0.0;
+	for (; last < my.count; last++) {
+	    double x = floor(xMap.transform(my.x[last]));
+	    x = qBound(my.p1 - 1.0, x, my.p2 + 1.0);
+	    if (x != column)
+		break;
+	    double y = my.store->itemValue(last);
+	    if (qIsNaN(y))
+		continue;
+	    if (start < 0) {
+		start = lo = hi = last;
+		min = max = y;
+	    }
+	    else if (y < min) {
+		lo = last;
+		min = y;
+	    }
+	    else if (y > max) {
+		hi = last;
+		max = y;
+	    }
+	    end = last;
+	}
+
+	if (start < 0) {
+	    my.points.append(QPointF(my.x[first], qQNaN()));
+	    my.index.append(first);
+	}
+	else {
+	    // emit in sample order, skipping any repeated indices
+	    int order[4] = { start, qMin(lo, hi), qMax(lo, hi), end };
+	    int previous = -1;
+	    for (int i = 0; i < 4; i++) {
+		if (order[i] == previous)
+		    continue;
+		my.points.append(rawSample(order[i]));
+		my.index.append(order[i]);
+		previous = order[i];
+	    }
+	}
+	first = last;
+    }
+
+    my.decimated = true;
+    return true;
+}
+
+//
+// First decimated point taken from the given sample or a later one, so
+// a range of samples maps onto the points drawn in their place.
+//
+int
+SamplingData::decimatedIndex(int index) const
+{
+    return qLowerBound(my.index.begin(), my.index.end(), index) -
+		my.index.begin();
+}
+
+QRectF
+SamplingData::boundingRect() const
+{
+    if (d_boundingRect.width() < 0)
+	d_boundingRect = qwtBoundingRect(*this);
+    return d_boundingRect;
+}
+
+
 //
 // SamplingCurve deals with overriding some QwtPlotCurve defaults;
 // particularly around dealing with empty sections of chart (NaN),
@@ -382,17 +581,32 @@ SamplingCurve::drawSeries(QPainter *p,
 {
     int okFrom, okTo = from;
     int size = (to > 0) ? to : dataSize();
+    bool decimated = false;
+
+    // long histories are drawn from a few points per pixel column,
+    // chosen here once and used by every sample() during this draw
+    if (my.series) {
+	decimated = my.series->decimate(xMap, (int)canvasRect.width());
+	if (decimated) {
+	    okTo = my.series->decimatedIndex(from);
+	    size = my.series->decimatedIndex(size);
+	}
+	my.series->setDrawing(decimated);
+    }
 
     while (okTo < size) {
 	okFrom = okTo;
-	while (qIsNaN(sample(okFrom).y()) && okFrom < size)
+	while (okFrom < size && qIsNaN(sample(okFrom).y()))
 	    ++okFrom;
 	okTo = okFrom;
-	while (!qIsNaN(sample(okTo).y()) && okTo < size)
+	while (okTo < size && !qIsNaN(sample(okTo).y()))
 	    ++okTo;
 	if (okFrom < size)
 	    QwtPlotCurve::drawSeries(p, xMap, yMap, canvasRect, okFrom, okTo-1);
     }
+
+    if (my.series)
+	my.series->setDrawing(false);
 }
 
 
@@ -776,17 +990,20 @@ SamplingEngine::replot(void)
     for (i = 0; i < itemCount; i++)
 	samplingItem(i)->replot(vh, vp);
 
+    // Only the visible points are recomputed - everything older is out
+    // of sight, and is refreshed here if it ever comes back into view.
     switch (my.chart->style()) {
 	case Chart::BarStyle:
 	case Chart::AreaStyle:
 	case Chart::LineStyle:
 	    for (i = 0; i < itemCount; i++)
-		samplingItem(i)->copyRawDataArray();
+		samplingItem(i)->copyRawDataArray(vh);
 	    break;
 
 	case Chart::UtilisationStyle:
 	    for (i = 0; i < itemCount; i++)
 		maxCount = samplingItem(i)->maximumDataCount(maxCount);
+	    maxCount = qMin(maxCount, vh);
 	    for (m = 0; m < maxCount; m++) {
 		sum = 0.0;
 		for (i = 0; i < itemCount; i++)
@@ -802,6 +1019,7 @@ SamplingEngine::replot(void)
 	case Chart::StackStyle:
 	    for (i = 0; i < itemCount; i++)
 		maxCount = samplingItem(i)->maximumDataCount(maxCount);
+	    maxCount = qMin(maxCount, vh);
 	    for (m = 0; m < maxCount; m++) {
 		for (i = 0; i < itemCount; i++)
 		    samplingItem(i)->copyDataPoint(m);
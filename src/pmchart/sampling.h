@@ -17,19 +17,119 @@
 #define SAMPLING_H
 
 #include <QtCore/QVariant>
+#include <QtCore/QVector>
 #include <qwt_plot.h>
 #include <qwt_plot_curve.h>
 #include <qwt_scale_engine.h>
+#include <qwt_series_data.h>
 #include "chart.h"
 
+//
+// Circular store of the sample history of one chart item - the raw
+// values as sampled, and the values plotted (after any stacking or
+// utilisation scaling).  Index zero is the most recent sample, and a
+// new sample is added at either end in constant time, no matter how
+// much history is kept.
+//
+class SamplingStore
+{
+public:
+    SamplingStore();
+    ~SamplingStore();
+
+    void resize(int);
+    int count() const { return my.count; }
+    void addFirst(double);
+    void addLast(double);
+
+    double &data(int index) { return my.data[offset(index)]; }
+    double &itemData(int index) { return my.itemData[offset(index)]; }
+    double itemValue(int index) const { return my.itemData[offset(index)]; }
+
+private:
+    int offset(int index) const
+    {
+	int i = my.head + index;
+	return i < my.size ? i : i - my.size;
+    }
+
+    struct {
+	double *data;
+	double *itemData;
+	int size;
+	int head;
+	int count;
+    } my;
+};
+
+//
+// Presents the plotted values of a SamplingStore to a Qwt curve, read
+// in place - there is no copying or reallocation on each replot, and
+// only the visible points are ever looked at.
+//
+// When there are many more points than pixel columns to draw them in,
+// the curve sees a decimated series instead: the first, minimum, maximum
+// and last value from each column, which renders identically to the
+// full series.  This is rebuilt only when the samples, time axis scale
+// or canvas size change, so drawing cost follows the chart width rather
+// than the length of the sample history.  The curve picks raw or
+// decimated points once per draw, everything else sees the raw samples.
+//
+class SamplingData : public QwtSeriesData<QPointF>
+{
+public:
+    SamplingData(const SamplingStore *store);
+
+    void setSamples(const double *timeData, int count);
+    bool decimate(const QwtScaleMap &xMap, int pixels) const;
+    int decimatedIndex(int index) const;
+    void setDrawing(bool decimated) const { my.drawing = decimated; }
+
+    size_t size(bool decimated) const
+	{ return decimated ? my.points.size() : my.count; }
+    QPointF sample(size_t i, bool decimated) const
+	{ return decimated ? my.points[i] : rawSample(i); }
+
+    virtual size_t size() const { return size(my.drawing); }
+    virtual QPointF sample(size_t i) const { return sample(i, my.drawing); }
+    virtual QRectF boundingRect() const;
+
+private:
+    QPointF rawSample(int i) const
+	{ return QPointF(my.x[i], my.store->itemValue(i)); }
+
+    struct {
+	const SamplingStore *store;
+	const double *x;
+	int count;
+
+	mutable bool drawing;		// points in use, for this draw only
+	mutable bool decimated;		// points worth using in place of samples
+	mutable bool valid;		// points match samples and scale
+	mutable QVector<QPointF> points;
+	mutable QVector<int> index;	// sample each point came from
+	mutable double s1, s2;		// time axis scale points built for
+	mutable double p1, p2;
+	mutable int pixels;
+    } my;
+};
+
 class SamplingCurve : public ChartCurve
 {
 public:
-    SamplingCurve(const QString &title) : ChartCurve(title) { }
+    SamplingCurve(const QString &title) : ChartCurve(title) { my.series = NULL; }
+
+    void setSamplingData(SamplingData *series)
+	{ my.series = series; setData(series); }
 
     virtual void drawSeries(QPainter *painter,
 		const QwtScaleMap &xMap, const QwtScaleMap &yMap,
 		const QRectF &canvasRect, int from, int to) const;
+
+private:
+    struct {
+	SamplingData *series;
+    } my;
 };
 
 class SamplingItem : public ChartItem
@@ -58,7 +158,7 @@ public:
     const QString &cursorInfo();
 
     void replot(int, double *);
-    void copyRawDataArray(void);
+    void copyRawDataArray(int count);
     void copyRawDataPoint(int index);
     void copyDataPoint(int index);
     int maximumDataCount(int maximum);
@@ -72,11 +172,10 @@ private:
     struct {
 	Chart *chart;
 	SamplingCurve *curve;
+	SamplingData *series;
 	QString info;
 	double scale;
-	double *data;
-	double *itemData;
-	int dataCount;
+	SamplingStore store;
     } my;
 };
 
@@ -5645,6 +5645,152 @@ linux_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
     return 1;
 }
 
+/*
+ * Batch callback provided to pmdaFetch, for the per-cpu and per-node
+ * times from /proc/stat and the network.interface counters.  The metric
+ * is decoded once for all instances; anything else returns -1 and is
+ * left to linux_fetchCallBack.
+ */
+static int
+linux_fetchBatchCallBack(pmdaMetric *mdesc, int numinst, const int *instlist,
+			pmAtomValue *atoms, int *status)
+{
+    __pmID_int		*idp = (__pmID_int *)&(mdesc->m_desc.pmid);
+    unsigned long long	*a, *b = NULL;
+    net_interface_t	*netip;
+    double		d;
+    int			size = _pm_cputime_size;
+    int			sub = 0;
+    int			i, inst;
+
+    if (mdesc->m_user != NULL)
+	return -1;
+
+    switch (idp->cluster) {
+    case CLUSTER_STAT:
+	switch (idp->item) {
+	case 0: /* kernel.percpu.cpu.user */
+	    a = proc_stat.p_user;
+	    break;
+	case 1: /* kernel.percpu.cpu.nice */
+	    a = proc_stat.p_nice;
+	    break;
+	case 2: /* kernel.percpu.cpu.sys */
+	    a = proc_stat.p_sys;
+	    break;
+	case 3: /* kernel.percpu.cpu.idle */
+	    a = proc_stat.p_idle;
+	    size = _pm_idletime_size;
+	    break;
+	case 30: /* kernel.percpu.cpu.wait.total */
+	    a = proc_stat.p_wait;
+	    break;
+	case 31: /* kernel.percpu.cpu.intr */
+	    a = proc_stat.p_irq;
+	    b = proc_stat.p_sirq;
+	    break;
+	case 56: /* kernel.percpu.cpu.irq.soft */
+	    a = proc_stat.p_sirq;
+	    break;
+	case 57: /* kernel.percpu.cpu.irq.hard */
+	    a = proc_stat.p_irq;
+	    break;
+	case 58: /* kernel.percpu.cpu.steal */
+	    a = proc_stat.p_steal;
+	    break;
+	case 61: /* kernel.percpu.cpu.guest */
+	    a = proc_stat.p_guest;
+	    break;
+	case 76: /* kernel.percpu.cpu.vuser */
+	    a = proc_stat.p_user;
+	    b = proc_stat.p_guest;
+	    sub = 1;
+	    break;
+	case 62: /* kernel.pernode.cpu.user */
+	    a = proc_stat.n_user;
+	    break;
+	case 63: /* kernel.pernode.cpu.nice */
+	    a = proc_stat.n_nice;
+	    break;
+	case 64: /* kernel.pernode.cpu.sys */
+	    a = proc_stat.n_sys;
+	    break;
+	case 65: /* kernel.pernode.cpu.idle */
+	    a = proc_stat.n_idle;
+	    size = _pm_idletime_size;
+	    break;
+	case 69: /* kernel.pernode.cpu.wait.total */
+	    a = proc_stat.n_wait;
+	    break;
+	case 66: /* kernel.pernode.cpu.intr */
+	    a = proc_stat.n_irq;
+	    b = proc_stat.n_sirq;
+	    break;
+	case 70: /* kernel.pernode.cpu.irq.soft */
+	    a = proc_stat.n_sirq;
+	    break;
+	case 71: /* kernel.pernode.cpu.irq.hard */
+	    a = proc_stat.n_irq;
+	    break;
+	case 67: /* kernel.pernode.cpu.steal */
+	    a = proc_stat.n_steal;
+	    break;
+	case 68: /* kernel.pernode.cpu.guest */
+	    a = proc_stat.n_guest;
+	    break;
+	case 77: /* kernel.pernode.cpu.vuser */
+	    a = proc_stat.n_user;
+	    b = proc_stat.n_guest;
+	    sub = 1;
+	    break;
+	default:
+	    return -1;
+	}
+	for (i = 0; i < numinst; i++) {
+	    inst = instlist[i];
+	    d = (double)a[inst];
+	    if (b != NULL)
+		d = sub ? d - (double)b[inst] : d + (double)b[inst];
+	    _pm_assign_utype(size, &atoms[i], 1000 * d / proc_stat.hz);
+	    status[i] = 1;
+	}
+	return 0;
+
+    case CLUSTER_NET_DEV: /* network.interface */
+	if (idp->item > 20)
+	    return -1;
+	for (i = 0; i < numinst; i++) {
+	    status[i] = pmdaCacheLookup(INDOM(NET_DEV_INDOM), instlist[i],
+					NULL, (void **)&netip);
+	    if (status[i] < 0)
+		continue;
+	    status[i] = 1;
+	    switch (idp->item) {
+	    case 16: /* network.interface.total.bytes */
+		atoms[i].ull = netip->counters[0] + netip->counters[8];
+		break;
+	    case 17: /* network.interface.total.packets */
+		atoms[i].ull = netip->counters[1] + netip->counters[9];
+		break;
+	    case 18: /* network.interface.total.errors */
+		atoms[i].ull = netip->counters[2] + netip->counters[10];
+		break;
+	    case 19: /* network.interface.total.drops */
+		atoms[i].ull = netip->counters[3] + netip->counters[11];
+		break;
+	    case 20: /* network.interface.total.mcasts */
+		atoms[i].ull = netip->counters[7];
+		break;
+	    default: /* network.interface.{in,out} */
+		atoms[i].ull = netip->counters[idp->item];
+		break;
+	    }
+	}
+	return 0;
+    }
+    return -1;
+}
+
 
 static int
 linux_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
@@ -5866,6 +6012,7 @@ linux_init(pmdaInterface *dp)
     dp->version.six.attribute = linux_attribute;
     dp->version.six.ext->e_endCallBack = linux_end_context;
     pmdaSetFetchCallBack(dp, linux_fetchCallBack);
+    pmdaSetFetchBatchCallBack(dp, linux_fetchBatchCallBack);
 
     proc_stat.cpu_indom = proc_cpuinfo.cpuindom = &indomtab[CPU_INDOM];
     numa_meminfo.node_indom = proc_cpuinfo.node_indom = &indomtab[NODE_INDOM];
@@ -59,6 +59,8 @@ static unsigned int		threads;	/* control.all.threads */
 static char *			cgroups;	/* control.all.cgroups */
 int				conf_gen;	/* hotproc config version, if zero hotproc not configured yet */
 long				hz;
+int				proc_workers;	/* threads for per-process refresh */
+static int			want_taskstats;	/* use netlink taskstats backend */
 
 extern struct timeval   hotproc_update_interval;
 
@@ -1301,6 +1303,36 @@ proc_statsfile(const char *path, char *buffer, int size)
     return fopen(buffer, "r");
 }
 
+/*
+ * Per-process clusters that can be refreshed in parallel, ahead of the
+ * fetch callbacks - see prefetch_proc_pidlist().
+ */
+static const struct {
+    int		cluster;
+    int		hotproc;
+    int		flags;
+} prefetchtab[] = {
+    { CLUSTER_PID_STAT, CLUSTER_HOTPROC_PID_STAT, PROC_PID_FLAG_STAT_FETCHED },
+    { CLUSTER_PID_STATM, CLUSTER_HOTPROC_PID_STATM, PROC_PID_FLAG_STATM_FETCHED },
+    { CLUSTER_PID_STATUS, CLUSTER_HOTPROC_PID_STATUS, PROC_PID_FLAG_STATUS_FETCHED },
+    { CLUSTER_PID_SCHEDSTAT, CLUSTER_HOTPROC_PID_SCHEDSTAT, PROC_PID_FLAG_SCHEDSTAT_FETCHED },
+    { CLUSTER_PID_IO, CLUSTER_HOTPROC_PID_IO, PROC_PID_FLAG_IO_FETCHED },
+    { CLUSTER_PID_FD, CLUSTER_HOTPROC_PID_FD, PROC_PID_FLAG_FD_FETCHED },
+};
+
+static void
+proc_prefetch(proc_pid_t *pp, pmdaExt *pmda, int *need_refresh, int hotproc)
+{
+    int		i, cluster, flags = 0;
+
+    for (i = 0; i < sizeof(prefetchtab)/sizeof(prefetchtab[0]); i++) {
+	cluster = hotproc ? prefetchtab[i].hotproc : prefetchtab[i].cluster;
+	if (need_refresh[cluster])
+	    flags |= prefetchtab[i].flags;
+    }
+    prefetch_proc_pid_profile(pp, pmda->e_prof, flags);
+}
+
 static int
 proc_refresh(pmdaExt *pmda, int *need_refresh)
 {
@@ -1363,7 +1395,7 @@ proc_refresh(pmdaExt *pmda, int *need_refresh)
 		proc_ctx_threads(pmda->e_context, threads),
 		proc_ctx_cgroups(pmda->e_context, cgroups),
 		container ? cgroup : NULL, cgrouplen);
-
+	proc_prefetch(&proc_pid, pmda, need_refresh, 0);
     }
     if (need_refresh[CLUSTER_HOTPROC_PID_STAT] ||
         need_refresh[CLUSTER_HOTPROC_PID_STATM] ||
@@ -1378,6 +1410,7 @@ proc_refresh(pmdaExt *pmda, int *need_refresh)
         refresh_hotproc_pid(&hotproc_pid,
                         proc_ctx_threads(pmda->e_context, threads),
                         proc_ctx_cgroups(pmda->e_context, cgroups));
+	proc_prefetch(&hotproc_pid, pmda, need_refresh, 1);
     }
     return 0;
 }
@@ -1483,6 +1516,22 @@ proc_instance(pmInDom indom, int inst, char *name, __pmInResult **result, pmdaEx
  * callback provided to pmdaFetch
  */
 
+/*
+ * Final accounting of exited tasks comes from the taskstats exit
+ * notifications rather than /proc files opened with the credentials
+ * of the client, so apply the equivalent (owner or root) check here.
+ */
+static int
+proc_taskstats_access(proc_pid_entry_t *entry)
+{
+    uid_t	uid;
+
+    if (!(entry->flags & PROC_PID_FLAG_EXITED) || all_access)
+	return 1;
+    uid = geteuid();
+    return (uid == 0 || uid == entry->taskstats.uid);
+}
+
 static int
 proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 {
@@ -1821,7 +1870,30 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 	if ((entry = fetch_proc_pid_schedstat(inst, active_proc_pid, &sts)) == NULL)
 	    return sts;
 
-	if (idp->item < NR_PROC_PID_SCHED) {
+	if (entry->flags & PROC_PID_FLAG_TASKSTATS_SCHED) {
+	    __uint64_t	value;
+
+	    if (!proc_taskstats_access(entry))
+		return 0;
+	    if (idp->item == PROC_PID_SCHED_CPUTIME)
+		value = entry->taskstats.cputime;
+	    else if (idp->item == PROC_PID_SCHED_RUNDELAY)
+		value = entry->taskstats.rundelay;
+	    else if (idp->item == PROC_PID_SCHED_PCOUNT)
+		value = entry->taskstats.pcount;
+	    else
+		return PM_ERR_PMID;
+	    if (idp->item == PROC_PID_SCHED_PCOUNT &&
+		mdesc->m_desc.type == PM_TYPE_U32)
+		atom->ul = (__uint32_t)value;
+	    else
+#if defined(HAVE_64BIT_PTR)
+		atom->ull = value;
+#else
+		atom->ul = (__uint32_t)value;
+#endif
+	}
+	else if (idp->item < NR_PROC_PID_SCHED) {
 	    if ((f = _pm_getfield(entry->schedstat_buf, idp->item)) == NULL)
 		return 0;
 	    if (idp->item == PROC_PID_SCHED_PCOUNT &&
@@ -1847,6 +1919,37 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 	if ((entry = fetch_proc_pid_io(inst, active_proc_pid, &sts)) == NULL)
 	    return sts;
 
+	if (entry->flags & PROC_PID_FLAG_TASKSTATS_IO) {
+	    if (!proc_taskstats_access(entry))
+		return 0;
+	    switch (idp->item) {
+	    case PROC_PID_IO_RCHAR:
+		atom->ull = entry->taskstats.rchar;
+		break;
+	    case PROC_PID_IO_WCHAR:
+		atom->ull = entry->taskstats.wchar;
+		break;
+	    case PROC_PID_IO_SYSCR:
+		atom->ull = entry->taskstats.syscr;
+		break;
+	    case PROC_PID_IO_SYSCW:
+		atom->ull = entry->taskstats.syscw;
+		break;
+	    case PROC_PID_IO_READ_BYTES:
+		atom->ull = entry->taskstats.read_bytes;
+		break;
+	    case PROC_PID_IO_WRITE_BYTES:
+		atom->ull = entry->taskstats.write_bytes;
+		break;
+	    case PROC_PID_IO_CANCELLED_BYTES:
+		atom->ull = entry->taskstats.cancelled_write_bytes;
+		break;
+	    default:
+		return PM_ERR_PMID;
+	    }
+	    break;
+	}
+
 	switch (idp->item) {
 
 	case PROC_PID_IO_RCHAR:
@@ -2596,6 +2699,97 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
     return PMDA_FETCH_STATIC;
 }
 
+/*
+ * Batch callback provided to pmdaFetch, for the numeric fields of
+ * /proc/<pid>/stat across all requested processes.  The access check
+ * and item decoding are done once per metric rather than once per
+ * process; everything else returns -1 and is left to the per-instance
+ * proc_fetchCallBack.
+ */
+static int
+proc_fetchBatchCallBack(pmdaMetric *mdesc, int numinst, const int *instlist,
+			pmAtomValue *atoms, int *status)
+{
+    __pmID_int		*idp = (__pmID_int *)&(mdesc->m_desc.pmid);
+    proc_pid_t		*active_proc_pid;
+    proc_pid_entry_t	*entry;
+    unsigned long	ul;
+    char		*tail;
+    char		*f;
+    int			jiffies = 0;
+    int			i;
+
+    if (mdesc->m_user != NULL)
+	return -1;
+    if (idp->cluster == CLUSTER_PID_STAT)
+	active_proc_pid = &proc_pid;
+    else if (idp->cluster == CLUSTER_HOTPROC_PID_STAT)
+	active_proc_pid = &hotproc_pid;
+    else
+	return -1;
+
+    switch (idp->item) {
+	case PROC_PID_STAT_UTIME:
+	case PROC_PID_STAT_STIME:
+	case PROC_PID_STAT_CUTIME:
+	case PROC_PID_STAT_CSTIME:
+	    jiffies = 1;
+	    break;
+	case PROC_PID_STAT_PPID:
+	case PROC_PID_STAT_PGRP:
+	case PROC_PID_STAT_SESSION:
+	case PROC_PID_STAT_TTY:
+	case PROC_PID_STAT_TTY_PGRP:
+	case PROC_PID_STAT_FLAGS:
+	case PROC_PID_STAT_MINFLT:
+	case PROC_PID_STAT_CMIN_FLT:
+	case PROC_PID_STAT_MAJ_FLT:
+	case PROC_PID_STAT_CMAJ_FLT:
+	case PROC_PID_STAT_REMOVED:
+	case PROC_PID_STAT_IT_REAL_VALUE:
+	case PROC_PID_STAT_START_TIME:
+	case PROC_PID_STAT_START_CODE:
+	case PROC_PID_STAT_END_CODE:
+	case PROC_PID_STAT_START_STACK:
+	case PROC_PID_STAT_ESP:
+	case PROC_PID_STAT_EIP:
+	case PROC_PID_STAT_SIGNAL:
+	case PROC_PID_STAT_BLOCKED:
+	case PROC_PID_STAT_SIGIGNORE:
+	case PROC_PID_STAT_SIGCATCH:
+	case PROC_PID_STAT_NSWAP:
+	case PROC_PID_STAT_CNSWAP:
+	case PROC_PID_STAT_EXIT_SIGNAL:
+	case PROC_PID_STAT_PROCESSOR:
+	    break;
+	default:
+	    return -1;
+    }
+
+    if (!have_access) {
+	for (i = 0; i < numinst; i++)
+	    status[i] = PM_ERR_PERMISSION;
+	return 0;
+    }
+
+    for (i = 0; i < numinst; i++) {
+	if ((entry = fetch_proc_pid_stat(instlist[i], active_proc_pid, &status[i])) == NULL)
+	    continue;
+	if ((f = _pm_getfield(entry->stat_buf, idp->item)) == NULL) {
+	    status[i] = 0;
+	    continue;
+	}
+	ul = (__uint32_t)strtoul(f, &tail, 0);
+	if (jiffies)
+	    /* unsigned jiffies converted to unsigned msecs */
+	    _pm_assign_ulong(&atoms[i], 1000 * (double)ul / hz);
+	else
+	    atoms[i].ul = ul;
+	status[i] = PMDA_FETCH_STATIC;
+    }
+    return 0;
+}
+
 static int
 proc_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 {
@@ -2835,6 +3029,7 @@ proc_init(pmdaInterface *dp)
     dp->version.six.attribute = proc_ctx_attrs;
     pmdaSetEndContextCallBack(dp, proc_ctx_end);
     pmdaSetFetchCallBack(dp, proc_fetchCallBack);
+    pmdaSetFetchBatchCallBack(dp, proc_fetchBatchCallBack);
 
     /*
      * Initialize the instance domain table.
@@ -2872,6 +3067,14 @@ proc_init(pmdaInterface *dp)
     proc_ctx_init();
     proc_dynamic_init(metrictab, nmetrics);
 
+    if (want_taskstats) {
+	int	sts;
+
+	if ((sts = taskstats_init(1)) < 0)
+	    __pmNotifyErr(LOG_WARNING, "taskstats unavailable, using /proc: %s",
+			pmErrStr(sts));
+    }
+
     rootfd = pmdaRootConnect(NULL);
     pmdaSetFlags(dp, PMDA_EXT_FLAG_HASHED);
     pmdaInit(dp, indomtab, nindoms, metrictab, nmetrics);
@@ -2900,13 +3103,15 @@ pmLongOptions	longopts[] = {
     PMDAOPT_LOGFILE,
     { "with-threads", 0, 'L', 0, "include threads in the all-processes instance domain" },
     { "from-cgroup", 1, 'r', "NAME", "restrict monitoring to processes in the named cgroup" },
+    { "workers", 1, 't', "N", "use N threads to refresh per-process metrics" },
+    { "taskstats", 0, 'T', 0, "use netlink taskstats for I/O and scheduler metrics" },
     PMDAOPT_USERNAME,
     PMOPT_HELP,
     PMDA_OPTIONS_END
 };
 
 pmdaOptions	opts = {
-    .short_options = "AD:d:l:Lr:U:?",
+    .short_options = "AD:d:l:Lr:t:TU:?",
     .long_options = longopts,
 };
 
@@ -2917,9 +3122,11 @@ main(int argc, char **argv)
     pmdaInterface	dispatch;
     char		helppath[MAXPATHLEN];
     char		*username = "root";
+    char		*endnum;
 
     _isDSO = 0;
     __pmSetProgname(argv[0]);
+    proc_workers = sysconf(_SC_NPROCESSORS_ONLN);
     snprintf(helppath, sizeof(helppath), "%s%c" "proc" "%c" "help",
 		pmGetConfig("PCP_PMDAS_DIR"), sep, sep);
     pmdaDaemon(&dispatch, PMDA_INTERFACE_6, pmProgname, PROC, "proc.log", helppath);
@@ -2935,6 +3142,17 @@ main(int argc, char **argv)
 	case 'r':
 	    cgroups = opts.optarg;
 	    break;
+	case 'T':
+	    want_taskstats = 1;
+	    break;
+	case 't':
+	    proc_workers = (int)strtol(opts.optarg, &endnum, 10);
+	    if (*endnum != '\0' || proc_workers < 0) {
+		fprintf(stderr, "%s: -t requires a non-negative numeric argument\n",
+			pmProgname);
+		opts.errors++;
+	    }
+	    break;
 	}
     }
 
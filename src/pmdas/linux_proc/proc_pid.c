@@ -25,6 +25,7 @@
 #include <sys/types.h>
 #include <pwd.h>
 #include <grp.h>
+#include <pthread.h>
 #include "proc_pid.h"
 #include "proc_runq.h"
 #include "indom.h"
@@ -32,8 +33,13 @@
 #include "hotproc.h"
 
 static proc_pid_list_t procpids; /* previous pids list that the proc pmda uses */
+static proc_pid_list_t exitpids; /* tasks exited since the previous refresh */
 static void refresh_proc_pidlist(proc_pid_t *, proc_pid_list_t *);
 
+/* flags retained for one refresh after a taskstats exit notification */
+#define PROC_PID_FLAG_EXITED_MASK \
+	(PROC_PID_FLAG_EXITED|PROC_PID_FLAG_TASKSTATS_SCHED|PROC_PID_FLAG_TASKSTATS_IO)
+
 
 /* Hotproc variables */
 
@@ -49,6 +55,7 @@ static proc_pid_t *hotproc_poss_pid;
 extern int conf_gen;
 extern char *proc_statspath;
 extern long hz;
+extern int proc_workers;
 
 /* Actual processes that are hot based on the current configuration 
  * Filled in hotproc_eval_procs 
@@ -468,6 +475,11 @@ hotproc_eval_procs(void)
     refresh_global_pidlist(0, NULL, &hotpids);
     refresh_proc_pidlist(hotproc_poss_pid, &hotpids);
 
+    /* read ahead the clusters used below, in parallel for many pids */
+    prefetch_proc_pidlist(hotproc_poss_pid, hotpids.pids, hotpids.count,
+		PROC_PID_FLAG_STAT_FETCHED | PROC_PID_FLAG_STATUS_FETCHED |
+		PROC_PID_FLAG_IO_FETCHED | PROC_PID_FLAG_SCHEDSTAT_FETCHED);
+
     for (i=0; i < hotpids.count; i++) {
 
 	pid = hotpids.pids[i];
@@ -821,7 +833,10 @@ refresh_proc_pidlist(proc_pid_t *proc_pid, proc_pid_list_t *pids)
     for (i=0; i < proc_pid->pidhash.hsize; i++) {
 	for (node=proc_pid->pidhash.hash[i]; node != NULL; node = node->next) {
 	    ep = (proc_pid_entry_t *)node->data;
-	    ep->flags = 0;
+	    if (ep->flags & PROC_PID_FLAG_EXITED)
+		ep->flags &= PROC_PID_FLAG_EXITED_MASK;
+	    else
+		ep->flags = 0;
 	}
     }
 
@@ -976,6 +991,86 @@ refresh_proc_pidlist(proc_pid_t *proc_pid, proc_pid_list_t *pids)
     }
 }
 
+/*
+ * Task exit notification from taskstats - retain the final accounting
+ * for the next refresh.  This includes tasks that started and exited
+ * entirely between two refreshes (when every task is an instance, i.e.
+ * in threads mode), which would otherwise never be seen at all.
+ */
+static void
+refresh_exited_pid(int pid, const proc_taskstats_t *stats, const char *comm, void *arg)
+{
+    proc_pid_t		*proc_pid = (proc_pid_t *)arg;
+    __pmHashNode	*node = __pmHashSearch(pid, &proc_pid->pidhash);
+    proc_pid_entry_t	*ep;
+    char		buf[64];
+
+    if (node != NULL)
+	ep = (proc_pid_entry_t *)node->data;
+    else if (!procpids.threads)
+	return;	/* a thread or an unseen process, not in the indom */
+    else {
+	if ((ep = (proc_pid_entry_t *)calloc(1, sizeof(proc_pid_entry_t))) == NULL)
+	    return;
+	ep->id = pid;
+	snprintf(buf, sizeof(buf), "%06d (%s)", pid, comm);
+	ep->name = strdup(buf);
+	__pmHashAdd(pid, (void *)ep, &proc_pid->pidhash);
+    }
+
+    ep->taskstats = *stats;
+    ep->flags |= PROC_PID_FLAG_EXITED | PROC_PID_FLAG_TASKSTATS_SCHED;
+    if (procpids.threads)
+	ep->flags |= PROC_PID_FLAG_TASKSTATS_IO;
+    pidlist_append_pid(pid, &exitpids);
+}
+
+static void
+refresh_exited_pidlist(proc_pid_t *proc_pid, int want_threads)
+{
+    __pmHashNode	*node;
+    proc_pid_entry_t	*ep;
+    int			i;
+
+    /* final values from the last round have been reported, drop them */
+    for (i = 0; i < exitpids.count; i++) {
+	if ((node = __pmHashSearch(exitpids.pids[i], &proc_pid->pidhash)) == NULL)
+	    continue;
+	ep = (proc_pid_entry_t *)node->data;
+	ep->flags &= ~PROC_PID_FLAG_EXITED_MASK;
+    }
+    exitpids.count = 0;
+    procpids.threads = want_threads;
+
+    if (taskstats_exits(refresh_exited_pid, proc_pid) <= 0)
+	return;
+    qsort(exitpids.pids, exitpids.count, sizeof(int), compare_pid);
+
+#if PCP_DEBUG
+    if (pmDebug & DBG_TRACE_LIBPMDA)
+	fprintf(stderr, "refresh_exited_pidlist: %d exited tasks\n", exitpids.count);
+#endif
+}
+
+/*
+ * Merge the exited tasks into the (sorted) list of current pids, so they
+ * remain in the indom with their final accounting for this refresh, then
+ * are harvested (evicted from the pid hash) the next time through.
+ */
+static void
+merge_exited_pidlist(proc_pid_list_t *pids)
+{
+    int		i, count = pids->count;
+
+    for (i = 0; i < exitpids.count; i++) {
+	if (bsearch(&exitpids.pids[i], pids->pids, count,
+			sizeof(int), compare_pid) == NULL)
+	    pidlist_append_pid(exitpids.pids[i], pids);
+    }
+    if (pids->count != count)
+	qsort(pids->pids, pids->count, sizeof(int), compare_pid);
+}
+
 int
 refresh_proc_pid(proc_pid_t *proc_pid, proc_runq_t *proc_runq,
 		 int want_threads, const char *cgroups,
@@ -987,6 +1082,10 @@ refresh_proc_pid(proc_pid_t *proc_pid, proc_runq_t *proc_runq,
 
     want_cgroups = container || (cgroups && cgroups[0] != '\0');
 
+    /* Exited tasks are only retained when all processes are being shown */
+    if (!want_cgroups && taskstats_active())
+	refresh_exited_pidlist(proc_pid, want_threads);
+
     /* For the run queue stats, we cannot avoid the global /proc refresh.
      * However, we can ensure we scan it once only (either here or below).
      */
@@ -1015,6 +1114,8 @@ refresh_proc_pid(proc_pid_t *proc_pid, proc_runq_t *proc_runq,
 	refresh_global_pidlist(want_threads, proc_runq, &procpids);
     if (sts < 0)
 	return sts;
+    if (!want_cgroups && exitpids.count > 0)
+	merge_exited_pidlist(&procpids);
 
 #if PCP_DEBUG
     if (pmDebug & DBG_TRACE_LIBPMDA)
@@ -1613,7 +1714,7 @@ fetch_proc_pid_schedstat(int id, proc_pid_t *proc_pid, int *sts)
     }
     ep = (proc_pid_entry_t *)node->data;
 
-    if (!(ep->flags & PROC_PID_FLAG_SCHEDSTAT_FETCHED)) {
+    if (!(ep->flags & (PROC_PID_FLAG_SCHEDSTAT_FETCHED|PROC_PID_FLAG_TASKSTATS_SCHED))) {
 	int fd, n;
 	char buf[1024];
 
@@ -1688,7 +1789,7 @@ fetch_proc_pid_io(int id, proc_pid_t *proc_pid, int *sts)
     }
     ep = (proc_pid_entry_t *)node->data;
 
-    if (!(ep->flags & PROC_PID_FLAG_IO_FETCHED)) {
+    if (!(ep->flags & (PROC_PID_FLAG_IO_FETCHED|PROC_PID_FLAG_TASKSTATS_IO))) {
 	int	fd, n;
 	char	buf[1024];
 	char	*curline;
@@ -1981,6 +2082,196 @@ fetch_proc_pid_label(int id, proc_pid_t *proc_pid, int *sts)
     return (*sts < 0) ? NULL : ep;
 }
 
+/*
+ * Parallel refresh of the per-process clusters.
+ *
+ * With many thousands of processes (or threads) the fetch callbacks spend
+ * nearly all of their time opening, reading and parsing the individual
+ * /proc/<pid>/xxx files, one pid after another.  The fetch_proc_pid_*()
+ * routines only ever modify the proc_pid_entry_t for the pid they are
+ * passed, so the pid list is carved up into small chunks here and handed
+ * out to a set of worker threads, each filling in entries independently.
+ * Once all workers are done, the fetch callbacks find the clusters marked
+ * as already fetched and simply extract values from the buffers.
+ *
+ * Only those clusters that do not touch shared state are handled this
+ * way - cgroup and label values are inserted into the shared strings
+ * dictionary, and maps can be huge, so those remain on-demand.
+ */
+#define PREFETCH_CHUNK		32	/* pids claimed by a worker at once */
+#define PREFETCH_MINPIDS	256	/* fewer pids per worker is not worth it */
+
+typedef struct {
+    proc_pid_t		*proc_pid;
+    const int		*pids;
+    int			count;
+    int			flags;		/* PROC_PID_FLAG_*_FETCHED clusters */
+    int			next;		/* next unclaimed index into pids */
+    pthread_mutex_t	lock;		/* serialises updates to next */
+} prefetch_t;
+
+static void
+prefetch_proc_pid(proc_pid_t *proc_pid, int id, int flags)
+{
+    __pmHashNode	*node = __pmHashSearch(id, &proc_pid->pidhash);
+    proc_pid_entry_t	*ep;
+    int			sts;
+
+    if (node == NULL)
+	return;
+    ep = (proc_pid_entry_t *)node->data;
+
+    /*
+     * On failure the fetched flag is cleared again, so that the fetch
+     * callback retries this cluster and returns the appropriate error.
+     */
+    if (flags & PROC_PID_FLAG_STAT_FETCHED) {
+	if (fetch_proc_pid_stat(id, proc_pid, &sts) == NULL)
+	    ep->flags &= ~(PROC_PID_FLAG_STAT_FETCHED|PROC_PID_FLAG_WCHAN_FETCHED);
+    }
+    if (flags & PROC_PID_FLAG_STATM_FETCHED) {
+	if (fetch_proc_pid_statm(id, proc_pid, &sts) == NULL)
+	    ep->flags &= ~PROC_PID_FLAG_STATM_FETCHED;
+    }
+    if (flags & PROC_PID_FLAG_STATUS_FETCHED)
+	fetch_proc_pid_status(id, proc_pid, &sts);
+    if (flags & PROC_PID_FLAG_SCHEDSTAT_FETCHED) {
+	if (fetch_proc_pid_schedstat(id, proc_pid, &sts) == NULL)
+	    ep->flags &= ~PROC_PID_FLAG_SCHEDSTAT_FETCHED;
+    }
+    if (flags & PROC_PID_FLAG_IO_FETCHED)
+	fetch_proc_pid_io(id, proc_pid, &sts);
+    if (flags & PROC_PID_FLAG_FD_FETCHED)
+	fetch_proc_pid_fd(id, proc_pid, &sts);
+}
+
+static void *
+prefetch_worker(void *arg)
+{
+    prefetch_t	*work = (prefetch_t *)arg;
+    int		i, start, end;
+
+    for (;;) {
+	pthread_mutex_lock(&work->lock);
+	start = work->next;
+	work->next += PREFETCH_CHUNK;
+	pthread_mutex_unlock(&work->lock);
+
+	if (start >= work->count)
+	    break;
+	if ((end = start + PREFETCH_CHUNK) > work->count)
+	    end = work->count;
+	for (i = start; i < end; i++)
+	    prefetch_proc_pid(work->proc_pid, work->pids[i], work->flags);
+    }
+    return NULL;
+}
+
+void
+prefetch_proc_pidlist(proc_pid_t *proc_pid, const int *pids, int count, int flags)
+{
+    pthread_t	*tids;
+    prefetch_t	work;
+    int		i, nworkers;
+
+    nworkers = count / PREFETCH_MINPIDS;
+    if (nworkers > proc_workers)
+	nworkers = proc_workers;
+    if (nworkers <= 1 || flags == 0)
+	return;		/* leave it to the fetch callbacks */
+
+    if ((tids = (pthread_t *)malloc(nworkers * sizeof(pthread_t))) == NULL)
+	return;
+
+    work.proc_pid = proc_pid;
+    work.pids = pids;
+    work.count = count;
+    work.flags = flags;
+    work.next = 0;
+    pthread_mutex_init(&work.lock, NULL);
+
+    /* the calling thread is the first worker, start the rest */
+    for (i = 1; i < nworkers; i++) {
+	if (pthread_create(&tids[i], NULL, prefetch_worker, &work) != 0)
+	    break;
+    }
+    nworkers = i;
+
+#if PCP_DEBUG
+    if (pmDebug & DBG_TRACE_LIBPMDA)
+	fprintf(stderr, "prefetch_proc_pidlist: %d pids, %d workers, flags=0x%x\n",
+		count, nworkers, flags);
+#endif
+
+    prefetch_worker(&work);
+    for (i = 1; i < nworkers; i++)
+	pthread_join(tids[i], NULL);
+
+    pthread_mutex_destroy(&work.lock);
+    free(tids);
+}
+
+/*
+ * Reply to a batched taskstats request, for a task that is still running.
+ * Only in threads mode is the (per-task) I/O accounting equivalent to the
+ * /proc/<pid>/io file - for processes that file sums over all threads.
+ */
+static void
+prefetch_taskstats(int pid, const proc_taskstats_t *stats, const char *comm, void *arg)
+{
+    proc_pid_t		*proc_pid = (proc_pid_t *)arg;
+    __pmHashNode	*node = __pmHashSearch(pid, &proc_pid->pidhash);
+    proc_pid_entry_t	*ep;
+
+    if (node == NULL)
+	return;
+    ep = (proc_pid_entry_t *)node->data;
+    if (ep->flags & PROC_PID_FLAG_EXITED)
+	return;
+    ep->taskstats = *stats;
+    ep->flags |= PROC_PID_FLAG_TASKSTATS_SCHED;
+    if (procpids.threads)
+	ep->flags |= PROC_PID_FLAG_TASKSTATS_IO;
+}
+
+void
+prefetch_proc_pid_profile(proc_pid_t *proc_pid, pmdaInProfile *prof, int flags)
+{
+    static int	*pids;
+    static int	size;
+    pmdaIndom	*indomp = proc_pid->indom;
+    int		i, count, tsflags = 0;
+
+    if (taskstats_active()) {
+	tsflags = PROC_PID_FLAG_SCHEDSTAT_FETCHED;
+	if (procpids.threads)
+	    tsflags |= PROC_PID_FLAG_IO_FETCHED;
+	tsflags &= flags;
+    }
+    if (flags == 0 || (proc_workers <= 1 && tsflags == 0))
+	return;
+
+    if (size < indomp->it_numinst) {
+	int	*tmp = (int *)realloc(pids, indomp->it_numinst * sizeof(int));
+
+	if (tmp == NULL)
+	    return;
+	pids = tmp;
+	size = indomp->it_numinst;
+    }
+
+    /* only those processes the client actually asked for */
+    for (i = count = 0; i < indomp->it_numinst; i++) {
+	if (__pmInProfile(indomp->it_indom, prof, indomp->it_set[i].i_inst))
+	    pids[count++] = indomp->it_set[i].i_inst;
+    }
+
+    /* values from taskstats replies take precedence over /proc files */
+    if (tsflags && taskstats_query(pids, count, prefetch_taskstats, proc_pid) > 0)
+	flags &= ~tsflags;
+    prefetch_proc_pidlist(proc_pid, pids, count, flags);
+}
+
 /*
  * Extract the ith (space separated) field from a char buffer.
  * The first field starts at zero. 
@@ -19,6 +19,7 @@
 
 #include "proc_runq.h"
 #include "hotproc.h"
+#include "taskstats.h"
 
 
 /*
@@ -206,6 +207,9 @@ enum {
     PROC_PID_FLAG_FD_FETCHED		= 1<<8,
     PROC_PID_FLAG_CGROUP_FETCHED	= 1<<9,
     PROC_PID_FLAG_LABEL_FETCHED		= 1<<10,
+    PROC_PID_FLAG_TASKSTATS_SCHED	= 1<<11, /* schedstat from taskstats */
+    PROC_PID_FLAG_TASKSTATS_IO		= 1<<12, /* io from taskstats */
+    PROC_PID_FLAG_EXITED		= 1<<13, /* final taskstats at exit */
 };
 
 typedef struct {
@@ -251,6 +255,9 @@ typedef struct {
 
     /* /proc/<pid>/attr/current cluster */
     int			label_id;
+
+    /* netlink taskstats, alternative to the schedstat and io clusters */
+    proc_taskstats_t	taskstats;
 } proc_pid_entry_t;
 
 typedef struct {
@@ -303,6 +310,12 @@ extern proc_pid_entry_t *fetch_proc_pid_cgroup(int, proc_pid_t *, int *);
 /* fetch a proc/<pid>/attr/current entry for pid */
 extern proc_pid_entry_t *fetch_proc_pid_label(int, proc_pid_t *, int *);
 
+/* read the given PROC_PID_FLAG_*_FETCHED clusters for a list of pids */
+extern void prefetch_proc_pidlist(proc_pid_t *, const int *, int, int);
+
+/* as above, for all pids in the indom that are in the client profile */
+extern void prefetch_proc_pid_profile(proc_pid_t *, pmdaInProfile *, int);
+
 /* extract the ith space separated field from a buffer */
 extern char *_pm_getfield(char *, int);
 
@@ -0,0 +1,315 @@
+/*
+ * Linux per-task accounting via the TASKSTATS generic netlink family
+ *
+ * Copyright (c) 2015 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include "pmapi.h"
+#include "impl.h"
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/taskstats.h>
+#include "taskstats.h"
+
+/*
+ * Requests are pipelined - up to this many are sent before replies
+ * are read back, keeping the number of round trips to the kernel low
+ * when refreshing tens of thousands of tasks.
+ */
+#define TASKSTATS_WINDOW	64
+#define TASKSTATS_RCVBUF	(1024 * 1024)
+
+#define GENLMSG_DATA(nlh)	((void *)((char *)NLMSG_DATA(nlh) + GENL_HDRLEN))
+#define GENLMSG_LEN(nlh)	((nlh)->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN)
+#define NLA_DATA(na)		((void *)((char *)(na) + NLA_HDRLEN))
+#define NLA_NEXT(na)		((struct nlattr *)((char *)(na) + NLA_ALIGN((na)->nla_len)))
+
+typedef struct {
+    struct nlmsghdr	n;
+    struct genlmsghdr	g;
+    char		buf[256];
+} genlmsg_t;
+
+static int		query_fd = -1;	/* request/response socket */
+static int		exits_fd = -1;	/* task exit notifications */
+static __uint16_t	family;		/* TASKSTATS family identifier */
+static __uint32_t	seqno;
+
+static int
+genl_open(void)
+{
+    struct sockaddr_nl	addr;
+    int			fd, size = TASKSTATS_RCVBUF;
+
+    if ((fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_GENERIC)) < 0)
+	return -oserror();
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+	int	sts = -oserror();
+	close(fd);
+	return sts;
+    }
+    return fd;
+}
+
+static int
+genl_send(int fd, __uint16_t type, __uint8_t cmd, __uint16_t attr,
+		const void *data, int length, __uint32_t seq)
+{
+    struct sockaddr_nl	addr;
+    struct nlattr	*na;
+    genlmsg_t		msg;
+    int			sts;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.n.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    msg.n.nlmsg_type = type;
+    msg.n.nlmsg_flags = NLM_F_REQUEST;
+    msg.n.nlmsg_seq = seq;
+    msg.n.nlmsg_pid = 0;
+    msg.g.cmd = cmd;
+    msg.g.version = 1;
+
+    na = (struct nlattr *)GENLMSG_DATA(&msg.n);
+    na->nla_type = attr;
+    na->nla_len = NLA_HDRLEN + length;
+    memcpy(NLA_DATA(na), data, length);
+    msg.n.nlmsg_len += NLA_ALIGN(na->nla_len);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    sts = sendto(fd, &msg, msg.n.nlmsg_len, 0,
+		(struct sockaddr *)&addr, sizeof(addr));
+    return sts < 0 ? -oserror() : 0;
+}
+
+static int
+genl_family(int fd, const char *name)
+{
+    struct nlmsghdr	*nlh;
+    struct nlattr	*na;
+    char		buf[4096];
+    int			len, sts;
+
+    if ((sts = genl_send(fd, GENL_ID_CTRL, CTRL_CMD_GETFAMILY,
+			CTRL_ATTR_FAMILY_NAME, name, strlen(name)+1, 0)) < 0)
+	return sts;
+    if ((len = recv(fd, buf, sizeof(buf), 0)) < 0)
+	return -oserror();
+
+    nlh = (struct nlmsghdr *)buf;
+    if (!NLMSG_OK(nlh, len))
+	return -EINVAL;
+    if (nlh->nlmsg_type == NLMSG_ERROR)
+	return ((struct nlmsgerr *)NLMSG_DATA(nlh))->error;
+
+    len = GENLMSG_LEN(nlh);
+    for (na = GENLMSG_DATA(nlh); len >= NLA_HDRLEN && na->nla_len >= NLA_HDRLEN;
+	 len -= NLA_ALIGN(na->nla_len), na = NLA_NEXT(na)) {
+	if (na->nla_type == CTRL_ATTR_FAMILY_ID)
+	    return *(__uint16_t *)NLA_DATA(na);
+    }
+    return -ENOENT;
+}
+
+static void
+taskstats_extract(const struct taskstats *ts, int length, proc_taskstats_t *tp)
+{
+    struct taskstats	stats;
+
+    /* kernel may be newer (larger) or older (smaller) than our headers */
+    memset(&stats, 0, sizeof(stats));
+    memcpy(&stats, ts, length < sizeof(stats) ? length : sizeof(stats));
+
+    tp->uid = stats.ac_uid;
+    tp->cputime = stats.cpu_run_virtual_total;
+    tp->rundelay = stats.cpu_delay_total;
+    tp->pcount = stats.cpu_count;
+    tp->rchar = stats.read_char;
+    tp->wchar = stats.write_char;
+    tp->syscr = stats.read_syscalls;
+    tp->syscw = stats.write_syscalls;
+    tp->read_bytes = stats.read_bytes;
+    tp->write_bytes = stats.write_bytes;
+    tp->cancelled_write_bytes = stats.cancelled_write_bytes;
+}
+
+/*
+ * Walk the attributes of one TASKSTATS_CMD_NEW message, calling back
+ * for each per-task (AGGR_PID) record found.  Thread group aggregates
+ * carry delay accounting only, so those are skipped.
+ */
+static int
+taskstats_message(struct nlmsghdr *nlh, taskstats_callback_t callback, void *arg)
+{
+    struct nlattr	*na, *nested;
+    proc_taskstats_t	stats;
+    char		comm[TS_COMM_LEN+1];
+    int			len, nlen, pid, count = 0;
+
+    len = GENLMSG_LEN(nlh);
+    for (na = GENLMSG_DATA(nlh); len >= NLA_HDRLEN && na->nla_len >= NLA_HDRLEN;
+	 len -= NLA_ALIGN(na->nla_len), na = NLA_NEXT(na)) {
+	if (na->nla_type != TASKSTATS_TYPE_AGGR_PID)
+	    continue;
+	pid = -1;
+	nlen = na->nla_len - NLA_HDRLEN;
+	for (nested = NLA_DATA(na); nlen >= NLA_HDRLEN && nested->nla_len >= NLA_HDRLEN;
+	     nlen -= NLA_ALIGN(nested->nla_len), nested = NLA_NEXT(nested)) {
+	    if (nested->nla_type == TASKSTATS_TYPE_PID)
+		pid = *(__uint32_t *)NLA_DATA(nested);
+	    else if (nested->nla_type == TASKSTATS_TYPE_STATS && pid >= 0) {
+		const struct taskstats *ts = NLA_DATA(nested);
+
+		taskstats_extract(ts, nested->nla_len - NLA_HDRLEN, &stats);
+		strncpy(comm, ts->ac_comm, TS_COMM_LEN);
+		comm[TS_COMM_LEN] = '\0';
+		callback(pid, &stats, comm, arg);
+		count++;
+	    }
+	}
+    }
+    return count;
+}
+
+int
+taskstats_init(int exits)
+{
+    char	cpumask[32];
+    int		sts, ncpus;
+
+    if ((query_fd = genl_open()) < 0)
+	return query_fd;
+    if ((sts = genl_family(query_fd, TASKSTATS_GENL_NAME)) < 0) {
+	close(query_fd);
+	query_fd = -1;
+	return sts;
+    }
+    family = sts;
+
+    if (!exits)
+	return 0;
+
+    /*
+     * Exit notifications arrive on their own socket, to keep them apart
+     * from replies to our own requests; register interest in all CPUs.
+     */
+    if ((exits_fd = genl_open()) < 0)
+	return exits_fd;
+    ncpus = sysconf(_SC_NPROCESSORS_CONF);
+    snprintf(cpumask, sizeof(cpumask), "0-%d", ncpus > 0 ? ncpus - 1 : 0);
+    if ((sts = genl_send(exits_fd, family, TASKSTATS_CMD_GET,
+			TASKSTATS_CMD_ATTR_REGISTER_CPUMASK,
+			cpumask, strlen(cpumask)+1, 0)) < 0) {
+	close(exits_fd);
+	exits_fd = -1;
+	return sts;
+    }
+    return 0;
+}
+
+int
+taskstats_active(void)
+{
+    return query_fd >= 0;
+}
+
+int
+taskstats_query(const int *pids, int count, taskstats_callback_t callback, void *arg)
+{
+    struct nlmsghdr	*nlh;
+    __uint32_t		pid;
+    char		buf[16384];
+    int			i, n, len, sent, pending, replies = 0, errors = 0;
+
+    if (query_fd < 0)
+	return -ENOTCONN;
+
+    for (i = 0; i < count; i += sent) {
+	for (sent = 0; sent < TASKSTATS_WINDOW && i + sent < count; sent++) {
+	    pid = pids[i + sent];
+	    if (genl_send(query_fd, family, TASKSTATS_CMD_GET,
+			TASKSTATS_CMD_ATTR_PID, &pid, sizeof(pid), ++seqno) < 0)
+		break;
+	}
+	if (sent == 0)
+	    return replies ? replies : -oserror();
+
+	/* each request is answered by one message, stats or error */
+	for (pending = sent; pending > 0; ) {
+	    if ((len = recv(query_fd, buf, sizeof(buf), 0)) < 0) {
+		if (oserror() == EINTR)
+		    continue;
+		return replies ? replies : -oserror();
+	    }
+	    for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len);
+		 nlh = NLMSG_NEXT(nlh, len)) {
+		pending--;
+		if (nlh->nlmsg_type == NLMSG_ERROR) {
+		    errors++;
+		    continue;
+		}
+		if ((n = taskstats_message(nlh, callback, arg)) > 0)
+		    replies += n;
+	    }
+	}
+
+	/*
+	 * Typically EPERM for all, as the credentials of an unprivileged
+	 * client are in effect - give up early, the caller falls back to
+	 * the /proc files.
+	 */
+	if (replies == 0 && errors == sent)
+	    break;
+    }
+
+#if PCP_DEBUG
+    if (pmDebug & DBG_TRACE_LIBPMDA)
+	fprintf(stderr, "taskstats_query: %d tasks, %d replies, %d errors\n",
+		count, replies, errors);
+#endif
+    return replies;
+}
+
+int
+taskstats_exits(taskstats_callback_t callback, void *arg)
+{
+    struct nlmsghdr	*nlh;
+    char		buf[16384];
+    int			len, count = 0;
+
+    if (exits_fd < 0)
+	return 0;
+
+    for (;;) {
+	if ((len = recv(exits_fd, buf, sizeof(buf), MSG_DONTWAIT)) < 0) {
+	    if (oserror() == EINTR)
+		continue;
+	    if (oserror() == ENOBUFS) {
+		/* notifications were dropped, carry on with what's next */
+		__pmNotifyErr(LOG_WARNING, "taskstats: exit notifications lost");
+		continue;
+	    }
+	    break;	/* EAGAIN - all drained */
+	}
+	for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len);
+	     nlh = NLMSG_NEXT(nlh, len)) {
+	    if (nlh->nlmsg_type == family)
+		count += taskstats_message(nlh, callback, arg);
+	}
+    }
+    return count;
+}
@@ -0,0 +1,51 @@
+/*
+ * Linux per-task accounting via the TASKSTATS generic netlink family
+ *
+ * Copyright (c) 2015 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#ifndef _TASKSTATS_H
+#define _TASKSTATS_H
+
+/*
+ * Subset of struct taskstats that overlaps /proc/<pid>/{io,schedstat}
+ */
+typedef struct {
+    __uint32_t		uid;		/* ac_uid, for exited task access checks */
+    __uint64_t		cputime;	/* nsec on-cpu (schedstat field 0) */
+    __uint64_t		rundelay;	/* nsec on a runqueue (schedstat field 1) */
+    __uint64_t		pcount;		/* timeslices run (schedstat field 2) */
+    __uint64_t		rchar;
+    __uint64_t		wchar;
+    __uint64_t		syscr;
+    __uint64_t		syscw;
+    __uint64_t		read_bytes;
+    __uint64_t		write_bytes;
+    __uint64_t		cancelled_write_bytes;
+} proc_taskstats_t;
+
+/* called once for each task reported, with its command name (if known) */
+typedef void (*taskstats_callback_t)(int, const proc_taskstats_t *, const char *, void *);
+
+/* open netlink sockets, optionally registering for task exit notifications */
+extern int taskstats_init(int);
+
+/* non-zero if the netlink backend is available */
+extern int taskstats_active(void);
+
+/* request accounting for a batch of tasks, returns number of replies */
+extern int taskstats_query(const int *, int, taskstats_callback_t, void *);
+
+/* drain pending task exit notifications, returns number of exited tasks */
+extern int taskstats_exits(taskstats_callback_t, void *);
+
+#endif /* _TASKSTATS_H */
@@ -103,6 +103,9 @@ metrictype(int mtype)
     case MMV_TYPE_ELAPSED:
 	type = "elapsed";
 	break;
+    case MMV_TYPE_HISTOGRAM:
+	type = "histogram";
+	break;
     default:
 	type = "?";
 	break;
@@ -233,6 +236,9 @@ dump_values(void *addr, int idx, long base, __uint64_t offset, __int32_t count)
 		printf("Bad ELAPSED 'extra' value found!");
 	    break;
 	}
+	case MMV_TYPE_HISTOGRAM:
+	    printf(" = histogram at %"PRIi64, vals[i].extra);
+	    break;
 	default:
 	    printf("Unknown type %d", m->type);
 	}
@@ -257,6 +263,117 @@ dump_strings(void *addr, int idx, long base, __uint64_t offset, __int32_t count)
     }
 }
 
+void
+dump_hash(void *addr, int idx, long base, __uint64_t offset, __int32_t count)
+{
+    int i, used = 0;
+    mmv_disk_hash_t * hash = (mmv_disk_hash_t *)
+			((char *)addr + offset);
+
+    for (i = 0; i < count; i++)
+	if (hash[i].value)
+	    used++;
+
+    printf("\nTOC[%d]: offset %ld, hash offset %"PRIu64" (%d entries, %d used)\n",
+		idx, base, offset, count, used);
+
+    for (i = 0; i < count; i++) {
+	if (hash[i].value == 0)
+	    continue;
+	printf("  [%u/%"PRIu64"] value %u, hash 0x%08x\n",
+		i, offset + i * sizeof(mmv_disk_hash_t),
+		hash[i].value, hash[i].hash);
+    }
+}
+
+void
+dump_shards(void *addr, int idx, long base, __uint64_t offset, __int32_t count)
+{
+    int i, j, k;
+    mmv_disk_header_t * hdr = (mmv_disk_header_t *) addr;
+    mmv_disk_toc_t * toc = (mmv_disk_toc_t *)
+		((char *)addr + sizeof(mmv_disk_header_t));
+
+    printf("\nTOC[%d]: offset %ld, shards offset %"PRIu64" (%d per value)\n",
+		idx, base, offset, count);
+
+    for (i = 0; i < hdr->tocs; i++) {
+	mmv_disk_value_t * vals = (mmv_disk_value_t *)
+			((char *)addr + toc[i].offset);
+
+	if (toc[i].type != MMV_TOC_VALUES)
+	    continue;
+	for (j = 0; j < toc[i].count; j++) {
+	    mmv_disk_metric_t * m = (mmv_disk_metric_t *)
+				((char *)addr + vals[j].metric);
+	    mmv_disk_shard_t * shard;
+	    __uint64_t total = 0;
+
+	    if (m->type != MMV_TYPE_I32 && m->type != MMV_TYPE_U32 &&
+		m->type != MMV_TYPE_I64 && m->type != MMV_TYPE_U64)
+		continue;
+	    if (vals[j].extra == 0)
+		continue;
+
+	    shard = (mmv_disk_shard_t *)((char *)addr + vals[j].extra);
+	    for (k = 0; k < count; k++) {
+		if (m->type == MMV_TYPE_I32 || m->type == MMV_TYPE_U32)
+		    total += shard[k].value.ul;
+		else
+		    total += shard[k].value.ull;
+	    }
+	    if (m->type == MMV_TYPE_I32 || m->type == MMV_TYPE_U32)
+		total = (__uint32_t)total;
+	    printf("  [%u/%"PRIi64"] %s", m->item, vals[j].extra, m->name);
+	    if (m->indom && m->indom != PM_IN_NULL) {
+		mmv_disk_instance_t *indom = (mmv_disk_instance_t *)
+				((char *)addr + vals[j].instance);
+		printf("[%d or \"%s\"]", indom->internal, indom->external);
+	    }
+	    printf(" shards total = %"PRIu64"\n", total);
+	}
+    }
+}
+
+void
+dump_histograms(void *addr, int idx, long base, __uint64_t offset, __int32_t count)
+{
+    int i, j, k;
+    mmv_disk_header_t * hdr = (mmv_disk_header_t *) addr;
+    mmv_disk_toc_t * toc = (mmv_disk_toc_t *)
+		((char *)addr + sizeof(mmv_disk_header_t));
+
+    printf("\nTOC[%d]: offset %ld, histograms offset %"PRIu64" (%d entries)\n",
+		idx, base, offset, count);
+
+    for (i = 0; i < hdr->tocs; i++) {
+	mmv_disk_value_t * vals = (mmv_disk_value_t *)
+			((char *)addr + toc[i].offset);
+
+	if (toc[i].type != MMV_TOC_VALUES)
+	    continue;
+	for (j = 0; j < toc[i].count; j++) {
+	    mmv_disk_metric_t * m = (mmv_disk_metric_t *)
+				((char *)addr + vals[j].metric);
+	    mmv_disk_histogram_t * h;
+
+	    if (m->type != MMV_TYPE_HISTOGRAM || vals[j].extra == 0)
+		continue;
+
+	    h = (mmv_disk_histogram_t *)((char *)addr + vals[j].extra);
+	    printf("  [%u/%"PRIi64"] %s max = %"PRIu64"\n",
+		    m->item, vals[j].extra, m->name, h->max);
+	    for (k = 0; k < MMV_HIST_BUCKETS; k++) {
+		if (h->buckets[k] == 0)
+		    continue;
+		printf("    [%d or \"%"PRIu64"-%"PRIu64"\"] = %"PRIu64"\n", k,
+			mmv_histogram_lower(k), mmv_histogram_upper(k),
+			h->buckets[k]);
+	    }
+	}
+    }
+}
+
 int
 dump(const char *file, void *addr)
 {
@@ -270,7 +387,7 @@ dump(const char *file, void *addr)
 		hdr->magic[0], hdr->magic[1], hdr->magic[2]);
 	return 1;
     }
-    if (hdr->version != MMV_VERSION) {
+    if (hdr->version < MMV_VERSION1 || hdr->version > MMV_VERSION) {
 	printf("version %d not supported\n", hdr->version);
 	return 1;
     }
@@ -306,6 +423,15 @@ dump(const char *file, void *addr)
 	case MMV_TOC_STRINGS:
 	    dump_strings(addr, i, base, toc[i].offset, toc[i].count);
 	    break;
+	case MMV_TOC_HASH:
+	    dump_hash(addr, i, base, toc[i].offset, toc[i].count);
+	    break;
+	case MMV_TOC_SHARDS:
+	    dump_shards(addr, i, base, toc[i].offset, toc[i].count);
+	    break;
+	case MMV_TOC_HISTOGRAMS:
+	    dump_histograms(addr, i, base, toc[i].offset, toc[i].count);
+	    break;
 	default:
 	    printf("Unrecognised TOC[%d] type: 0x%x\n", i, toc[i].type);
 	}
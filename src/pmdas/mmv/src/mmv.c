@@ -31,6 +31,9 @@
 #include "./domain.h"
 #include <sys/stat.h>
 #include <ctype.h>
+#ifdef IS_LINUX
+#include <sys/inotify.h>
+#endif
 
 static int isDSO = 1;
 static char *username;
@@ -57,8 +60,20 @@ static int incnt;
 
 static int reload;
 static __pmnsTree * pmns;
+static int pmns_stale;			/* names removed, rebuild before use */
+static int pmns_rehash;			/* names added, rehash before use */
 static int statsdir_code;		/* last statsdir stat code */
 static time_t statsdir_ts;		/* last statsdir timestamp */
+static char ** pending;			/* clients still being created */
+static int npending;
+
+#ifdef IS_LINUX
+#define NOTIFY_MASK	(IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_ATTRIB | \
+			 IN_MOVED_FROM | IN_MOVED_TO | \
+			 IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+static int notify_fd = -1;		/* inotify instance */
+#endif
+static int notify_wd = -1;		/* watch on statsdir, if any */
 static char * prefix = "mmv";
 
 static char * pcptmpdir;		/* probably /var/tmp */
@@ -74,10 +89,22 @@ typedef struct {
     mmv_disk_metric_t *	metrics;	/* metric descs in mmap */
     int		vcnt;			/* number of values */
     int		mcnt;			/* number of metrics */
+    int		nshards;		/* shards per sharded value */
+    int		nhistograms;		/* number of histograms */
+    pmInDom	hindom;			/* histogram buckets, if any */
+    int		hitem;			/* last item for derived metrics */
     pid_t	pid;			/* process identifier */
     int		cluster;		/* cluster identifier */
     __int64_t	len;			/* mmap region len */
     __uint64_t	gen;			/* generation number on open */
+    dev_t	dev;			/* file identity, to notice */
+    ino_t	ino;			/* replacement when scanning */
+    int		seen;			/* found by the latest scan */
+    pmdaMetric * mtab;			/* metrics of this client */
+    char **	mnames;			/* and their names */
+    int		mtabcnt;
+    pmdaIndom *	itab;			/* indoms of this client */
+    int		itabcnt;
 } stats_t;
 
 static stats_t * slist;
@@ -117,8 +144,10 @@ choose_cluster(int requested, const char *path)
 }
 
 static int
-create_client_stat(const char *client, const char *path, size_t size)
+create_client_stat(const char *client, const char *path, struct stat *statbuf)
 {
+    size_t size = statbuf->st_size;
+    stats_t *sp;
     int fd;
 
     if (pmDebug & DBG_TRACE_APPL0)
@@ -137,7 +166,7 @@ create_client_stat(const char *client, const char *path, size_t size)
 		return -EINVAL;
 	    }
 
-	    if (hdr->version != MMV_VERSION) {
+	    if (hdr->version < MMV_VERSION1 || hdr->version > MMV_VERSION) {
 		__pmNotifyErr(LOG_ERR, "%s: %s client version %d "
 				"not supported (current is %d)",
 				pmProgname, prefix, hdr->version, MMV_VERSION);
@@ -164,39 +193,54 @@ create_client_stat(const char *client, const char *path, size_t size)
 		__pmNotifyErr(LOG_DEBUG, "MMV: %s: loading %s client: %d \"%s\"",
 				    pmProgname, prefix, cluster, path);
 
-	    slist = realloc(slist, sizeof(stats_t)*(scnt+1));
-	    if (slist != NULL) {
+	    sp = realloc(slist, sizeof(stats_t)*(scnt+1));
+	    if (sp != NULL) {
+		slist = sp;
+		memset(&slist[scnt], 0, sizeof(stats_t));
 		slist[scnt].name = strdup(client);
 		slist[scnt].addr = m;
 		slist[scnt].pid = (pid_t)((hdr->flags & MMV_FLAG_PROCESS)? hdr->process : 0);
 		slist[scnt].cluster = cluster;
 		slist[scnt].mcnt = 0;
+		slist[scnt].nshards = 0;
+		slist[scnt].nhistograms = 0;
+		slist[scnt].hindom = PM_INDOM_NULL;
+		slist[scnt].hitem = 1 << 10;
 		slist[scnt].gen = hdr->g1;
 		slist[scnt].len = size;
+		slist[scnt].dev = statbuf->st_dev;
+		slist[scnt].ino = statbuf->st_ino;
+		slist[scnt].seen = 1;
 		scnt++;
 	    } else {
 		__pmNotifyErr(LOG_ERR, "%s: client \"%s\" out of memory - %s",
 				pmProgname, client, osstrerror());
 		__pmMemoryUnmap(m, size);
-		scnt = 0;
+		return -ENOMEM;
 	    }
 	} else {
             __pmNotifyErr(LOG_ERR, "%s: failed to memory map \"%s\" - %s",
 				pmProgname, path, osstrerror());
+	    return -ENOMEM;
 	}
     } else {
+	int sts = -oserror();
+
 	__pmNotifyErr(LOG_ERR, "%s: failed to open client file \"%s\" - %s",
 				pmProgname, client, osstrerror());
+	return sts;
     }
     return 0;
 }
 
-/* check validity of client metric name, return non-zero if bad or duplicate */
+/*
+ * check validity of client metric name, return non-zero if bad;
+ * duplicates are found when names are added to the PMNS
+ */
 static int
 verify_metric_name(const char *name, int pos, stats_t *s)
 {
     const char *p = name;
-    pmID pmid;
 
     if (pmDebug & DBG_TRACE_APPL0)
 	__pmNotifyErr(LOG_DEBUG, "MMV: verify_metric_name: %s", name);
@@ -213,8 +257,6 @@ verify_metric_name(const char *name, int pos, stats_t *s)
 			    pos, s->name, *p);
 	return -EINVAL;
     }
-    if (pmdaTreePMID(pmns, name, &pmid) == 0)
-	return -EEXIST;
     return 0;
 }
 
@@ -233,43 +275,68 @@ verify_metric_item(unsigned int item, char *name, stats_t *s)
     return 0;
 }
 
+/* append a metric to those of a client */
+static pmdaMetric *
+new_metric(stats_t *s, const char *name)
+{
+    pmdaMetric *mp;
+    char **np;
+
+    if ((mp = realloc(s->mtab, sizeof(pmdaMetric) * (s->mtabcnt + 1))) != NULL)
+	s->mtab = mp;
+    if ((np = realloc(s->mnames, sizeof(char *) * (s->mtabcnt + 1))) != NULL)
+	s->mnames = np;
+    if (mp == NULL || np == NULL ||
+	(s->mnames[s->mtabcnt] = strdup(name)) == NULL) {
+	__pmNotifyErr(LOG_ERR, "cannot grow MMV metric list: %s", s->name);
+	return NULL;
+    }
+    mp = &s->mtab[s->mtabcnt++];
+    memset(mp, 0, sizeof(pmdaMetric));
+    return mp;
+}
+
 static int
 create_metric(pmdaExt *pmda, stats_t *s, mmv_disk_metric_t *m, char *name, pmID pmid)
 {
+    pmdaMetric *mp;
+
     if (pmDebug & DBG_TRACE_APPL0)
 	__pmNotifyErr(LOG_DEBUG, "MMV: create_metric: %s - %s", name, pmIDStr(pmid));
 
-    metrics = realloc(metrics, sizeof(pmdaMetric) * (mcnt + 1));
-    if (metrics == NULL)  {
-	__pmNotifyErr(LOG_ERR, "cannot grow MMV metric list: %s", s->name);
+    if ((mp = new_metric(s, name)) == NULL)
 	return -ENOMEM;
-    }
 
-    metrics[mcnt].m_user = NULL;
-    metrics[mcnt].m_desc.pmid = pmid;
+    mp->m_user = NULL;
+    mp->m_desc.pmid = pmid;
 
     if (m->type == MMV_TYPE_ELAPSED) {
 	pmUnits unit = PMDA_PMUNITS(0,1,0,0,PM_TIME_USEC,0);
-	metrics[mcnt].m_desc.sem = PM_SEM_COUNTER;
-	metrics[mcnt].m_desc.type = MMV_TYPE_I64;
-	metrics[mcnt].m_desc.units = unit;
+	mp->m_desc.sem = PM_SEM_COUNTER;
+	mp->m_desc.type = MMV_TYPE_I64;
+	mp->m_desc.units = unit;
+    } else if (m->type == MMV_TYPE_HISTOGRAM) {
+	pmUnits unit = PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE);
+	mp->m_desc.sem = PM_SEM_COUNTER;
+	mp->m_desc.type = PM_TYPE_U64;
+	mp->m_desc.units = unit;
     } else {
 	if (m->semantics)
-	    metrics[mcnt].m_desc.sem = m->semantics;
+	    mp->m_desc.sem = m->semantics;
 	else
-	    metrics[mcnt].m_desc.sem = PM_SEM_COUNTER;
-	metrics[mcnt].m_desc.type = m->type;
-	memcpy(&metrics[mcnt].m_desc.units, &m->dimension, sizeof(pmUnits));
+	    mp->m_desc.sem = PM_SEM_COUNTER;
+	mp->m_desc.type = m->type;
+	memcpy(&mp->m_desc.units, &m->dimension, sizeof(pmUnits));
     }
-    metrics[mcnt].m_desc.indom = (!m->indom || m->indom == PM_INDOM_NULL) ?
+    if (m->type == MMV_TYPE_HISTOGRAM)
+	mp->m_desc.indom = s->hindom;
+    else
+	mp->m_desc.indom = (!m->indom || m->indom == PM_INDOM_NULL) ?
 				PM_INDOM_NULL : pmInDom_build(pmda->e_domain,
 					(s->cluster << 11) | m->indom);
     if (pmDebug & DBG_TRACE_APPL0)
-	__pmNotifyErr(LOG_DEBUG, "MMV: map_stats adding metric[%d] %s %s from %s\n",
-			mcnt, name, pmIDStr(pmid), s->name);
-
-    mcnt++;
-    __pmAddPMNSNode(pmns, pmid, name);
+	__pmNotifyErr(LOG_DEBUG, "MMV: map_client adding metric[%d] %s %s from %s\n",
+			s->mtabcnt - 1, name, pmIDStr(pmid), s->name);
 
     return 0;
 }
@@ -290,9 +357,9 @@ verify_indom_serial(pmdaExt *pmda, int serial, stats_t *s, pmInDom *p, pmdaIndom
     }
 
     *p = pmInDom_build(pmda->e_domain, (s->cluster << 11) | serial);
-    for (index = 0; index < incnt; index++) {
-	*i = &indoms[index];
-	if (indoms[index].it_indom == *p)
+    for (index = 0; index < s->itabcnt; index++) {
+	*i = &s->itab[index];
+	if (s->itab[index].it_indom == *p)
 	    return -EEXIST;
     }
     *i = NULL;
@@ -344,6 +411,24 @@ update_indom(pmdaExt *pmda, stats_t *s, mmv_disk_indom_t *id, pmdaIndom *ip)
     return 0;
 }
 
+/* append an indom to those of a client */
+static pmdaIndom *
+new_indom(stats_t *s)
+{
+    pmdaIndom *ip;
+
+    ip = realloc(s->itab, sizeof(pmdaIndom) * (s->itabcnt + 1));
+    if (ip == NULL) {
+	__pmNotifyErr(LOG_ERR, "%s: cannot grow indom list in %s",
+			pmProgname, s->name);
+	return NULL;
+    }
+    s->itab = ip;
+    ip = &s->itab[s->itabcnt++];
+    memset(ip, 0, sizeof(pmdaIndom));
+    return ip;
+}
+
 static int
 create_indom(pmdaExt *pmda, stats_t *s, mmv_disk_indom_t *id, pmInDom indom)
 {
@@ -353,13 +438,8 @@ create_indom(pmdaExt *pmda, stats_t *s, mmv_disk_indom_t *id, pmInDom indom)
     if (pmDebug & DBG_TRACE_APPL0)
 	__pmNotifyErr(LOG_DEBUG, "MMV: create_indom: %u", id->serial);
 
-    indoms = realloc(indoms, sizeof(pmdaIndom) * (incnt + 1));
-    if (indoms == NULL) {
-	__pmNotifyErr(LOG_ERR, "%s: cannot grow indom list in %s",
-			pmProgname, s->name);
+    if ((ip = new_indom(s)) == NULL)
 	return -ENOMEM;
-    }
-    ip = &indoms[incnt++];
     ip->it_indom = indom;
     ip->it_set = (pmdaInstid *)calloc(id->count, sizeof(pmdaInstid));
     if (ip->it_set != NULL) {
@@ -379,64 +459,512 @@ create_indom(pmdaExt *pmda, stats_t *s, mmv_disk_indom_t *id, pmInDom indom)
     return 0;
 }
 
+/*
+ * Histograms - the buckets are exported as a counter over an instance
+ * domain shared by all histograms of a client, with instance names of
+ * the form "lower-upper".  Percentiles and the maximum are exported as
+ * derived metrics, computed from the buckets at fetch time; the m_user
+ * field of these encodes which statistic and the histogram item.
+ */
+#define HIST_P50	1
+#define HIST_P99	2
+#define HIST_MAX	3
+#define HIST_ITEMBITS	10
+
+static const struct {
+    int		kind;
+    char	*suffix;
+    char	*oneline;
+} hist_derived[] = {
+    { HIST_P50, "p50", "Median of values recorded in histogram" },
+    { HIST_P99, "p99", "99th percentile of values recorded in histogram" },
+    { HIST_MAX, "max", "Largest value recorded in histogram" },
+};
+
+static char *
+histogram_name(int bucket)
+{
+    static char	names[MMV_HIST_BUCKETS][48];
+    static int	setup;
+    int		i;
+
+    if (!setup) {
+	for (i = 0; i < MMV_HIST_BUCKETS; i++)
+	    snprintf(names[i], sizeof(names[i]), "%llu-%llu",
+			(unsigned long long)mmv_histogram_lower(i),
+			(unsigned long long)mmv_histogram_upper(i));
+	setup = 1;
+    }
+    return names[bucket];
+}
+
+/* serial for the bucket indom, choosing one not used by the client */
+static int
+histogram_indom(pmdaExt *pmda, stats_t *s)
+{
+    mmv_disk_header_t * hdr = (mmv_disk_header_t *)s->addr;
+    mmv_disk_toc_t * toc = (mmv_disk_toc_t *)
+			((char *)s->addr + sizeof(mmv_disk_header_t));
+    mmv_disk_indom_t * id;
+    pmdaIndom *ip;
+    int i, j, serial;
+
+    if (s->hindom != PM_INDOM_NULL)
+	return 0;
+
+    for (serial = (1 << 11) - 1; serial > 0; serial--) {
+	for (i = 0; i < hdr->tocs; i++) {
+	    if (toc[i].type != MMV_TOC_INDOMS)
+		continue;
+	    id = (mmv_disk_indom_t *)((char *)s->addr + toc[i].offset);
+	    for (j = 0; j < toc[i].count; j++)
+		if (id[j].serial == serial)
+		    break;
+	    if (j < toc[i].count)
+		break;
+	}
+	if (i == hdr->tocs)
+	    break;
+    }
+    if (serial == 0)
+	return -EINVAL;
+
+    if ((ip = new_indom(s)) == NULL)
+	return -ENOMEM;
+    ip->it_set = (pmdaInstid *)calloc(MMV_HIST_BUCKETS, sizeof(pmdaInstid));
+    if (ip->it_set == NULL) {
+	__pmNotifyErr(LOG_ERR, "%s: cannot get memory for histogram in %s",
+			pmProgname, s->name);
+	return -ENOMEM;
+    }
+    ip->it_indom = pmInDom_build(pmda->e_domain, (s->cluster << 11) | serial);
+    ip->it_numinst = MMV_HIST_BUCKETS;
+    for (i = 0; i < MMV_HIST_BUCKETS; i++) {
+	ip->it_set[i].i_inst = i;
+	ip->it_set[i].i_name = histogram_name(i);
+    }
+    s->hindom = ip->it_indom;
+    return 0;
+}
+
+/* next item for a derived metric, choosing one not used by the client */
+static int
+histogram_item(stats_t *s)
+{
+    int i;
+
+    while (--s->hitem > 0) {
+	for (i = 0; i < s->mcnt; i++)
+	    if (s->metrics[i].item == s->hitem)
+		break;
+	if (i == s->mcnt)
+	    return s->hitem;
+    }
+    return -EINVAL;
+}
+
+static int
+create_histogram(pmdaExt *pmda, stats_t *s, mmv_disk_metric_t *m, char *name, pmID pmid)
+{
+    char *suffix = name + strlen(name);
+    pmdaMetric *mp;
+    pmID derived;
+    int i, item, sts;
+
+    if ((sts = histogram_indom(pmda, s)) < 0)
+	return sts;
+
+    strcpy(suffix, ".bucket");
+    if ((sts = create_metric(pmda, s, m, name, pmid)) < 0)
+	return sts;
+
+    for (i = 0; i < sizeof(hist_derived)/sizeof(hist_derived[0]); i++) {
+	sprintf(suffix, ".%s", hist_derived[i].suffix);
+	if (verify_metric_name(name, i, s) != 0)
+	    continue;
+	if ((item = histogram_item(s)) < 0) {
+	    __pmNotifyErr(LOG_WARNING, "no item for %s in %s, ignored",
+			    name, s->name);
+	    break;
+	}
+	derived = pmid_build(pmda->e_domain, s->cluster, item);
+
+	if ((mp = new_metric(s, name)) == NULL)
+	    return -ENOMEM;
+	mp->m_user = (void *)(__psint_t)
+		((hist_derived[i].kind << HIST_ITEMBITS) | m->item);
+	mp->m_desc.pmid = derived;
+	mp->m_desc.type = PM_TYPE_U64;
+	mp->m_desc.sem = PM_SEM_INSTANT;
+	mp->m_desc.indom = PM_INDOM_NULL;
+	memcpy(&mp->m_desc.units, &m->dimension, sizeof(pmUnits));
+	if (pmDebug & DBG_TRACE_APPL0)
+	    __pmNotifyErr(LOG_DEBUG, "MMV: map_client adding metric[%d] %s %s from %s\n",
+			s->mtabcnt - 1, name, pmIDStr(derived), s->name);
+    }
+    return 0;
+}
+
+/*
+ * Walk the TOC of a newly mapped client, building its metrics and indoms
+ */
 static void
-map_stats(pmdaExt *pmda)
+map_client(pmdaExt *pmda, stats_t *s)
 {
-    struct dirent **files;
-    char name[64];
-    int need_reload = 0;
-    int i, j, k, sts, num;
+    mmv_disk_header_t * hdr = (mmv_disk_header_t *)s->addr;
+    mmv_disk_toc_t * toc = (mmv_disk_toc_t *)
+			((char *)s->addr + sizeof(mmv_disk_header_t));
+    int j, k;
+
+    for (j = 0; j < hdr->tocs; j++) {
+	switch (toc[j].type) {
+	    case MMV_TOC_METRICS: {
+		mmv_disk_metric_t *ml = (mmv_disk_metric_t *)
+				    ((char *)s->addr + toc[j].offset);
+
+		s->metrics = ml;
+		s->mcnt = toc[j].count;
+
+		for (k = 0; k < toc[j].count; k++) {
+		    char name[MAXPATHLEN];
+		    pmID pmid;
+
+		    /* build name, check its legitimate and unique */
+		    if (hdr->flags & MMV_FLAG_NOPREFIX)
+			sprintf(name, "%s.", prefix);
+		    else
+			sprintf(name, "%s.%s.", prefix, s->name);
+		    strcat(name, ml[k].name);
+		    if (verify_metric_name(name, k, s) != 0)
+			continue;
+		    if (verify_metric_item(ml[k].item, name, s) != 0)
+			continue;
+
+		    pmid = pmid_build(pmda->e_domain, s->cluster, ml[k].item);
+		    if (ml[k].type == MMV_TYPE_HISTOGRAM)
+			create_histogram(pmda, s, &ml[k], name, pmid);
+		    else
+			create_metric(pmda, s, &ml[k], name, pmid);
+		}
+		break;
+	    }
+
+	    case MMV_TOC_INDOMS: {
+		mmv_disk_indom_t * id = (mmv_disk_indom_t *)
+				    ((char *)s->addr + toc[j].offset);
+
+		for (k = 0; k < toc[j].count; k++) {
+		    int sts, serial = id[k].serial;
+		    pmInDom pmindom;
+		    pmdaIndom *ip;
+
+		    sts = verify_indom_serial(pmda, serial, s, &pmindom, &ip);
+		    if (sts == -EINVAL)
+			continue;
+		    else if (sts == -EEXIST)
+			/* see if we have new instances to add here */
+			update_indom(pmda, s, &id[k], ip);
+		    else
+			/* first time we've observed this indom */
+			create_indom(pmda, s, &id[k], pmindom);
+		}
+		break;
+	    }
+
+	    case MMV_TOC_VALUES: {
+		s->vcnt = toc[j].count;
+		s->values = (mmv_disk_value_t *)
+		    ((char *)s->addr + toc[j].offset);
+		break;
+	    }
 
-    if (pmns)
-	__pmFreePMNS(pmns);
+	    case MMV_TOC_SHARDS: {
+		int n = toc[j].count;
 
-    if ((sts = __pmNewPMNS(&pmns)) < 0) {
-	__pmNotifyErr(LOG_ERR, "%s: failed to create new pmns: %s\n",
-			pmProgname, pmErrStr(sts));
-	pmns = NULL;
+		/* a power of two, within reason */
+		if (n > 0 && n <= MMV_SHARDMAX && (n & (n - 1)) == 0)
+		    s->nshards = n;
+		break;
+	    }
+
+	    case MMV_TOC_HISTOGRAMS: {
+		s->nhistograms = toc[j].count;
+		break;
+	    }
+
+	    default:
+		break;
+	}
+    }
+}
+
+static void
+free_client(stats_t *s)
+{
+    int i;
+
+    for (i = 0; i < s->mtabcnt; i++)
+	free(s->mnames[i]);
+    for (i = 0; i < s->itabcnt; i++)
+	free(s->itab[i].it_set);
+    free(s->mnames);
+    free(s->mtab);
+    free(s->itab);
+    free(s->name);
+    __pmMemoryUnmap(s->addr, s->len);
+}
+
+static void
+remove_client(int i)
+{
+    if (pmDebug & DBG_TRACE_APPL0)
+	__pmNotifyErr(LOG_DEBUG, "MMV: %s: removing %s client: %d \"%s\"",
+			pmProgname, prefix, slist[i].cluster, slist[i].name);
+
+    free_client(&slist[i]);
+    scnt--;
+    memmove(&slist[i], &slist[i+1], (scnt - i) * sizeof(stats_t));
+    pmns_stale = 1;
+}
+
+/* add names of a client to the PMNS, unless it is to be rebuilt anyway */
+static void
+pmns_add(stats_t *s)
+{
+    int i, sts;
+
+    if (pmns == NULL || pmns_stale)
 	return;
+    for (i = 0; i < s->mtabcnt; i++) {
+	sts = __pmAddPMNSNode(pmns, s->mtab[i].m_desc.pmid, s->mnames[i]);
+	if (sts < 0)
+	    __pmNotifyErr(LOG_WARNING, "duplicate metric %s in %s, ignored",
+			    s->mnames[i], s->name);
     }
+    pmns_rehash = 1;
+}
 
-    /* hard-coded metrics (not from mmap'd files */
-    snprintf(name, sizeof(name), "%s.reload", prefix);
-    __pmAddPMNSNode(pmns, pmid_build(pmda->e_domain, 0, 0), name);
-    snprintf(name, sizeof(name), "%s.debug", prefix);
-    __pmAddPMNSNode(pmns, pmid_build(pmda->e_domain, 0, 1), name);
-    mcnt = 2;
+/*
+ * The PMNS is only needed for name lookups, so it is brought up to date
+ * here rather than whenever clients come and go - in particular, never
+ * on the fetch path.
+ */
+static void
+pmns_update(pmdaExt *pmda)
+{
+    char name[64];
+    int i, sts;
 
-    if (indoms != NULL) {
-	for (i = 0; i < incnt; i++)
-	    free(indoms[i].it_set);
-	free(indoms);
-	indoms = NULL;
-	incnt = 0;
+    if (pmns == NULL || pmns_stale) {
+	if (pmns)
+	    __pmFreePMNS(pmns);
+
+	if ((sts = __pmNewPMNS(&pmns)) < 0) {
+	    __pmNotifyErr(LOG_ERR, "%s: failed to create new pmns: %s\n",
+			    pmProgname, pmErrStr(sts));
+	    pmns = NULL;
+	    return;
+	}
+
+	/* hard-coded metrics (not from mmap'd files */
+	snprintf(name, sizeof(name), "%s.reload", prefix);
+	__pmAddPMNSNode(pmns, pmid_build(pmda->e_domain, 0, 0), name);
+	snprintf(name, sizeof(name), "%s.debug", prefix);
+	__pmAddPMNSNode(pmns, pmid_build(pmda->e_domain, 0, 1), name);
+
+	pmns_stale = 0;
+	for (i = 0; i < scnt; i++)
+	    pmns_add(&slist[i]);
+	pmns_rehash = 1;
+    }
+    if (pmns_rehash) {
+	pmdaTreeRebuildHash(pmns, mcnt);	/* for reverse (pmid->name) lookups */
+	pmns_rehash = 0;
+    }
+}
+
+/*
+ * Gather the metrics and indoms of all clients into the tables used by
+ * pmdaFetch, pmdaDesc and pmdaInstance, after the hard-coded metrics.
+ */
+static void
+rebuild_tables(pmdaExt *pmda)
+{
+    pmdaMetric *mp;
+    pmdaIndom *ip;
+    int i, m = 2, n = 1;
+
+    for (i = 0; i < scnt; i++) {
+	m += slist[i].mtabcnt;
+	n += slist[i].itabcnt;
     }
 
-    if (slist != NULL) {
+    mcnt = 2;
+    incnt = 0;
+    if ((mp = realloc(metrics, sizeof(pmdaMetric) * m)) != NULL)
+	metrics = mp;
+    if ((ip = realloc(indoms, sizeof(pmdaIndom) * n)) != NULL)
+	indoms = ip;
+    if (mp == NULL || ip == NULL) {
+	__pmNotifyErr(LOG_ERR, "%s: cannot grow metric and indom lists",
+			pmProgname);
+    } else {
 	for (i = 0; i < scnt; i++) {
-	    free(slist[i].name);
-	    __pmMemoryUnmap(slist[i].addr, slist[i].len);
+	    memcpy(&metrics[mcnt], slist[i].mtab,
+			slist[i].mtabcnt * sizeof(pmdaMetric));
+	    mcnt += slist[i].mtabcnt;
+	    memcpy(&indoms[incnt], slist[i].itab,
+			slist[i].itabcnt * sizeof(pmdaIndom));
+	    incnt += slist[i].itabcnt;
 	}
-	free(slist);
-	slist = NULL;
-	scnt = 0;
     }
 
-    num = scandir(statsdir, &files, NULL, NULL);
-    for (i = 0; i < num; i++) {
-	struct stat statbuf;
-	char path[MAXPATHLEN];
-	char *client;
+    pmda->e_indoms = indoms;
+    pmda->e_nindoms = incnt;
+    pmdaRehash(pmda, metrics, mcnt);
+}
 
-	if (files[i]->d_name[0] == '.')
-	    continue;
+static int
+add_client(pmdaExt *pmda, const char *client)
+{
+    struct stat statbuf;
+    char path[MAXPATHLEN];
+    int sts;
+
+    if (snprintf(path, sizeof(path), "%s%c%s",
+		statsdir, __pmPathSeparator(), client) >= sizeof(path)) {
+	if (pmDebug & DBG_TRACE_APPL0)
+	    __pmNotifyErr(LOG_DEBUG, "MMV: add_client: %s: name too long", client);
+	return -ENAMETOOLONG;
+    }
+    if (stat(path, &statbuf) < 0)
+	return -oserror();
+    if (!S_ISREG(statbuf.st_mode))
+	return -EINVAL;
+    /* just created, not yet sized by the client */
+    if (statbuf.st_size < sizeof(mmv_disk_header_t))
+	return -EAGAIN;
+    if ((sts = create_client_stat(client, path, &statbuf)) < 0)
+	return sts;
+
+    map_client(pmda, &slist[scnt-1]);
+    pmns_add(&slist[scnt-1]);
+    return 0;
+}
+
+static void
+pending_add(const char *client)
+{
+    char **pp;
+    int i;
+
+    for (i = 0; i < npending; i++)
+	if (strcmp(pending[i], client) == 0)
+	    return;
+    if ((pp = realloc(pending, sizeof(char *) * (npending + 1))) == NULL)
+	return;
+    pending = pp;
+    if ((pending[npending] = strdup(client)) != NULL)
+	npending++;
+}
+
+static void
+pending_drop(const char *client)
+{
+    int i;
 
+    for (i = 0; i < npending; i++) {
+	if (strcmp(pending[i], client) == 0) {
+	    free(pending[i]);
+	    pending[i] = pending[--npending];
+	    return;
+	}
+    }
+}
+
+/*
+ * Something changed for the named client - drop any mapping we have,
+ * and map it afresh if the file is (still) there.  Returns non-zero if
+ * metrics or indoms came or went.
+ */
+static int
+refresh_client(pmdaExt *pmda, const char *client)
+{
+    char name[MAXPATHLEN];
+    int i, sts, changed = 0;
+
+    /* may be the name of a client about to be freed */
+    strncpy(name, client, sizeof(name));
+    name[sizeof(name)-1] = '\0';
+
+    pending_drop(name);
+    for (i = 0; i < scnt; i++) {
+	if (strcmp(slist[i].name, name) == 0) {
+	    remove_client(i);
+	    changed = 1;
+	    break;
+	}
+    }
+    if ((sts = add_client(pmda, name)) == 0)
+	changed = 1;
+    else if (sts == -EAGAIN)
+	/* still in flux, try again next time */
+	pending_add(name);
+    return changed;
+}
+
+static int
+retry_pending(pmdaExt *pmda)
+{
+    char **list = pending;
+    int i, n = npending, changed = 0;
+
+    pending = NULL;
+    npending = 0;
+    for (i = 0; i < n; i++) {
+	changed |= refresh_client(pmda, list[i]);
+	free(list[i]);
+    }
+    free(list);
+    return changed;
+}
+
+/*
+ * Compare the directory with the clients we have mapped - new files
+ * are mapped, replaced files remapped and removed files unmapped, and
+ * the rest are left alone.
+ */
+static int
+scan_stats(pmdaExt *pmda)
+{
+    struct dirent **files;
+    struct stat statbuf;
+    char path[MAXPATHLEN];
+    char *client;
+    int i, j, num, changed = 0;
+
+    for (i = 0; i < scnt; i++)
+	slist[i].seen = 0;
+
+    num = scandir(statsdir, &files, NULL, NULL);
+    for (i = 0; i < num; i++) {
 	client = files[i]->d_name;
-	sprintf(path, "%s%c%s", statsdir, __pmPathSeparator(), client);
+	if (client[0] == '.')
+	    continue;
 
-	if (stat(path, &statbuf) >= 0 && S_ISREG(statbuf.st_mode))
-	    if (create_client_stat(client, path, statbuf.st_size) == -EAGAIN)
-		need_reload = 1;
+	for (j = 0; j < scnt; j++)
+	    if (strcmp(slist[j].name, client) == 0)
+		break;
+	if (j < scnt &&
+	    snprintf(path, sizeof(path), "%s%c%s",
+		statsdir, __pmPathSeparator(), client) < sizeof(path)) {
+	    if (stat(path, &statbuf) >= 0 &&
+		statbuf.st_dev == slist[j].dev && statbuf.st_ino == slist[j].ino) {
+		slist[j].seen = 1;
+		continue;
+	    }
+	}
+	changed |= refresh_client(pmda, client);
     }
 
     for (i = 0; i < num; i++)
@@ -444,79 +972,116 @@ map_stats(pmdaExt *pmda)
     if (num > 0)
 	free(files);
 
-    for (i = 0; slist && i < scnt; i++) {
-	stats_t * s = slist + i;
-	mmv_disk_header_t * hdr = (mmv_disk_header_t *)s->addr;
-	mmv_disk_toc_t * toc = (mmv_disk_toc_t *)
-			((char *)s->addr + sizeof(mmv_disk_header_t));
-
-	for (j = 0; j < hdr->tocs; j++) {
-	    switch (toc[j].type) {
-		case MMV_TOC_METRICS: {
-		    mmv_disk_metric_t *ml = (mmv_disk_metric_t *)
-					((char *)s->addr + toc[j].offset);
-
-		    s->metrics = ml;
-		    s->mcnt = toc[j].count;
-
-		    for (k = 0; k < toc[j].count; k++) {
-			char name[MAXPATHLEN];
-			pmID pmid;
-
-			/* build name, check its legitimate and unique */
-			if (hdr->flags & MMV_FLAG_NOPREFIX)
-			    sprintf(name, "%s.", prefix);
-			else
-			    sprintf(name, "%s.%s.", prefix, s->name);
-			strcat(name, ml[k].name);
-			if (verify_metric_name(name, k, s) != 0)
-			    continue;
-			if (verify_metric_item(ml[k].item, name, s) != 0)
-			    continue;
-
-			pmid = pmid_build(pmda->e_domain, s->cluster, ml[k].item);
-			create_metric(pmda, s, &ml[k], name, pmid);
-		    }
-		    break;
-		}
+    for (i = scnt - 1; i >= 0; i--) {
+	if (!slist[i].seen) {
+	    remove_client(i);
+	    changed = 1;
+	}
+    }
+    return changed;
+}
 
-		case MMV_TOC_INDOMS: {
-		    mmv_disk_indom_t * id = (mmv_disk_indom_t *)
-					((char *)s->addr + toc[j].offset);
-
-		    for (k = 0; k < toc[j].count; k++) {
-			int sts, serial = id[k].serial;
-			pmInDom pmindom;
-			pmdaIndom *ip;
-
-			sts = verify_indom_serial(pmda, serial, s, &pmindom, &ip);
-			if (sts == -EINVAL)
-			    continue;
-			else if (sts == -EEXIST)
-			    /* see if we have new instances to add here */
-			    update_indom(pmda, s, &id[k], ip);
-			else
-			    /* first time we've observed this indom */
-			    create_indom(pmda, s, &id[k], pmindom);
-		    }
-		    break;
-		}
+/* unmap everything and start over */
+static void
+map_stats(pmdaExt *pmda)
+{
+    while (scnt > 0)
+	remove_client(scnt - 1);
+    while (npending > 0)
+	pending_drop(pending[0]);
+    scan_stats(pmda);
+}
 
-		case MMV_TOC_VALUES: {
-		    s->vcnt = toc[j].count;
-		    s->values = (mmv_disk_value_t *)
-			((char *)s->addr + toc[j].offset);
-		    break;
-		}
+/*
+ * Where inotify is available the directory is watched, and only those
+ * clients named in events are remapped; otherwise, or when events have
+ * been lost, changes to the directory timestamp trigger a scan.
+ */
+static int
+notify_watch(void)
+{
+#ifdef IS_LINUX
+    if (notify_fd < 0 &&
+	(notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+	if (pmDebug & DBG_TRACE_APPL0)
+	    __pmNotifyErr(LOG_DEBUG, "MMV: inotify_init1: %s", osstrerror());
+	return 0;
+    }
+    if (notify_wd < 0 &&
+	(notify_wd = inotify_add_watch(notify_fd, statsdir, NOTIFY_MASK)) < 0) {
+	if (pmDebug & DBG_TRACE_APPL0)
+	    __pmNotifyErr(LOG_DEBUG, "MMV: inotify_add_watch %s: %s",
+			    statsdir, osstrerror());
+	return 0;
+    }
+    return 1;
+#else
+    return 0;
+#endif
+}
 
-		default:
+static int
+notify_events(pmdaExt *pmda, int *rescan)
+{
+#ifdef IS_LINUX
+    struct inotify_event *ev;
+    char buffer[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char **names = NULL, **np, *p;
+    int i, len, count = 0, changed = 0;
+
+    for (;;) {
+	if ((len = read(notify_fd, buffer, sizeof(buffer))) < 0) {
+	    if (oserror() == EINTR)
+		continue;
+	    break;	/* EAGAIN - all drained */
+	}
+	for (p = buffer; p < buffer + len; p += sizeof(*ev) + ev->len) {
+	    ev = (struct inotify_event *)p;
+	    if (ev->mask & IN_Q_OVERFLOW) {
+		*rescan = 1;
+		continue;
+	    }
+	    if (ev->wd != notify_wd)
+		continue;	/* from an earlier watch */
+	    if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+		/* directory gone or moved, back to checking timestamps */
+		if (!(ev->mask & IN_IGNORED))
+		    inotify_rm_watch(notify_fd, notify_wd);
+		notify_wd = -1;
+		statsdir_ts = 0;
+		*rescan = 1;
+		continue;
+	    }
+	    if (ev->len == 0 || ev->name[0] == '.')
+		continue;
+	    /* several events for one client are common, e.g. create+close */
+	    for (i = 0; i < count; i++)
+		if (strcmp(names[i], ev->name) == 0)
 		    break;
+	    if (i < count)
+		continue;
+	    if ((np = realloc(names, sizeof(char *) * (count + 1))) == NULL) {
+		*rescan = 1;
+		continue;
 	    }
+	    names = np;
+	    if ((names[count] = strdup(ev->name)) != NULL)
+		count++;
+	    else
+		*rescan = 1;
 	}
     }
 
-    pmdaTreeRebuildHash(pmns, mcnt);	/* for reverse (pmid->name) lookups */
-    reload = need_reload;
+    for (i = 0; i < count; i++) {
+	if (!*rescan)
+	    changed |= refresh_client(pmda, names[i]);
+	free(names[i]);
+    }
+    free(names);
+    return changed;
+#else
+    return 0;
+#endif
 }
 
 static int
@@ -562,6 +1127,133 @@ mmv_lookup_stat_metric_value(pmID pmid, unsigned int inst,
     return sts;
 }
 
+/*
+ * Sharded counter - add in the per-thread shards of the value
+ */
+static void
+mmv_shard_sum(stats_t *s, mmv_disk_metric_t *m, mmv_disk_value_t *v,
+		pmAtomValue *atom)
+{
+    mmv_disk_shard_t * shard;
+    int i;
+
+    if (v->extra <= 0 ||
+	v->extra + s->nshards * sizeof(mmv_disk_shard_t) > s->len)
+	return;
+
+    shard = (mmv_disk_shard_t *)((char *)s->addr + v->extra);
+    for (i = 0; i < s->nshards; i++) {
+	if (m->type == MMV_TYPE_I32 || m->type == MMV_TYPE_U32)
+	    atom->ul += shard[i].value.ul;
+	else
+	    atom->ull += shard[i].value.ull;
+    }
+}
+
+static mmv_disk_histogram_t *
+mmv_histogram(stats_t *s, mmv_disk_value_t *v)
+{
+    if (s->nhistograms == 0 || v->extra <= 0 ||
+	v->extra + sizeof(mmv_disk_histogram_t) > s->len)
+	return NULL;
+    return (mmv_disk_histogram_t *)((char *)s->addr + v->extra);
+}
+
+/*
+ * Percentiles are reported as the upper bound of the bucket holding the
+ * value of that rank, so are within the bucket resolution of the truth.
+ */
+static int
+mmv_histogram_derived(pmdaMetric *mdesc, pmAtomValue *atom)
+{
+    __psint_t code = (__psint_t)mdesc->m_user;
+    int kind = code >> HIST_ITEMBITS;
+    int item = code & ((1 << HIST_ITEMBITS) - 1);
+    pmID pmid = mdesc->m_desc.pmid;
+    mmv_disk_histogram_t * h;
+    mmv_disk_metric_t * m;
+    mmv_disk_value_t * v;
+    __uint64_t total, rank, sum, max;
+    stats_t * s;
+    int i, sts;
+
+    pmid = pmid_build(pmid_domain(pmid), pmid_cluster(pmid), item);
+    if ((sts = mmv_lookup_stat_metric_value(pmid, PM_IN_NULL, &s, &m, &v)) < 0)
+	return sts;
+    if ((h = mmv_histogram(s, v)) == NULL)
+	return 0;
+
+    for (total = 0, i = 0; i < MMV_HIST_BUCKETS; i++)
+	total += h->buckets[i];
+    if (total == 0)
+	return 0;
+    max = h->max;
+    if (kind == HIST_MAX) {
+	atom->ull = max;
+	return 1;
+    }
+
+    rank = (kind == HIST_P50) ? (total * 50 + 99) / 100 : (total * 99 + 99) / 100;
+    for (sum = 0, i = 0; i < MMV_HIST_BUCKETS - 1; i++)
+	if ((sum += h->buckets[i]) >= rank)
+	    break;
+    atom->ull = mmv_histogram_upper(i);
+    if (atom->ull > max)
+	atom->ull = max;
+    return 1;
+}
+
+/*
+ * Extract one value from a client's memory mapped file
+ */
+static int
+mmv_value(stats_t *s, mmv_disk_metric_t *m, mmv_disk_value_t *v,
+		unsigned int inst, pmAtomValue *atom)
+{
+    mmv_disk_histogram_t * h;
+    mmv_disk_string_t * str;
+
+    switch (m->type) {
+	case MMV_TYPE_I32:
+	case MMV_TYPE_U32:
+	case MMV_TYPE_I64:
+	case MMV_TYPE_U64:
+	    memcpy(atom, &v->value, sizeof(pmAtomValue));
+	    if (s->nshards)
+		mmv_shard_sum(s, m, v, atom);
+	    break;
+	case MMV_TYPE_FLOAT:
+	case MMV_TYPE_DOUBLE:
+	    memcpy(atom, &v->value, sizeof(pmAtomValue));
+	    break;
+	case MMV_TYPE_ELAPSED: {
+	    atom->ll = v->value.ll;
+	    if (v->extra < 0) {	/* inside a timed section */
+		struct timeval tv; 
+		__pmtimevalNow(&tv); 
+		atom->ll += (tv.tv_sec * 1e6 + tv.tv_usec) + v->extra;
+	    }
+	    break;
+	}
+	case MMV_TYPE_STRING: {
+	    str = (mmv_disk_string_t *)((char *)s->addr + v->extra);
+	    atom->cp = str->payload;
+	    break;
+	}
+	case MMV_TYPE_HISTOGRAM: {
+	    /* no value for empty buckets, keeping results small */
+	    if ((h = mmv_histogram(s, v)) == NULL || inst >= MMV_HIST_BUCKETS)
+		return 0;
+	    if ((atom->ull = h->buckets[inst]) == 0)
+		return 0;
+	    break;
+	}
+	case MMV_TYPE_NOSUPPORT:
+	    return PM_ERR_APPVERSION;
+    }
+    return 1;
+}
+
 /*
  * callback provided to pmdaFetch
  */
@@ -582,45 +1274,112 @@ mmv_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 	return PM_ERR_PMID;
 
     } else if (scnt > 0) {	/* We have at least one source of metrics */
-	mmv_disk_string_t * str;
 	mmv_disk_metric_t * m;
 	mmv_disk_value_t * v;
 	stats_t * s;
 	int rv;
 
+	if (mdesc->m_user != NULL)
+	    return mmv_histogram_derived(mdesc, atom);
+
 	rv = mmv_lookup_stat_metric_value(mdesc->m_desc.pmid, inst, &s, &m, &v);
 	if (rv < 0)
 	    return rv;
+	return mmv_value(s, m, v, inst, atom);
+    }
 
-	switch (m->type) {
-	    case MMV_TYPE_I32:
-	    case MMV_TYPE_U32:
-	    case MMV_TYPE_I64:
-	    case MMV_TYPE_U64:
-	    case MMV_TYPE_FLOAT:
-	    case MMV_TYPE_DOUBLE:
-		memcpy(atom, &v->value, sizeof(pmAtomValue));
-		break;
-	    case MMV_TYPE_ELAPSED: {
-		atom->ll = v->value.ll;
-		if (v->extra < 0) {	/* inside a timed section */
-		    struct timeval tv; 
-		    __pmtimevalNow(&tv); 
-		    atom->ll += (tv.tv_sec * 1e6 + tv.tv_usec) + v->extra;
-		}
-		break;
-	    }
-	    case MMV_TYPE_STRING: {
-		str = (mmv_disk_string_t *)((char *)s->addr + v->extra);
-		atom->cp = str->payload;
-		break;
-	    }
-	    case MMV_TYPE_NOSUPPORT:
-		return PM_ERR_APPVERSION;
+    return 0;
+}
+
+static const int *batch_insts;
+
+static int
+mmv_compare_inst(const void *a, const void *b)
+{
+    int ia = batch_insts[*(const int *)a];
+    int ib = batch_insts[*(const int *)b];
+
+    return ia < ib ? -1 : (ia > ib);
+}
+
+/*
+ * Batch callback provided to pmdaFetch - the values of one metric for
+ * all requested instances from a single pass over the client's values,
+ * rather than a scan of the values for each instance.  Returns -1 for
+ * anything unusual, and pmdaFetch then uses mmv_fetchCallBack instead.
+ */
+static int
+mmv_fetchBatchCallBack(pmdaMetric *mdesc, int numinst, const int *instlist,
+			pmAtomValue *atoms, int *status)
+{
+    __pmID_int * id = (__pmID_int *)&(mdesc->m_desc.pmid);
+    static int * order;
+    static int maxorder;
+    mmv_disk_metric_t * m = NULL;
+    mmv_disk_value_t * v;
+    stats_t * s = NULL;
+    int lo, hi, mid, i;
+
+    if (id->cluster == 0 || scnt == 0 || mdesc->m_user != NULL)
+	return -1;
+
+    for (i = 0; i < scnt; i++) {
+	if (slist[i].cluster == id->cluster) {
+	    s = &slist[i];
+	    break;
+	}
+    }
+    if (s == NULL)
+	return -1;
+    for (i = 0; i < s->mcnt; i++) {
+	if (s->metrics[i].item == id->item) {
+	    m = &s->metrics[i];
+	    break;
 	}
-	return 1;
     }
+    if (m == NULL || m->indom == PM_INDOM_NULL || m->indom == 0 ||
+	m->type == MMV_TYPE_HISTOGRAM)
+	return -1;
+
+    /* positions in instlist[], ordered by instance identifier */
+    if (numinst > maxorder) {
+	int	*tmp;
+
+	if ((tmp = realloc(order, numinst * sizeof(int))) == NULL)
+	    return -1;
+	order = tmp;
+	maxorder = numinst;
+    }
+    for (i = 0; i < numinst; i++)
+	order[i] = i;
+    batch_insts = instlist;
+    qsort(order, numinst, sizeof(int), mmv_compare_inst);
+
+    v = s->values;
+    for (i = 0; i < s->vcnt; i++) {
+	mmv_disk_instance_t * is;
+	int inst;
 
+	if ((mmv_disk_metric_t *)((char *)s->addr + v[i].metric) != m)
+	    continue;
+	is = (mmv_disk_instance_t *)((char *)s->addr + v[i].instance);
+	inst = is->internal;
+	for (lo = 0, hi = numinst - 1; lo <= hi; ) {
+	    mid = (lo + hi) / 2;
+	    if (instlist[order[mid]] < inst)
+		lo = mid + 1;
+	    else if (instlist[order[mid]] > inst)
+		hi = mid - 1;
+	    else
+		break;
+	}
+	if (lo > hi)
+	    continue;
+	mid = order[mid];
+	/* as for mmv_lookup_stat_metric_value, the first value wins */
+	if (status[mid] == PM_ERR_INST)
+	    status[mid] = mmv_value(s, m, &v[i], inst, &atoms[mid]);
+    }
     return 0;
 }
 
@@ -629,50 +1388,66 @@ mmv_reload_maybe(pmdaExt *pmda)
 {
     int i;
     struct stat s;
-    int need_reload = reload;
+    int changed = 0;
+    int rescan = 0;
+
+    if (reload) {
+	if (pmDebug & DBG_TRACE_APPL0)
+	    __pmNotifyErr(LOG_DEBUG, "MMV: %s: reloading", pmProgname);
+	map_stats(pmda);
+	reload = 0;
+	changed = 1;
+    }
 
     /* check if generation numbers changed or monitored process exited */
     for (i = 0; i < scnt; i++) {
 	mmv_disk_header_t *hdr = (mmv_disk_header_t *)slist[i].addr;
 	if (hdr->g1 != slist[i].gen || hdr->g2 != slist[i].gen) {
-	    need_reload++;
-	    break;
+	    /* remapped client goes to the end of the list */
+	    refresh_client(pmda, slist[i--].name);
+	    changed = 1;
 	}
-	if (slist[i].pid && !__pmProcessExists(slist[i].pid)) {
-	    need_reload++;
-	    break;
+	else if (slist[i].pid && !__pmProcessExists(slist[i].pid)) {
+	    remove_client(i--);
+	    changed = 1;
 	}
     }
 
-    /*
-     * check if the directory has been modified, reload if so;
-     * note modification may involve removal or newly appeared,
-     * a change in permissions from accessible to not (or vice-
-     * versa), and so on.
-     */
-    if (stat(statsdir, &s) >= 0) {
-	if (s.st_mtime != statsdir_ts) {
-	    need_reload++;
-	    statsdir_code = 0;
-	    statsdir_ts = s.st_mtime;
-	}
+    if (notify_wd >= 0) {
+	changed |= notify_events(pmda, &rescan);
     } else {
-	i = oserror();
-	if (statsdir_code != i) {
-	    statsdir_code = i;
-	    statsdir_ts = 0;
-	    need_reload++;
+	/*
+	 * check if the directory has been modified, rescan if so;
+	 * note modification may involve removal or newly appeared,
+	 * a change in permissions from accessible to not (or vice-
+	 * versa), and so on.
+	 */
+	if (stat(statsdir, &s) >= 0) {
+	    if (s.st_mtime != statsdir_ts) {
+		rescan = 1;
+		statsdir_code = 0;
+		statsdir_ts = s.st_mtime;
+	    }
+	} else {
+	    i = oserror();
+	    if (statsdir_code != i) {
+		statsdir_code = i;
+		statsdir_ts = 0;
+		rescan = 1;
+	    }
 	}
+	/* events missed before the watch is set up are found by the scan */
+	if (rescan)
+	    notify_watch();
     }
 
-    if (need_reload) {
-	if (pmDebug & DBG_TRACE_APPL0)
-	    __pmNotifyErr(LOG_DEBUG, "MMV: %s: reloading", pmProgname);
-	map_stats(pmda);
+    if (rescan)
+	changed |= scan_stats(pmda);
+    if (npending)
+	changed |= retry_pending(pmda);
 
-	pmda->e_indoms = indoms;
-	pmda->e_nindoms = incnt;
-	pmdaRehash(pmda, metrics, mcnt);
+    if (changed) {
+	rebuild_tables(pmda);
 
 	if (pmDebug & DBG_TRACE_APPL0)
 	    __pmNotifyErr(LOG_DEBUG, 
@@ -718,10 +1493,24 @@ mmv_text(int ident, int type, char **buffer, pmdaExt *ep)
 	    return PM_ERR_PMID;
     }
     else {
+	static char histhelp[] =
+"Derived from the buckets of the histogram metric of the same name, when\n"
+"fetched.  Percentiles are the upper bound of the bucket holding the value\n"
+"of that rank, and have the precision of the histogram buckets.\n";
 	mmv_disk_string_t * str;
 	mmv_disk_metric_t * m;
 	mmv_disk_value_t * v;
 	stats_t * s;
+	int i, j;
+
+	for (i = 0; i < mcnt; i++) {
+	    if (metrics[i].m_desc.pmid != (pmID)ident ||
+		metrics[i].m_user == NULL)
+		continue;
+	    j = ((__psint_t)metrics[i].m_user >> HIST_ITEMBITS) - 1;
+	    *buffer = (type & PM_TEXT_ONELINE) ? hist_derived[j].oneline : histhelp;
+	    return 0;
+	}
 
 	if (mmv_lookup_stat_metric_value(ident, PM_IN_NULL, &s, &m, &v) != 0)
 	    return PM_ERR_PMID;
@@ -800,6 +1589,7 @@ static int
 mmv_pmid(const char *name, pmID *pmid, pmdaExt *pmda)
 {
     mmv_reload_maybe(pmda);
+    pmns_update(pmda);
     return pmdaTreePMID(pmns, name, pmid);
 }
 
@@ -807,6 +1597,7 @@ static int
 mmv_name(pmID pmid, char ***nameset, pmdaExt *pmda)
 {
     mmv_reload_maybe(pmda);
+    pmns_update(pmda);
     return pmdaTreeName(pmns, pmid, nameset);
 }
 
@@ -814,6 +1605,7 @@ static int
 mmv_children(const char *name, int traverse, char ***kids, int **sts, pmdaExt *pmda)
 {
     mmv_reload_maybe(pmda);
+    pmns_update(pmda);
     return pmdaTreeChildren(pmns, name, traverse, kids, sts);
 }
 
@@ -878,6 +1670,7 @@ mmv_init(pmdaInterface *dp)
 	dp->version.four.name = mmv_name;
 	dp->version.four.children = mmv_children;
 	pmdaSetFetchCallBack(dp, mmv_fetchCallBack);
+	pmdaSetFetchBatchCallBack(dp, mmv_fetchBatchCallBack);
 
 	pmdaSetFlags(dp, PMDA_EXT_FLAG_HASHED);
 	pmdaInit(dp, indoms, incnt, metrics, mcnt);
@@ -188,6 +188,12 @@ static pmDesc	desctab[] = {
     { PMDA_PMID(5,8), PM_TYPE_FLOAT, PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,-1,1,0,PM_TIME_SEC,PM_COUNT_ONE) },
 /* pmie.eval.actual */
     { PMDA_PMID(5,9), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
+/* pmie.fetch.latency */
+    { PMDA_PMID(5,10), PM_TYPE_FLOAT, PM_INDOM_NULL, PM_SEM_INSTANT, PMDA_PMUNITS(0,1,0,0,PM_TIME_SEC,0) },
+/* pmie.fetch.latency_max */
+    { PMDA_PMID(5,11), PM_TYPE_FLOAT, PM_INDOM_NULL, PM_SEM_INSTANT, PMDA_PMUNITS(0,1,0,0,PM_TIME_SEC,0) },
+/* pmie.fetch.late */
+    { PMDA_PMID(5,12), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
 
 /* client.whoami */
     { PMDA_PMID(6,0), PM_TYPE_STRING, PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,0,0,0,0,0) },
@@ -460,7 +466,9 @@ refresh_pmie_indom(void)
 				fullpath, osstrerror());
 		    continue;
 		}
-		if (statbuf.st_size != sizeof(pmiestats_t))
+		/* version 1 files from an older pmie lack the host table */
+		if (statbuf.st_size != sizeof(pmiestats_t) &&
+		    statbuf.st_size != PMIESTATS_V1_SIZE)
 		    continue;
 		if  ((endp = strdup(dp->d_name)) == NULL) {
 		    __pmNoMem("pmie iname", strlen(dp->d_name), PM_RECOV_ERR);
@@ -485,7 +493,10 @@ refresh_pmie_indom(void)
 		    free(endp);
 		    continue;
 		}
-		else if (((pmiestats_t *)ptr)->version != 1) {
+		else if (!(((pmiestats_t *)ptr)->version == 1 &&
+			   statbuf.st_size == PMIESTATS_V1_SIZE) &&
+			 !(((pmiestats_t *)ptr)->version == 2 &&
+			   statbuf.st_size == sizeof(pmiestats_t))) {
 		    __pmNotifyErr(LOG_WARNING, "incompatible pmie version: %s",
 				fullpath);
 		    __pmMemoryUnmap(ptr, statbuf.st_size);
@@ -1215,6 +1226,40 @@ fetch_cputime(int item, int ctx, pmAtomValue *avp)
     return 0;
 }
 
+/*
+ * pmie.fetch metrics, over all hosts of a pmie instance: the slowest
+ * latest and overall fetch, and the total number of missed deadlines.
+ * Only version 2 pmie instrumentation has the host table.
+ */
+static int
+fetch_pmiehosts(int item, pmiestats_t *pmie, pmAtomValue *avp)
+{
+    pmiehost_t		*hs;
+    unsigned int	i;
+
+    if (pmie->version < 2)
+	return 0;
+    memset(avp, 0, sizeof(*avp));
+    for (i = 0, hs = pmie->hosts; i < pmie->numhosts; i++, hs++) {
+	if (i == PMIE_MAXHOSTS)
+	    break;
+	switch (item) {
+	    case 10:		/* pmie.fetch.latency */
+		if (hs->latency > avp->f)
+		    avp->f = hs->latency;
+		break;
+	    case 11:		/* pmie.fetch.latency_max */
+		if (hs->latency_max > avp->f)
+		    avp->f = hs->latency_max;
+		break;
+	    case 12:		/* pmie.fetch.late */
+		avp->ul += hs->late;
+		break;
+	}
+    }
+    return 1;
+}
+
 static void
 end_context(int ctx)
 {
@@ -1567,6 +1612,10 @@ pmcd_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 	    case 5:	/* pmie metrics */
 		refresh_pmie_indom();
 		for (j = numval = 0; j < npmies; j++) {
+		    pmie = (pmiestats_t *)pmies[j].mmap;
+		    if (pmidp->item >= 10 &&
+			fetch_pmiehosts(pmidp->item, pmie, &atom) == 0)
+			continue;
 		    if (__pmInProfile(pmieindom, _profile, pmies[j].pid))
 			numval++;
 		}
@@ -1580,8 +1629,11 @@ pmcd_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 		for (j = numval = 0; j < npmies; ++j) {
 		    if (!__pmInProfile(pmieindom, _profile, pmies[j].pid))
 			continue;
-		    vset->vlist[numval].inst = pmies[j].pid;
 		    pmie = (pmiestats_t *)pmies[j].mmap;
+		    if (pmidp->item >= 10 &&
+			fetch_pmiehosts(pmidp->item, pmie, &atom) == 0)
+			continue;	/* no host table from this pmie */
+		    vset->vlist[numval].inst = pmies[j].pid;
 		    switch (pmidp->item) {
 			case 0:		/* pmie.configfile */
 			    atom.cp = pmie->config;
@@ -1613,6 +1665,10 @@ pmcd_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 			case 9:		/* pmie.eval.actual */
 			    atom.ul = pmie->eval_actual;
 			    break;
+			case 10:	/* pmie.fetch.latency */
+			case 11:	/* pmie.fetch.latency_max */
+			case 12:	/* pmie.fetch.late */
+			    break;	/* atom from fetch_pmiehosts() */
 			default:
 			    sts = atom.l = PM_ERR_PMID;
 			    break;
@@ -0,0 +1,366 @@
+/*
+ * Copyright (c) 2015 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * Drain trace data aggregated by libpcp_trace in shared memory - each
+ * application maps a file of per-thread slots below $PCP_TMP_DIR, and
+ * the running totals found there are folded into the summary and ring
+ * buffer here exactly as if they had arrived as PDUs.
+ */
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include "pmapi.h"
+#include "impl.h"
+#include "trace_dev.h"
+
+#if defined(__ATOMIC_ACQUIRE)
+#define SHM_LOAD_ACQUIRE(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define SHM_FENCE_ACQUIRE()	__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define SHM_STORE_RELEASE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#define SHM_LOAD_ACQUIRE(p)	(__sync_synchronize(), *(p))
+#define SHM_FENCE_ACQUIRE()	__sync_synchronize()
+#define SHM_STORE_RELEASE(p, v)	(__sync_synchronize(), *(p) = (v))
+#endif
+
+#define SHM_RETRIES	100	/* attempts at a consistent copy of a tag */
+
+extern int updateData(char *, int, int, int, __uint64_t,
+			double, double, double, double);
+
+typedef struct {
+    __uint64_t		count;	/* totals at the previous drain */
+    double		sum;
+} shmprev_t;
+
+typedef struct shmclient {
+    struct shmclient	*next;
+    pid_t		pid;
+    dev_t		dev;
+    ino_t		ino;
+    char		*addr;
+    size_t		size;
+    int			seen;	/* found in most recent directory scan */
+    shmprev_t		*prev;	/* TRACE_SHM_SLOTS x TRACE_SHM_TAGS */
+} shmclient_t;
+
+typedef struct {
+    dev_t		dev;
+    ino_t		ino;
+} shmretired_t;
+
+static char		shmdir[MAXPATHLEN];
+static time_t		shmstart;
+static __pmTraceShmEpoch *shmepoch;
+static shmclient_t	*shmclients;
+static shmretired_t	*shmretired;	/* drained, but cannot be removed */
+static int		nshmretired;
+
+/*
+ * Create (or reuse, so running applications keep seeing it advance)
+ * the epoch file.  Without it the shared memory transport is disabled.
+ * Applications run as any user, so the directory is world writable
+ * and sticky, like $PCP_TMP_DIR itself.
+ */
+void
+shmInit(void)
+{
+    char	path[MAXPATHLEN];
+    mode_t	cur_umask;
+    void	*addr = NULL;
+    int		fd, sep = __pmPathSeparator();
+
+    if (snprintf(shmdir, sizeof(shmdir), "%s%c" TRACE_SHM_DIR,
+		pmGetConfig("PCP_TMP_DIR"), sep) >= sizeof(shmdir) ||
+	snprintf(path, sizeof(path), "%s%c" TRACE_SHM_EPOCH,
+		shmdir, sep) >= sizeof(path)) {
+	shmdir[0] = '\0';
+	__pmNotifyErr(LOG_INFO, "shared memory transport disabled: "
+			"$PCP_TMP_DIR path too long");
+	return;
+    }
+
+    if (mkdir2(shmdir, S_IRWXU | S_IRWXG | S_IRWXO) == 0) {
+	/* not subject to umask, and mkdir may ignore the sticky bit */
+	if (chmod(shmdir, S_ISVTX | S_IRWXU | S_IRWXG | S_IRWXO) < 0)
+	    __pmNotifyErr(LOG_WARNING, "cannot set mode of %s: %s",
+			shmdir, osstrerror());
+    }
+    else if (oserror() != EEXIST) {
+	__pmNotifyErr(LOG_INFO, "shared memory transport disabled: %s: %s",
+			shmdir, osstrerror());
+	return;
+    }
+
+    cur_umask = umask(S_IWGRP | S_IWOTH);
+    if ((fd = open(path, O_RDWR)) < 0) {
+	unlink(path);
+	fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    umask(cur_umask);
+    if (fd < 0) {
+	__pmNotifyErr(LOG_INFO, "shared memory transport disabled: %s: %s",
+			path, osstrerror());
+	return;
+    }
+    if (ftruncate(fd, sizeof(__pmTraceShmEpoch)) == 0)
+	addr = __pmMemoryMap(fd, sizeof(__pmTraceShmEpoch), 1);
+    close(fd);
+    if (addr == NULL) {
+	__pmNotifyErr(LOG_ERR, "shared memory transport disabled: "
+			"cannot map %s: %s", path, osstrerror());
+	return;
+    }
+    shmepoch = (__pmTraceShmEpoch *)addr;
+    shmepoch->magic = TRACE_SHM_MAGIC;
+    shmstart = time(NULL);
+}
+
+static int
+shmIsRetired(struct stat *sbuf)
+{
+    int		i;
+
+    for (i = 0; i < nshmretired; i++) {
+	if (shmretired[i].dev == sbuf->st_dev &&
+	    shmretired[i].ino == sbuf->st_ino)
+	    return 1;
+    }
+    return 0;
+}
+
+/*
+ * Remove the file of an exited process once drained - failing that (it
+ * belongs to another user) remember it, so it is not drained again.
+ */
+static void
+shmRetire(shmclient_t *cp)
+{
+    shmretired_t	*rp;
+    char		path[MAXPATHLEN];
+    int			sep = __pmPathSeparator();
+
+    if (snprintf(path, sizeof(path), "%s%c%" FMT_PID,
+		shmdir, sep, cp->pid) >= sizeof(path))
+	return;
+    if (unlink(path) == 0 || oserror() == ENOENT)
+	return;
+    rp = (shmretired_t *)realloc(shmretired,
+				(nshmretired + 1) * sizeof(shmretired_t));
+    if (rp == NULL) {
+	__pmNotifyErr(LOG_ERR, "cannot retire %s: %s", path, osstrerror());
+	return;
+    }
+    shmretired = rp;
+    shmretired[nshmretired].dev = cp->dev;
+    shmretired[nshmretired].ino = cp->ino;
+    nshmretired++;
+}
+
+static void
+shmFree(shmclient_t *cp)
+{
+    __pmMemoryUnmap(cp->addr, cp->size);
+    free(cp->prev);
+    free(cp);
+}
+
+static void
+shmMap(const char *path, pid_t pid, struct stat *sbuf)
+{
+    __pmTraceShmHdr	*hdr;
+    shmclient_t		*cp;
+    size_t		size;
+    void		*addr;
+    int			fd;
+
+    size = sizeof(__pmTraceShmHdr) +
+		TRACE_SHM_SLOTS * sizeof(__pmTraceShmSlot);
+    if (sbuf->st_size != size)
+	return;		/* not yet sized, or not one of ours */
+    if ((fd = open(path, O_RDONLY)) < 0)
+	return;
+    addr = __pmMemoryMap(fd, size, 0);
+    close(fd);
+    if (addr == NULL)
+	return;
+
+    hdr = (__pmTraceShmHdr *)addr;
+    if (SHM_LOAD_ACQUIRE(&hdr->magic) != TRACE_SHM_MAGIC ||
+	hdr->version != TRACE_SHM_VERSION || hdr->pid != pid ||
+	hdr->nslots != TRACE_SHM_SLOTS || hdr->ntags != TRACE_SHM_TAGS) {
+	__pmMemoryUnmap(addr, size);
+	return;
+    }
+    if ((cp = (shmclient_t *)calloc(1, sizeof(shmclient_t))) == NULL ||
+	(cp->prev = (shmprev_t *)calloc(TRACE_SHM_SLOTS * TRACE_SHM_TAGS,
+					sizeof(shmprev_t))) == NULL) {
+	__pmNotifyErr(LOG_ERR, "cannot drain process %" FMT_PID ": %s",
+			pid, osstrerror());
+	if (cp != NULL)
+	    free(cp);
+	__pmMemoryUnmap(addr, size);
+	return;
+    }
+    cp->pid = pid;
+    cp->dev = sbuf->st_dev;
+    cp->ino = sbuf->st_ino;
+    cp->addr = (char *)addr;
+    cp->size = size;
+    cp->seen = 1;
+    cp->next = shmclients;
+    shmclients = cp;
+#ifdef PCP_DEBUG
+    if (pmDebug & DBG_TRACE_APPL0)
+	__pmNotifyErr(LOG_DEBUG, "draining process %" FMT_PID " via %s",
+			pid, path);
+#endif
+}
+
+/* look for new processes, and files left by processes that have exited */
+static void
+shmScan(void)
+{
+    struct dirent	*dp;
+    struct stat		sbuf;
+    shmclient_t		*cp;
+    char		path[MAXPATHLEN];
+    char		*end;
+    DIR			*dir;
+    pid_t		pid;
+    int			sep = __pmPathSeparator();
+
+    for (cp = shmclients; cp != NULL; cp = cp->next)
+	cp->seen = 0;
+    if ((dir = opendir(shmdir)) == NULL)
+	return;
+    while ((dp = readdir(dir)) != NULL) {
+	pid = (pid_t)strtol(dp->d_name, &end, 10);
+	if (*end != '\0' || end == dp->d_name || pid <= 0)
+	    continue;
+	if (snprintf(path, sizeof(path), "%s%c%s",
+		shmdir, sep, dp->d_name) >= sizeof(path))
+	    continue;
+	if (stat(path, &sbuf) < 0)
+	    continue;
+	for (cp = shmclients; cp != NULL; cp = cp->next) {
+	    if (cp->pid == pid &&
+		cp->dev == sbuf.st_dev && cp->ino == sbuf.st_ino)
+		break;
+	}
+	if (cp != NULL)
+	    cp->seen = 1;
+	else if (__pmProcessExists(pid))
+	    shmMap(path, pid, &sbuf);
+	else if (shmIsRetired(&sbuf))
+	    continue;
+	else if (sbuf.st_mtime >= shmstart)
+	    shmMap(path, pid, &sbuf);	/* exited, drain just the once */
+	else
+	    unlink(path);	/* exited before we started, not ours to report */
+    }
+    closedir(dir);
+}
+
+/* fold in changes to each tag since the previous drain */
+static void
+shmDrainClient(shmclient_t *cp)
+{
+    __pmTraceShmSlot	*slot;
+    __pmTraceShmTag	*tp;
+    shmprev_t		*pp;
+    __uint64_t		count;
+    __uint32_t		seq;
+    double		sum, min, max, last;
+    char		*tag;
+    int			s, t, type, taglen, tries;
+
+    slot = (__pmTraceShmSlot *)(cp->addr + sizeof(__pmTraceShmHdr));
+    for (s = 0; s < TRACE_SHM_SLOTS; s++, slot++) {
+	if (slot->used == 0)
+	    continue;
+	for (t = 0; t < TRACE_SHM_TAGS; t++) {
+	    tp = &slot->tags[t];
+	    if ((type = SHM_LOAD_ACQUIRE(&tp->type)) == 0)
+		continue;
+	    pp = &cp->prev[s * TRACE_SHM_TAGS + t];
+	    for (tries = 0; tries < SHM_RETRIES; tries++) {
+		if ((seq = SHM_LOAD_ACQUIRE(&tp->seq)) & 1)
+		    continue;
+		count = tp->count;
+		sum = tp->sum;
+		min = tp->min;
+		max = tp->max;
+		last = tp->last;
+		SHM_FENCE_ACQUIRE();
+		if (tp->seq == seq)
+		    break;
+	    }
+	    if (tries == SHM_RETRIES || count == pp->count)
+		continue;	/* busy (try next time), or unchanged */
+
+	    taglen = tp->taglength;
+	    if (type < TRACE_FIRST_TYPE || type > TRACE_LAST_TYPE ||
+		taglen < 2 || taglen > MAXTAGNAMELEN ||
+		tp->tag[taglen-1] != '\0') {
+		__pmNotifyErr(LOG_ERR, "process %" FMT_PID ": bad tag in slot "
+			"%d (type=%d, length=%d)", cp->pid, s, type, taglen);
+		pp->count = count;
+		continue;
+	    }
+	    if ((tag = strdup(tp->tag)) == NULL) {
+		__pmNotifyErr(LOG_ERR, "dropping trace data for '%s': %s",
+				tp->tag, osstrerror());
+		continue;
+	    }
+	    updateData(tag, taglen, type, -1, count - pp->count,
+			sum - pp->sum, min, max, last);
+	    pp->count = count;
+	    pp->sum = sum;
+	}
+    }
+}
+
+/*
+ * Called before each fetch and at each timer event - drains every
+ * process, then advances the epoch so that min and max restart.
+ */
+void
+shmDrain(void)
+{
+    shmclient_t		*cp, **cpp;
+
+    if (shmepoch == NULL)
+	return;
+
+    shmScan();
+    for (cpp = &shmclients; (cp = *cpp) != NULL; ) {
+	shmDrainClient(cp);
+	if (cp->seen && __pmProcessExists(cp->pid)) {
+	    cpp = &cp->next;
+	    continue;
+	}
+	/* process has exited - its final totals have now been seen */
+#ifdef PCP_DEBUG
+	if (pmDebug & DBG_TRACE_APPL0)
+	    __pmNotifyErr(LOG_DEBUG, "process %" FMT_PID " is gone", cp->pid);
+#endif
+	if (cp->seen)
+	    shmRetire(cp);
+	*cpp = cp->next;
+	shmFree(cp);
+    }
+    SHM_STORE_RELEASE(&shmepoch->epoch, shmepoch->epoch + 1);
+}
@@ -124,6 +124,8 @@ static pmdaMetric metrictab[] = {
 };
 
 extern void __pmdaStartInst(pmInDom indom, pmdaExt *pmda);
+extern void shmInit(void);
+extern void shmDrain(void);
 
 extern int		ctlport;
 extern unsigned int	rbufsize;
@@ -271,48 +273,22 @@ summarydel(void *a)
 }
 
 /*
- * Processes data from pcp_trace-linked client programs.
- *
- * Return negative only on fd-related errors, as that connection will
- * later be closed.  Other errors - report in log file but continue.
+ * Fold trace data for one tag into the summary and the working ring
+ * buffer entry.  This is either a single event from a PDU (count is one)
+ * or an aggregate drained from shared memory (fd is -1).  Takes over tag.
  */
 int
-readData(int clientfd, int *protocol)
+updateData(char *tag, int taglen, int type, int fd, __uint64_t count,
+	   double sum, double min, double max, double last)
 {
-    __pmTracePDU	*result;
-    double	 	data;
     hashdata_t		newhash;
     hashdata_t		*hptr;
     hashdata_t		hash;
-    char		*tag;
-    int			type, taglen, sts;
     int			freeflag=0;
 
-    if ((sts = __pmtracegetPDU(clientfd, TRACE_TIMEOUT_NEVER, &result)) < 0) {
-	__pmNotifyErr(LOG_ERR, "bogus PDU read - %s", pmtraceerrstr(sts));
-	return -1;
-    }
-    else if (sts == TRACE_PDU_DATA) {
-	if ((sts = __pmtracedecodedata(result, &tag, &taglen,
-						&type, protocol, &data)) < 0)
-	    return -1;
-	if (type < TRACE_FIRST_TYPE || type > TRACE_LAST_TYPE) {
-	    __pmNotifyErr(LOG_ERR, "unknown trace type for '%s' (%d)", tag, type);
-	    free(tag);
-	    return -1;
-	}
-	newhash.tag = tag;
-	newhash.taglength = taglen;
-	newhash.tracetype = type;
-    }
-    else if (sts == 0) {	/* client has exited - cleanup in mainloop */
-	return -1;
-    }
-    else {	/* unknown PDU type - bail & later kill connection */
-	__pmNotifyErr(LOG_ERR, "unknown PDU - expected data PDU"
-		" (not type #%d)", sts);
-	return -1;
-    }
+    newhash.tag = tag;
+    newhash.taglength = taglen;
+    newhash.tracetype = type;
 
     /*
      * First, update the global summary table with this new data
@@ -340,11 +316,12 @@ readData(int clientfd, int *protocol)
 	    newhash.id = ++observes;
 	newhash.txcount = -1;	/* first time since reset or start */
 	newhash.padding = 0;
-	newhash.realcount = 1;	
-	newhash.realtime = data;	
-	newhash.fd = clientfd;
-	newhash.txmin = newhash.txmax = data;
-	newhash.txsum = data;
+	newhash.realcount = count;
+	newhash.realtime = sum;
+	newhash.fd = fd;
+	newhash.txmin = min;
+	newhash.txmax = max;
+	newhash.txsum = (type == TRACE_TYPE_TRANSACT) ? sum : last;
 	hptr = &newhash;
 #ifdef PCP_DEBUG
 	if (pmDebug & DBG_TRACE_APPL0)
@@ -371,10 +348,10 @@ readData(int clientfd, int *protocol)
 	/* walk the indom table - if we find this new tag in it already, then
 	 * something is badly busted.
 	 */
-	for (sts = 0; sts < indomtab[indom].it_numinst; sts++) {
-	    if (strcmp(indomtab[indom].it_set[sts].i_name, hptr->tag) == 0) {
+	for (index = 0; index < indomtab[indom].it_numinst; index++) {
+	    if (strcmp(indomtab[indom].it_set[index].i_name, hptr->tag) == 0) {
 		fprintf(stderr, "'%s' (inst=%d, type=%d) entry in indomtab already!!!\n",
-			hptr->tag, indomtab[indom].it_set[sts].i_inst, hptr->tracetype);
+			hptr->tag, indomtab[indom].it_set[index].i_inst, hptr->tracetype);
 		abort();
 	    }
 	}
@@ -411,15 +388,15 @@ readData(int clientfd, int *protocol)
 	    return -1;
 	}
 	else {	/* update existing entries free running counter */
-	    hptr->realcount++;
+	    hptr->realcount += count;
 	    if (hptr->tracetype == TRACE_TYPE_TRANSACT)
-		hptr->realtime += data;
+		hptr->realtime += sum;
 		/* keep running total of time attributed to transactions */
 	    else if (hptr->tracetype == TRACE_TYPE_COUNTER)
-		hptr->txsum = data;
+		hptr->txsum = last;
 		/* counters are 'permanent' and immediately available */
 	    else if (hptr->tracetype == TRACE_TYPE_OBSERVE)
-		hptr->txsum = data;
+		hptr->txsum = last;
 		/* observations are 'permanent' and immediately available */
 #ifdef PCP_DEBUG
 	    if (pmDebug & DBG_TRACE_APPL0)
@@ -438,19 +415,20 @@ readData(int clientfd, int *protocol)
 	hash.tracetype = type;
 	hash.id = 0;	/* the ring buffer is never used to resolve indoms */
 	hash.padding = 0;
-	hash.realcount = 1;
-	hash.realtime = data;
+	hash.realcount = count;
+	hash.realtime = sum;
 	hash.taglength = (unsigned int)taglen;
-	hash.fd = clientfd;
-	hash.txcount = 1;
-	hash.txmin = hash.txmax = data;
-	hash.txsum = data;
+	hash.fd = fd;
+	hash.txcount = (__int32_t)count;
+	hash.txmin = min;
+	hash.txmax = max;
+	hash.txsum = sum;
 	hptr = &hash;
 #ifdef PCP_DEBUG
 	if (pmDebug & DBG_TRACE_APPL0)
 	    __pmNotifyErr(LOG_DEBUG, "fresh interval data on fd=%d rpos=%d "
-		    "('%s': len=%d type=%d value=%d)", clientfd, rpos,
-		    hash.tag, taglen, type, (int)data);
+		    "('%s': len=%d type=%d count=%d min=%f max=%f)", fd, rpos,
+		    hash.tag, taglen, type, hash.txcount, min, max);
 #endif
 	if (__pmhashinsert(ringbuf.ring[rpos].stats, hash.tag, hptr) < 0) {
 	    __pmNotifyErr(LOG_ERR, "ring buffer insert failure - '%s' "
@@ -460,19 +438,19 @@ readData(int clientfd, int *protocol)
 	}
     }
     else {	/* update existing entry */
-	hptr->txcount++;
+	hptr->txcount += (__int32_t)count;
 	if (hptr->tracetype == TRACE_TYPE_TRANSACT) {
-	    if (data < hptr->txmin)
-		hptr->txmin = data;
-	    if (data > hptr->txmax)
-		hptr->txmax = data;
-	    hptr->txsum += data;
+	    if (min < hptr->txmin)
+		hptr->txmin = min;
+	    if (max > hptr->txmax)
+		hptr->txmax = max;
+	    hptr->txsum += sum;
 	}
 #ifdef PCP_DEBUG
 	if (pmDebug & DBG_TRACE_APPL0)
 	    __pmNotifyErr(LOG_DEBUG, "Updating data on fd=%d ('%s': type=%d "
 		    "count=%d min=%f max=%f sum=%f)",
-		    clientfd, hptr->tag, hptr->tracetype,
+		    fd, hptr->tag, hptr->tracetype,
 		    hptr->txcount, hptr->txmin, hptr->txmax, hptr->txsum);
 #endif
     }
@@ -484,6 +462,46 @@ readData(int clientfd, int *protocol)
     return hptr->tracetype;
 }
 
+/*
+ * Processes data from pcp_trace-linked client programs.
+ *
+ * Return negative only on fd-related errors, as that connection will
+ * later be closed.  Other errors - report in log file but continue.
+ */
+int
+readData(int clientfd, int *protocol)
+{
+    __pmTracePDU	*result;
+    double	 	data;
+    char		*tag;
+    int			type, taglen, sts;
+
+    if ((sts = __pmtracegetPDU(clientfd, TRACE_TIMEOUT_NEVER, &result)) < 0) {
+	__pmNotifyErr(LOG_ERR, "bogus PDU read - %s", pmtraceerrstr(sts));
+	return -1;
+    }
+    else if (sts == TRACE_PDU_DATA) {
+	if ((sts = __pmtracedecodedata(result, &tag, &taglen,
+						&type, protocol, &data)) < 0)
+	    return -1;
+	if (type < TRACE_FIRST_TYPE || type > TRACE_LAST_TYPE) {
+	    __pmNotifyErr(LOG_ERR, "unknown trace type for '%s' (%d)", tag, type);
+	    free(tag);
+	    return -1;
+	}
+    }
+    else if (sts == 0) {	/* client has exited - cleanup in mainloop */
+	return -1;
+    }
+    else {	/* unknown PDU type - bail & later kill connection */
+	__pmNotifyErr(LOG_ERR, "unknown PDU - expected data PDU"
+		" (not type #%d)", sts);
+	return -1;
+    }
+
+    return updateData(tag, taglen, type, clientfd, 1, data, data, data, data);
+}
+
 static void
 clearTable(hashtable_t *t, void *entry)
 {
@@ -499,6 +517,9 @@ clearTable(hashtable_t *t, void *entry)
 void
 timerUpdate(void)
 {
+    /* fold in the interval's shared memory data before moving on */
+    shmDrain();
+
     /* summary table must be reset for next fetch */
     if (dosummary == 0) {
 	__pmhashtraverse(&summary, clearTable);
@@ -854,6 +875,7 @@ traceFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
     int			numval;
     int			sts, i, j, need;
 
+    shmDrain();
     indomSortCheck();
     pmda->e_idp = indomtab;
 
@@ -1148,4 +1170,6 @@ traceInit(pmdaInterface *dp)
 						osstrerror());
 	exit(1);
     }
+
+    shmInit();
 }
@@ -64,12 +64,18 @@ static int width = 6;
 static int sampleCount;
 static int repeatLines;
 
+// Export (-e) formats, bypassing QTextStream for bulk output
+typedef enum { ExportNone, ExportCSV, ExportBinary } ExportFormat;
+static ExportFormat exportFormat = ExportNone;
+static bool errStrFlag;
+
 static pmLongOptions longopts[] = {
     PMAPI_GENERAL_OPTIONS,
     PMAPI_OPTIONS_HEADER("Reporting options"),
     { "config", 1, 'c', "FILE", "read list of metrics from FILE" },
     { "check", 0, 'C', 0, "exit before dumping any values" },
     { "delimiter", 1, 'd', "CHAR", "character separating each column" },
+    { "export", 1, 'e', "FORMAT", "bulk export values as csv or binary" },
     { "time-format", 1, 'f', "FMT", "time format string" },
     { "fixed", 0, 'F', 0, "print fixed width values" },
     { "scientific", 0, 'G', 0, "print values in scientific format if shorter" },
@@ -609,6 +615,328 @@ dumpHeader()
     }
 }
 
+/*
+ * Export mode - values are formatted straight into a large buffer, which
+ * is written out in big chunks rather than a line at a time, and numbers
+ * are converted without going through QTextStream or the locale.
+ *
+ * The binary format is columnar: a header naming each column, followed
+ * by blocks of up to EXPORT_ROWS rows.  Each block is a row count and
+ * then, column by column, that many little-endian IEEE doubles.  The
+ * first column is the time in seconds since the epoch, unavailable
+ * values and strings are NaN.  All integers are 32-bit little-endian.
+ *
+ *	"PMDTCOL1" ncolumns { namelen name unitslen units } ...
+ *	nrows { double ... } ...
+ */
+#define EXPORT_BUFSIZE	(1024 * 1024)
+#define EXPORT_ROWS	1024
+#define EXPORT_MAGIC	"PMDTCOL1"
+
+static struct {
+    char	*buf;
+    int		len;
+    int		columns;	// value columns, fixed from the first fetch
+    QList<int>	counts;		// values exported per metric
+    double	*block;		// binary columns, EXPORT_ROWS each
+    int		rows;		// rows in current block
+    double	scale;		// 10^precision, for formatDouble()
+} out;
+
+static void
+exportFlush(void)
+{
+    if (out.len > 0 && fwrite(out.buf, 1, out.len, stdout) != (size_t)out.len) {
+	fprintf(stderr, "%s: export write failed: %s\n",
+		pmProgname, strerror(errno));
+	exit(1);
+    }
+    out.len = 0;
+}
+
+static inline char *
+exportSpace(int bytes)
+{
+    if (out.len + bytes > EXPORT_BUFSIZE)
+	exportFlush();
+    return out.buf + out.len;
+}
+
+static void
+exportBytes(const void *data, int bytes)
+{
+    if (bytes > EXPORT_BUFSIZE) {
+	exportFlush();
+	if (fwrite(data, 1, bytes, stdout) != (size_t)bytes) {
+	    fprintf(stderr, "%s: export write failed: %s\n",
+		    pmProgname, strerror(errno));
+	    exit(1);
+	}
+	return;
+    }
+    memcpy(exportSpace(bytes), data, bytes);
+    out.len += bytes;
+}
+
+static void
+exportInt(__uint32_t value)
+{
+    unsigned char bytes[4];
+
+    bytes[0] = value & 0xff;
+    bytes[1] = (value >> 8) & 0xff;
+    bytes[2] = (value >> 16) & 0xff;
+    bytes[3] = (value >> 24) & 0xff;
+    exportBytes(bytes, sizeof(bytes));
+}
+
+static void
+exportString(const QString &str)
+{
+    QByteArray bytes = str.toUtf8();
+
+    exportInt(bytes.length());
+    exportBytes(bytes.constData(), bytes.length());
+}
+
+static void
+exportQuoted(const QString &str)
+{
+    QByteArray bytes = str.toUtf8();
+    const char *p;
+
+    // CSV quoting, only when needed
+    if (strpbrk(bytes.constData(), ",\"\n") == NULL &&
+	strchr(bytes.constData(), delimiter) == NULL) {
+	exportBytes(bytes.constData(), bytes.length());
+	return;
+    }
+    exportBytes("\"", 1);
+    for (p = bytes.constData(); *p; p++) {
+	if (*p == '"')
+	    exportBytes("\"", 1);
+	exportBytes(p, 1);
+    }
+    exportBytes("\"", 1);
+}
+
+//
+// Fixed notation with the requested precision, exactly as "%.*f" would
+// produce in the C locale - done by hand with integer arithmetic unless
+// the value is too large, or so close to a rounding boundary that only
+// snprintf can be trusted to get the last digit right.
+//
+static int
+formatDouble(char *buf, double value)
+{
+    char	digits[24];
+    __uint64_t	scaled, whole, frac;
+    double	v = fabs(value) * out.scale;
+    double	f = v - floor(v);
+    char	*p = buf;
+    int		n, i;
+
+    // below 2^52 the fraction is still represented, and v + 0.5 is exact
+    if (precision > 15 || !(v < 4503599627370496.0) ||	// and NaN, infinity
+	fabs(f - 0.5) < 1.0e-6)
+	return snprintf(buf, 64, "%.*f", precision, value);
+
+    scaled = (__uint64_t)(v + 0.5);
+    whole = scaled / (__uint64_t)out.scale;
+    frac = scaled % (__uint64_t)out.scale;
+
+    if (signbit(value))
+	*p++ = '-';
+    n = 0;
+    do {
+	digits[n++] = '0' + (whole % 10);
+	whole /= 10;
+    } while (whole);
+    while (n > 0)
+	*p++ = digits[--n];
+    if (precision > 0) {
+	*p++ = '.';
+	for (i = precision - 1; i >= 0; i--) {
+	    p[i] = '0' + (frac % 10);
+	    frac /= 10;
+	}
+	p += precision;
+    }
+    return p - buf;
+}
+
+static void
+exportHeader(void)
+{
+    QmcMetric	*metric;
+    int		m, i;
+
+    for (m = 0; m < metrics.size(); m++) {
+	out.counts.append(metrics[m]->numValues());
+	out.columns += metrics[m]->numValues();
+    }
+
+    if (exportFormat == ExportBinary) {
+	exportBytes(EXPORT_MAGIC, 8);
+	exportInt(out.columns + 1);
+	exportString("Time");
+	exportString("sec");
+	for (m = 0; m < metrics.size(); m++) {
+	    metric = metrics[m];
+	    for (i = 0; i < out.counts[m]; i++) {
+		exportString(metric->spec(sourceFlag, true, i));
+		exportString(metric->desc().units());
+		if (!metric->real() && i == 0)
+		    pmprintf("%s: Warning: %s is not numeric, exported as NaN\n",
+			     pmProgname, (const char *)metric->name().toAscii());
+	    }
+	}
+	pmflush();
+	out.block = (double *)malloc((out.columns + 1) * EXPORT_ROWS * sizeof(double));
+	if (out.block == NULL) {
+	    fprintf(stderr, "%s: out of memory for export buffer\n", pmProgname);
+	    exit(1);
+	}
+	return;
+    }
+
+    if (timeFlag) {
+	exportQuoted("Time");
+	exportBytes(&delimiter, 1);
+    }
+    for (m = 0; m < metrics.size(); m++) {
+	metric = metrics[m];
+	for (i = 0; i < out.counts[m]; i++) {
+	    if (m || i)
+		exportBytes(&delimiter, 1);
+	    exportQuoted(metric->spec(sourceFlag, true, i));
+	}
+    }
+    exportBytes("\n", 1);
+}
+
+static void
+exportInit(void)
+{
+    if ((out.buf = (char *)malloc(EXPORT_BUFSIZE)) == NULL) {
+	fprintf(stderr, "%s: out of memory for export buffer\n", pmProgname);
+	exit(1);
+    }
+    out.scale = pow(10.0, precision);
+
+    // CSV is comma separated, unless asked otherwise
+    if (exportFormat == ExportCSV && delimiter == '\t')
+	delimiter = ',';
+    if (!errStrFlag)
+	errStr = "";
+    if (timeFormat.length() == 0)
+	timeFormat = "%Y-%m-%d %H:%M:%S";
+
+    exportHeader();
+}
+
+static void
+exportBlock(void)
+{
+    int c;
+
+    if (out.rows == 0)
+	return;
+    exportInt(out.rows);
+    for (c = 0; c <= out.columns; c++) {
+	double *column = out.block + c * EXPORT_ROWS;
+#ifdef HAVE_NETWORK_BYTEORDER
+	for (int r = 0; r < out.rows; r++) {
+	    __uint64_t bits, swap = 0;
+	    memcpy(&bits, &column[r], sizeof(bits));
+	    for (int b = 0; b < 8; b++, bits >>= 8)
+		swap = (swap << 8) | (bits & 0xff);
+	    memcpy(&column[r], &swap, sizeof(swap));
+	}
+#endif
+	exportBytes(column, out.rows * sizeof(double));
+    }
+    out.rows = 0;
+}
+
+static void
+exportEnd(void)
+{
+    if (exportFormat == ExportBinary)
+	exportBlock();
+    exportFlush();
+    fflush(stdout);
+}
+
+static inline bool
+exportValue(QmcMetric *metric, int i, double *value)
+{
+    if (i >= metric->numValues())
+	return false;
+    if (rawFlag) {
+	if (metric->currentError(i) < 0)
+	    return false;
+	*value = metric->currentValue(i);
+    }
+    else {
+	if (metric->error(i) < 0)
+	    return false;
+	*value = metric->value(i);
+    }
+    return true;
+}
+
+static void
+exportRow(struct timeval const &curPos)
+{
+    QmcMetric	*metric;
+    double	value;
+    int		m, i, c;
+
+    if (exportFormat == ExportBinary) {
+	out.block[out.rows] = __pmtimevalToReal(&curPos);
+	for (m = 0, c = 1; m < metrics.size(); m++) {
+	    metric = metrics[m];
+	    for (i = 0; i < out.counts[m]; i++, c++) {
+		if (!metric->real() || !exportValue(metric, i, &value))
+		    value = NAN;
+		out.block[c * EXPORT_ROWS + out.rows] = value;
+	    }
+	}
+	if (++out.rows == EXPORT_ROWS)
+	    exportBlock();
+	return;
+    }
+
+    if (timeFlag) {
+	const char *timeStr = dumpTime(curPos);
+	exportBytes(timeStr, strlen(timeStr));
+	exportBytes(&delimiter, 1);
+    }
+    for (m = 0; m < metrics.size(); m++) {
+	metric = metrics[m];
+	for (i = 0; i < out.counts[m]; i++) {
+	    if (m || i) {
+		*exportSpace(1) = delimiter;
+		out.len++;
+	    }
+	    if (metric->real()) {
+		if (exportValue(metric, i, &value)) {
+		    out.len += formatDouble(exportSpace(64), value);
+		    continue;
+		}
+	    }
+	    else if (i < metric->numValues() &&
+		     (rawFlag ? metric->currentError(i) : metric->error(i)) >= 0) {
+		exportQuoted(metric->stringValue(i));
+		continue;
+	    }
+	    exportQuoted(errStr);
+	}
+    }
+    exportBytes("\n", 1);
+}
+
 /*
  * Get Extended Time Base interval and Units from a timeval
  */
@@ -707,7 +1035,7 @@ main(int argc, char *argv[])
     pmOptions opts;
     memset(&opts, 0, sizeof(opts));
     opts.flags = PM_OPTFLAG_MULTI;
-    opts.short_options = PMAPI_OPTIONS "c:Cd:f:FGHilmMNoP:rR:uU:w:X";
+    opts.short_options = PMAPI_OPTIONS "c:Cd:e:f:FGHilmMNoP:rR:uU:w:X";
     opts.long_options = longopts;
     opts.short_usage = "[options] [metrics ...]";
     opts.override = override;
@@ -751,6 +1079,17 @@ main(int argc, char *argv[])
 	    	delimiter = opts.optarg[0];
 	    break;
 
+	case 'e':	// export format
+	    if (strcmp(opts.optarg, "csv") == 0)
+		exportFormat = ExportCSV;
+	    else if (strcmp(opts.optarg, "binary") == 0)
+		exportFormat = ExportBinary;
+	    else {
+		pmprintf("%s: -e format must be csv or binary\n", pmProgname);
+		opts.errors++;
+	    }
+	    break;
+
 	case 'f':	// Time format
 	    timeFormat = opts.optarg;
 	    if (timeFormat.length() == 0)
@@ -870,6 +1209,7 @@ main(int argc, char *argv[])
 
 	case 'U':	// error string
 	    errStr = opts.optarg;
+	    errStrFlag = true;
 	    break;
 
         case 'w':       // width
@@ -1106,7 +1446,8 @@ main(int argc, char *argv[])
     }
 
     pmflush();
-    dumpHeader();
+    if (exportFormat == ExportNone || !dumpFlag)
+	dumpHeader();
 
     // Only dump full names once
     if (fullXFlag == false)
@@ -1115,6 +1456,9 @@ main(int argc, char *argv[])
     if (!dumpFlag)
 	exit(0);
 
+    if (exportFormat != ExportNone)
+	exportInit();
+
     if (!isLive) {
 	int tmp_mode = PM_MODE_INTERP;
 	int tmp_delay = getXTBintervalFromTimeval(&tmp_mode, &opts.interval);
@@ -1136,6 +1480,17 @@ main(int argc, char *argv[])
 	group->fetch();
 	sampleCount++;
 
+	if (exportFormat != ExportNone) {
+	    exportRow(opts.origin);
+	    opts.origin = tadd(opts.origin, opts.interval);
+	    if (isLive) {
+		exportEnd();	// live data should not sit in the buffer
+		sleeptill(opts.origin);
+	    }
+	    pos = __pmtimevalToReal(&opts.origin);
+	    continue;
+	}
+
 	if (timeFlag)
 	    cout << dumpTime(opts.origin) << delimiter;
 
@@ -1248,5 +1603,8 @@ main(int argc, char *argv[])
 	}
     }
 
+    if (exportFormat != ExportNone)
+	exportEnd();
+
     return 0;
 }
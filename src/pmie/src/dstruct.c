@@ -29,6 +29,7 @@
 #include "fun.h"
 #include "eval.h"
 #include "show.h"
+#include "fuse.h"
 
 #if defined(HAVE_VALUES_H)
 #include <values.h>
@@ -60,6 +61,8 @@ char		*stopFlag;			/* end time specified? */
 char		*alignFlag;			/* align time specified? */
 char		*offsetFlag;			/* offset time specified? */
 RealTime	runTime;			/* run time interval */
+RealTime	fetchWait;			/* per-host fetch deadline */
+int		noFuse;				/* no compiled kernels */
 int		hostZone;			/* timezone from host? */
 char		*timeZone;			/* timezone from command line */
 int		verbose;			/* verbosity 0, 1 or 2 */
@@ -665,6 +668,7 @@ freeExpr(Expr *x)
 	     */
 	    free(x->metrics);
 	}
+	if (x->kern) freeKernel(x->kern);
 	if (x->ring) free(x->ring);
 	free(x);
     }
@@ -724,14 +728,27 @@ void
 changeSmpls(Expr **p, int nsmpls)
 {
     Expr   *x = *p;
+    Expr   *old = x;
     Metric *m;
     int    i;
 
     if (nsmpls == x->nsmpls) return;
+    /* compiled kernels refer to the old Expr, and the old shape */
+    fuseRelease(x);
     *p = x = (Expr *) ralloc(x, sizeof(Expr) + (nsmpls - 1) * sizeof(Sample));
     x->nsmpls = nsmpls;
     x->nvals = x->tspan * nsmpls;
     x->valid = 0;
+    if (x->parent) {
+	if (x->parent->arg1 == old)
+	    x->parent->arg1 = x;
+	if (x->parent->arg2 == old)
+	    x->parent->arg2 = x;
+    }
+    if (x->arg1 && x->arg1->parent == old)
+	x->arg1->parent = x;
+    if (x->arg2 && x->arg2->parent == old)
+	x->arg2->parent = x;
     if (x->op == CND_FETCH) {
 	m = x->metrics;
 	for (i = 0; i < x->hdom; i++) {
@@ -740,6 +757,7 @@ changeSmpls(Expr **p, int nsmpls)
 	}
     }
     newRingBfr(x);
+    fuseRecompile(x);
 }
 
 
@@ -1026,6 +1044,7 @@ static struct {
     { cndGte_1_n,	"cndGte_1_n" },
     { cndGte_n_1,	"cndGte_n_1" },
     { cndGte_n_n,	"cndGte_n_n" },
+    { cndKernel,	"cndKernel" },
     { cndLt_1_1,	"cndLt_1_1" },
     { cndLt_1_n,	"cndLt_1_n" },
     { cndLt_n_1,	"cndLt_n_1" },
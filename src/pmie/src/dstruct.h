@@ -38,6 +38,7 @@ struct profile;
 struct fetch;
 struct host;
 struct task;
+struct kernel;
 
 
 /***********************************************************************
@@ -119,6 +120,7 @@ typedef struct expr {
     int		    nsmpls;	/* number of samples in ring buffer */
     int		    nvals;	/* total number of values in ring buffer */
     struct metric   *metrics;	/* array of per host metric info */
+    struct kernel   *kern;	/* compiled region rooted here, or NULL */
 
     /* description of single value */
     int   	    sem;	/* value semantics, see below */
@@ -197,6 +199,8 @@ typedef struct host {
     int	    	    down;	/* host is not delivering metrics */
     Metric	    *waits;	/* wait list of Metrics */
     Metric          *duds;	/* bad Metrics discovered during evaluation */
+    struct hostfetch *async;	/* concurrent fetch state, see taskFetch() */
+    pmiehost_t	    *stats;	/* fetch instrumentation, or NULL */
 } Host;
 
 /* element of evaluator task queue */
@@ -398,6 +402,8 @@ extern char	   *dfltHostConn;  /* default PM_CONTEXT_HOST parameter  */
 extern char	   *dfltHostName;  /* pmContextGetHostName of host name */
 extern RealTime	   dfltDelta;	/* default sample interval */
 extern RealTime    runTime;	/* run time interval */
+extern RealTime	   fetchWait;	/* per-host fetch deadline, 0 for default */
+extern int	   noFuse;	/* no compiled kernels, see fuse.c */
 extern int	   hostZone;	/* timezone from host? */
 extern char	   *timeZone;	/* timezone from command line */
 extern int	   verbose;	/* verbosity 0, 1 or 2 */
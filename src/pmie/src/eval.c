@@ -309,9 +309,9 @@ clobber(Expr *x)
  * exported functions
  ***********************************************************************/
 
-/* fill in appropriate evaluator function for given Expr */
-void
-findEval(Expr *x)
+/* scalar operands of given Expr */
+int
+findArity(Expr *x)
 {
     int		arity = 0;
     Metric	*m;
@@ -335,6 +335,15 @@ findEval(Expr *x)
 	}
 	if (m == NULL) arity |= 2;
     }
+    return arity;
+}
+
+
+/* fill in appropriate evaluator function for given Expr */
+void
+findEval(Expr *x)
+{
+    int		arity = findArity(x);
 
     /*
      * never come here with x->op == NULL or OP_VAR
@@ -725,6 +734,10 @@ findEval(Expr *x)
 	exit(1);
     }
 
+    /* compiled region rooted here, see fuse.c */
+    if (x->kern)
+	x->eval = cndKernel;
+
     /* patch in fake actions for archive mode */
     if (archives &&
 	(x->op == ACT_SHELL || x->op == ACT_ALARM || x->op == ACT_SYSLOG ||
@@ -23,6 +23,9 @@
 
 #include "dstruct.h"
 
+/* scalar operands of given Expr, as a bit mask */
+int findArity(Expr *);
+
 /* fill in apprpriate evaluator function for given Expr */
 void findEval(Expr *);
 
@@ -110,6 +110,7 @@ void cndPcnt_time(Expr *);
 void cndCount_host(Expr *);
 void cndCount_inst(Expr *);
 void cndCount_time(Expr *);
+void cndKernel(Expr *);
 void actAnd(Expr *);
 void actOr(Expr *);
 void actShell(Expr *);
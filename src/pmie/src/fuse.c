@@ -0,0 +1,873 @@
+/***********************************************************************
+ * fuse.c - compiled (fused) evaluation of elementwise expressions
+ ***********************************************************************
+ *
+ * Copyright (c) 2015 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * Each connected region of elementwise operators in a rule is compiled
+ * into a Kernel, and the root of the region is given cndKernel() as its
+ * evaluator.  The operands of the region (fetches, rates, aggregates,
+ * constants, ...) are still evaluated via their own evaluators, then
+ * the whole region is computed one block of instances at a time.
+ *
+ * Intermediate values are written to their ring buffers exactly as the
+ * tree walk would, so %v bindings in actions and -v/-V output see the
+ * same values - except for numeric values feeding straight into another
+ * arithmetic operator, which cannot be observed from outside the region
+ * and so are kept in scratch rows instead.  Kernels are never evaluated
+ * concurrently, so all of them share one small (cache resident) pool
+ * of scratch rows.
+ *
+ * Common sub-expressions within a region are computed once, and a region
+ * identical to one evaluated earlier in the same Task cycle copies that
+ * region's results rather than recomputing them.
+ */
+
+#include "pmapi.h"
+#include "impl.h"
+#include "dstruct.h"
+#include "eval.h"
+#include "fun.h"
+#include "fuse.h"
+#include "show.h"
+
+static Kernel	*kernels;	/* all compiled kernels */
+static __pmHashCtl kernhash;	/* kernels by signature hash */
+static int	epoch;		/* bumped when expression shapes change */
+
+static char	**sigs;		/* per-slot signatures, compile only */
+
+static double	*scratch;	/* rows of KERNEL_BLOCK values, all kernels */
+static int	nscratch;
+
+/* kernels released by fuseRelease(), NULL root for the Expr itself */
+typedef struct {
+    Expr	*root;
+    Task	*task;
+    int		always;
+} Redo;
+
+static Redo	*redo;
+static int	nredo;
+
+
+/***********************************************************************
+ * typed elementwise loops
+ ***********************************************************************/
+
+#define NEG(x)		-(x)
+#define ADD(x,y)	((x) + (y))
+#define SUB(x,y)	((x) - (y))
+#define MUL(x,y)	((x) * (y))
+#define DIV(x,y)	((x) / (y))
+#define EQ(x,y)		((x) == (y))
+#define NEQ(x,y)	((x) != (y))
+#define LT(x,y)		((x) < (y))
+#define LTE(x,y)	((x) <= (y))
+#define GT(x,y)		((x) > (y))
+#define GTE(x,y)	((x) >= (y))
+#define NOT(x)		(((x) == B_TRUE || (x) == B_FALSE) ? !(x) : B_UNKNOWN)
+/* as for andor.c */
+#define OR(x,y)		(((x) == B_TRUE || (y) == B_TRUE) ? B_TRUE : (((x) == B_FALSE && (y) == B_FALSE) ? B_FALSE : B_UNKNOWN))
+#define OR1(x)		((x) == B_TRUE ? B_TRUE : B_UNKNOWN)
+#define AND(x,y)	(((x) == B_TRUE && (y) == B_TRUE) ? B_TRUE : (((x) == B_FALSE || (y) == B_FALSE) ? B_FALSE : B_UNKNOWN))
+#define AND1(x)		(((x) == B_FALSE) ? B_FALSE : B_UNKNOWN)
+
+/*
+ * One function per operator and type, with the vector/scalar cases
+ * split out so that each inner loop is a simple unit-stride loop.
+ */
+#define UNARY(fun, itype, otype, op)					\
+static void								\
+fun(otype *d, const itype *a, int va, int n)				\
+{									\
+    int		i;							\
+    itype	v;							\
+									\
+    if (va) {								\
+	for (i = 0; i < n; i++)						\
+	    d[i] = op(a[i]);						\
+    }									\
+    else {								\
+	v = *a;								\
+	for (i = 0; i < n; i++)						\
+	    d[i] = op(v);						\
+    }									\
+}
+
+#define BINARY(fun, itype, otype, op)					\
+static void								\
+fun(otype *d, const itype *a, int va, const itype *b, int vb, int n)	\
+{									\
+    int		i;							\
+    itype	v, w;							\
+									\
+    if (va && vb) {							\
+	for (i = 0; i < n; i++)						\
+	    d[i] = op(a[i], b[i]);					\
+    }									\
+    else if (va) {							\
+	w = *b;								\
+	for (i = 0; i < n; i++)						\
+	    d[i] = op(a[i], w);						\
+    }									\
+    else if (vb) {							\
+	v = *a;								\
+	for (i = 0; i < n; i++)						\
+	    d[i] = op(v, b[i]);						\
+    }									\
+    else {								\
+	v = *a;								\
+	w = *b;								\
+	for (i = 0; i < n; i++)						\
+	    d[i] = op(v, w);						\
+    }									\
+}
+
+UNARY(kNeg, double, double, NEG)
+BINARY(kAdd, double, double, ADD)
+BINARY(kSub, double, double, SUB)
+BINARY(kMul, double, double, MUL)
+BINARY(kDiv, double, double, DIV)
+BINARY(kEq, double, Boolean, EQ)
+BINARY(kNeq, double, Boolean, NEQ)
+BINARY(kLt, double, Boolean, LT)
+BINARY(kLte, double, Boolean, LTE)
+BINARY(kGt, double, Boolean, GT)
+BINARY(kGte, double, Boolean, GTE)
+UNARY(kNot, Boolean, Boolean, NOT)
+BINARY(kAnd, Boolean, Boolean, AND)
+UNARY(kAnd1, Boolean, Boolean, AND1)
+BINARY(kOr, Boolean, Boolean, OR)
+UNARY(kOr1, Boolean, Boolean, OR1)
+
+
+/***********************************************************************
+ * compilation
+ ***********************************************************************/
+
+/* operators that may be fused into a kernel */
+static int
+fusable(int op)
+{
+    switch (op) {
+    case CND_NEG:
+    case CND_ADD:
+    case CND_SUB:
+    case CND_MUL:
+    case CND_DIV:
+    case CND_EQ:
+    case CND_NEQ:
+    case CND_LT:
+    case CND_LTE:
+    case CND_GT:
+    case CND_GTE:
+    case CND_NOT:
+    case CND_AND:
+    case CND_OR:
+	return 1;
+    }
+    return 0;
+}
+
+/* operators with numeric (double) results */
+static int
+numeric(int op)
+{
+    return op == CND_NEG || op == CND_ADD || op == CND_SUB ||
+	   op == CND_MUL || op == CND_DIV;
+}
+
+/* may this argument be computed within its parent's kernel? */
+static int
+inline_arg(Expr *x)
+{
+    return x != NULL && fusable(x->op) && x->nsmpls == 1;
+}
+
+/* signature buffer size for a given length, grown in powers of two */
+static int
+sigsize(int len)
+{
+    int		size = 64;
+
+    while (size < len + 1)
+	size *= 2;
+    return size;
+}
+
+/* append to a signature */
+static void
+sigcat(char **sig, int *len, const char *s)
+{
+    int		n = strlen(s);
+
+    if (*sig == NULL || sigsize(*len + n) > sigsize(*len))
+	*sig = (char *)ralloc(*sig, sigsize(*len + n));
+    memcpy(*sig + *len, s, n + 1);
+    *len += n;
+}
+
+/*
+ * Canonical form of an expression - two expressions with the same
+ * signature compute the same values from the same fetched data.
+ */
+static void
+sigExpr(Expr *x, char **sig, int *len)
+{
+    Metric	*m;
+    char	buf[64];
+    int		i, j;
+
+    snprintf(buf, sizeof(buf), "(%d/%d", x->op, x->nsmpls);
+    sigcat(sig, len, buf);
+
+    if (x->op == CND_FETCH) {
+	for (i = 0, m = x->metrics; i < x->hdom; i++, m++) {
+	    sigcat(sig, len, " ");
+	    sigcat(sig, len, symName(m->mname));
+	    sigcat(sig, len, ":");
+	    sigcat(sig, len, symName(m->hname));
+	    for (j = 0; j < m->specinst; j++) {
+		sigcat(sig, len, "#");
+		sigcat(sig, len, m->inames[j]);
+	    }
+	}
+    }
+    else if (x->op == NOP && x->sem == SEM_NUMCONST) {
+	for (i = 0; i < x->tspan; i++) {
+	    snprintf(buf, sizeof(buf), " %.17g", ((double *)x->smpls[0].ptr)[i]);
+	    sigcat(sig, len, buf);
+	}
+    }
+    else if (x->op == NOP || x->op == OP_VAR) {
+	/* strings, regular expressions, variables: same storage only */
+	snprintf(buf, sizeof(buf), " " PRINTF_P_PFX "%p", x->smpls[0].ptr);
+	sigcat(sig, len, buf);
+    }
+    else {
+	if (x->arg1)
+	    sigExpr(x->arg1, sig, len);
+	if (x->arg2)
+	    sigExpr(x->arg2, sig, len);
+    }
+    sigcat(sig, len, ")");
+}
+
+static unsigned int
+sighash(const char *sig)
+{
+    unsigned int	h = 2166136261U;	/* FNV-1a */
+
+    while (*sig) {
+	h ^= (unsigned char)*sig++;
+	h *= 16777619U;
+    }
+    return h;
+}
+
+static int
+newSlot(Kernel *k, Expr *x, int insn, int size, int scratch, char *sig)
+{
+    Slot	*s;
+
+    k->slots = (Slot *)ralloc(k->slots, (k->nslots + 1) * sizeof(Slot));
+    sigs = (char **)ralloc(sigs, (k->nslots + 1) * sizeof(char *));
+    sigs[k->nslots] = sig;
+    s = &k->slots[k->nslots];
+    s->x = x;
+    s->insn = insn;
+    s->size = size;
+    s->scratch = scratch ? k->nscratch++ : -1;
+    s->ptr = NULL;
+    return k->nslots++;
+}
+
+static Insn *
+newInsn(Kernel *k, Expr *x, int op)
+{
+    Insn	*ip;
+
+    k->insns = (Insn *)ralloc(k->insns, (k->ninsns + 1) * sizeof(Insn));
+    ip = &k->insns[k->ninsns++];
+    memset(ip, 0, sizeof(Insn));
+    ip->x = x;
+    ip->op = op;
+    ip->arity = (op == KOP_COPY) ? 0 : findArity(x);
+    ip->src2 = -1;
+    return ip;
+}
+
+static int compileNode(Kernel *, Expr *, int);
+
+/* compile an argument, returns slot holding its values */
+static int
+compileArg(Kernel *k, Expr *parent, Expr *x)
+{
+    char	*sig = NULL;
+    int		len = 0;
+
+    if (inline_arg(x))
+	return compileNode(k, x, numeric(x->op) && numeric(parent->op));
+
+    k->leaves = (Expr **)ralloc(k->leaves, (k->nleaves + 1) * sizeof(Expr *));
+    k->leaves[k->nleaves++] = x;
+    sigExpr(x, &sig, &len);
+    return newSlot(k, x, -1,
+	    x->sem == SEM_BOOLEAN ? sizeof(Boolean) : sizeof(double), 0, sig);
+}
+
+/* compile an operator, in tree walk order, returns slot for its values */
+static int
+compileNode(Kernel *k, Expr *x, int scratch)
+{
+    Insn	*ip;
+    char	*sig = NULL;
+    char	buf[32];
+    int		len = 0;
+    int		src1, src2 = -1;
+    int		size = numeric(x->op) ? sizeof(double) : sizeof(Boolean);
+    int		i;
+
+    src1 = compileArg(k, x, x->arg1);
+    if (x->arg2)
+	src2 = compileArg(k, x, x->arg2);
+
+    /* as for sigExpr(), built from the operand signatures */
+    snprintf(buf, sizeof(buf), "(%d/%d", x->op, x->nsmpls);
+    sigcat(&sig, &len, buf);
+    sigcat(&sig, &len, sigs[src1]);
+    if (src2 >= 0)
+	sigcat(&sig, &len, sigs[src2]);
+    sigcat(&sig, &len, ")");
+
+    for (i = 0; i < k->ninsns; i++) {
+	if (k->insns[i].op != KOP_COPY &&
+	    strcmp(sigs[k->insns[i].dst], sig) == 0)
+	    break;
+    }
+    if (i < k->ninsns) {
+	/* common sub-expression, values are computed already */
+	if (scratch) {
+	    free(sig);
+	    return k->insns[i].dst;
+	}
+	ip = newInsn(k, x, KOP_COPY);
+	ip->src1 = k->insns[i].dst;
+    }
+    else {
+	ip = newInsn(k, x, x->op);
+	ip->src1 = src1;
+	ip->src2 = src2;
+    }
+    ip->dst = newSlot(k, x, k->ninsns - 1, size, scratch, sig);
+    return ip->dst;
+}
+
+static Kernel *
+newKernel(Task *t, Expr *x, int always)
+{
+    Kernel	*k;
+    Kernel	*o;
+    __pmHashNode *hp;
+    int		i;
+
+    k = (Kernel *)zalloc(sizeof(Kernel));
+    k->root = x;
+    k->task = t;
+    k->always = always;
+    k->epoch = epoch;
+    compileNode(k, x, 0);
+
+    /* root is always last, and its signature describes the kernel */
+    k->sig = sigs[k->nslots - 1];
+    for (i = 0; i < k->nslots - 1; i++)
+	free(sigs[i]);
+    free(sigs);
+    sigs = NULL;
+
+    if (k->nscratch > nscratch) {
+	nscratch = k->nscratch;
+	scratch = (double *)ralloc(scratch, nscratch * KERNEL_BLOCK * sizeof(double));
+    }
+
+    /*
+     * a kernel evaluated unconditionally on every cycle of the same Task
+     * as an identical, earlier one may simply copy the earlier results
+     */
+    k->hash = sighash(k->sig);
+    if (always) {
+	for (hp = __pmHashSearch(k->hash, &kernhash); hp; hp = hp->next) {
+	    o = (Kernel *)hp->data;
+	    if (hp->key == k->hash && o->always && o->task == t &&
+		o->ninsns == k->ninsns && o->nleaves == k->nleaves &&
+		strcmp(o->sig, k->sig) == 0) {
+		k->twin = o;
+		break;
+	    }
+	}
+    }
+    __pmHashAdd(k->hash, k, &kernhash);
+    k->next = kernels;
+    kernels = k;
+
+    x->kern = k;
+    x->eval = cndKernel;
+
+#if PCP_DEBUG
+    if (pmDebug & DBG_TRACE_APPL1) {
+	fprintf(stderr, "newKernel: compiled kernel for expr " PRINTF_P_PFX "%p\n", x);
+	dumpKernel(k);
+    }
+#endif
+    return k;
+}
+
+/*
+ * always is cleared below the action part of a rule, and within
+ * rulesets, as these are not evaluated on every cycle
+ */
+static void
+fuseTree(Task *t, Expr *x, int always)
+{
+    Kernel	*k;
+    int		i;
+
+    if (x == NULL || x->op >= NOP)
+	return;
+    if (x->kern)	/* shared sub-expression, compiled already */
+	return;
+
+    if (fusable(x->op) && (inline_arg(x->arg1) || inline_arg(x->arg2))) {
+	k = newKernel(t, x, always);
+	for (i = 0; i < k->nleaves; i++)
+	    fuseTree(t, k->leaves[i], always);
+	return;
+    }
+
+    if (x->op == RULE) {
+	fuseTree(t, x->arg1, always);
+	fuseTree(t, x->arg2, 0);
+	return;
+    }
+    if (x->op == CND_RULESET || x->op == CND_OTHER || x->op >= ACT_SEQ)
+	always = 0;
+    fuseTree(t, x->arg1, always);
+    fuseTree(t, x->arg2, always);
+}
+
+
+/***********************************************************************
+ * evaluation
+ ***********************************************************************/
+
+/*
+ * Validity, shape and timestamp for one instruction, following the
+ * rules of the equivalent tree walk evaluators in fun.c and andor.c
+ */
+static void
+prepare(Kernel *k, Insn *ip)
+{
+    Expr	*x = ip->x;
+    Expr	*arg1 = k->slots[ip->src1].x;
+    Expr	*arg2 = ip->src2 >= 0 ? k->slots[ip->src2].x : NULL;
+    Sample	*os = &x->smpls[0];
+    int		arity = ip->arity;
+    int		n = x->tspan;
+    int		ok = 0;
+
+    ip->len = 0;
+    switch (ip->op) {
+
+    case KOP_COPY:
+	if (arg1->valid) {
+	    ip->len = k->insns[k->slots[ip->src1].insn].len;
+	    os->stamp = arg1->smpls[0].stamp;
+	    ok = 1;
+	}
+	break;
+
+    case CND_NEG:
+    case CND_NOT:
+	if (arg1->valid) {
+	    if (arity & 1) {
+		ip->len = 1;
+		ok = 1;
+	    }
+	    else if (n > 0) {
+		ip->len = n;
+		ok = 1;
+	    }
+	    os->stamp = arg1->smpls[0].stamp;
+	}
+	break;
+
+    case CND_AND:
+    case CND_OR:
+	if (arg1->valid && arg2->valid)
+	    ip->mode = 3;
+	else if (arg1->valid)
+	    ip->mode = 1;
+	else if (arg2->valid)
+	    ip->mode = 2;
+	else
+	    break;
+	if ((arity & 3) == 3) {
+	    ip->len = 1;
+	    ok = 1;
+	}
+	else if (n > 0 || (ip->op == CND_AND && arity == 0)) {
+	    /* one valid scalar operand gives one value */
+	    ip->len = (ip->mode != 3 && (arity & ip->mode)) ? 1 : n;
+	    ok = 1;
+	}
+	if (ip->mode == 1)
+	    os->stamp = arg1->smpls[0].stamp;
+	else if (ip->mode == 2)
+	    os->stamp = arg2->smpls[0].stamp;
+	else
+	    os->stamp = (arg1->smpls[0].stamp > arg2->smpls[0].stamp) ?
+			arg1->smpls[0].stamp : arg2->smpls[0].stamp;
+	break;
+
+    default:
+	if (arg1->valid && arg2->valid) {
+	    if ((arity & 3) == 3) {
+		ip->len = 1;
+		ok = 1;
+	    }
+	    else if (n > 0 && ((arity & 1) || n == arg1->tspan) &&
+			      ((arity & 2) || n == arg2->tspan)) {
+		ip->len = n;
+		ok = 1;
+	    }
+	    os->stamp = (arg1->smpls[0].stamp > arg2->smpls[0].stamp) ?
+			arg1->smpls[0].stamp : arg2->smpls[0].stamp;
+	}
+	break;
+    }
+
+    if (ok)
+	x->valid++;
+    else
+	x->valid = 0;
+}
+
+/* values for the block starting at instance lo */
+static char *
+slotptr(Slot *s, int vector, int lo)
+{
+    if (s->scratch >= 0 || !vector)
+	return s->ptr;
+    return s->ptr + lo * s->size;
+}
+
+/* execute one instruction over the block starting at instance lo */
+static void
+step(Kernel *k, Insn *ip, int lo)
+{
+    Slot	*d = &k->slots[ip->dst];
+    Slot	*s1 = &k->slots[ip->src1];
+    Slot	*s2 = ip->src2 >= 0 ? &k->slots[ip->src2] : NULL;
+    int		v1 = !(ip->arity & 1);
+    int		v2 = !(ip->arity & 2);
+    int		n = ip->len - lo;
+    char	*dp, *p1, *p2 = NULL;
+
+    if (n > KERNEL_BLOCK)
+	n = KERNEL_BLOCK;
+    dp = slotptr(d, 1, lo);
+    p1 = slotptr(s1, v1, lo);
+    if (s2)
+	p2 = slotptr(s2, v2, lo);
+
+    switch (ip->op) {
+    case KOP_COPY:
+	if (d->scratch < 0)
+	    memcpy(dp, p1, n * d->size);
+	break;
+    case CND_NEG:
+	kNeg((double *)dp, (double *)p1, v1, n);
+	break;
+    case CND_ADD:
+	kAdd((double *)dp, (double *)p1, v1, (double *)p2, v2, n);
+	break;
+    case CND_SUB:
+	kSub((double *)dp, (double *)p1, v1, (double *)p2, v2, n);
+	break;
+    case CND_MUL:
+	kMul((double *)dp, (double *)p1, v1, (double *)p2, v2, n);
+	break;
+    case CND_DIV:
+	kDiv((double *)dp, (double *)p1, v1, (double *)p2, v2, n);
+	break;
+    case CND_EQ:
+	kEq((Boolean *)dp, (double *)p1, v1, (double *)p2, v2, n);
+	break;
+    case CND_NEQ:
+	kNeq((Boolean *)dp, (double *)p1, v1, (double *)p2, v2, n);
+	break;
+    case CND_LT:
+	kLt((Boolean *)dp, (double *)p1, v1, (double *)p2, v2, n);
+	break;
+    case CND_LTE:
+	kLte((Boolean *)dp, (double *)p1, v1, (double *)p2, v2, n);
+	break;
+    case CND_GT:
+	kGt((Boolean *)dp, (double *)p1, v1, (double *)p2, v2, n);
+	break;
+    case CND_GTE:
+	kGte((Boolean *)dp, (double *)p1, v1, (double *)p2, v2, n);
+	break;
+    case CND_NOT:
+	kNot((Boolean *)dp, (Boolean *)p1, v1, n);
+	break;
+    case CND_AND:
+	if (ip->mode == 3)
+	    kAnd((Boolean *)dp, (Boolean *)p1, v1, (Boolean *)p2, v2, n);
+	else if (ip->mode == 1)
+	    kAnd1((Boolean *)dp, (Boolean *)p1, v1, n);
+	else
+	    kAnd1((Boolean *)dp, (Boolean *)p2, v2, n);
+	break;
+    case CND_OR:
+	if (ip->mode == 3)
+	    kOr((Boolean *)dp, (Boolean *)p1, v1, (Boolean *)p2, v2, n);
+	else if (ip->mode == 1)
+	    kOr1((Boolean *)dp, (Boolean *)p1, v1, n);
+	else
+	    kOr1((Boolean *)dp, (Boolean *)p2, v2, n);
+	break;
+    }
+}
+
+static void
+execute(Kernel *k)
+{
+    Insn	*ip;
+    Slot	*s;
+    int		nmax = 0;
+    int		lo;
+    int		i;
+
+    /* ring buffers move on rotation and when instances change */
+    for (i = 0, s = k->slots; i < k->nslots; i++, s++) {
+	if (s->scratch < 0)
+	    s->ptr = (char *)s->x->smpls[0].ptr;
+	else
+	    s->ptr = (char *)&scratch[s->scratch * KERNEL_BLOCK];
+    }
+
+    for (i = 0, ip = k->insns; i < k->ninsns; i++, ip++) {
+	prepare(k, ip);
+	if (ip->len > nmax)
+	    nmax = ip->len;
+    }
+
+    for (lo = 0; lo < nmax; lo += KERNEL_BLOCK) {
+	for (i = 0, ip = k->insns; i < k->ninsns; i++, ip++) {
+	    if (ip->len > lo)
+		step(k, ip, lo);
+	}
+    }
+}
+
+/*
+ * Copy results from the twin kernel, if it was evaluated this cycle
+ * from operands with the same shape and timestamps.
+ */
+static int
+share(Kernel *k)
+{
+    Kernel	*t = k->twin;
+    Insn	*ip, *tp;
+    Expr	*x, *y;
+    int		i;
+
+    if (t->done != now)
+	return 0;
+    for (i = 0; i < k->nleaves; i++) {
+	x = k->leaves[i];
+	y = t->leaves[i];
+	if ((x->valid == 0) != (y->valid == 0) || x->tspan != y->tspan ||
+	    x->smpls[0].stamp != y->smpls[0].stamp)
+	    return 0;
+    }
+    for (i = 0; i < k->ninsns; i++) {
+	if (k->insns[i].x->tspan != t->insns[i].x->tspan)
+	    return 0;
+    }
+
+    for (i = 0, ip = k->insns, tp = t->insns; i < k->ninsns; i++, ip++, tp++) {
+	x = ip->x;
+	y = tp->x;
+	ip->len = tp->len;
+	ip->mode = tp->mode;
+	if (y->valid) {
+	    if (k->slots[ip->dst].scratch < 0)
+		memcpy(x->smpls[0].ptr, y->smpls[0].ptr,
+			tp->len * k->slots[ip->dst].size);
+	    x->smpls[0].stamp = y->smpls[0].stamp;
+	    x->valid++;
+	}
+	else
+	    x->valid = 0;
+    }
+    return 1;
+}
+
+/* operator CND_* for a compiled region */
+void
+cndKernel(Expr *x)
+{
+    Kernel	*k = x->kern;
+    Insn	*ip;
+    int		i;
+
+    for (i = 0; i < k->nleaves; i++) {
+	EVALARG(k->leaves[i])
+    }
+    ROTATE(x)
+
+    if (k->epoch != epoch) {
+	/* instances have come or gone, scalar operands may have changed */
+	for (i = 0, ip = k->insns; i < k->ninsns; i++, ip++) {
+	    if (ip->op != KOP_COPY)
+		ip->arity = findArity(ip->x);
+	}
+	k->epoch = epoch;
+    }
+
+    if (k->twin == NULL || !share(k))
+	execute(k);
+    k->done = now;
+
+#if PCP_DEBUG
+    if (pmDebug & DBG_TRACE_APPL2) {
+	fprintf(stderr, "cndKernel(" PRINTF_P_PFX "%p) ...\n", x);
+	dumpExpr(x);
+    }
+#endif
+}
+
+
+/***********************************************************************
+ * exported functions
+ ***********************************************************************/
+
+void
+fuseRule(Task *t, Expr *x)
+{
+    if (!noFuse)
+	fuseTree(t, x, 1);
+}
+
+void
+fuseReshape(void)
+{
+    epoch++;
+}
+
+/*
+ * changeSmpls() may move an Expr, and an Expr buffering more than one
+ * sample can no longer be computed inline, so every kernel that refers
+ * to the Expr is released first and compiled afresh afterwards.
+ */
+void
+fuseRelease(Expr *x)
+{
+    Kernel	*k, *next;
+    Redo	*r;
+    int		found;
+    int		i;
+
+    for (k = kernels; k; k = next) {
+	next = k->next;
+	found = (k->root == x);
+	for (i = 0; !found && i < k->nleaves; i++)
+	    found = (k->leaves[i] == x);
+	for (i = 0; !found && i < k->ninsns; i++)
+	    found = (k->insns[i].x == x);
+	if (!found)
+	    continue;
+	redo = (Redo *)ralloc(redo, (nredo + 1) * sizeof(Redo));
+	r = &redo[nredo++];
+	r->root = (k->root == x) ? NULL : k->root;
+	r->task = k->task;
+	r->always = k->always;
+	freeKernel(k);
+    }
+}
+
+void
+fuseRecompile(Expr *x)
+{
+    Expr	*root;
+    int		i;
+
+    for (i = 0; i < nredo; i++) {
+	root = redo[i].root ? redo[i].root : x;
+	findEval(root);
+	fuseTree(redo[i].task, root, redo[i].always);
+    }
+    nredo = 0;
+}
+
+void
+freeKernel(Kernel *k)
+{
+    Kernel	*o;
+    Kernel	**p;
+
+    for (p = &kernels; *p; p = &(*p)->next) {
+	if (*p == k) {
+	    *p = k->next;
+	    break;
+	}
+    }
+    for (o = kernels; o; o = o->next) {
+	if (o->twin == k)
+	    o->twin = NULL;
+    }
+    __pmHashDel(k->hash, k, &kernhash);
+    k->root->kern = NULL;
+    free(k->sig);
+    free(k->leaves);
+    free(k->slots);
+    free(k->insns);
+    free(k);
+}
+
+void
+dumpKernel(Kernel *k)
+{
+    Insn	*ip;
+    int		i;
+
+    fprintf(stderr, "Kernel dump @ " PRINTF_P_PFX "%p root=" PRINTF_P_PFX "%p twin=" PRINTF_P_PFX "%p always=%d\n",
+	k, k->root, k->twin, k->always);
+    fprintf(stderr, "  sig=%s\n", k->sig);
+    for (i = 0; i < k->nleaves; i++)
+	fprintf(stderr, "  leaf[%d] %s @ " PRINTF_P_PFX "%p\n",
+		i, opStrings(k->leaves[i]->op), k->leaves[i]);
+    for (i = 0, ip = k->insns; i < k->ninsns; i++, ip++) {
+	fprintf(stderr, "  insn[%d] %s @ " PRINTF_P_PFX "%p arity=%d src=%d,%d dst=%d",
+		i, ip->op == KOP_COPY ? "<copy>" : opStrings(ip->op), ip->x,
+		ip->arity, ip->src1, ip->src2, ip->dst);
+	if (k->slots[ip->dst].scratch >= 0)
+	    fprintf(stderr, " scratch=%d", k->slots[ip->dst].scratch);
+	fputc('\n', stderr);
+    }
+}
@@ -0,0 +1,90 @@
+/***********************************************************************
+ * fuse.h - compiled (fused) evaluation of elementwise expressions
+ ***********************************************************************
+ *
+ * Copyright (c) 2015 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#ifndef FUSE_H
+#define FUSE_H
+
+#include "dstruct.h"
+
+/*
+ * A kernel replaces the tree walk over a connected region of elementwise
+ * operators (arithmetic, relational, not, and, or) with a flat sequence
+ * of typed instructions.  The instructions are executed a block of
+ * instances at a time, so intermediate values stay in cache between
+ * operators, and intermediate numeric values that nothing outside the
+ * kernel can observe never touch their ring buffers at all.
+ */
+#define KERNEL_BLOCK	256	/* instances per block */
+
+/* value slot - a leaf operand, or the result of an instruction */
+typedef struct {
+    Expr	*x;		/* Expr owning these values */
+    int		insn;		/* instruction filling slot, -1 for leaf */
+    int		scratch;	/* scratch row, -1 if values in x->ring */
+    int		size;		/* sizeof(double) or sizeof(Boolean) */
+    char	*ptr;		/* values for this evaluation */
+} Slot;
+
+/* one operator in the flattened region */
+typedef struct {
+    Expr	*x;		/* Expr computed */
+    int		op;		/* operator, or KOP_COPY */
+    int		arity;		/* scalar operand mask, see findArity() */
+    int		src1;		/* operand slots */
+    int		src2;		/* -1 for unary operators */
+    int		dst;		/* result slot */
+    int		len;		/* values computed this evaluation */
+    int		mode;		/* which operands are valid (and, or) */
+} Insn;
+
+#define KOP_COPY	(-1)	/* common sub-expression, copy of src1 */
+
+typedef struct kernel {
+    struct kernel *next;	/* list of all kernels */
+    struct kernel *twin;	/* identical kernel, may share results */
+    Expr	*root;		/* Expr evaluated via cndKernel() */
+    Task	*task;		/* Task evaluating root */
+    char	*sig;		/* canonical form, for sharing */
+    unsigned int hash;		/* of sig */
+    int		always;		/* evaluated on every Task cycle */
+    int		epoch;		/* arity snapshot, see fuseReshape() */
+    int		nleaves;
+    Expr	**leaves;	/* operands, in tree walk order */
+    int		nslots;
+    Slot	*slots;
+    int		ninsns;
+    Insn	*insns;		/* instructions, in tree walk order */
+    int		nscratch;	/* scratch rows used */
+    RealTime	done;		/* time of last evaluation */
+} Kernel;
+
+/* compile the elementwise regions of a rule into kernels */
+void fuseRule(Task *, Expr *);
+
+/* instance or metric shape changed, refresh compiled kernels */
+void fuseReshape(void);
+
+/* Expr about to move or change its number of samples, and after */
+void fuseRelease(Expr *);
+void fuseRecompile(Expr *);
+
+/* release kernel rooted at given Expr */
+void freeKernel(Kernel *);
+
+/* diagnostic tracing */
+void dumpKernel(Kernel *);
+
+#endif /* FUSE_H */
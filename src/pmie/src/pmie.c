@@ -376,7 +376,7 @@ startmonitor(void)
     perf->logfile[sizeof(perf->logfile)-1] = '\0';
     strncpy(perf->defaultfqdn, dfltHostName, sizeof(perf->defaultfqdn));
     perf->defaultfqdn[sizeof(perf->defaultfqdn)-1] = '\0';
-    perf->version = 1;
+    perf->version = 2;
 }
 
 
@@ -925,6 +925,8 @@ interact(void)
 int
 main(int argc, char **argv)
 {
+    char	*p, *end;
+
     __pmGetUsername(&username);
     setlinebuf(stdout);
 
@@ -932,8 +934,22 @@ main(int argc, char **argv)
     if (getenv("PCP_COUNTER_WRAP") != NULL)
 	dowrap = 1;
 
+    /* PMIE_NOFUSE in environment evaluates every rule by tree walk */
+    if (getenv("PMIE_NOFUSE") != NULL)
+	noFuse = 1;
+
     getargs(argc, argv);
 
+    /* PMIE_FETCH_TIMEOUT in environment overrides per-host fetch deadline */
+    if ((p = getenv("PMIE_FETCH_TIMEOUT")) != NULL) {
+	fetchWait = strtod(p, &end);
+	if (*end != '\0' || fetchWait < 0) {
+	    fprintf(stderr, "%s: ignored bad PMIE_FETCH_TIMEOUT = '%s'\n",
+		    pmProgname, p);
+	    fetchWait = 0;
+	}
+    }
+
     if (interactive)
 	interact();
     else
@@ -25,11 +25,14 @@
 
 #include <math.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <signal.h>
 #include "pmapi.h"
 #include "impl.h"
 #include "dstruct.h"
 #include "eval.h"
 #include "pragmatics.h"
+#include "fuse.h"
 #if defined(HAVE_IEEEFP_H)
 #include <ieeefp.h>
 #endif
@@ -1022,6 +1025,7 @@ reinitMetric(Metric *m)
 	    }
 	    break;
 	}
+	fuseReshape();
     }
 
 end:
@@ -1079,6 +1083,7 @@ pragmatics(Symbol rule, RealTime delta)
     if (x->op != NOP) {
 	t = findTask(delta);
 	bundle(t, x);
+	fuseRule(t, x);
 	t->nrules++;
 	t->rules = (Symbol *) ralloc(t->rules, t->nrules * sizeof(Symbol));
 	t->rules[t->nrules-1] = symCopy(rule);
@@ -1111,6 +1116,344 @@ mark_all(Host *hdown)
     }
 }
 
+/*
+ * Concurrent fetching.  In live mode each Host has a worker thread, so
+ * the fetches for all Hosts in a Task are issued together and a slow
+ * or unreachable pmcd cannot hold up the others.  The evaluator waits
+ * at most fetchWait seconds (by default, FETCH_WAIT of the Task's sample
+ * interval) and then carries on with whatever has arrived - a Host still
+ * busy contributes no values this time around, and when its late results
+ * do turn up they are discarded.  A Host without a worker thread (the
+ * thread could not be created) is fetched from the evaluator thread.
+ * The latency of each Host's fetches, and the number of rounds that
+ * missed the deadline, are recorded in the pmiestats_t host table.
+ */
+#define FETCH_WAIT	0.5	/* default deadline, fraction of delta */
+
+typedef struct {
+    int		handle;		/* context for this Fetch */
+    int		npmids;
+    pmID	*pmids;		/* private copy, Fetch may be rebundled */
+    int		sts;		/* from pmFetch */
+    pmResult	*result;	/* not yet claimed by the evaluator */
+} FetchJob;
+
+typedef struct hostfetch {
+    pthread_t	thread;
+    pthread_cond_t go;		/* signalled when jobs are posted */
+    int		busy;		/* worker is fetching */
+    int		posted;		/* posted this round, see taskFetch() */
+    int		lost;		/* fetch error, acted on after unlocking */
+    RealTime	start;		/* time jobs were posted */
+    RealTime	latency;	/* of the last completed round */
+    int		late;		/* last round missed the deadline */
+    int		njobs;
+    int		maxjobs;
+    FetchJob	*jobs;		/* one per Fetch of the Host */
+} HostFetch;
+
+static pthread_mutex_t	fetchlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	fetchdone = PTHREAD_COND_INITIALIZER;
+
+/* fetch instrumentation slot for a Host, shared by Tasks */
+static pmiehost_t *
+hostStats(Host *h)
+{
+    const char	*name = symName(h->name);
+    pmiehost_t	*hs;
+    unsigned int i;
+
+    for (i = 0, hs = perf->hosts; i < perf->numhosts; i++, hs++) {
+	if (strcmp(hs->name, name) == 0)
+	    return hs;
+    }
+    if (perf->numhosts == PMIE_MAXHOSTS)
+	return NULL;
+    strncpy(hs->name, name, sizeof(hs->name));
+    hs->name[sizeof(hs->name)-1] = '\0';
+    perf->numhosts++;
+    return hs;
+}
+
+/* record a completed fetch round, only called from the evaluator thread */
+static void
+hostLatency(Host *h, RealTime latency)
+{
+    pmiehost_t	*hs = h->stats;
+
+    if (hs == NULL)
+	return;
+    hs->latency = latency;
+    if (latency > hs->latency_max)
+	hs->latency_max = latency;
+    hs->fetches++;
+}
+
+/* never called with fetchlock held, this logs and walks the rule tree */
+static void
+lostHost(Host *h, int sts)
+{
+    __pmNotifyErr(LOG_ERR, "pmFetch from %s failed: %s\n",
+		symName(h->name), pmErrStr(sts));
+    host_state_changed(symName(h->name), STATE_LOSTCONN);
+    h->down = 1;
+    mark_all(h);
+}
+
+static void *
+fetchWorker(void *arg)
+{
+    HostFetch	*a = (HostFetch *)arg;
+    FetchJob	*j;
+    RealTime	done;
+    int		i;
+
+    pthread_mutex_lock(&fetchlock);
+    for ( ; ; ) {
+	while (! a->busy)
+	    pthread_cond_wait(&a->go, &fetchlock);
+	pthread_mutex_unlock(&fetchlock);
+
+	/* jobs belong to this thread until busy is cleared */
+	for (i = 0, j = a->jobs; i < a->njobs; i++, j++) {
+	    j->result = NULL;
+	    if ((j->sts = pmUseContext(j->handle)) >= 0)
+		j->sts = pmFetch(j->npmids, j->pmids, &j->result);
+	    if (j->sts < 0)
+		j->result = NULL;
+	}
+	done = getReal();
+
+	pthread_mutex_lock(&fetchlock);
+	a->latency = done - a->start;
+	a->busy = 0;
+	pthread_cond_broadcast(&fetchdone);
+    }
+    return NULL;
+}
+
+static HostFetch *
+newHostFetch(Host *h)
+{
+    HostFetch	*a = (HostFetch *)zalloc(sizeof(HostFetch));
+    sigset_t	all, old;
+    int		sts;
+
+    pthread_cond_init(&a->go, NULL);
+
+    /* signals are for the evaluator thread, not the workers */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    sts = pthread_create(&a->thread, NULL, fetchWorker, a);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (sts != 0) {
+	__pmNotifyErr(LOG_ERR, "cannot create fetch thread for %s: %s\n",
+		symName(h->name), strerror(sts));
+	pthread_cond_destroy(&a->go);
+	free(a);
+	return NULL;
+    }
+    return a;
+}
+
+/* discard results unclaimed from a late round, called with fetchlock held */
+static int
+dropJobs(HostFetch *a)
+{
+    FetchJob	*j;
+    int		sts = 0;
+    int		i;
+
+    for (i = 0, j = a->jobs; i < a->njobs; i++, j++) {
+	if (j->result) {
+	    pmFreeResult(j->result);
+	    j->result = NULL;
+	}
+	else if (j->sts < 0 && sts == 0)
+	    sts = j->sts;
+	j->sts = 0;
+    }
+    return sts;
+}
+
+/* post fetches for Host to its worker, called with fetchlock held */
+static void
+postJobs(Host *h, HostFetch *a)
+{
+    Fetch	*f;
+    FetchJob	*j;
+    int		n = 0;
+
+    for (f = h->fetches; f; f = f->next)
+	n++;
+    if (n > a->maxjobs) {
+	a->jobs = (FetchJob *)ralloc(a->jobs, n * sizeof(FetchJob));
+	memset(&a->jobs[a->maxjobs], 0, (n - a->maxjobs) * sizeof(FetchJob));
+	a->maxjobs = n;
+    }
+    for (f = h->fetches, j = a->jobs; f; f = f->next, j++) {
+	j->pmids = (pmID *)ralloc(j->pmids, f->npmids * sizeof(pmID));
+	memcpy(j->pmids, f->pmids, f->npmids * sizeof(pmID));
+	j->npmids = f->npmids;
+	j->handle = f->handle;
+    }
+    a->njobs = n;
+    a->busy = 1;
+    a->posted = 1;
+    a->start = getReal();
+    pthread_cond_signal(&a->go);
+}
+
+/* execute fetches for given Host from the evaluator thread */
+static void
+hostFetch(Host *h)
+{
+    Fetch	*f;
+    int		sts;
+
+    f = h->fetches;
+    while (f) {
+	if (f->result) pmFreeResult(f->result);
+	if (! h->down) {
+	    pmUseContext(f->handle);
+	    if ((sts = pmFetch(f->npmids, f->pmids, &f->result)) < 0) {
+		if (! archives)
+		    lostHost(h, sts);
+		f->result = NULL;
+	    }
+	}
+	else
+	    f->result = NULL;
+	f = f->next;
+    }
+}
+
+/* execute fetches for given Task, one Host at a time (archives) */
+static void
+serialFetch(Task *t)
+{
+    Host	*h;
+
+    /* do all fetches, quick as you can */
+    for (h = t->hosts; h; h = h->next)
+	hostFetch(h);
+}
+
+/* execute fetches for given Task, all Hosts at once */
+static void
+concurrentFetch(Task *t)
+{
+    Host	*h;
+    Fetch	*f;
+    FetchJob	*j;
+    HostFetch	*a;
+    RealTime	wait;
+    RealTime	deadline;
+    RealTime	start;
+    RealTime	latency;
+    struct timespec ts;
+    int		pending = 0;
+    int		sts;
+
+    for (h = t->hosts; h; h = h->next) {
+	for (f = h->fetches; f; f = f->next) {
+	    if (f->result) pmFreeResult(f->result);
+	    f->result = NULL;
+	}
+	if (h->async == NULL && ! h->down)
+	    h->async = newHostFetch(h);
+	if (h->stats == NULL)
+	    h->stats = hostStats(h);
+    }
+
+    pthread_mutex_lock(&fetchlock);
+    for (h = t->hosts; h; h = h->next) {
+	if ((a = h->async) == NULL)
+	    continue;
+	a->posted = 0;
+	a->lost = 0;
+	if (a->busy)	/* still working on a round that missed its deadline */
+	    continue;
+	if (a->late) {	/* that round has finished since */
+	    hostLatency(h, a->latency);
+	    a->late = 0;
+	}
+	if ((sts = dropJobs(a)) < 0 && ! h->down) {
+	    a->lost = sts;
+	    continue;
+	}
+	if (h->down || h->fetches == NULL)
+	    continue;
+	postJobs(h, a);
+	pending++;
+    }
+    pthread_mutex_unlock(&fetchlock);
+
+    /* while the workers are busy, fetch from Hosts that have none */
+    wait = fetchWait > 0 ? fetchWait : FETCH_WAIT * t->delta;
+    for (h = t->hosts; h; h = h->next) {
+	if (h->async != NULL || h->down || h->fetches == NULL)
+	    continue;
+	start = getReal();
+	hostFetch(h);
+	latency = getReal() - start;
+	hostLatency(h, latency);
+	if (latency > wait && h->stats)
+	    h->stats->late++;
+    }
+
+    deadline = getReal() + wait;
+    ts.tv_sec = (time_t)deadline;
+    ts.tv_nsec = (long)((deadline - ts.tv_sec) * 1000000000.0);
+    pthread_mutex_lock(&fetchlock);
+    while (pending) {
+	pending = 0;
+	for (h = t->hosts; h; h = h->next) {
+	    if ((a = h->async) != NULL && a->posted && a->busy)
+		pending++;
+	}
+	if (pending == 0)
+	    break;
+	if (pthread_cond_timedwait(&fetchdone, &fetchlock, &ts) == ETIMEDOUT)
+	    break;
+    }
+
+    /* claim results from the Hosts that made it in time */
+    for (h = t->hosts; h; h = h->next) {
+	if ((a = h->async) == NULL || ! a->posted)
+	    continue;
+	if (a->busy) {
+	    a->late = 1;
+	    if (h->stats)
+		h->stats->late++;
+#if PCP_DEBUG
+	    if (pmDebug & DBG_TRACE_FETCH)
+		fprintf(stderr, "concurrentFetch: %s missed deadline\n",
+			symName(h->name));
+#endif
+	    continue;
+	}
+	hostLatency(h, a->latency);
+	for (f = h->fetches, j = a->jobs; f; f = f->next, j++) {
+	    if (j->sts < 0) {
+		if (a->lost == 0)
+		    a->lost = j->sts;
+	    }
+	    else if (a->lost == 0) {
+		f->result = j->result;
+		j->result = NULL;
+	    }
+	}
+	dropJobs(a);
+    }
+    pthread_mutex_unlock(&fetchlock);
+
+    for (h = t->hosts; h; h = h->next) {
+	if ((a = h->async) != NULL && a->lost < 0 && ! h->down)
+	    lostHost(h, a->lost);
+    }
+}
+
 /* execute fetches for given Task */
 void
 taskFetch(Task *t)
@@ -1122,33 +1465,11 @@ taskFetch(Task *t)
     pmResult	*r;
     pmValueSet	**v;
     int		i;
-    int		sts;
 
-    /* do all fetches, quick as you can */
-    h = t->hosts;
-    while (h) {
-	f = h->fetches;
-	while (f) {
-	    if (f->result) pmFreeResult(f->result);
-	    if (! h->down) {
-		pmUseContext(f->handle);
-		if ((sts = pmFetch(f->npmids, f->pmids, &f->result)) < 0) {
-		    if (! archives) {
-			__pmNotifyErr(LOG_ERR, "pmFetch from %s failed: %s\n",
-				symName(f->host->name), pmErrStr(sts));
-			host_state_changed(symName(f->host->name), STATE_LOSTCONN);
-			h->down = 1;
-			mark_all(h);
-		    }
-		    f->result = NULL;
-		}
-	    }
-	    else
-		f->result = NULL;
-	    f = f->next;
-	}
-	h = h->next;
-    }
+    if (archives)
+	serialFetch(t);
+    else
+	concurrentFetch(t);
 
     /* sort and distribute pmValueSets to requesting Metrics */
     h = t->hosts;
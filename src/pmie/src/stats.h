@@ -16,10 +16,23 @@
 
 #include <sys/types.h>
 #include <sys/param.h>
+#include <stddef.h>
 
 /* subdir nested under PCP_TMP_DIR */
 #define PMIE_SUBDIR	"pmie"
 
+/* most hosts with per-host instrumentation */
+#define PMIE_MAXHOSTS	32
+
+/* per-host fetch instrumentation (version 2 onwards) */
+typedef struct {
+    char		name[MAXHOSTNAMELEN+1];
+    float		latency;		/* last fetch, seconds */
+    float		latency_max;		/* slowest fetch, seconds */
+    unsigned int	fetches;		/* fetches completed */
+    unsigned int	late;			/* fetches past the deadline */
+} pmiehost_t;
+
 /* pmie performance instrumentation */
 typedef struct {
     char		config[MAXPATHLEN+1];
@@ -33,6 +46,12 @@ typedef struct {
     unsigned int	eval_unknown;		/* pmcd.pmie.eval.unknown  */
     unsigned int	eval_actual;		/* pmcd.pmie.eval.actual   */
     unsigned int	version;
+    /* version 2 */
+    unsigned int	numhosts;		/* entries used in hosts[] */
+    pmiehost_t		hosts[PMIE_MAXHOSTS];
 } pmiestats_t;
 
+/* size of the version 1 structure, all fields up to numhosts */
+#define PMIESTATS_V1_SIZE	offsetof(pmiestats_t, numhosts)
+
 #endif /* STATS_H */
@@ -33,6 +33,8 @@ typedef struct _reclist_t {
     int			written;	/* written status */
     struct _reclist_t	*ptr;		/* ptr to record in another reclist */
     struct _reclist_t	*next;		/* ptr to next reclist_t record */
+    struct _reclist_t	**index;	/* indom records sorted by stamp */
+    int			nindex;		/* number of entries in index */
 } reclist_t;
 
 /*
@@ -47,6 +49,7 @@ typedef struct {
     pmResult	*_Nresult;
     int		eof[2];
     int		mark;		/* need EOL marker */
+    int		curvol;		/* data volume being read */
 } inarch_t;
 
 extern inarch_t	*inarch;	/* input archive control(s) */
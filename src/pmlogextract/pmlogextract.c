@@ -281,8 +281,9 @@ static off_t	flushsize = 100000;		/* bytes before flush */
 
 /* archive control stuff */
 char			*outarchname = NULL;	/* name of output archive */
-static __pmHashCtl	mdesc_hash;	/* pmids that have been written */
-static __pmHashCtl	mindom_hash;	/* indoms that have been written */
+static __pmHashCtl	mdesc_hash;	/* desc record for each pmid */
+static __pmHashCtl	mindom_hash;	/* first indom record for each indom */
+static __pmHashCtl	mname_hash;	/* desc records, by metric name */
 static __pmLogCtl	logctl;		/* output archive control */
 inarch_t		*inarch;	/* input archive control(s) */
 int			inarchnum;	/* number of input archives */
@@ -293,6 +294,21 @@ static reclist_t	*rlog;		/* log records to be written */
 static reclist_t	*rdesc;		/* meta desc records to be written */
 static reclist_t	*rindom;	/* meta indom records to be written */
 
+/*
+ *  next log record from each input archive, as a min-heap ordered by
+ *  timestamp, so picking the earliest of many archives is O(log n)
+ */
+typedef struct {
+    __pmTimeval		stamp;		/* of _Nresult or mark pdu */
+    int			arch;		/* index into inarch[] */
+} logheap_t;
+
+static logheap_t	*logheap;
+static int		nlogheap;
+static int		*logrefill;	/* archives needing their next record */
+static int		nlogrefill;
+static int		numlogeof;	/* archives with no more log records */
+
 static __pmTimeval	curlog;		/* most recent timestamp in log */
 static __pmTimeval	current;	/* most recent timestamp overall */
 
@@ -556,54 +572,44 @@ mk_reclist_t(void)
     rec->desc.indom = PM_IN_NULL;
     rec->desc.sem = 0;
     rec->desc.units = nullunits;	/* struct assignment */
+    rec->stamp.tv_sec = rec->stamp.tv_usec = 0;
     rec->written = NOT_WRITTEN;
     rec->ptr = NULL;
     rec->next = NULL;
+    rec->index = NULL;
+    rec->nindex = 0;
     return(rec);
 }
 
 /*
  * find indom in indomreclist - if it isn't in the list then add it in
  * with no pdu buffer
+ *
+ * all the records for one indom are kept together, and mindom_hash
+ * points at the first of these
  */
 static reclist_t *
 findnadd_indomreclist(int indom)
 {
-    reclist_t	*curr;
+    __pmHashNode	*hp;
+    reclist_t		*curr;
 
-    if (rindom == NULL) {
-	rindom = mk_reclist_t();
-	rindom->desc.pmid = PM_ID_NULL;
-	rindom->desc.type = PM_TYPE_NOSUPPORT;
-	rindom->desc.indom = indom;
-	rindom->desc.sem = 0;
-	rindom->desc.units = nullunits;	/* struct assignment */
-	return(rindom);
+    if ((hp = __pmHashSearch((unsigned int)indom, &mindom_hash)) != NULL) {
+	/* we have found a matching record - return the pointer */
+	return((reclist_t *)hp->data);
     }
-    else {
-	curr = rindom;
-
-	/* find matching record or last record */
-	while (curr->next != NULL && curr->desc.indom != indom)
-	    curr = curr->next;
 
-	if (curr->desc.indom == indom) {
-	    /* we have found a matching record - return the pointer */
-	    return(curr);
-	}
-	else {
-	    /* we have not found a matching record - append new record */
-	    curr->next = mk_reclist_t();
-	    curr = curr->next;
-	    curr->desc.pmid = PM_ID_NULL;
-	    curr->desc.type = PM_TYPE_NOSUPPORT;
-	    curr->desc.indom = indom;
-	    curr->desc.sem = 0;
-	    curr->desc.units = nullunits;	/* struct assignment */
-	    return(curr);
-	}
+    /* we have not found a matching record - add new record */
+    curr = mk_reclist_t();
+    curr->desc.indom = indom;
+    if (__pmHashAdd((unsigned int)indom, (void *)curr, &mindom_hash) < 0) {
+	fprintf(stderr, "%s: Error: cannot malloc space for indom hash.\n",
+		pmProgname);
+	abandon();
     }
-
+    curr->next = rindom;
+    rindom = curr;
+    return(curr);
 }
 
 /*
@@ -643,6 +649,68 @@ append_logreclist(int i)
     iap->pb[LOG] = NULL;
 }
 
+/*
+ * hash for a metric name, as packed <len><name> in a desc pdu buffer
+ */
+static unsigned int
+namehash(const char *name, int len)
+{
+    unsigned int	h = 2166136261U;	/* FNV-1a */
+    int			i;
+
+    for (i = 0; i < len; i++) {
+	h ^= (unsigned char)name[i];
+	h *= 16777619U;
+    }
+    return h;
+}
+
+/*
+ * add (rec != NULL) the metric name(s) from a desc record to mname_hash,
+ * or else find a desc record for some other pmid sharing any of the
+ * names in the pdu buffer
+ */
+static reclist_t *
+hashnames(__pmPDU *pdubuf, pmID pmid, reclist_t *rec)
+{
+    __pmHashNode	*hp;
+    reclist_t		*other;
+    __pmPDU		len;
+    unsigned int	key;
+    char		*p;
+    int			numnames;
+    int			i;
+
+    if (ntohl(pdubuf[0]) <= 8)
+	return NULL;
+    numnames = ntohl(pdubuf[7]);
+    p = (char *)&pdubuf[8];
+    for (i = 0; i < numnames; i++) {
+	memmove((void *)&len, (void *)p, sizeof(__pmPDU));
+	len = ntohl(len);
+	p += sizeof(__pmPDU);
+	key = namehash(p, len);
+	p += len;
+	if (rec != NULL) {
+	    if (__pmHashAdd(key, (void *)rec, &mname_hash) < 0) {
+		fprintf(stderr, "%s: Error: cannot malloc space for name hash.\n",
+			pmProgname);
+		abandon();
+	    }
+	    continue;
+	}
+	for (hp = __pmHashSearch(key, &mname_hash); hp != NULL; hp = hp->next) {
+	    if (hp->key != key)
+		continue;
+	    other = (reclist_t *)hp->data;
+	    if (other->desc.pmid != pmid && other->pdu != NULL &&
+		matchnames(other->pdu, pdubuf) != MATCH_NONE)
+		return other;
+	}
+    }
+    return NULL;
+}
+
 /*
  *  append a new record to the desc meta record list if not seen
  *  before, else check the desc meta record is semantically the
@@ -653,47 +721,31 @@ update_descreclist(int i)
 {
     inarch_t	*iap;
     reclist_t	*curr;
+    __pmHashNode	*hp;
+    pmID	pmid;
     pmUnits	pmu;
     pmUnits	*pmup;
 
     iap = &inarch[i];
+    pmid = ntoh_pmID(iap->pb[META][2]);
 
-    if (rdesc == NULL) {
-	/* first time */
-	curr = rdesc = mk_reclist_t();
-    }
-    else {
-	curr = rdesc;
-	/* find matching record or last record */
 #ifdef PCP_DEBUG
-	if (pmDebug & DBG_TRACE_APPL1) {
-	    fprintf(stderr, "update_descreclist: looking for ");
-	    printmetricnames(stderr, iap->pb[META]);
-	    fprintf(stderr, " (pmid:%s)\n", pmIDStr(ntoh_pmID(iap->pb[META][2])));
-	}
-#endif
-	while (curr->next != NULL && curr->desc.pmid != ntoh_pmID(iap->pb[META][2])) {
-	    if (curr->pdu != NULL) {
-		if (matchnames(curr->pdu, iap->pb[META]) != MATCH_NONE) {
-		    fprintf(stderr, "%s: Error: metric ", pmProgname);
-		    printmetricnames(stderr, curr->pdu);
-		    fprintf(stderr, ": PMID changed from %s", pmIDStr(curr->desc.pmid));
-		    fprintf(stderr, " to %s!\n", pmIDStr(ntoh_pmID(iap->pb[META][2])));
-		    abandon();
-		}
-#ifdef PCP_DEBUG
-		if (pmDebug & DBG_TRACE_APPL1) {
-		    fprintf(stderr, "update_descreclist: nomatch ");
-		    printmetricnames(stderr, curr->pdu);
-		    fprintf(stderr, " (pmid:%s)\n", pmIDStr(curr->desc.pmid));
-		}
+    if (pmDebug & DBG_TRACE_APPL1) {
+	fprintf(stderr, "update_descreclist: looking for ");
+	printmetricnames(stderr, iap->pb[META]);
+	fprintf(stderr, " (pmid:%s)\n", pmIDStr(pmid));
+    }
 #endif
-	    }
-	    curr = curr->next;
-	}
+    if ((curr = hashnames(iap->pb[META], pmid, NULL)) != NULL) {
+	fprintf(stderr, "%s: Error: metric ", pmProgname);
+	printmetricnames(stderr, curr->pdu);
+	fprintf(stderr, ": PMID changed from %s", pmIDStr(curr->desc.pmid));
+	fprintf(stderr, " to %s!\n", pmIDStr(pmid));
+	abandon();
     }
 
-    if (curr->desc.pmid == ntoh_pmID(iap->pb[META][2])) {
+    if ((hp = __pmHashSearch((unsigned int)pmid, &mdesc_hash)) != NULL) {
+	curr = (reclist_t *)hp->data;
 #ifdef PCP_DEBUG
 	if (pmDebug & DBG_TRACE_APPL1) {
 	    fprintf(stderr, "update_descreclist: pmid match ");
@@ -769,17 +821,24 @@ update_descreclist(int i)
 	iap->pb[META] = NULL;
     }
     else {
-	/* append new record */
-	curr->next = mk_reclist_t();
-	curr = curr->next;
+	/* add new record */
+	curr = mk_reclist_t();
 	curr->pdu = iap->pb[META];
-	curr->desc.pmid = ntoh_pmID(iap->pb[META][2]);
+	curr->desc.pmid = pmid;
 	curr->desc.type = ntohl(iap->pb[META][3]);
 	curr->desc.indom = ntoh_pmInDom(iap->pb[META][4]);
 	curr->desc.sem = ntohl(iap->pb[META][5]);
 	pmup =(pmUnits *)&iap->pb[META][6];
 	curr->desc.units = ntoh_pmUnits(*pmup);
 	curr->ptr = findnadd_indomreclist(curr->desc.indom);
+	if (__pmHashAdd((unsigned int)pmid, (void *)curr, &mdesc_hash) < 0) {
+	    fprintf(stderr, "%s: Error: cannot malloc space for desc hash.\n",
+		    pmProgname);
+	    abandon();
+	}
+	hashnames(curr->pdu, pmid, curr);
+	curr->next = rdesc;
+	rdesc = curr;
 	iap->pb[META] = NULL;
     }
 }
@@ -796,63 +855,83 @@ append_indomreclist(int i)
 
     iap = &inarch[i];
 
-    if (rindom == NULL) {
-	rindom = mk_reclist_t();
-	rindom->pdu = iap->pb[META];
-	rindom->stamp.tv_sec = ntohl(rindom->pdu[2]);
-	rindom->stamp.tv_usec = ntohl(rindom->pdu[3]);
-	rindom->desc.pmid = PM_ID_NULL;
-	rindom->desc.type = PM_TYPE_NOSUPPORT;
-	rindom->desc.indom = ntoh_pmInDom(iap->pb[META][4]);
-	rindom->desc.sem = 0;
-	rindom->desc.units = nullunits;	/* struct assignment */
+    curr = findnadd_indomreclist(ntoh_pmInDom(iap->pb[META][4]));
+    if (curr->pdu == NULL) {
+	/* insert new record */
+	curr->pdu = iap->pb[META];
+	curr->stamp.tv_sec = ntohl(curr->pdu[2]);
+	curr->stamp.tv_usec = ntohl(curr->pdu[3]);
     }
     else {
-	curr = rindom;
+	/* do NOT discard old record; insert new record */
+	rec = mk_reclist_t();
+	rec->pdu = iap->pb[META];
+	rec->stamp.tv_sec = ntohl(rec->pdu[2]);
+	rec->stamp.tv_usec = ntohl(rec->pdu[3]);
+	rec->desc.pmid = PM_ID_NULL;
+	rec->desc.type = PM_TYPE_NOSUPPORT;
+	rec->desc.indom = ntoh_pmInDom(iap->pb[META][4]);
+	rec->desc.sem = 0;
+	rec->desc.units = nullunits;	/* struct assignment */
+	rec->next = curr->next;
+	curr->next = rec;
+    }
 
-	/* find matching record or last record */
-	while (curr->next != NULL && curr->desc.indom != ntoh_pmInDom(iap->pb[META][4])) {
-	    curr = curr->next;
-	}
+    iap->pb[META] = NULL;
+}
 
-	if (curr->desc.indom == ntoh_pmInDom(iap->pb[META][4])) {
-	    if (curr->pdu == NULL) {
-		/* insert new record */
-		curr->pdu = iap->pb[META];
-		curr->stamp.tv_sec = ntohl(curr->pdu[2]);
-		curr->stamp.tv_usec = ntohl(curr->pdu[3]);
-	    }
-	    else {
-		/* do NOT discard old record; insert new record */
-		rec = mk_reclist_t();
-		rec->pdu = iap->pb[META];
-		rec->stamp.tv_sec = ntohl(rec->pdu[2]);
-		rec->stamp.tv_usec = ntohl(rec->pdu[3]);
-		rec->desc.pmid = PM_ID_NULL;
-		rec->desc.type = PM_TYPE_NOSUPPORT;
-		rec->desc.indom = ntoh_pmInDom(iap->pb[META][4]);
-		rec->desc.sem = 0;
-		rec->desc.units = nullunits;	/* struct assignment */
-		rec->next = curr->next;
-		curr->next = rec;
-	    }
+/*
+ *  once all the meta data has been read, sort the records for each
+ *  indom by timestamp, keeping the order of the indom list for equal
+ *  timestamps (the last of these is the one chosen)
+ */
+typedef struct {
+    reclist_t	*rec;
+    int		pos;		/* position in the indom list */
+} indomsort_t;
+
+static int
+indomcmp(const void *a, const void *b)
+{
+    const indomsort_t	*ap = (const indomsort_t *)a;
+    const indomsort_t	*bp = (const indomsort_t *)b;
+    int			sts;
+
+    if ((sts = tvcmp(ap->rec->stamp, bp->rec->stamp)) != 0)
+	return sts;
+    return ap->pos - bp->pos;
+}
+
+static void
+index_indomreclist(void)
+{
+    reclist_t	*head;
+    reclist_t	*curr;
+    indomsort_t	*sort;
+    int		i;
+    int		n;
+
+    for (head = rindom; head != NULL; head = curr) {
+	n = 0;
+	for (curr = head; curr != NULL && curr->desc.indom == head->desc.indom; curr = curr->next)
+	    n++;
+	sort = (indomsort_t *)malloc(n * sizeof(indomsort_t));
+	head->index = (reclist_t **)malloc(n * sizeof(reclist_t *));
+	if (sort == NULL || head->index == NULL) {
+	    fprintf(stderr, "%s: Error: cannot malloc space for indom index.\n",
+		    pmProgname);
+	    abandon();
 	}
-	else {
-	    /* append new record */
-	    curr->next = mk_reclist_t();
-	    curr = curr->next;
-	    curr->pdu = iap->pb[META];
-	    curr->stamp.tv_sec = ntohl(curr->pdu[2]);
-	    curr->stamp.tv_usec = ntohl(curr->pdu[3]);
-	    curr->desc.pmid = PM_ID_NULL;
-	    curr->desc.type = PM_TYPE_NOSUPPORT;
-	    curr->desc.indom = ntoh_pmInDom(iap->pb[META][4]);
-	    curr->desc.sem = 0;
-	    curr->desc.units = nullunits;	/* struct assignment */
+	for (i = 0, curr = head; i < n; i++, curr = curr->next) {
+	    sort[i].rec = curr;
+	    sort[i].pos = i;
 	}
-    } /*else*/
-
-    iap->pb[META] = NULL;
+	qsort(sort, n, sizeof(indomsort_t), indomcmp);
+	for (i = 0; i < n; i++)
+	    head->index[i] = sort[i].rec;
+	head->nindex = n;
+	free(sort);
+    }
 }
 
 /*
@@ -958,9 +1037,12 @@ write_metareclist(pmResult *result, int *needti)
     reclist_t		*curr_desc;	/* current desc record */
     reclist_t		*curr_indom;	/* current indom record */
     reclist_t   	*othr_indom;	/* other indom record */
+    __pmHashNode	*hp;
     pmID		pmid;
     pmInDom		indom;
     struct timeval	*this;		/* ptr to timestamp in result */
+    __pmTimeval		*stamp;		/* timestamp of indom record */
+    int			lo, mid, hi;
 
     this = &result->timestamp;
 
@@ -971,9 +1053,8 @@ write_metareclist(pmResult *result, int *needti)
 	indom = PM_IN_NULL;
 	curr_indom = NULL;
 
-	curr_desc = rdesc;
-	while (curr_desc != NULL && curr_desc->desc.pmid != pmid)
-	    curr_desc = curr_desc->next;
+	hp = __pmHashSearch((unsigned int)pmid, &mdesc_hash);
+	curr_desc = hp == NULL ? NULL : (reclist_t *)hp->data;
 
 	if (curr_desc == NULL) {
 	    /* descriptor has not been found - this is bad
@@ -1014,35 +1095,28 @@ write_metareclist(pmResult *result, int *needti)
 	 * now go and find & write the indom
 	 */
 	if (indom != PM_INDOM_NULL) {
-	    /* there may be more than one indom in the list, so we need
-	     * to traverse the entire list
+	    /* there may be more than one indom in the list (at least one
+	     * from each input archive)
 	     *	- we can safely ignore all indoms after the current timestamp
 	     *	- we want the latest indom at, or before the current timestamp
+	     *	- index[] of the first indom record is sorted by timestamp,
+	     *	  so a binary search finds it
 	     */
 	    othr_indom = NULL;
-	    while (curr_indom != NULL && curr_indom->desc.indom == indom) {
-		if (curr_indom->stamp.tv_sec < this->tv_sec ||
-		         (curr_indom->stamp.tv_sec == this->tv_sec &&
-		          curr_indom->stamp.tv_usec <= this->tv_usec))
-		{
-		    /* indom is in list, indom has pdu
-		     * and timestamp in pdu suits us
-		     */
-		    if (othr_indom == NULL) {
-			othr_indom = curr_indom;
-		    }
-		    else if (othr_indom->stamp.tv_sec < curr_indom->stamp.tv_sec ||
-			     (othr_indom->stamp.tv_sec == curr_indom->stamp.tv_sec &&
-			      othr_indom->stamp.tv_usec <= curr_indom->stamp.tv_usec))
-		    {
-			/* we already have a perfectly good indom,
-			 * but curr_indom has a better timestamp
-			 */
-			othr_indom = curr_indom;
-		    }
-		}
-		curr_indom = curr_indom->next;
-	    } /*while()*/
+	    lo = 0;
+	    hi = curr_indom->nindex;
+	    while (lo < hi) {
+		mid = (lo + hi) / 2;
+		stamp = &curr_indom->index[mid]->stamp;
+		if (stamp->tv_sec < this->tv_sec ||
+		    (stamp->tv_sec == this->tv_sec &&
+		     stamp->tv_usec <= this->tv_usec))
+		    lo = mid + 1;
+		else
+		    hi = mid;
+	    }
+	    if (lo > 0)
+		othr_indom = curr_indom->index[lo-1];
 
 	    if (othr_indom != NULL && othr_indom->pdu != NULL && othr_indom->written != WRITTEN) {
 		othr_indom->written = MARK_FOR_WRITE;
@@ -1097,15 +1171,79 @@ _createmark(void)
     return((__pmPDU *)markp);
 }
 
-void
-checklogtime(__pmTimeval *this, int i)
+/*
+ *  add the pending log record (or mark) of archive i to the heap
+ */
+static void
+logpush(int i)
 {
-    if ((curlog.tv_sec == 0 && curlog.tv_usec == 0) ||
-	(curlog.tv_sec > this->tv_sec ||
-	(curlog.tv_sec == this->tv_sec && curlog.tv_usec > this->tv_usec))) {
-	    ilog = i;
-	    curlog.tv_sec = this->tv_sec;
-	    curlog.tv_usec = this->tv_usec;
+    inarch_t	*iap = &inarch[i];
+    logheap_t	elm;
+    int		k, parent, sts;
+
+    if (iap->_Nresult != NULL) {
+	elm.stamp.tv_sec = iap->_Nresult->timestamp.tv_sec;
+	elm.stamp.tv_usec = iap->_Nresult->timestamp.tv_usec;
+    }
+    else {
+	elm.stamp.tv_sec = iap->pb[LOG][3]; /* no swab needed */
+	elm.stamp.tv_usec = iap->pb[LOG][4]; /* no swab needed */
+    }
+    elm.arch = i;
+
+    /* earliest first, and on a tie the archive named first */
+    for (k = nlogheap++; k > 0; k = parent) {
+	parent = (k - 1) / 2;
+	if ((sts = tvcmp(logheap[parent].stamp, elm.stamp)) < 0 ||
+	    (sts == 0 && logheap[parent].arch < elm.arch))
+	    break;
+	logheap[k] = logheap[parent];
+    }
+    logheap[k] = elm;
+}
+
+/*
+ *  remove the earliest record from the heap, and arrange for the next
+ *  record from that archive to be read
+ */
+static void
+logpop(void)
+{
+    logheap_t	elm;
+    int		k, child, sts;
+
+    logrefill[nlogrefill++] = logheap[0].arch;
+    elm = logheap[--nlogheap];
+    for (k = 0; (child = 2 * k + 1) < nlogheap; k = child) {
+	if (child + 1 < nlogheap &&
+	    ((sts = tvcmp(logheap[child+1].stamp, logheap[child].stamp)) < 0 ||
+	     (sts == 0 && logheap[child+1].arch < logheap[child].arch)))
+	    child++;
+	if ((sts = tvcmp(elm.stamp, logheap[child].stamp)) < 0 ||
+	    (sts == 0 && elm.arch < logheap[child].arch))
+	    break;
+	logheap[k] = logheap[child];
+    }
+    logheap[k] = elm;
+}
+
+/*
+ *  checkwinend() may discard the pending records of any archive, so
+ *  rebuild the heap from scratch
+ */
+static void
+logreheap(void)
+{
+    inarch_t	*iap;
+    int		i;
+
+    nlogheap = nlogrefill = 0;
+    for (i=0; i<inarchnum; i++) {
+	iap = &inarch[i];
+	if (iap->_Nresult != NULL || iap->pb[LOG] != NULL)
+	    logpush(i);
+	else if (!iap->eof[LOG])
+	    logrefill[nlogrefill++] = i;
     }
 }
 
@@ -1187,8 +1325,6 @@ againmeta:
 	    }
 
 	    if (want) {
-		if (__pmHashSearch((int)pmid, &mdesc_hash) == NULL)
-		    __pmHashAdd((int)pmid, NULL, &mdesc_hash);
 		/*
 		 * update the desc list (add first time, check on subsequent
 		 * sightings of desc for this pmid from this source
@@ -1219,10 +1355,6 @@ againmeta:
 	    }
 
 	    if (want) {
-	        if (__pmHashSearch((int)indom, &mindom_hash) == NULL) {
-		    /* meta record has never been seen ... add it to the list */
-		    __pmHashAdd((int)indom, NULL, &mindom_hash);
-	        }
 		/* add to indom list */
 		/* append_indomreclist() sets pb[META] to NULL
 		 * append_indomreclist() may unpin the pdu buffer
@@ -1251,13 +1383,15 @@ againmeta:
 
 
 /*
- * read in next log record for every archive
+ * read in next log record for every archive that needs one, then set
+ * ilog and curlog from the earliest record (or mark) of all archives
  */
 static int
 nextlog(void)
 {
     int		i;
-    int		eoflog = 0;	/* number of log files at eof */
+    int		k;
+    int		newmarks = 0;	/* number of marks created this time */
     int		sts;
     __pmTimeval	curtime;
     __pmLogCtl	*lcp;
@@ -1265,29 +1399,15 @@ nextlog(void)
     inarch_t	*iap;
 
 
-    for (i=0; i<inarchnum; i++) {
+    for (k=0; k<nlogrefill; k++) {
+	i = logrefill[k];
 	iap = &inarch[i];
 
-	/* if at the end of log file then skip this archive
+	/* if at the end of log file (or mark has been written out)
+	 * then skip this archive
 	 */
-	if (iap->eof[LOG]) {
-	    ++eoflog;
-	    continue;
-	}
-
-	/* if we already have a log record then skip this archive
-	 */
-	if (iap->_Nresult != NULL) {
-	    continue;
-	}
-
-	/* if mark has been written out, then log is at EOF
-	 */
-	if (iap->mark) {
-	    iap->eof[LOG] = 1;
-	    ++eoflog;
+	if (iap->eof[LOG])
 	    continue;
-	}
 
 	if ((ctxp = __pmHandleToPtr(iap->ctx)) == NULL) {
 	    fprintf(stderr, "%s: botch: __pmHandleToPtr(%d) returns NULL!\n", pmProgname, iap->ctx);
@@ -1308,20 +1428,27 @@ againlog:
 	     * do not generate a mark record, and you may as well ignore
 	     * this archive
 	     */
-	    if (first_datarec) {
-		iap->mark = 1;
-		iap->eof[LOG] = 1;
-		++eoflog;
-	    }
+	    iap->mark = 1;
+	    iap->eof[LOG] = 1;
+	    if (first_datarec)
+		++numlogeof;
 	    else {
-		iap->mark = 1;
 		iap->pb[LOG] = _createmark();
+		logpush(i);
+		++newmarks;
 	    }
 	    PM_UNLOCK(ctxp->c_lock);
 	    continue;
 	}
 	assert(iap->_result != NULL);
 
+#if defined(POSIX_FADV_SEQUENTIAL)
+	if (iap->curvol != lcp->l_curvol) {
+	    /* each volume is read just the once, start to finish */
+	    posix_fadvise(fileno(lcp->l_mfp), 0, 0, POSIX_FADV_SEQUENTIAL);
+	    iap->curvol = lcp->l_curvol;
+	}
+#endif
 
 	/* set current log time - this is only done so that we can
 	 * determine whether to keep or discard the log
@@ -1368,16 +1495,29 @@ againlog:
                 goto againlog;
             }
 	}
+	logpush(i);
 
 	PM_UNLOCK(ctxp->c_lock);
-    } /*for(i)*/
+    } /*for(k)*/
+    nlogrefill = 0;
 
     /* if we are here, then each archive control struct should either
      * be at eof, or it should have a _result, or it should have a mark PDU
      * (if we have a _result, we may want all/some/none of the pmid's in it)
+     *
+     * an archive that has only just reached the end of its log still
+     * has its mark to be merged, so is only counted as at eof from the
+     * next call
      */
+    if (numlogeof == inarchnum) return(-1);
+    numlogeof += newmarks;
 
-    if (eoflog == inarchnum) return(-1);
+    if (nlogheap > 0) {
+	ilog = logheap[0].arch;
+	curlog = logheap[0].stamp;
+    }
+    else
+	ilog = -1;
     return 0;
 }
 
@@ -1789,10 +1929,7 @@ main(int argc, char **argv)
     char	*msg;
 
     __pmTimeval 	now = {0,0};	/* the current time */
-    __pmTimeval 	mintime = {0,0};
-    __pmTimeval 	tmptime = {0,0};
 
-    __pmTimeval		tstamp;		/* temporary timestamp */
     inarch_t		*iap;		/* ptr to archive control */
     rlist_t		*rlready;	/* list of results ready for writing */
     struct timeval	unused;
@@ -1825,6 +1962,13 @@ main(int argc, char **argv)
 		pmProgname, osstrerror());
 	exit(1);
     }
+    logheap = (logheap_t *) malloc(inarchnum * sizeof(logheap_t));
+    logrefill = (int *) malloc(inarchnum * sizeof(int));
+    if (logheap == NULL || logrefill == NULL) {
+	fprintf(stderr, "%s: Error: malloc log heap: %s\n",
+		pmProgname, osstrerror());
+	exit(1);
+    }
 #ifdef PCP_DEBUG
     if (pmDebug & DBG_TRACE_APPL0) {
         totalmalloc += (inarchnum * sizeof(inarch_t));
@@ -1842,8 +1986,10 @@ main(int argc, char **argv)
 	iap->pb[LOG] = iap->pb[META] = NULL;
 	iap->eof[LOG] = iap->eof[META] = 0;
 	iap->mark = 0;
+	iap->curvol = -1;
 	iap->_result = NULL;
 	iap->_Nresult = NULL;
+	logrefill[nlogrefill++] = i;
 
 	if ((iap->ctx = pmNewContext(PM_CONTEXT_ARCHIVE, iap->name)) < 0) {
 	    fprintf(stderr, "%s: Error: cannot open archive \"%s\": %s\n",
@@ -1993,6 +2139,7 @@ main(int argc, char **argv)
     do {
 	stsmeta = nextmeta();
     } while (stsmeta >= 0);
+    index_indomreclist();
 
 
     /* get log record - choose one with earliest timestamp
@@ -2008,46 +2155,15 @@ main(int argc, char **argv)
 	assert(old_meta_offset >= 0);
 
 	/* nextlog() resets ilog, and curlog (to the smallest timestamp)
+	 * from the _Nresult (or mark pdu) with the earliest timestamp
 	 */
 	stslog = nextlog();
 
 	if (stslog < 0)
 	    break;
 
-	/* find the _Nresult (or mark pdu) with the earliest timestamp;
-	 * set ilog
-	 * (this is a bit more complex when tflag is specified)
-	 */
-	mintime.tv_sec = mintime.tv_usec = 0;
-	for (i=0; i<inarchnum; i++) {
-	    if (inarch[i]._Nresult != NULL) {
-		tstamp.tv_sec = inarch[i]._Nresult->timestamp.tv_sec;
-		tstamp.tv_usec = inarch[i]._Nresult->timestamp.tv_usec;
-		checklogtime(&tstamp, i);
-
-		if (ilog == i) {
-		    tmptime = curlog;
-		    if (mintime.tv_sec <= 0 || tvcmp(mintime, tmptime) > 0)
-		        mintime = tmptime;
-		}
-	    }
-	    else if (inarch[i].pb[LOG] != NULL) {
-		tstamp.tv_sec = inarch[i].pb[LOG][3]; /* no swab needed */
-		tstamp.tv_usec = inarch[i].pb[LOG][4]; /* no swab needed */
-		checklogtime(&tstamp, i);
-
-		if (ilog == i) {
-		    tmptime = curlog;
-		    if (mintime.tv_sec <= 0 || tvcmp(mintime, tmptime) > 0)
-		        mintime = tmptime;
-		}
-	    }
-	}
-
 	/* now     == the earliest timestamp of the archive(s)
 	 *		and/or mark records
-	 * mintime == now or timestamp of the earliest mark
-	 *		(whichever is smaller)
 	 */
 	now = curlog;
 
@@ -2060,8 +2176,10 @@ main(int argc, char **argv)
 	sts = checkwinend(now);
 	if (sts < 0)
 	    break;
-	if (sts > 0)
+	if (sts > 0) {
+	    logreheap();
 	    continue;
+	}
 
 	current = curlog;
 
@@ -2075,6 +2193,7 @@ main(int argc, char **argv)
 
 
 	iap = &inarch[ilog];
+	logpop();
 	if (iap->mark)
 	    writemark(iap);
 	else {
@@ -2151,8 +2270,8 @@ cleanup:
 	assert(new_meta_offset >= 0);
 
 #if 0
-	fprintf(stderr, "*** last tstamp: \n\tmintime=%d.%06d \n\ttmptime=%d.%06d \n\tlogend=%d.%06d \n\twinend=%d.%06d \n\tcurrent=%d.%06d\n",
-	    mintime.tv_sec, mintime.tv_usec, tmptime.tv_sec, tmptime.tv_usec, logend.tv_sec, logend.tv_usec, winend.tv_sec, winend.tv_usec, current.tv_sec, current.tv_usec);
+	fprintf(stderr, "*** last tstamp: \n\tlogend=%d.%06d \n\twinend=%d.%06d \n\tcurrent=%d.%06d\n",
+	    logend.tv_sec, logend.tv_usec, winend.tv_sec, winend.tv_usec, current.tv_sec, current.tv_usec);
 #endif
 
 	fseek(logctl.l_mfp, old_log_offset, SEEK_SET);
@@ -192,25 +192,26 @@ _pmLogPut(FILE *f, __pmPDU *pb)
  * construct new external label, and check label records from
  * input archives
  */
-void
-newlabel(void)
+int
+newlabel(__pmLogCtl *lcp, const pmLogLabel *ilp, const char *name)
 {
-    __pmLogLabel	*lp = &logctl.l_label;
+    __pmLogLabel	*lp = &lcp->l_label;
 
     /* check version number */
-    if ((ilabel.ll_magic & 0xff) != PM_LOG_VERS02) {
+    if ((ilp->ll_magic & 0xff) != PM_LOG_VERS02) {
 	fprintf(stderr,"%s: Error: version number %d (not %d as expected) in archive (%s)\n",
-		pmProgname, ilabel.ll_magic & 0xff, PM_LOG_VERS02, iname);
-	exit(1);
+		pmProgname, ilp->ll_magic & 0xff, PM_LOG_VERS02, name);
+	return -1;
     }
 
     /* copy magic number, host and timezone, use our pid */
-    lp->ill_magic = ilabel.ll_magic;
+    lp->ill_magic = ilp->ll_magic;
     lp->ill_pid = (int)getpid();
-    strncpy(lp->ill_hostname, ilabel.ll_hostname, PM_LOG_MAXHOSTLEN);
+    strncpy(lp->ill_hostname, ilp->ll_hostname, PM_LOG_MAXHOSTLEN);
     lp->ill_hostname[PM_LOG_MAXHOSTLEN-1] = '\0';
-    strncpy(lp->ill_tz, ilabel.ll_tz, PM_TZ_MAXLEN);
+    strncpy(lp->ill_tz, ilp->ll_tz, PM_TZ_MAXLEN);
     lp->ill_tz[PM_TZ_MAXLEN-1] = '\0';
+    return 0;
 }
 
 
@@ -218,32 +219,32 @@ newlabel(void)
  * write label records into all files of the output archive
  */
 void
-writelabel(void)
+writelabel(__pmLogCtl *lcp)
 {
-    logctl.l_label.ill_vol = 0;
-    __pmLogWriteLabel(logctl.l_mfp, &logctl.l_label);
-    logctl.l_label.ill_vol = PM_LOG_VOL_TI;
-    __pmLogWriteLabel(logctl.l_tifp, &logctl.l_label);
-    logctl.l_label.ill_vol = PM_LOG_VOL_META;
-    __pmLogWriteLabel(logctl.l_mdfp, &logctl.l_label);
+    lcp->l_label.ill_vol = 0;
+    __pmLogWriteLabel(lcp->l_mfp, &lcp->l_label);
+    lcp->l_label.ill_vol = PM_LOG_VOL_TI;
+    __pmLogWriteLabel(lcp->l_tifp, &lcp->l_label);
+    lcp->l_label.ill_vol = PM_LOG_VOL_META;
+    __pmLogWriteLabel(lcp->l_mdfp, &lcp->l_label);
 }
 
 /*
  *  switch output volumes
  */
 void
-newvolume(char *base, __pmTimeval *tvp)
+newvolume(__pmLogCtl *lcp, char *base, __pmTimeval *tvp)
 {
     FILE		*newfp;
-    int			nextvol = logctl.l_curvol + 1;
+    int			nextvol = lcp->l_curvol + 1;
     struct timeval	stamp;
 
     if ((newfp = __pmLogNewFile(base, nextvol)) != NULL) {
-	fclose(logctl.l_mfp);
-	logctl.l_mfp = newfp;
-	logctl.l_label.ill_vol = logctl.l_curvol = nextvol;
-	__pmLogWriteLabel(logctl.l_mfp, &logctl.l_label);
-	fflush(logctl.l_mfp);
+	fclose(lcp->l_mfp);
+	lcp->l_mfp = newfp;
+	lcp->l_label.ill_vol = lcp->l_curvol = nextvol;
+	__pmLogWriteLabel(lcp->l_mfp, &lcp->l_label);
+	fflush(lcp->l_mfp);
 	stamp.tv_sec = tvp->tv_sec;
 	stamp.tv_usec = tvp->tv_usec;
 	fprintf(stderr, "%s: New log volume %d, at ",
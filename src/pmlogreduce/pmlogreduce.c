@@ -81,6 +81,9 @@ static struct timeval winend_tval;	/* window end tval */
 /* cmd line args that could exist, but don't (needed for pmParseTimeWin) */
 static char	*Oarg;			/* -O arg - non-existent */
 
+static int	rarg;			/* -R arg - number of rollup resolutions */
+static int	targ_set;		/* -t seen */
+
 static pmLongOptions longopts[] = {
     PMAPI_OPTIONS_HEADER("Options"),
     PMOPT_ALIGN,
@@ -89,6 +92,7 @@ static pmLongOptions longopts[] = {
     PMOPT_SAMPLES,
     PMOPT_FINISH,
     { "interval", 1, 't', "DELTA", "sample output interval [default 10min]" },
+    { "rollup", 1, 'R', "LIST", "streaming rollups at each resolution in LIST" },
     { "", 1, 'v', "NUM", "switch log volumes after this many samples" },
     PMOPT_TIMEZONE,
     PMOPT_HOSTZONE,
@@ -97,9 +101,9 @@ static pmLongOptions longopts[] = {
 };
 
 static pmOptions opts = {
-    .short_options = "A:D:S:s:T:t:v:Z:z?",
+    .short_options = "A:D:R:S:s:T:t:v:Z:z?",
     .long_options = longopts,
-    .short_usage = "[options] input-archive output-archive",
+    .short_usage = "[options] input-archive [input-archive ...] output-archive",
 };
 
 static int
@@ -129,6 +133,16 @@ parseargs(int argc, char *argv[])
 		pmDebug |= sts;
 	    break;
 
+	case 'R':	/* rollup resolutions */
+	    if ((sts = rollupres(opts.optarg, &msg)) < 0) {
+		pmprintf("%s: -R: %s", pmProgname, msg);
+		free(msg);
+		opts.errors++;
+	    }
+	    else
+		rarg = sts;
+	    break;
+
 	case 's':	/* number of samples to write out */
 	    sarg = (int)strtol(opts.optarg, &endnum, 10);
 	    if (*endnum != '\0' || sarg < 0) {
@@ -154,6 +168,7 @@ parseargs(int argc, char *argv[])
 	    }
 	    else
 		targ = __pmtimevalToReal(&interval);
+	    targ_set = 1;
 	    break;
 
 	case 'v':	/* number of samples per volume */
@@ -195,6 +210,26 @@ parseargs(int argc, char *argv[])
 	pmprintf("%s: Error: insufficient arguments\n", pmProgname);
 	opts.errors++;
     }
+    else if (opts.errors == 0 && rarg) {
+	if (targ_set) {
+	    pmprintf("%s: at most one of -R and/or -t allowed\n", pmProgname);
+	    opts.errors++;
+	}
+	if (opts.optind < argc-2 && strstr(argv[argc-1], "%i") == NULL) {
+	    pmprintf("%s: output name must include %%i for multiple input archives\n",
+		    pmProgname);
+	    opts.errors++;
+	}
+	if (rarg > 1 && strstr(argv[argc-1], "%r") == NULL) {
+	    pmprintf("%s: output name must include %%r for multiple resolutions\n",
+		    pmProgname);
+	    opts.errors++;
+	}
+    }
+    else if (opts.errors == 0 && opts.optind < argc-2) {
+	pmprintf("%s: multiple input archives require -R\n", pmProgname);
+	opts.errors++;
+    }
 
     return -opts.errors;
 }
@@ -216,6 +251,25 @@ main(int argc, char **argv)
 	exit(1);
     }
 
+    if (rarg) {
+	/* -R - streaming rollups, any number of input archives */
+	if (tz != NULL) {
+	    if ((sts = pmNewZone(tz)) < 0) {
+		fprintf(stderr, "%s: Cannot set timezone to \"%s\": %s\n",
+			pmProgname, tz, pmErrStr(sts));
+		exit(1);
+	    }
+	}
+	else if (!zarg) {
+	    if ((sts = pmNewZone(__pmTimezone())) < 0) {
+		fprintf(stderr, "%s: Cannot set local host's timezone: %s\n",
+			pmProgname, pmErrStr(sts));
+		exit(1);
+	    }
+	}
+	exit(rollupall(argc-1 - opts.optind, &argv[opts.optind], argv[argc-1]) ? 1 : 0);
+    }
+
     /* input  archive name is argv[opts.optind] */
     /* output archive name is argv[argc-1]) */
 
@@ -318,11 +372,12 @@ main(int argc, char **argv)
      *		- set start time
      *		- write labels
      */
-    newlabel();
+    if (newlabel(&logctl, &ilabel, iname) < 0)
+	exit(1);
     current.tv_sec = logctl.l_label.ill_start.tv_sec = winstart_tval.tv_sec;
     current.tv_usec = logctl.l_label.ill_start.tv_usec = winstart_tval.tv_usec;
     /* write label record */
-    writelabel();
+    writelabel(&logctl);
     /*
      * Supress any automatic label creation in libpcp at the first
      * pmResult write.
@@ -425,7 +480,7 @@ main(int argc, char **argv)
 		__pmTimeval	next_stamp;
 		next_stamp.tv_sec = irp->timestamp.tv_sec;
 		next_stamp.tv_usec = irp->timestamp.tv_usec;
-		newvolume(oname, &next_stamp);
+		newvolume(&logctl, oname, &next_stamp);
 	    }
 	}
 	/*
@@ -438,7 +493,7 @@ main(int argc, char **argv)
 	    __pmTimeval	next_stamp;
 	    next_stamp.tv_sec = irp->timestamp.tv_sec;
 	    next_stamp.tv_usec = irp->timestamp.tv_usec;
-	    newvolume(oname, &next_stamp);
+	    newvolume(&logctl, oname, &next_stamp);
 	}
 
 	current.tv_sec = orp->timestamp.tv_sec;
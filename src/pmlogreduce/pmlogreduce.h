@@ -73,9 +73,9 @@ extern char		*tz;		/* -Z arg - use timezone from user */
 
 extern int	_pmLogGet(__pmLogCtl *, int, __pmPDU **);
 extern int	_pmLogPut(FILE *, __pmPDU *);
-extern void	newlabel(void);
-extern void	writelabel(void);
-extern void	newvolume(char *, __pmTimeval *);
+extern int	newlabel(__pmLogCtl *, const pmLogLabel *, const char *);
+extern void	writelabel(__pmLogCtl *);
+extern void	newvolume(__pmLogCtl *, char *, __pmTimeval *);
 
 extern pmResult *rewrite(pmResult *);
 extern void	rewrite_free(void);
@@ -83,3 +83,6 @@ extern void	rewrite_free(void);
 extern void	dometric(const char *);
 extern void	doindom(pmResult *);
 extern void	doscan(struct timeval *);
+
+extern int	rollupres(char *, char **);
+extern int	rollupall(int, char **, char *);
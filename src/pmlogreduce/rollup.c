@@ -0,0 +1,1285 @@
+/*
+ * Streaming rollups of one or more archives, at one or more resolutions
+ *
+ * Copyright (c) 2015 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * Unlike the default reduction (interpolated fetches, plus a scan of
+ * the raw records in each interval), every input archive here is read
+ * just once, record by record, and the observations in each interval are
+ * folded into running statistics for every output resolution at the same
+ * time.  Intervals are aligned to multiples of the resolution since the
+ * Epoch, and each interval (end-1, end] is written at its end time.
+ *
+ * For each metric-instance in an interval the output archive has
+ *	- numeric instantaneous and discrete metrics: the average (as the
+ *	  original metric, but double), and the minimum, maximum and number
+ *	  of observations (as <name>_min, <name>_max and <name>_count)
+ *	- counters: the last value (promoted to 64-bits, as for the default
+ *	  reduction), the minimum and maximum rate between observations and
+ *	  the number of observations
+ *	- strings: the last value
+ *
+ * Input archives are independent and are reduced in parallel, up to one
+ * thread per processor.
+ */
+
+#include "pmlogreduce.h"
+
+#define ROLL_STATS	0	/* numeric instantaneous or discrete */
+#define ROLL_COUNTER	1	/* numeric counter */
+#define ROLL_LAST	2	/* anything else, last value only */
+
+#define STAT_MIN	0	/* extra metrics, <name>_min ... */
+#define STAT_MAX	1
+#define STAT_COUNT	2
+#define NSTATS		3
+
+static const char	*statsuffix[NSTATS] = { "_min", "_max", "_count" };
+
+/* statistics for one metric-instance in the current output interval */
+typedef struct {
+    unsigned int	count;		/* observations */
+    unsigned int	nrate;		/* rates (counters only) */
+    double		sum;
+    double		min;		/* values, or rates for counters */
+    double		max;
+    pmAtomValue		last;		/* counters and strings */
+} rollacc_t;
+
+typedef struct {
+    int			inst;
+    int			hasprev;	/* prev and prevt are valid */
+    double		prev;		/* previous value (counters only) */
+    double		prevt;
+    rollacc_t		acc[1];		/* one per resolution, extends */
+} rollinst_t;
+
+typedef struct {
+    pmDesc		idesc;		/* input descriptor */
+    pmDesc		odesc;		/* output descriptor, original PMID */
+    pmDesc		sdesc[NSTATS];	/* extra metrics, pmid PM_ID_NULL if none */
+    int			kind;
+    double		scale;		/* counter units to rate units */
+    int			numnames;
+    char		**names;
+    __pmHashCtl		insthash;	/* inst -> rollinst_t */
+    int			ninst;
+    rollinst_t		**insts;
+} rollmetric_t;
+
+typedef struct {
+    pmInDom		indom;
+    int			numinst;	/* instances written so far */
+    int			*inst;
+    char		**name;
+} rollindom_t;
+
+typedef struct {
+    char		*name;		/* output archive */
+    const char		*res;		/* resolution as given */
+    __int64_t		interval;	/* usec */
+    __int64_t		end;		/* current interval end, usec */
+    int			pending;	/* values in current interval */
+    int			written;	/* records written */
+    int			created;	/* by us, so unlink on error */
+    __pmLogCtl		logctl;
+    __pmTimeval		last;		/* last stamp written */
+    __pmHashCtl		indoms;		/* indom -> rollindom_t */
+} rollout_t;
+
+typedef struct {
+    const char		*iname;		/* input archive */
+    char		*ident;		/* %i for iname */
+    char		**oname;	/* output archive per resolution */
+    int			ctx;
+    int			sts;		/* 0 for success */
+    pmLogLabel		label;
+    int			nmetric;
+    rollmetric_t	*metrics;
+    __pmHashCtl		pmids;		/* pmid -> metrics[] index */
+    rollout_t		*out;		/* one per resolution */
+    pmResult		*result;	/* for output records */
+    struct timeval	start;
+    struct timeval	end;
+} rolljob_t;
+
+static int	nres;
+static char	**reslist;
+static __int64_t *resusec;
+
+static char	*template;		/* output archive name, %i and %r */
+static int	njob;
+static rolljob_t *joblist;
+static int	nextjob;
+
+#ifdef PM_MULTI_THREAD
+static pthread_mutex_t	joblock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t	tzlock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static __int64_t
+tv2usec(const struct timeval *tp)
+{
+    return (__int64_t)tp->tv_sec * 1000000 + tp->tv_usec;
+}
+
+static void
+usec2ts(__int64_t usec, __pmTimeval *tp)
+{
+    tp->tv_sec = (__int32_t)(usec / 1000000);
+    tp->tv_usec = (__int32_t)(usec % 1000000);
+}
+
+/*
+ * Parse the -R list of resolutions, e.g. 1min,1hour,1day
+ */
+int
+rollupres(char *list, char **msg)
+{
+    struct timeval	interval;
+    char		*p, *q;
+    size_t		size;
+
+    for (p = list; p != NULL && *p != '\0'; p = q) {
+	if ((q = strchr(p, ',')) != NULL)
+	    *q++ = '\0';
+	if (pmParseInterval(p, &interval, msg) < 0)
+	    return -1;
+	if (tv2usec(&interval) <= 0) {
+	    if ((*msg = malloc(64 + strlen(p))) != NULL)
+		sprintf(*msg, "resolution \"%s\" must be positive\n", p);
+	    return -1;
+	}
+	size = (nres + 1) * sizeof(char *);
+	if ((reslist = (char **)realloc(reslist, size)) == NULL)
+	    __pmNoMem("rollupres.reslist", size, PM_FATAL_ERR);
+	size = (nres + 1) * sizeof(__int64_t);
+	if ((resusec = (__int64_t *)realloc(resusec, size)) == NULL)
+	    __pmNoMem("rollupres.resusec", size, PM_FATAL_ERR);
+	reslist[nres] = p;
+	resusec[nres++] = tv2usec(&interval);
+    }
+    return nres;
+}
+
+/*
+ * The %i for an input archive - its basename without any .meta or
+ * .index suffix, or if that is not unique among the inputs (as for
+ * the same date from several <host>/<date> directories) the whole
+ * path with the separators replaced by '-'.
+ */
+static char *
+inputid(const char *iname, int fullpath)
+{
+    const char	*base;
+    char	*ident, *p;
+    size_t	len;
+
+    base = iname;
+    if (fullpath) {
+	/* not a hidden file, so no leading separator, ./ or ../ */
+	for ( ; ; ) {
+	    if (*base == __pmPathSeparator())
+		base++;
+	    else if (base[0] == '.' && base[1] == __pmPathSeparator())
+		base += 2;
+	    else if (base[0] == '.' && base[1] == '.' &&
+		     base[2] == __pmPathSeparator())
+		base += 3;
+	    else
+		break;
+	}
+    }
+    else if ((p = strrchr(iname, __pmPathSeparator())) != NULL)
+	base = p + 1;
+    len = strlen(base);
+    if (len > 5 && strcmp(&base[len-5], ".meta") == 0)
+	len -= 5;
+    else if (len > 6 && strcmp(&base[len-6], ".index") == 0)
+	len -= 6;
+
+    if ((ident = (char *)malloc(len + 1)) == NULL)
+	__pmNoMem("inputid", len + 1, PM_FATAL_ERR);
+    memcpy(ident, base, len);
+    ident[len] = '\0';
+    for (p = ident; *p; p++) {
+	if (*p == __pmPathSeparator())
+	    *p = '-';
+    }
+    return ident;
+}
+
+/*
+ * Expand %i (input archive identifier) and %r (resolution) in the
+ * output archive name template.
+ */
+static char *
+outname(const char *ident, const char *res)
+{
+    const char	*p;
+    char	*name, *np;
+    size_t	size;
+
+    size = strlen(template) + 1;
+    for (p = template; *p; p++) {
+	if (p[0] == '%' && p[1] == 'i')
+	    size += strlen(ident);
+	else if (p[0] == '%' && p[1] == 'r')
+	    size += strlen(res);
+    }
+    if ((name = (char *)malloc(size)) == NULL)
+	__pmNoMem("outname", size, PM_FATAL_ERR);
+    for (p = template, np = name; *p; p++) {
+	if (p[0] == '%' && p[1] == 'i') {
+	    strcpy(np, ident);
+	    np += strlen(ident);
+	    p++;
+	}
+	else if (p[0] == '%' && p[1] == 'r') {
+	    strcpy(np, res);
+	    np += strlen(res);
+	    p++;
+	}
+	else if (p[0] == '%' && p[1] == '%') {
+	    *np++ = '%';
+	    p++;
+	}
+	else
+	    *np++ = *p;
+    }
+    *np = '\0';
+    return name;
+}
+
+/*
+ * Add one metric from the input archive's PMNS (pmTraversePMNS_r callback)
+ */
+static void
+addmetric(const char *name, void *arg)
+{
+    rolljob_t		*jp = (rolljob_t *)arg;
+    rollmetric_t	*mp;
+    pmID		pmid;
+    size_t		size;
+    int			sts;
+
+    if (jp->sts < 0)
+	return;
+    if ((sts = pmLookupName(1, (char **)&name, &pmid)) < 0) {
+	fprintf(stderr, "%s: %s: Error: cannot lookup pmID for metric \"%s\": %s\n",
+		pmProgname, jp->iname, name, pmErrStr(sts));
+	jp->sts = sts;
+	return;
+    }
+    if (__pmHashSearch(pmid, &jp->pmids) != NULL)
+	return;		/* duplicate name in the PMNS */
+
+    size = (jp->nmetric + 1) * sizeof(rollmetric_t);
+    if ((jp->metrics = (rollmetric_t *)realloc(jp->metrics, size)) == NULL)
+	__pmNoMem("addmetric.metrics", size, PM_FATAL_ERR);
+    mp = &jp->metrics[jp->nmetric];
+    memset(mp, 0, sizeof(*mp));
+    if ((sts = pmLookupDesc(pmid, &mp->idesc)) < 0) {
+	fprintf(stderr, "%s: %s: Error: cannot lookup pmDesc for metric \"%s\": %s\n",
+		pmProgname, jp->iname, name, pmErrStr(sts));
+	jp->sts = sts;
+	return;
+    }
+    if (mp->idesc.type == PM_TYPE_AGGREGATE ||
+        mp->idesc.type == PM_TYPE_AGGREGATE_STATIC ||
+        mp->idesc.type == PM_TYPE_EVENT ||
+	mp->idesc.type == PM_TYPE_HIGHRES_EVENT) {
+	fprintf(stderr, "%s: %s: Warning: skipping %s metric\n",
+		pmProgname, name, pmTypeStr(mp->idesc.type));
+	return;
+    }
+    if ((mp->numnames = pmNameAll(pmid, &mp->names)) < 0) {
+	fprintf(stderr, "%s: %s: Error: failed to get names for %s (%s): %s\n",
+		pmProgname, jp->iname, name, pmIDStr(pmid), pmErrStr(mp->numnames));
+	jp->sts = mp->numnames;
+	return;
+    }
+    mp->odesc = mp->idesc;	/* struct assignment */
+    mp->sdesc[STAT_MIN].pmid = mp->sdesc[STAT_MAX].pmid =
+	mp->sdesc[STAT_COUNT].pmid = PM_ID_NULL;
+    mp->scale = 1.0;
+    if (mp->idesc.type == PM_TYPE_STRING)
+	mp->kind = ROLL_LAST;
+    else if (mp->idesc.sem == PM_SEM_COUNTER) {
+	mp->kind = ROLL_COUNTER;
+	if (mp->idesc.type == PM_TYPE_32)
+	    mp->odesc.type = PM_TYPE_64;
+	else if (mp->idesc.type == PM_TYPE_U32)
+	    mp->odesc.type = PM_TYPE_U64;
+    }
+    else {
+	mp->kind = ROLL_STATS;
+	mp->odesc.type = PM_TYPE_DOUBLE;
+    }
+    __pmHashAdd(pmid, (void *)(__psint_t)jp->nmetric, &jp->pmids);
+    jp->nmetric++;
+}
+
+/*
+ * Choose pmIDs and descriptors for the extra _min, _max and _count
+ * metrics, in the same domain as the original with the statistic in
+ * the top bits of the cluster ... skipping any that would collide with
+ * a metric in the input archive.
+ */
+static void
+addstats(rolljob_t *jp, rollmetric_t *mp)
+{
+    pmDesc		*dp;
+    pmUnits		units;
+    __pmID_int		*ip;
+    int			s;
+
+    if (mp->kind == ROLL_LAST)
+	return;
+    ip = (__pmID_int *)&mp->idesc.pmid;
+    if (ip->cluster >= (1 << 10)) {
+	fprintf(stderr, "%s: %s: Warning: no rollup statistics for %s: cluster too large\n",
+		pmProgname, jp->iname, mp->names[0]);
+	return;
+    }
+
+    units = mp->idesc.units;
+    if (mp->kind == ROLL_COUNTER) {
+	if (units.dimTime == 0) {
+	    /* rate conversion */
+	    units.dimTime = -1;
+	    units.scaleTime = PM_TIME_SEC;
+	}
+	else if (units.dimTime == 1) {
+	    /* becomes (time) utilization */
+	    pmUnits	secs = units;
+	    pmAtomValue	av;
+
+	    secs.scaleTime = PM_TIME_SEC;
+	    av.d = 1.0;
+	    if (pmConvScale(PM_TYPE_DOUBLE, &av, &units, &av, &secs) < 0)
+		return;
+	    mp->scale = av.d;
+	    units.dimTime = 0;
+	    units.scaleTime = 0;
+	}
+	else
+	    units.dimTime = -2;	/* no rates */
+    }
+
+    for (s = 0; s < NSTATS; s++) {
+	pmID		pmid;
+	__pmID_int	*sp = (__pmID_int *)&pmid;
+
+	if (s != STAT_COUNT && units.dimTime == -2)
+	    continue;
+	pmid = mp->idesc.pmid;
+	sp->cluster |= (s + 1) << 10;
+	if (__pmHashSearch(pmid, &jp->pmids) != NULL) {
+	    fprintf(stderr, "%s: %s: Warning: no %s rollup for %s: pmID %s in use\n",
+		    pmProgname, jp->iname, statsuffix[s], mp->names[0], pmIDStr(pmid));
+	    continue;
+	}
+	dp = &mp->sdesc[s];
+	*dp = mp->idesc;	/* struct assignment */
+	dp->pmid = pmid;
+	dp->sem = PM_SEM_INSTANT;
+	if (s == STAT_COUNT) {
+	    dp->type = PM_TYPE_U32;
+	    memset(&dp->units, 0, sizeof(dp->units));
+	    dp->units.dimCount = 1;
+	    dp->units.scaleCount = PM_COUNT_ONE;
+	}
+	else {
+	    dp->type = PM_TYPE_DOUBLE;
+	    if (mp->kind == ROLL_COUNTER)
+		dp->units = units;
+	}
+    }
+}
+
+static int
+putdesc(rolljob_t *jp, __pmLogCtl *lcp, pmDesc *dp, int numnames, char **names, const char *suffix)
+{
+    char	**snames = names;
+    int		i, sts;
+
+    if (suffix != NULL) {
+	if ((snames = (char **)malloc(numnames * sizeof(char *))) == NULL)
+	    __pmNoMem("putdesc.names", numnames * sizeof(char *), PM_FATAL_ERR);
+	for (i = 0; i < numnames; i++) {
+	    if ((snames[i] = malloc(strlen(names[i]) + strlen(suffix) + 1)) == NULL)
+		__pmNoMem("putdesc.name", strlen(names[i]) + strlen(suffix) + 1, PM_FATAL_ERR);
+	    strcpy(snames[i], names[i]);
+	    strcat(snames[i], suffix);
+	}
+    }
+    if ((sts = __pmLogPutDesc(lcp, dp, numnames, snames)) < 0) {
+	fprintf(stderr, "%s: %s: Error: failed to add pmDesc for %s%s (%s): %s\n",
+		pmProgname, jp->iname, names[0], suffix ? suffix : "",
+		pmIDStr(dp->pmid), pmErrStr(sts));
+    }
+    if (suffix != NULL) {
+	for (i = 0; i < numnames; i++)
+	    free(snames[i]);
+	free(snames);
+    }
+    return sts;
+}
+
+/*
+ * Create an output archive - label, and descriptors for all metrics
+ */
+static int
+newoutput(rolljob_t *jp, rollout_t *op)
+{
+    __pmLogCtl		*lcp = &op->logctl;
+    __pmTimeval		stamp;
+    rollmetric_t	*mp;
+    int			m, s, sts;
+
+    if ((sts = __pmLogCreate("", op->name, PM_LOG_VERS02, lcp)) < 0) {
+	fprintf(stderr, "%s: Error: __pmLogCreate(%s): %s\n",
+		pmProgname, op->name, pmErrStr(sts));
+	return sts;
+    }
+    op->created = 1;
+    if (newlabel(lcp, &jp->label, jp->iname) < 0)
+	return PM_ERR_LABEL;
+    stamp.tv_sec = lcp->l_label.ill_start.tv_sec = jp->start.tv_sec;
+    stamp.tv_usec = lcp->l_label.ill_start.tv_usec = jp->start.tv_usec;
+    writelabel(lcp);
+    lcp->l_state = PM_LOG_STATE_INIT;
+
+    for (m = 0; m < jp->nmetric; m++) {
+	mp = &jp->metrics[m];
+	if ((sts = putdesc(jp, lcp, &mp->odesc, mp->numnames, mp->names, NULL)) < 0)
+	    return sts;
+	for (s = 0; s < NSTATS; s++) {
+	    if (mp->sdesc[s].pmid == PM_ID_NULL)
+		continue;
+	    if ((sts = putdesc(jp, lcp, &mp->sdesc[s], mp->numnames, mp->names, statsuffix[s])) < 0)
+		return sts;
+	}
+    }
+    fflush(lcp->l_mdfp);
+    __pmLogPutIndex(lcp, &stamp);
+    op->last = stamp;
+    return 0;
+}
+
+static void
+closeoutput(rollout_t *op, int unlinkit)
+{
+    __pmLogCtl	*lcp = &op->logctl;
+    char	fname[MAXPATHLEN];
+    int		vol;
+
+    if (lcp->l_mfp != NULL) {
+	if (!unlinkit) {
+	    fflush(lcp->l_mfp);
+	    fflush(lcp->l_mdfp);
+	    __pmLogPutIndex(lcp, &op->last);
+	}
+	fclose(lcp->l_mfp);
+	fclose(lcp->l_mdfp);
+	fclose(lcp->l_tifp);
+	lcp->l_mfp = NULL;
+    }
+    /* never remove an archive that was there before us */
+    if (unlinkit && op->created) {
+	fprintf(stderr, "Archive \"%s\" not created.\n", op->name);
+	for (vol = 0; vol <= lcp->l_curvol; vol++) {
+	    snprintf(fname, sizeof(fname), "%s.%d", op->name, vol);
+	    unlink(fname);
+	}
+	snprintf(fname, sizeof(fname), "%s.meta", op->name);
+	unlink(fname);
+	snprintf(fname, sizeof(fname), "%s.index", op->name);
+	unlink(fname);
+    }
+}
+
+static rollinst_t *
+getinst(rollmetric_t *mp, int inst)
+{
+    __pmHashNode	*hp;
+    rollinst_t		*ip;
+    size_t		size;
+
+    if ((hp = __pmHashSearch((unsigned int)inst, &mp->insthash)) != NULL)
+	return (rollinst_t *)hp->data;
+
+    size = sizeof(rollinst_t) + (nres - 1) * sizeof(rollacc_t);
+    if ((ip = (rollinst_t *)calloc(1, size)) == NULL)
+	__pmNoMem("getinst", size, PM_FATAL_ERR);
+    ip->inst = inst;
+    __pmHashAdd((unsigned int)inst, (void *)ip, &mp->insthash);
+    if ((mp->ninst & (mp->ninst - 1)) == 0) {
+	/* grow by doubling */
+	size = (mp->ninst ? 2 * mp->ninst : 1) * sizeof(rollinst_t *);
+	if ((mp->insts = (rollinst_t **)realloc(mp->insts, size)) == NULL)
+	    __pmNoMem("getinst.insts", size, PM_FATAL_ERR);
+    }
+    mp->insts[mp->ninst++] = ip;
+    return ip;
+}
+
+/*
+ * Numeric value from a pmValue - values from pmFetchArchive are already
+ * in host byte order, but 64-bit values may not be aligned.
+ */
+static double
+getvalue(int valfmt, const pmValue *vp, int type, pmAtomValue *avp)
+{
+    pmAtomValue		av;
+
+    size_t		len;
+
+    if (valfmt == PM_VAL_INSITU)
+	av.l = vp->value.lval;
+    else {
+	len = vp->value.pval->vlen - PM_VAL_HDR_SIZE;
+	memcpy(&av, vp->value.pval->vbuf, len < sizeof(av) ? len : sizeof(av));
+    }
+    if (avp != NULL)
+	*avp = av;
+    switch (type) {
+	case PM_TYPE_32:
+	    return av.l;
+	case PM_TYPE_U32:
+	    return av.ul;
+	case PM_TYPE_64:
+	    return av.ll;
+	case PM_TYPE_U64:
+	    return av.ull;
+	case PM_TYPE_FLOAT:
+	    return av.f;
+	case PM_TYPE_DOUBLE:
+	    return av.d;
+    }
+    return 0;
+}
+
+static void
+addvalue(rolljob_t *jp, rollmetric_t *mp, int valfmt, pmValue *vp, double t)
+{
+    rollinst_t		*ip = getinst(mp, vp->inst);
+    rollacc_t		*ap;
+    pmAtomValue		av;
+    double		v = 0, rate = 0;
+    int			hasrate = 0;
+    int			r;
+
+    if (mp->kind == ROLL_LAST) {
+	/* strings */
+	for (r = 0; r < nres; r++) {
+	    ap = &ip->acc[r];
+	    if (ap->last.cp != NULL)
+		free(ap->last.cp);
+	    if ((ap->last.cp = strdup(vp->value.pval->vbuf)) == NULL)
+		__pmNoMem("addvalue.string", strlen(vp->value.pval->vbuf) + 1, PM_FATAL_ERR);
+	    ap->count++;
+	}
+	return;
+    }
+
+    v = getvalue(valfmt, vp, mp->idesc.type, &av);
+    if (mp->kind == ROLL_COUNTER) {
+	if (ip->hasprev && t > ip->prevt && v >= ip->prev) {
+	    /* no rate across a counter wrap or reset */
+	    rate = (v - ip->prev) * mp->scale / (t - ip->prevt);
+	    hasrate = 1;
+	}
+	ip->prev = v;
+	ip->prevt = t;
+	ip->hasprev = 1;
+	/* promote 32-bit counters, as for the default reduction */
+	if (mp->idesc.type == PM_TYPE_32)
+	    av.ll = av.l;
+	else if (mp->idesc.type == PM_TYPE_U32)
+	    av.ull = av.ul;
+    }
+
+    for (r = 0; r < nres; r++) {
+	ap = &ip->acc[r];
+	if (mp->kind == ROLL_COUNTER) {
+	    ap->last = av;
+	    if (hasrate) {
+		if (ap->nrate == 0 || rate < ap->min)
+		    ap->min = rate;
+		if (ap->nrate == 0 || rate > ap->max)
+		    ap->max = rate;
+		ap->nrate++;
+	    }
+	}
+	else {
+	    if (ap->count == 0 || v < ap->min)
+		ap->min = v;
+	    if (ap->count == 0 || v > ap->max)
+		ap->max = v;
+	    ap->sum += v;
+	}
+	ap->count++;
+    }
+}
+
+/*
+ * Make sure the output archive's metadata knows about every instance
+ * in the output record - the instance domain is rewritten when new
+ * instances appear.
+ */
+static int
+checkindom(rolljob_t *jp, rollout_t *op, pmInDom indom, pmValueSet *vsp, __pmTimeval *stamp)
+{
+    __pmHashNode	*hp;
+    rollindom_t		*idp;
+    int			*instlist, *newinst;
+    char		**namelist, **newname;
+    char		*name;
+    int			numinst;
+    int			i, j, k, sts;
+    size_t		size;
+
+    if ((hp = __pmHashSearch(indom, &op->indoms)) != NULL)
+	idp = (rollindom_t *)hp->data;
+    else {
+	if ((idp = (rollindom_t *)calloc(1, sizeof(rollindom_t))) == NULL)
+	    __pmNoMem("checkindom", sizeof(rollindom_t), PM_FATAL_ERR);
+	idp->indom = indom;
+	__pmHashAdd(indom, (void *)idp, &op->indoms);
+    }
+    for (i = 0; i < vsp->numval; i++) {
+	for (j = 0; j < idp->numinst; j++) {
+	    if (idp->inst[j] == vsp->vlist[i].inst)
+		break;
+	}
+	if (j == idp->numinst)
+	    break;
+    }
+    if (i == vsp->numval)
+	return 0;
+
+    /*
+     * new instance(s) - current instance domain, plus any missing ...
+     * __pmLogPutInDom keeps the lists, so these are never freed
+     */
+    if ((numinst = pmGetInDom(indom, &instlist, &namelist)) < 0) {
+	numinst = 0;
+	instlist = NULL;
+	namelist = NULL;
+    }
+    size = (numinst + vsp->numval) * sizeof(int);
+    if ((newinst = (int *)malloc(size)) == NULL)
+	__pmNoMem("checkindom.inst", size, PM_FATAL_ERR);
+    size = (numinst + vsp->numval) * sizeof(char *);
+    if ((newname = (char **)malloc(size)) == NULL)
+	__pmNoMem("checkindom.name", size, PM_FATAL_ERR);
+    for (k = 0; k < numinst; k++) {
+	newinst[k] = instlist[k];
+	if ((newname[k] = strdup(namelist[k])) == NULL)
+	    __pmNoMem("checkindom.name", strlen(namelist[k]) + 1, PM_FATAL_ERR);
+    }
+    for (i = 0; i < vsp->numval; i++) {
+	for (j = 0; j < k; j++) {
+	    if (newinst[j] == vsp->vlist[i].inst)
+		break;
+	}
+	if (j < k)
+	    continue;
+	if (pmNameInDomArchive(indom, vsp->vlist[i].inst, &name) < 0)
+	    continue;
+	newinst[k] = vsp->vlist[i].inst;
+	newname[k++] = name;
+    }
+    if (instlist != NULL)
+	free(instlist);
+    if (namelist != NULL)
+	free(namelist);
+    idp->numinst = k;
+    idp->inst = newinst;
+    idp->name = newname;
+    sts = __pmLogPutInDom(&op->logctl, indom, stamp, idp->numinst, idp->inst, idp->name);
+    if (sts < 0)
+	fprintf(stderr, "%s: Error: failed to add pmInDom %s to %s: %s\n",
+		pmProgname, pmInDomStr(indom), op->name, pmErrStr(sts));
+    return sts < 0 ? sts : 1;
+}
+
+static pmValueSet *
+newvset(int numval)
+{
+    pmValueSet	*vsp;
+    size_t	size;
+
+    size = sizeof(pmValueSet) + (numval - 1) * sizeof(pmValue);
+    if ((vsp = (pmValueSet *)malloc(size)) == NULL)
+	__pmNoMem("newvset", size, PM_FATAL_ERR);
+    vsp->numval = 0;
+    return vsp;
+}
+
+static void
+stuff(pmValueSet *vsp, int inst, pmAtomValue *avp, int type)
+{
+    pmValue	*vp = &vsp->vlist[vsp->numval];
+    int		sts;
+
+    vp->inst = inst;
+    if ((sts = __pmStuffValue(avp, vp, type)) < 0) {
+	fprintf(stderr, "%s: Error: __pmStuffValue failed: %s\n",
+		pmProgname, pmErrStr(sts));
+	exit(1);
+    }
+    if (vsp->numval++ == 0)
+	vsp->valfmt = sts;
+}
+
+static void
+freevsets(pmResult *rp)
+{
+    pmValueSet	*vsp;
+    int		i, j;
+
+    for (i = 0; i < rp->numpmid; i++) {
+	vsp = rp->vset[i];
+	if (vsp->valfmt == PM_VAL_DPTR) {
+	    for (j = 0; j < vsp->numval; j++)
+		free(vsp->vlist[j].value.pval);
+	}
+	free(vsp);
+    }
+    rp->numpmid = 0;
+}
+
+/*
+ * Write the statistics for the current interval of output r, with
+ * timestamp usec, and start afresh.
+ */
+static int
+flush(rolljob_t *jp, int r, __int64_t usec)
+{
+    rollout_t		*op = &jp->out[r];
+    __pmLogCtl		*lcp = &op->logctl;
+    rollmetric_t	*mp;
+    rollinst_t		*ip;
+    rollacc_t		*ap;
+    pmResult		*rp = jp->result;
+    pmValueSet		*vsp, *svsp[NSTATS];
+    pmAtomValue		av;
+    __pmTimeval		stamp;
+    __pmPDU		*pb;
+    unsigned long	peek_offset;
+    int			m, i, s, n, sts = 0;
+    int			needti = 0;
+
+    op->pending = 0;
+    usec2ts(usec, &stamp);
+    if (sarg >= 0 && op->written >= sarg)
+	goto reset;
+
+    rp->numpmid = 0;
+    rp->timestamp.tv_sec = stamp.tv_sec;
+    rp->timestamp.tv_usec = stamp.tv_usec;
+    for (m = 0; m < jp->nmetric; m++) {
+	mp = &jp->metrics[m];
+	for (n = i = 0; i < mp->ninst; i++)
+	    if (mp->insts[i]->acc[r].count > 0)
+		n++;
+	if (n == 0)
+	    continue;
+	vsp = rp->vset[rp->numpmid++] = newvset(n);
+	vsp->pmid = mp->odesc.pmid;
+	for (s = 0; s < NSTATS; s++) {
+	    svsp[s] = NULL;
+	    if (mp->sdesc[s].pmid == PM_ID_NULL)
+		continue;
+	    svsp[s] = rp->vset[rp->numpmid++] = newvset(n);
+	    svsp[s]->pmid = mp->sdesc[s].pmid;
+	}
+	for (i = 0; i < mp->ninst; i++) {
+	    ip = mp->insts[i];
+	    ap = &ip->acc[r];
+	    if (ap->count == 0)
+		continue;
+	    switch (mp->kind) {
+		case ROLL_STATS:
+		    av.d = ap->sum / ap->count;
+		    stuff(vsp, ip->inst, &av, PM_TYPE_DOUBLE);
+		    break;
+		case ROLL_COUNTER:
+		    stuff(vsp, ip->inst, &ap->last, mp->odesc.type);
+		    break;
+		default:
+		    stuff(vsp, ip->inst, &ap->last, PM_TYPE_STRING);
+		    break;
+	    }
+	    if (svsp[STAT_MIN] != NULL &&
+		(mp->kind == ROLL_STATS || ap->nrate > 0)) {
+		av.d = ap->min;
+		stuff(svsp[STAT_MIN], ip->inst, &av, PM_TYPE_DOUBLE);
+		av.d = ap->max;
+		stuff(svsp[STAT_MAX], ip->inst, &av, PM_TYPE_DOUBLE);
+	    }
+	    if (svsp[STAT_COUNT] != NULL) {
+		av.ul = ap->count;
+		stuff(svsp[STAT_COUNT], ip->inst, &av, PM_TYPE_U32);
+	    }
+	}
+	if (mp->odesc.indom != PM_INDOM_NULL) {
+	    if ((sts = checkindom(jp, op, mp->odesc.indom, vsp, &stamp)) < 0)
+		goto done;
+	    needti |= sts;
+	}
+    }
+    /* a minimum and maximum need two observations of a counter */
+    for (i = n = 0; i < rp->numpmid; i++) {
+	if (rp->vset[i]->numval > 0)
+	    rp->vset[n++] = rp->vset[i];
+	else
+	    free(rp->vset[i]);
+    }
+    if ((rp->numpmid = n) == 0)
+	goto reset;
+
+    if ((sts = __pmEncodeResult(PDU_OVERRIDE2, rp, &pb)) < 0) {
+	fprintf(stderr, "%s: Error: __pmEncodeResult: %s\n",
+		pmProgname, pmErrStr(sts));
+	goto done;
+    }
+    if (needti) {
+	fflush(lcp->l_mdfp);
+	__pmLogPutIndex(lcp, &stamp);
+    }
+    /* switch volumes if required, as in main() */
+    if (varg > 0 && op->written > 0 && (op->written % varg) == 0)
+	newvolume(lcp, op->name, &stamp);
+    peek_offset = ftell(lcp->l_mfp);
+    peek_offset += ((__pmPDUHdr *)pb)->len - sizeof(__pmPDUHdr) + 2*sizeof(int);
+    if (peek_offset > 0x7fffffff)
+	newvolume(lcp, op->name, &stamp);
+    sts = __pmLogPutResult2(lcp, pb);
+    __pmUnpinPDUBuf(pb);
+    if (sts < 0) {
+	fprintf(stderr, "%s: Error: __pmLogPutResult2: %s: %s\n",
+		pmProgname, op->name, pmErrStr(sts));
+	goto done;
+    }
+    op->written++;
+    op->last = stamp;
+
+reset:
+    for (m = 0; m < jp->nmetric; m++) {
+	mp = &jp->metrics[m];
+	for (i = 0; i < mp->ninst; i++) {
+	    ap = &mp->insts[i]->acc[r];
+	    if (ap->last.cp != NULL && mp->kind == ROLL_LAST)
+		free(ap->last.cp);
+	    memset(ap, 0, sizeof(*ap));
+	}
+    }
+done:
+    freevsets(rp);
+    return sts < 0 ? sts : 0;
+}
+
+static int
+putmark(rollout_t *op, __int64_t usec)
+{
+    struct {
+	__pmPDU		len;
+	__pmPDU		type;
+	__pmPDU		from;
+	__pmTimeval	timestamp;
+	int		numpmid;	/* zero PMIDs to follow */
+	__pmPDU		trailer;
+    } markrec;
+    __pmTimeval		stamp;
+    int			sts;
+
+    if (sarg >= 0 && op->written >= sarg)
+	return 0;
+    usec2ts(usec, &stamp);
+    /* logic copied from doscan() */
+    markrec.len = sizeof(markrec) - sizeof(__pmPDU);
+    markrec.type = markrec.from = 0;
+    markrec.timestamp.tv_sec = htonl(stamp.tv_sec);
+    markrec.timestamp.tv_usec = htonl(stamp.tv_usec);
+    markrec.numpmid = 0;
+    if ((sts = __pmLogPutResult2(&op->logctl, (__pmPDU *)&markrec)) < 0) {
+	fprintf(stderr, "%s: Error: __pmLogPutResult2: mark record write: %s\n",
+		pmProgname, pmErrStr(sts));
+	return sts;
+    }
+    op->last = stamp;
+    return 0;
+}
+
+/*
+ * Time window for one input archive - parsed under a lock, as the
+ * timezone is global state.
+ */
+static int
+window(rolljob_t *jp)
+{
+    struct timeval	logstart, logend, unused;
+    char		*msg;
+    int			sts;
+
+    logstart.tv_sec = jp->label.ll_start.tv_sec;
+    logstart.tv_usec = jp->label.ll_start.tv_usec;
+    if ((sts = pmGetArchiveEnd(&logend)) < 0) {
+	fprintf(stderr, "%s: Error: cannot get end of archive (%s): %s\n",
+		pmProgname, jp->iname, pmErrStr(sts));
+	return sts;
+    }
+#ifdef PM_MULTI_THREAD
+    pthread_mutex_lock(&tzlock);
+#endif
+    if (zarg)
+	pmNewZone(jp->label.ll_tz);
+    sts = pmParseTimeWindow(Sarg, Targ, Aarg, NULL, &logstart, &logend,
+			    &jp->start, &jp->end, &unused, &msg);
+#ifdef PM_MULTI_THREAD
+    pthread_mutex_unlock(&tzlock);
+#endif
+    if (sts < 0) {
+	fprintf(stderr, "%s: %s: Invalid time window specified: %s\n",
+		pmProgname, jp->iname, msg);
+	free(msg);
+    }
+    return sts;
+}
+
+static void
+freejob(rolljob_t *jp)
+{
+    rollmetric_t	*mp;
+    rollinst_t		*ip;
+    int			m, i, r;
+
+    for (m = 0; m < jp->nmetric; m++) {
+	mp = &jp->metrics[m];
+	for (i = 0; i < mp->ninst; i++) {
+	    ip = mp->insts[i];
+	    if (mp->kind == ROLL_LAST)
+		for (r = 0; r < nres; r++)
+		    if (ip->acc[r].last.cp != NULL)
+			free(ip->acc[r].last.cp);
+	    free(ip);
+	}
+	free(mp->insts);
+	__pmHashClear(&mp->insthash);
+	free(mp->names);
+    }
+    free(jp->metrics);
+    __pmHashClear(&jp->pmids);
+    free(jp->result);
+    jp->metrics = NULL;
+    jp->result = NULL;
+    jp->nmetric = 0;
+}
+
+/*
+ * Reduce one input archive, reading each record once.
+ */
+static int
+rollup(rolljob_t *jp)
+{
+    pmResult		*rp;
+    pmValueSet		*vsp;
+    rollmetric_t	*mp;
+    __pmHashNode	*hp;
+    __int64_t		t, winend;
+    size_t		size;
+    int			i, j, r, sts;
+    int			nout = 0;
+    int			active;
+
+    if ((jp->ctx = pmNewContext(PM_CONTEXT_ARCHIVE, jp->iname)) < 0) {
+	fprintf(stderr, "%s: Error: cannot open archive \"%s\": %s\n",
+		pmProgname, jp->iname, pmErrStr(jp->ctx));
+	return jp->ctx;
+    }
+    if ((sts = pmGetArchiveLabel(&jp->label)) < 0) {
+	fprintf(stderr, "%s: Error: cannot get archive label record (%s): %s\n",
+		pmProgname, jp->iname, pmErrStr(sts));
+	goto done;
+    }
+    if ((sts = window(jp)) < 0)
+	goto done;
+    winend = tv2usec(&jp->end);
+
+    if ((sts = pmTraversePMNS_r("", addmetric, jp)) < 0) {
+	fprintf(stderr, "%s: %s: Error traversing namespace ... %s\n",
+		pmProgname, jp->iname, pmErrStr(sts));
+	goto done;
+    }
+    if ((sts = jp->sts) < 0)
+	goto done;
+    for (i = 0; i < jp->nmetric; i++)
+	addstats(jp, &jp->metrics[i]);
+    size = sizeof(pmResult) + (jp->nmetric * (NSTATS + 1)) * sizeof(pmValueSet *);
+    if ((jp->result = (pmResult *)malloc(size)) == NULL)
+	__pmNoMem("rollup.result", size, PM_FATAL_ERR);
+    jp->result->numpmid = 0;
+
+    size = nres * sizeof(rollout_t);
+    if ((jp->out = (rollout_t *)calloc(1, size)) == NULL)
+	__pmNoMem("rollup.out", size, PM_FATAL_ERR);
+    for (nout = 0; nout < nres; nout++) {
+	rollout_t	*op = &jp->out[nout];
+
+	op->res = reslist[nout];
+	op->interval = resusec[nout];
+	op->name = jp->oname[nout];
+	if ((sts = newoutput(jp, op)) < 0) {
+	    nout++;
+	    goto done;
+	}
+    }
+
+    if ((sts = pmSetMode(PM_MODE_FORW, &jp->start, 0)) < 0) {
+	fprintf(stderr, "%s: %s: Error: pmSetMode failed: %s\n",
+		pmProgname, jp->iname, pmErrStr(sts));
+	goto done;
+    }
+    for ( ; ; ) {
+	if ((sts = pmFetchArchive(&rp)) < 0) {
+	    if (sts == PM_ERR_EOL)
+		break;
+	    fprintf(stderr, "%s: %s: Error: pmFetchArchive failed: %s\n",
+		    pmProgname, jp->iname, pmErrStr(sts));
+	    goto done;
+	}
+	t = tv2usec(&rp->timestamp);
+	if (t > winend) {
+	    /* past end time as per -T */
+	    pmFreeResult(rp);
+	    break;
+	}
+
+	/* finish any interval that ends before this record */
+	for (active = r = 0; r < nres; r++) {
+	    rollout_t	*op = &jp->out[r];
+
+	    if (op->pending && t > op->end) {
+		if ((sts = flush(jp, r, op->end)) < 0) {
+		    pmFreeResult(rp);
+		    goto done;
+		}
+	    }
+	    if (sarg < 0 || op->written < sarg)
+		active++;
+	}
+	if (!active) {
+	    /* all output archives have -s samples */
+	    pmFreeResult(rp);
+	    break;
+	}
+
+	if (rp->numpmid == 0) {
+	    /*
+	     * Mark record ... finish the current intervals early, and
+	     * no rates across the gap
+	     */
+	    for (r = 0; r < nres; r++) {
+		if (jp->out[r].pending && (sts = flush(jp, r, t)) < 0)
+		    break;
+		if ((sts = putmark(&jp->out[r], t)) < 0)
+		    break;
+	    }
+	    pmFreeResult(rp);
+	    if (sts < 0)
+		goto done;
+	    for (i = 0; i < jp->nmetric; i++) {
+		mp = &jp->metrics[i];
+		for (j = 0; j < mp->ninst; j++)
+		    mp->insts[j]->hasprev = 0;
+	    }
+	    continue;
+	}
+
+	for (r = 0; r < nres; r++) {
+	    rollout_t	*op = &jp->out[r];
+
+	    if (!op->pending) {
+		/* new interval, (end-interval, end] contains t */
+		op->end = ((t + op->interval - 1) / op->interval) * op->interval;
+		op->pending = 1;
+	    }
+	}
+	for (i = 0; i < rp->numpmid; i++) {
+	    vsp = rp->vset[i];
+	    if (vsp->numval <= 0)
+		continue;
+	    if ((hp = __pmHashSearch(vsp->pmid, &jp->pmids)) == NULL)
+		continue;
+	    mp = &jp->metrics[(int)(__psint_t)hp->data];
+	    for (j = 0; j < vsp->numval; j++)
+		addvalue(jp, mp, vsp->valfmt, &vsp->vlist[j], t / 1e6);
+	}
+	pmFreeResult(rp);
+    }
+
+    sts = 0;
+    for (r = 0; r < nres; r++) {
+	if (jp->out[r].pending && (sts = flush(jp, r, jp->out[r].end)) < 0)
+	    break;
+    }
+
+done:
+    for (r = 0; r < nout; r++) {
+	closeoutput(&jp->out[r], sts < 0);
+    }
+    free(jp->out);
+    jp->out = NULL;
+    freejob(jp);
+    pmDestroyContext(jp->ctx);
+    return sts;
+}
+
+static rolljob_t *
+getjob(void)
+{
+    rolljob_t	*jp = NULL;
+
+#ifdef PM_MULTI_THREAD
+    pthread_mutex_lock(&joblock);
+#endif
+    if (nextjob < njob)
+	jp = &joblist[nextjob++];
+#ifdef PM_MULTI_THREAD
+    pthread_mutex_unlock(&joblock);
+#endif
+    return jp;
+}
+
+static void *
+roller(void *arg)
+{
+    rolljob_t	*jp;
+
+    while ((jp = getjob()) != NULL)
+	jp->sts = rollup(jp);
+    return NULL;
+}
+
+/*
+ * Reduce each input archive in parallel (up to one thread per CPU).
+ * Returns the number of archives that could not be reduced.
+ */
+int
+rollupall(int ninput, char **inputs, char *output)
+{
+    char	**full;
+    int		i, j, k, r, nfail = 0;
+#ifdef PM_MULTI_THREAD
+    pthread_t	*tids;
+    long	nthreads;
+    size_t	size;
+#endif
+
+    template = output;
+    njob = ninput;
+    if ((joblist = (rolljob_t *)calloc(njob, sizeof(rolljob_t))) == NULL)
+	__pmNoMem("rollupall.joblist", njob * sizeof(rolljob_t), PM_FATAL_ERR);
+    for (i = 0; i < njob; i++)
+	joblist[i].iname = inputs[i];
+
+    /*
+     * Name every output archive before any are created, so one job
+     * cannot collide with (and then clean up) the output of another
+     */
+    for (i = 0; i < njob; i++)
+	joblist[i].ident = inputid(joblist[i].iname, 0);
+    if ((full = (char **)calloc(njob, sizeof(char *))) == NULL)
+	__pmNoMem("rollupall.full", njob * sizeof(char *), PM_FATAL_ERR);
+    for (i = 0; i < njob; i++) {
+	for (j = 0; j < njob; j++) {
+	    if (j != i && strcmp(joblist[j].ident, joblist[i].ident) == 0)
+		break;
+	}
+	if (j < njob)
+	    full[i] = inputid(joblist[i].iname, 1);
+    }
+    for (i = 0; i < njob; i++) {
+	if (full[i] != NULL) {
+	    free(joblist[i].ident);
+	    joblist[i].ident = full[i];
+	}
+    }
+    free(full);
+
+    /* distinct inputs may still expand to the same names */
+    for (i = 0; i < njob; i++) {
+	rolljob_t	*jp = &joblist[i];
+
+	if ((jp->oname = (char **)calloc(nres, sizeof(char *))) == NULL)
+	    __pmNoMem("rollupall.oname", nres * sizeof(char *), PM_FATAL_ERR);
+	for (r = 0; r < nres; r++) {
+	    jp->oname[r] = outname(jp->ident, reslist[r]);
+	    for (j = 0; j <= i; j++) {
+		for (k = 0; k < (j == i ? r : nres); k++) {
+		    if (strcmp(joblist[j].oname[k], jp->oname[r]) == 0) {
+			fprintf(stderr, "%s: Error: output archive \"%s\" for both %s and %s\n",
+				pmProgname, jp->oname[r], joblist[j].iname, jp->iname);
+			nfail = njob;
+		    }
+		}
+	    }
+	}
+    }
+    if (nfail)
+	goto done;
+
+#ifdef PM_MULTI_THREAD
+    if ((nthreads = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+	nthreads = 1;
+    if (nthreads > njob)
+	nthreads = njob;
+    size = nthreads * sizeof(pthread_t);
+    if ((tids = (pthread_t *)malloc(size)) == NULL)
+	__pmNoMem("rollupall.tids", size, PM_FATAL_ERR);
+    for (i = 0; i < nthreads; i++) {
+	if (pthread_create(&tids[i], NULL, roller, NULL) != 0)
+	    break;
+    }
+    if ((nthreads = i) == 0)
+	roller(NULL);
+    for (i = 0; i < nthreads; i++)
+	pthread_join(tids[i], NULL);
+    free(tids);
+#else
+    roller(NULL);
+#endif
+
+    for (i = 0; i < njob; i++) {
+	if (joblist[i].sts < 0)
+	    nfail++;
+    }
+
+done:
+    for (i = 0; i < njob; i++) {
+	if (joblist[i].oname != NULL) {
+	    for (r = 0; r < nres && joblist[i].oname[r] != NULL; r++)
+		free(joblist[i].oname[r]);
+	    free(joblist[i].oname);
+	}
+	free(joblist[i].ident);
+    }
+    free(joblist);
+    return nfail;
+}
@@ -35,7 +35,9 @@ static pmLongOptions longopts[] = {
     { "maximum", 0, 'M', 0, "also print maximum value" },
     PMOPT_NAMESPACE,
     { "", 0, 'N', 0, "suppress warnings from individual archive fetches (default)" },
+    { "onepass", 0, 'o', 0, "read archive once, estimating value distribution (-B)" },
     { "precision", 0, 'p', 0, "number of digits to display after the decimal point" },
+    { "percentiles", 1, 'P', "LIST", "print estimated percentiles (comma separated)" },
     PMOPT_START,
     PMOPT_FINISH,
     { "verbose", 0, 'v', 0, "verbose, enable warnings from individual archive fetches" },
@@ -49,13 +51,31 @@ static pmLongOptions longopts[] = {
 
 static int override(int, pmOptions *);
 static pmOptions opts = {
-    .flags = PM_OPTFLAG_DONE | PM_OPTFLAG_BOUNDARIES | PM_OPTFLAG_STDOUT_TZ,
-    .short_options = "abB:D:fFHiIlmMNn:p:rsS:T:vxyzZ:?",
+    .flags = PM_OPTFLAG_DONE | PM_OPTFLAG_BOUNDARIES | PM_OPTFLAG_STDOUT_TZ |
+	     PM_OPTFLAG_MULTI,
+    .short_options = "abB:D:fFHiIlmMNn:op:P:rsS:T:vxyzZ:?",
     .long_options = longopts,
-    .short_usage = "[options] archive [metricname ...]",
+    .short_usage = "[options] archive[,archive...] [metricname ...]",
     .override = override,
 };
 
+/*
+ * Mergeable sketch of the distribution of values (DDSketch) - buckets
+ * on a (piecewise linear) logarithmic scale, so that any value reported
+ * from a bucket is within SKETCH_ALPHA (relative) of those counted there.
+ */
+#define SKETCH_ALPHA	0.01
+#define SKETCH_MIN	1e-9		/* smaller magnitudes count as zero */
+#define SKETCH_MAXBINS	2048		/* per sign, lowest buckets collapse */
+
+typedef struct {
+    unsigned int	count;		/* all values */
+    unsigned int	zero;		/* values within SKETCH_MIN of zero */
+    int			lo[2];		/* lowest bucket, negative/positive */
+    int			nbin[2];	/* number of buckets, neg/pos */
+    unsigned int	*bin[2];	/* bucket counts, neg/pos */
+} sketch_t;
+
 typedef struct {
     int			inst;
     unsigned int	count;
@@ -73,6 +93,7 @@ typedef struct {
     int			marked;		/* seen since last "mark" record? */
     unsigned int	bintotal;	/* copy of count for 2nd pass */
     unsigned int	*bin;		/* bins for value distribution */
+    sketch_t		*sketch;	/* for percentiles & one pass bins */
 } instData;
 
 typedef struct {
@@ -80,8 +101,23 @@ typedef struct {
     double		scale;
     instData		**instlist;
     unsigned int	listsize;
+    __pmHashCtl		insthash;	/* instlist hashed by inst */
 } aveData;
 
+/*
+ * State for each archive when summarizing several archives together
+ */
+typedef struct {
+    char		*name;
+    int			ctx;
+    int			sts;		/* fetch or open status */
+    __pmHashCtl		hashlist;
+} archData;
+
+static archData		*archlist;
+static int		narchive;
+static int		nextarchive;
+
 /*
  * Hash control for statistics & errors related to each metric
  */
@@ -101,6 +137,16 @@ static unsigned int	warnflag;	/* warnings are off by default */
 static unsigned int	delimiter = ' ';/* output field separator */
 static unsigned int	nbins;		/* number of distribution bins */
 static unsigned int	precision = 3;	/* number of digits after "." */
+static unsigned int	onepass;	/* bins from sketches, no 2nd pass */
+static double		*pctlist;	/* percentiles to report */
+static unsigned int	npct;
+static unsigned int	usesketch;	/* sketch of values is needed */
+static double		sketchscale;	/* buckets per unit of sketchlog */
+
+#ifdef PM_MULTI_THREAD
+static pthread_mutex_t	errlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t	archlock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 /* time window stuff */
 static int		dayflag;
@@ -139,7 +185,12 @@ tadd(struct timeval *a, struct timeval *b)
 static void
 pmiderr(pmID pmid, const char *msg, ...)
 {
-    if (warnflag && __pmHashSearch(pmid, &errlist) == NULL) {
+    if (!warnflag)
+	return;
+#ifdef PM_MULTI_THREAD
+    pthread_mutex_lock(&errlock);
+#endif
+    if (__pmHashSearch(pmid, &errlist) == NULL) {
 	va_list	arg;
 	int	numnames;
 	char	**names;
@@ -154,6 +205,9 @@ pmiderr(pmID pmid, const char *msg, ...)
 	__pmHashAdd(pmid, NULL, &errlist);
 	if (numnames > 0) free(names);
     }
+#ifdef PM_MULTI_THREAD
+    pthread_mutex_unlock(&errlock);
+#endif
 }
 
 static void
@@ -218,6 +272,8 @@ printlabel(void)
 static void
 printheaders(void)
 {
+    int		i;
+
     printf("metric");
     if (stocaveflag)
 	printf("%cstochastic_average", delimiter);
@@ -235,11 +291,248 @@ printheaders(void)
 	printf("%cmaximum_time", delimiter);
     if (countflag)
 	printf("%ccount", delimiter);
+    for (i = 0; i < npct; i++)
+	printf("%cp%g", delimiter, pctlist[i]);
     if (nbins)
 	printf("%cbins", delimiter);
     printf("%cunits\n", delimiter);
 }
 
+unsigned int findbin(pmID, double, double, double);
+
+/*
+ * log2 interpolated linearly between powers of two - far cheaper than
+ * log(), and its slope (w.r.t. natural log) is at least one, so buckets
+ * of width log(gamma) on this scale are no wider than with log().
+ */
+static double
+sketchlog(double val)
+{
+    int		e;
+    double	m = frexp(val, &e);	/* val == m * 2^e, 0.5 <= m < 1 */
+
+    return e - 2 + 2 * m;
+}
+
+static double
+sketchexp(double y)
+{
+    double	e = floor(y);
+
+    return ldexp(1 + y - e, (int)e);
+}
+
+static void
+sketchinit(void)
+{
+    sketchscale = 1.0 / log((1.0 + SKETCH_ALPHA) / (1.0 - SKETCH_ALPHA));
+}
+
+/*
+ * Find the count for bucket k, growing the bucket array (with room to
+ * spare, for steadily rising or falling values) as needed - beyond
+ * SKETCH_MAXBINS the buckets for the smallest magnitudes are folded
+ * into one, trading accuracy there for bounded space.
+ */
+static unsigned int *
+sketchbucket(sketch_t *sp, int s, int k)
+{
+    unsigned int	*bin;
+    size_t		size;
+    int			i, j, lo, hi, slack;
+
+    if (sp->nbin[s] == 0)
+	lo = hi = k;
+    else {
+	lo = sp->lo[s];
+	hi = lo + sp->nbin[s] - 1;
+	if (k >= lo && k <= hi)
+	    return &sp->bin[s][k - lo];
+	slack = sp->nbin[s] / 2 + 8;
+	if (k < lo) {
+	    lo = k - slack;
+	    if (hi - lo >= SKETCH_MAXBINS)
+		lo = hi - SKETCH_MAXBINS + 1;
+	}
+	else {
+	    hi = k + slack;
+	    if (hi - lo >= SKETCH_MAXBINS)
+		hi = lo + SKETCH_MAXBINS - 1;
+	    if (hi < k) {
+		hi = k;
+		lo = hi - SKETCH_MAXBINS + 1;
+	    }
+	}
+    }
+    if (k < lo)
+	k = lo;
+
+    size = (hi - lo + 1) * sizeof(unsigned int);
+    if ((bin = (unsigned int *)malloc(size)) == NULL)
+	__pmNoMem("sketchbucket", size, PM_FATAL_ERR);
+    memset(bin, 0, size);
+    for (i = 0; i < sp->nbin[s]; i++) {
+	if ((j = sp->lo[s] + i - lo) < 0)
+	    j = 0;
+	bin[j] += sp->bin[s][i];
+    }
+    if (sp->bin[s])
+	free(sp->bin[s]);
+    sp->bin[s] = bin;
+    sp->lo[s] = lo;
+    sp->nbin[s] = hi - lo + 1;
+    return &sp->bin[s][k - lo];
+}
+
+static void
+sketchadd(sketch_t *sp, double val, unsigned int n)
+{
+    sp->count += n;
+    if (val >= SKETCH_MIN)
+	*sketchbucket(sp, 1, (int)ceil(sketchlog(val) * sketchscale)) += n;
+    else if (val <= -SKETCH_MIN)
+	*sketchbucket(sp, 0, (int)ceil(sketchlog(-val) * sketchscale)) += n;
+    else
+	sp->zero += n;
+}
+
+static void
+sketchmerge(sketch_t *dst, sketch_t *src)
+{
+    int		i, s;
+
+    for (s = 0; s < 2; s++) {
+	for (i = 0; i < src->nbin[s]; i++)
+	    if (src->bin[s][i])
+		*sketchbucket(dst, s, src->lo[s] + i) += src->bin[s][i];
+    }
+    dst->zero += src->zero;
+    dst->count += src->count;
+}
+
+static void
+sketchfree(sketch_t *sp)
+{
+    if (sp->bin[0])
+	free(sp->bin[0]);
+    if (sp->bin[1])
+	free(sp->bin[1]);
+    free(sp);
+}
+
+/* representative value for bucket k, clamped to the observed range */
+static double
+sketchvalue(instData *instdata, int s, int k)
+{
+    double	val, lo, hi;
+
+    if (k == INT_MIN)
+	val = 0.0;
+    else {	/* harmonic mean of the bucket bounds */
+	lo = sketchexp((k - 1) / sketchscale);
+	hi = sketchexp(k / sketchscale);
+	val = 2 * lo * hi / (lo + hi);
+	if (s == 0)
+	    val = -val;
+    }
+    if (val < instdata->min)
+	return instdata->min;
+    if (val > instdata->max)
+	return instdata->max;
+    return val;
+}
+
+/*
+ * Visit the buckets in ascending order of value - negative values
+ * (largest magnitude first), zero (k == INT_MIN), then positive values.
+ * Stops when the callback returns non-zero.
+ */
+typedef int (*sketchvisit)(instData *, int, int, unsigned int, void *);
+
+static void
+sketchwalk(instData *instdata, sketchvisit visit, void *arg)
+{
+    sketch_t	*sp = instdata->sketch;
+    int		i;
+
+    for (i = sp->nbin[0] - 1; i >= 0; i--)
+	if (sp->bin[0][i] && visit(instdata, 0, sp->lo[0] + i, sp->bin[0][i], arg))
+	    return;
+    if (sp->zero && visit(instdata, 1, INT_MIN, sp->zero, arg))
+	return;
+    for (i = 0; i < sp->nbin[1]; i++)
+	if (sp->bin[1][i] && visit(instdata, 1, sp->lo[1] + i, sp->bin[1][i], arg))
+	    return;
+}
+
+typedef struct {
+    double	rank;		/* wanted, counting from zero */
+    double	seen;
+    double	value;
+} quantile_t;
+
+static int
+quantilevisit(instData *instdata, int s, int k, unsigned int n, void *arg)
+{
+    quantile_t	*qp = (quantile_t *)arg;
+
+    qp->seen += n;
+    qp->value = sketchvalue(instdata, s, k);
+    return qp->seen > qp->rank;
+}
+
+static double
+quantile(instData *instdata, double pct)
+{
+    quantile_t	q;
+
+    q.rank = pct / 100.0 * (instdata->sketch->count - 1);
+    q.seen = 0;
+    q.value = instdata->min;
+    sketchwalk(instdata, quantilevisit, &q);
+    return q.value;
+}
+
+static int
+binvisit(instData *instdata, int s, int k, unsigned int n, void *arg)
+{
+    pmID	pmid = *(pmID *)arg;
+    double	val = sketchvalue(instdata, s, k);
+
+    instdata->bin[findbin(pmid, val, instdata->min, instdata->max)] += n;
+    return 0;
+}
+
+static __pmHashWalkState
+freenode(const __pmHashNode *tp, void *arg)
+{
+    return PM_HASH_WALK_DELETE_NEXT;
+}
+
+/*
+ * Instance names can be found in any of the archives when there are
+ * several, not only in the one currently being traversed.
+ */
+static int
+nameindom(pmInDom indom, int inst, char **name)
+{
+    int		i, ctx, sts;
+
+    if ((sts = pmNameInDom(indom, inst, name)) >= 0 ||
+	indom == PM_INDOM_NULL || narchive < 2)
+	return sts;
+    ctx = pmWhichContext();
+    for (i = 0; i < narchive; i++) {
+	if (archlist[i].ctx == ctx)
+	    continue;
+	pmUseContext(archlist[i].ctx);
+	if ((sts = pmNameInDom(indom, inst, name)) >= 0)
+	    break;
+    }
+    pmUseContext(ctx);
+    return sts;
+}
+
 static void
 printsummary(const char *name)
 {
@@ -287,7 +580,7 @@ printsummary(const char *name)
 	    /* counter metric doesn't cover 90% of log */
 	    star = (avedata->desc.sem == PM_SEM_COUNTER && metricspan / logspan <= 0.1);
 
-	    if ((sts = pmNameInDom(avedata->desc.indom, instdata->inst, &str)) < 0) {
+	    if ((sts = nameindom(avedata->desc.indom, instdata->inst, &str)) < 0) {
 		if (msp && msp->ninst > 0 && avedata->desc.indom == PM_INDOM_NULL)
 		    break;
 		if (star)
@@ -346,6 +639,11 @@ printsummary(const char *name)
 		instdata->count = instdata->count - instdata->markcount - 1;
 	    if (countflag)
 		printf("%c%u", delimiter, instdata->count);
+	    for (j = 0; j < npct; j++)
+		printf("%c%.*f", delimiter, (int)precision,
+			quantile(instdata, pctlist[j]));
+	    if (nbins && onepass)	/* estimate distribution from sketch */
+		sketchwalk(instdata, binvisit, &avedata->desc.pmid);
 	    for (j=0; j < nbins; j++) {	/* print value distribution summary */
 		if (j > 0 && instdata->min == instdata->max)	/* all in 1st bin */
 		    printf("%c[]%c%u", delimiter, delimiter, 0);
@@ -359,10 +657,14 @@ printsummary(const char *name)
 	    if (instdata) {
 		if (instdata->bin)
 		    free(instdata->bin);
+		if (instdata->sketch)
+		    sketchfree(instdata->sketch);
 		free(instdata);
 	    }
 	}
 	if (avedata->instlist) free(avedata->instlist);
+	__pmHashWalkCB(freenode, NULL, &avedata->insthash);
+	__pmHashClear(&avedata->insthash);
 	__pmHashDel(avedata->desc.pmid, (void*)avedata, &hashlist);
 	free(avedata);
     }
@@ -399,12 +701,41 @@ unwrap(double current, double previous, int pmtype)
     return outval;
 }
 
+/*
+ * find the statistics for an instance - usually at the same position
+ * in instlist as in the result, else hashed by instance identifier
+ */
+static instData *
+findinst(aveData *avedata, int pos, int inst)
+{
+    __pmHashNode	*hptr;
+
+    if (pos < avedata->listsize && avedata->instlist[pos]->inst == inst)
+	return avedata->instlist[pos];
+    if ((hptr = __pmHashSearch(inst, &avedata->insthash)) != NULL)
+	return (instData *)hptr->data;
+    return NULL;
+}
+
+static void
+addinst(aveData *avedata, instData *instdata)
+{
+    size_t	size;
+
+    size = (avedata->listsize+1) * sizeof(instData *);
+    avedata->instlist = (instData **) realloc(avedata->instlist, size);
+    if (avedata->instlist == NULL)
+	__pmNoMem("addinst.instlist", size, PM_FATAL_ERR);
+    avedata->instlist[avedata->listsize++] = instdata;
+    if (__pmHashAdd(instdata->inst, (void *)instdata, &avedata->insthash) < 0)
+	__pmNoMem("addinst.insthash", sizeof(__pmHashNode), PM_FATAL_ERR);
+}
+
 static void
 newHashInst(pmValue *vp,
 	aveData *avedata,		/* updated by this function */
 	int valfmt,
-	struct timeval *timestamp,	/* timestamp for this sample */
-	int pos)			/* position of this inst in instlist */
+	struct timeval *timestamp)	/* timestamp for this sample */
 {
     int		sts;
     size_t	size;
@@ -416,12 +747,8 @@ newHashInst(pmValue *vp,
 	fprintf(stderr, "%s: possibly corrupt archive?\n", pmProgname);
 	exit(1);
     }
-    size = (pos+1) * sizeof(instData *);
-    avedata->instlist = (instData **) realloc(avedata->instlist, size);
-    if (avedata->instlist == NULL)
-	__pmNoMem("newHashInst.instlist", size, PM_FATAL_ERR);
     size = sizeof(instData);
-    avedata->instlist[pos] = instdata = (instData *) malloc(size);
+    instdata = (instData *) malloc(size);
     if (instdata == NULL)
 	__pmNoMem("newHashInst.instlist[inst]", size, PM_FATAL_ERR);
     if (nbins == 0)
@@ -433,6 +760,17 @@ newHashInst(pmValue *vp,
 	    __pmNoMem("newHashInst.instlist[inst].bin", size, PM_FATAL_ERR);
 	memset(instdata->bin, 0, size);
     }
+    if (usesketch == 0)
+	instdata->sketch = NULL;
+    else {	/* values (or rates) are sketched as they are seen */
+	size = sizeof(sketch_t);
+	instdata->sketch = (sketch_t *)malloc(size);
+	if (instdata->sketch == NULL)
+	    __pmNoMem("newHashInst.instlist[inst].sketch", size, PM_FATAL_ERR);
+	memset(instdata->sketch, 0, size);
+	if (avedata->desc.sem != PM_SEM_COUNTER)
+	    sketchadd(instdata->sketch, av.d, 1);
+    }
     instdata->inst = vp->inst;
     if (avedata->desc.sem == PM_SEM_COUNTER) {
 	instdata->min = 0.0;
@@ -460,7 +798,7 @@ newHashInst(pmValue *vp,
     instdata->lastval = av.d;
     instdata->firsttime = *timestamp;
     instdata->lasttime = *timestamp;
-    avedata->listsize++;
+    addinst(avedata, instdata);
 #ifdef PCP_DEBUG
     if (pmDebug & DBG_TRACE_APPL0) {
 	int	numnames;
@@ -504,8 +842,9 @@ newHashItem(pmValueSet *vsp,
     }
     avedata->listsize = 0;
     avedata->instlist = NULL;
+    __pmHashInit(&avedata->insthash);
     for (j = 0; j < vsp->numval; j++)
-	newHashInst(&vsp->vlist[j], avedata, vsp->valfmt, timestamp, j);
+	newHashInst(&vsp->vlist[j], avedata, vsp->valfmt, timestamp);
 }
 
 /*
@@ -548,7 +887,7 @@ findbin(pmID pmid, double val, double min, double max)
  * record has been seen between now & the last fetch for that instance
  */
 static void
-markrecord(pmResult *result)
+markrecord(pmResult *result, __pmHashCtl *hashlist)
 {
     int			i, j;
     __pmHashNode	*hptr;
@@ -563,8 +902,8 @@ markrecord(pmResult *result)
 	printf(" - mark record\n\n");
     }
 #endif
-    for (i = 0; i < hashlist.hsize; i++) {
-	for (hptr = hashlist.hash[i]; hptr != NULL; hptr = hptr->next) {
+    for (i = 0; i < hashlist->hsize; i++) {
+	for (hptr = hashlist->hash[i]; hptr != NULL; hptr = hptr->next) {
 	    avedata = (aveData *)hptr->data;
 	    for (j = 0; j < avedata->listsize; j++) {
 		instdata = avedata->instlist[j];
@@ -588,7 +927,7 @@ markrecord(pmResult *result)
 static void
 calcbinning(pmResult *result)
 {
-    int			i, j, k;
+    int			i, j;
     int			sts;
     int			wrap;
     double		val;
@@ -602,7 +941,7 @@ calcbinning(pmResult *result)
     struct timeval	timediff;
 
     if (result->numpmid == 0)	/* mark record */
-	markrecord(result);
+	markrecord(result, &hashlist);
 
     for (i = 0; i < result->numpmid; i++) {
 	vsp = result->vset[i];
@@ -618,25 +957,15 @@ calcbinning(pmResult *result)
 	    for (j = 0; j < vsp->numval; j++) {	/* iterate thro result values */
 		int	fp_bad;
 		vp = &vsp->vlist[j];
-		k = j;	/* index into stored inst list, result may differ */
 		if ((vsp->numval > 1) || (avedata->desc.indom != PM_INDOM_NULL)) {
-		    if ((k < avedata->listsize) && (avedata->instlist[k]->inst != vp->inst)) {
-			for (k = 0; k < avedata->listsize; k++) {
-			    if (vp->inst == avedata->instlist[k]->inst)
-				break;	/* k now correct */
-			}
-			if (k == avedata->listsize) {
-			    pmiderr(vsp->pmid, "ignoring new instance found on second pass\n");
-			    continue;
-			}
-		    }
-		    else if (k >= avedata->listsize) {
-			k = avedata->listsize;
+		    /* result order may differ from the stored inst list */
+		    if ((instdata = findinst(avedata, j, vp->inst)) == NULL) {
 			pmiderr(vsp->pmid, "ignoring new instance found on second pass\n");
 			continue;
 		    }
 		}
-		instdata = avedata->instlist[k];
+		else
+		    instdata = avedata->instlist[j];
 
 		if ((sts = pmExtractValue(vsp->valfmt, vp, avedata->desc.type, &av, PM_TYPE_DOUBLE)) < 0) {
 		    pmiderr(avedata->desc.pmid, "failed to extract value: %s\n", pmErrStr(sts));
@@ -712,9 +1041,9 @@ calcbinning(pmResult *result)
 }
 
 static void
-calcaverage(pmResult *result)
+calcaverage(pmResult *result, __pmHashCtl *hashlist)
 {
-    int			i, j, k;
+    int			i, j;
     int			sts;
     int			wrap;
     double		val;
@@ -730,7 +1059,7 @@ calcaverage(pmResult *result)
     struct timeval	timediff;
 
     if (result->numpmid == 0)	/* mark record */
-	markrecord(result);
+	markrecord(result, hashlist);
 
     for (i = 0; i < result->numpmid; i++) {
 	vsp = result->vset[i];
@@ -742,7 +1071,7 @@ calcaverage(pmResult *result)
 	}
 
 	/* check if pmid already in hash list */
-	if ((hptr = __pmHashSearch(vsp->pmid, &hashlist)) == NULL) {
+	if ((hptr = __pmHashSearch(vsp->pmid, hashlist)) == NULL) {
 	    if ((sts = pmLookupDesc(vsp->pmid, &desc)) < 0) {
 		pmiderr(vsp->pmid, "cannot find descriptor: %s\n", pmErrStr(sts));
 		continue;
@@ -757,7 +1086,7 @@ calcaverage(pmResult *result)
 	    /* create a new one & add to list */
 	    avedata = (aveData*) malloc(sizeof(aveData));
 	    newHashItem(vsp, &desc, avedata, &result->timestamp);
-	    if (__pmHashAdd(avedata->desc.pmid, (void*)avedata, &hashlist) < 0) {
+	    if (__pmHashAdd(avedata->desc.pmid, (void*)avedata, hashlist) < 0) {
 		pmiderr(avedata->desc.pmid, "failed %s hash table insertion\n", pmProgname);
 		/* free memory allocated above on insert failure */
 		for (j = 0; j < vsp->numval; j++)
@@ -771,27 +1100,16 @@ calcaverage(pmResult *result)
 	    for (j = 0; j < vsp->numval; j++) {	/* iterate thro result values */
 		int	fp_bad;
 		vp = &vsp->vlist[j];
-		k = j;	/* index into stored inst list, result may differ */
 		if ((vsp->numval > 1) || (avedata->desc.indom != PM_INDOM_NULL)) {
 		    /* must store values using correct inst - probably in correct order already */
-		    if ((k < avedata->listsize) && (avedata->instlist[k]->inst != vp->inst)) {
-			for (k = 0; k < avedata->listsize; k++) {
-			    if (vp->inst == avedata->instlist[k]->inst) {
-				break;	/* k now correct */
-			    }
-			}
-			if (k == avedata->listsize) {	/* no matching inst was found */
-			    newHashInst(vp, avedata, vsp->valfmt, &result->timestamp, k);
-			    continue;
-			}
-		    }
-		    else if (k >= avedata->listsize) {
-			k = avedata->listsize;
-			newHashInst(vp, avedata, vsp->valfmt, &result->timestamp, k);
+		    if ((instdata = findinst(avedata, j, vp->inst)) == NULL) {
+			/* no matching inst was found */
+			newHashInst(vp, avedata, vsp->valfmt, &result->timestamp);
 			continue;
 		    }
 		}
-		instdata = avedata->instlist[k];
+		else
+		    instdata = avedata->instlist[j];
 
 		if ((sts = pmExtractValue(vsp->valfmt, vp, avedata->desc.type, &av, PM_TYPE_DOUBLE)) < 0) {
 		    pmiderr(avedata->desc.pmid, "failed to extract value: %s\n", pmErrStr(sts));
@@ -850,6 +1168,8 @@ calcaverage(pmResult *result)
 		    else {
 			rate = (val - instdata->lastval) / diff;
 			instdata->stocave += rate;
+			if (instdata->sketch)
+			    sketchadd(instdata->sketch, rate, 1);
 			if (!instdata->marked)
 			    instdata->timeave += (val - instdata->lastval);
 			else {
@@ -909,6 +1229,8 @@ calcaverage(pmResult *result)
 		    val = av.d;
 		    instdata->sum += val;
 		    instdata->stocave += val;
+		    if (instdata->sketch)
+			sketchadd(instdata->sketch, val, 1);
 		    if (val < instdata->min) {
 			instdata->min = val;
 			instdata->mintime = result->timestamp;
@@ -974,6 +1296,242 @@ calcaverage(pmResult *result)
     }
 }
 
+/*
+ * Combine the statistics for one instance from two archives - the
+ * time spans covered are added, as are the sums & counts.
+ */
+static void
+mergeinst(aveData *avedata, instData *dst, instData *src)
+{
+    struct timeval	span, srcspan;
+    int			counter = (avedata->desc.sem == PM_SEM_COUNTER);
+
+    span = dst->lasttime;
+    tsub(&span, &dst->firsttime);
+    srcspan = src->lasttime;
+    tsub(&srcspan, &src->firsttime);
+    tadd(&span, &srcspan);
+    if (__pmtimevalSub(&src->lasttime, &dst->lasttime) > 0) {
+	dst->lasttime = src->lasttime;
+	dst->lastval = src->lastval;
+    }
+    dst->firsttime = dst->lasttime;
+    tsub(&dst->firsttime, &span);
+
+    /* counters have no minimum or maximum rate until count is non-zero */
+    if (!counter || src->count > 0) {
+	if ((counter && dst->count == 0) || src->min < dst->min) {
+	    dst->min = src->min;
+	    dst->mintime = src->mintime;
+	}
+	if ((counter && dst->count == 0) || src->max > dst->max) {
+	    dst->max = src->max;
+	    dst->maxtime = src->maxtime;
+	}
+    }
+    dst->count += src->count;
+    dst->markcount += src->markcount;
+    dst->sum += src->sum;
+    dst->stocave += src->stocave;
+    dst->timeave += src->timeave;
+    if (dst->sketch && src->sketch)
+	sketchmerge(dst->sketch, src->sketch);
+}
+
+/* fold the statistics for one metric from an archive into hashlist */
+static __pmHashWalkState
+mergemetric(const __pmHashNode *tp, void *arg)
+{
+    archData		*ap = (archData *)arg;
+    aveData		*src = (aveData *)tp->data;
+    aveData		*dst;
+    instData		*instdata, *srcinst;
+    __pmHashNode	*hptr;
+    int			j, differ;
+
+    if ((hptr = __pmHashSearch(src->desc.pmid, &hashlist)) == NULL) {
+	if (__pmHashAdd(src->desc.pmid, (void *)src, &hashlist) < 0)
+	    __pmNoMem("mergemetric.hashlist", sizeof(__pmHashNode), PM_FATAL_ERR);
+	return PM_HASH_WALK_DELETE_NEXT;
+    }
+
+    dst = (aveData *)hptr->data;
+    differ = (dst->desc.type != src->desc.type ||
+	      dst->desc.sem != src->desc.sem ||
+	      memcmp(&dst->desc.units, &src->desc.units, sizeof(pmUnits)) != 0);
+    if (differ)
+	pmiderr(src->desc.pmid, "metadata differs in archive %s, values ignored\n",
+		ap->name);
+    for (j = 0; j < src->listsize; j++) {
+	srcinst = src->instlist[j];
+	if (!differ) {
+	    if ((instdata = findinst(dst, j, srcinst->inst)) == NULL) {
+		addinst(dst, srcinst);
+		continue;
+	    }
+	    mergeinst(dst, instdata, srcinst);
+	}
+	if (srcinst->bin)
+	    free(srcinst->bin);
+	if (srcinst->sketch)
+	    sketchfree(srcinst->sketch);
+	free(srcinst);
+    }
+    if (src->instlist)
+	free(src->instlist);
+    __pmHashWalkCB(freenode, NULL, &src->insthash);
+    __pmHashClear(&src->insthash);
+    free(src);
+    return PM_HASH_WALK_DELETE_NEXT;
+}
+
+/*
+ * Summarize one archive (all in one pass) into its own hashlist,
+ * ready to be merged with the other archives.
+ */
+static void
+summarize(archData *ap)
+{
+    pmResult		*result;
+    pmResult		mark;
+    int			sts;
+
+    __pmHashInit(&ap->hashlist);
+    if (ap->ctx < 0 &&
+	(ap->ctx = pmNewContext(PM_CONTEXT_ARCHIVE, ap->name)) < 0) {
+	ap->sts = ap->ctx;
+	return;
+    }
+    if ((sts = pmUseContext(ap->ctx)) < 0 ||
+	(sts = pmSetMode(PM_MODE_FORW, &opts.start, 0)) < 0) {
+	ap->sts = sts;
+	return;
+    }
+
+    for ( ; ; ) {
+	if ((sts = pmFetchArchive(&result)) < 0)
+	    break;
+	if (opts.finish.tv_sec > result->timestamp.tv_sec ||
+	    (opts.finish.tv_sec == result->timestamp.tv_sec &&
+	     opts.finish.tv_usec >= result->timestamp.tv_usec)) {
+	    calcaverage(result, &ap->hashlist);
+	    pmFreeResult(result);
+	}
+	else {
+	    pmFreeResult(result);
+	    sts = PM_ERR_EOL;
+	    break;
+	}
+    }
+    ap->sts = sts;
+
+    /* this archive ends like a mark record, extending discrete metrics */
+    memset(&mark, 0, sizeof(mark));
+    if (pmGetArchiveEnd(&mark.timestamp) < 0 ||
+	__pmtimevalSub(&mark.timestamp, &opts.finish) > 0)
+	mark.timestamp = opts.finish;
+    markrecord(&mark, &ap->hashlist);
+}
+
+static archData *
+getarchive(void)
+{
+    archData	*ap = NULL;
+
+#ifdef PM_MULTI_THREAD
+    pthread_mutex_lock(&archlock);
+#endif
+    if (nextarchive < narchive)
+	ap = &archlist[nextarchive++];
+#ifdef PM_MULTI_THREAD
+    pthread_mutex_unlock(&archlock);
+#endif
+    return ap;
+}
+
+static void *
+summarizer(void *arg)
+{
+    archData	*ap;
+
+    while ((ap = getarchive()) != NULL)
+	summarize(ap);
+    return NULL;
+}
+
+/*
+ * Summarize each archive in parallel (up to one thread per CPU), then
+ * merge them in the order given - as each archive is read just once,
+ * value distributions come from the (mergeable) sketches.
+ */
+static int
+summarizeall(void)
+{
+    archData	*ap;
+    int		i, sts = PM_ERR_EOL;
+#ifdef PM_MULTI_THREAD
+    pthread_t	*tids;
+    long	nthreads;
+    size_t	size;
+
+    if ((nthreads = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+	nthreads = 1;
+    if (nthreads > narchive)
+	nthreads = narchive;
+    size = nthreads * sizeof(pthread_t);
+    if ((tids = (pthread_t *)malloc(size)) == NULL)
+	__pmNoMem("summarizeall.tids", size, PM_FATAL_ERR);
+    for (i = 0; i < nthreads; i++) {
+	if (pthread_create(&tids[i], NULL, summarizer, NULL) != 0)
+	    break;
+    }
+    if ((nthreads = i) == 0)
+	summarizer(NULL);
+    for (i = 0; i < nthreads; i++)
+	pthread_join(tids[i], NULL);
+    free(tids);
+#else
+    summarizer(NULL);
+#endif
+
+    for (i = 0; i < narchive; i++) {
+	ap = &archlist[i];
+	if (ap->ctx < 0) {
+	    fprintf(stderr, "%s: Cannot open archive \"%s\": %s\n",
+		    pmProgname, ap->name, pmErrStr(ap->sts));
+	    exit(1);
+	}
+	if (ap->sts != PM_ERR_EOL) {
+	    fprintf(stderr, "%s: fetch from \"%s\" failed: %s\n",
+		    pmProgname, ap->name, pmErrStr(ap->sts));
+	    sts = ap->sts;
+	}
+	__pmHashWalkCB(mergemetric, ap, &ap->hashlist);
+	__pmHashClear(&ap->hashlist);
+    }
+    return sts;
+}
+
+/*
+ * Traverse the namespace of each archive in turn - printsummary drops
+ * each metric once printed, so metrics in several archives print once.
+ */
+static int
+traverse(const char *name)
+{
+    int		i, sts = 0, found = 0;
+
+    if (narchive < 2)
+	return pmTraversePMNS(name, printsummary);
+    for (i = 0; i < narchive; i++) {
+	pmUseContext(archlist[i].ctx);
+	if ((sts = pmTraversePMNS(name, printsummary)) >= 0)
+	    found = 1;
+    }
+    pmUseContext(archlist[0].ctx);
+    return found ? 0 : sts;
+}
+
 static int
 override(int opt, pmOptions *opts)
 {
@@ -1054,6 +1612,10 @@ main(int argc, char *argv[])
 	    warnflag = 0;
 	    break;
 
+	case 'o':	/* one pass, bins estimated from sketches */
+	    onepass = 1;
+	    break;
+
 	case 'p':	/* number of digits after decimal point */
 	    precision = (unsigned int)strtol(opts.optarg, &endnum, 10);
 	    if (*endnum != '\0') {
@@ -1062,6 +1624,25 @@ main(int argc, char *argv[])
 	    }
 	    break;
 
+	case 'P':	/* percentiles, comma separated */
+	    for (endnum = opts.optarg; *endnum != '\0'; ) {
+		double	pct = strtod(endnum, &endnum);
+		size_t	size = (npct + 1) * sizeof(double);
+
+		if ((*endnum != '\0' && *endnum != ',') || pct < 0 || pct > 100) {
+		    pmprintf("%s: -P requires percentiles between 0 and 100\n",
+			    pmProgname);
+		    opts.errors++;
+		    break;
+		}
+		if ((pctlist = (double *)realloc(pctlist, size)) == NULL)
+		    __pmNoMem("percentiles", size, PM_FATAL_ERR);
+		pctlist[npct++] = pct;
+		if (*endnum == ',')
+		    endnum++;
+	    }
+	    break;
+
 	case 's':	/* print sums (and only sums) */
 	    stocaveflag = timeaveflag = lflag = countflag = minflag = maxflag = 0;
 	    sumflag = 1;
@@ -1093,12 +1674,14 @@ main(int argc, char *argv[])
 	exit(1);
     }
 
-    if (opts.narchives > 0) {
-	archive = opts.archives[0];
-    } else {
-	archive = argv[opts.optind++];
-	__pmAddOptArchive(&opts, archive);
+    if (opts.narchives == 0)
+	__pmAddOptArchiveList(&opts, argv[opts.optind++]);
+    if (opts.narchives == 0) {
+	pmprintf("Error: no archive specified\n\n");
+	pmUsageMessage(&opts);
+	exit(1);
     }
+    archive = opts.archives[0];
     opts.flags &= ~PM_OPTFLAG_DONE;
     __pmEndOptions(&opts);
 
@@ -1112,7 +1695,25 @@ main(int argc, char *argv[])
 	pmflush();	/* runtime errors only at this stage */
 	exit(EXIT_FAILURE);
     }
-    
+
+    /* several archives are read just once each, in parallel */
+    if (opts.narchives > 1) {
+	size_t	size = opts.narchives * sizeof(archData);
+
+	if ((archlist = (archData *)malloc(size)) == NULL)
+	    __pmNoMem("archives", size, PM_FATAL_ERR);
+	memset(archlist, 0, size);
+	for (i = 0; i < opts.narchives; i++) {
+	    archlist[i].name = opts.archives[i];
+	    archlist[i].ctx = i ? -1 : c;
+	}
+	narchive = opts.narchives;
+	onepass = 1;
+	pmUseContext(c);	/* time window setup opened other contexts */
+    }
+    usesketch = (npct > 0 || (nbins > 0 && onepass));
+    sketchinit();
+
     if ((sts = pmSetMode(PM_MODE_FORW, &opts.start, 0)) < 0) {
 	fprintf(stderr, "%s: pmSetMode failed: %s\n", pmProgname, pmErrStr(sts));
 	exit(1);
@@ -1129,7 +1730,9 @@ main(int argc, char *argv[])
     if (timespan.tv_sec > 86400) /* seconds per day: 60*60*24 */
 	dayflag = 1;
 
-    for (trip = 0; trip < 2; trip++) {	/* two passes if binning */
+    if (narchive > 1)
+	sts = summarizeall();
+    else for (trip = 0; trip < 2; trip++) {	/* two passes if binning */
 	for ( ; ; ) {
 	    if ((sts = pmFetchArchive(&result)) < 0)
 		break;
@@ -1138,7 +1741,7 @@ main(int argc, char *argv[])
 		(opts.finish.tv_sec == result->timestamp.tv_sec &&
 		 opts.finish.tv_usec >= result->timestamp.tv_usec)) {
 		if (trip == 0)
-		    calcaverage(result);
+		    calcaverage(result, &hashlist);
 		else
 		    calcbinning(result);
 		pmFreeResult(result);
@@ -1150,7 +1753,7 @@ main(int argc, char *argv[])
 	    }
 	}
 
-	if (trip == 0 && nbins > 0) {	/* distribute values into bins */
+	if (trip == 0 && nbins > 0 && !onepass) {	/* distribute values into bins */
 #ifdef PCP_DEBUG
 	    if (pmDebug & DBG_TRACE_APPL0)
 		fprintf(stderr, "resetting for second iteration\n");
@@ -1166,7 +1769,8 @@ main(int argc, char *argv[])
     }
 
     if (sts != PM_ERR_EOL) {
-	fprintf(stderr, "%s: fetch failed: %s\n", pmProgname, pmErrStr(sts));
+	if (narchive < 2)	/* else already reported for each archive */
+	    fprintf(stderr, "%s: fetch failed: %s\n", pmProgname, pmErrStr(sts));
 	exitstatus = 1;
     }
 
@@ -1174,7 +1778,7 @@ main(int argc, char *argv[])
 	printheaders();
 
     if (opts.optind >= argc) {	/* print all results */
-	if ((sts = pmTraversePMNS("", printsummary)) < 0) {
+	if ((sts = traverse("")) < 0) {
 	    fprintf(stderr, "%s: PMNS traversal failed: %s\n", pmProgname, pmErrStr(sts));
 	    exit(1);
 	}
@@ -1188,7 +1792,7 @@ main(int argc, char *argv[])
 		free(msg);
 		continue;
 	    }
-	    if ((sts = pmTraversePMNS(msp->metric, printsummary)) < 0)
+	    if ((sts = traverse(msp->metric)) < 0)
 		fprintf(stderr, "%s: PMNS traversal failed for %s: %s\n",
 			pmProgname, msp->metric, pmErrStr(sts));
 	    pmFreeMetricSpec(msp);
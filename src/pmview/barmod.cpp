@@ -130,6 +130,11 @@ BarMod::generate(SoNode *obj, float xSpace, float zSpace)
 		block._sep->addChild(block._scale);
 
 		block._sep->addChild(obj);
+
+		// refresh() changes are batched, see Modulate::flush()
+		quiet(block._sep);
+		quiet(block._color);
+		quiet(block._scale);
 	    }
 	}
 
@@ -172,11 +177,11 @@ BarMod::refresh(bool fetchFlag)
 	    if (metric.error(i) <= 0) {
 
 		if (block._state != Modulate::error) {
-		    block._color->rgb.setValue(_errorColor.getValue());
+		    setColor(block._color, _errorColor);
 		    if (_mod != color)
-			block._scale->scaleFactor.setValue(_xScale, 
-							   theMinScale,
-							   _zScale);
+			setScale(block._scale, _xScale,
+				 theMinScale,
+				 _zScale);
 		    block._state = Modulate::error;
 		}
 	    }
@@ -186,11 +191,11 @@ BarMod::refresh(bool fetchFlag)
                 
 		if (value > theNormError) {
 		    if (block._state != Modulate::saturated) {
-			block._color->rgb.setValue(Modulate::_saturatedColor);
+			setColor(block._color, Modulate::_saturatedColor);
 			if (_mod != color)
-			    block._scale->scaleFactor.setValue(_xScale, 
-							       _yScale, 
-							       _zScale);
+			    setScale(block._scale, _xScale,
+				     _yScale,
+				     _zScale);
 			block._state = Modulate::saturated;
 		    }
 		}
@@ -198,18 +203,18 @@ BarMod::refresh(bool fetchFlag)
 		    if (block._state != Modulate::normal) {
 			block._state = Modulate::normal;
 			if (_mod == yScale)
-			    block._color->rgb.setValue(_metrics->color(m).getValue());
+			    setColor(block._color, _metrics->color(m));
 		    }
 		    else if (_mod != yScale)
-			block._color->rgb.setValue(_colScale.step(unscaled).color().getValue());
+			setColor(block._color, _colScale.step(unscaled).color());
 		    if (_mod != color) {
 			if (value < Modulate::theMinScale)
 			    value = Modulate::theMinScale;
 			else if (value > 1.0)
 			    value = 1.0;
-			block._scale->scaleFactor.setValue(_xScale,
-							   _yScale * value,
-							   _zScale);
+			setScale(block._scale, _xScale,
+				 _yScale * value,
+				 _zScale);
 		    }
 
 		}
@@ -568,6 +573,7 @@ BarMod::regenerate(float xScale, float zScale, float xSpace, float zSpace)
 	    block._selected = false;
 	}
     }
+    _root->touch();	// color and scale are quiet, see generate()
 }
 
 const char *
@@ -39,6 +39,7 @@ ColorMod::ColorMod(const char *metric, double scale,
     _color->rgb.setValue(_errorColor.getValue());
     _root->addChild(_color);
     _root->addChild(obj);
+    quiet(_color);	// refresh() changes are batched, see Modulate::flush()
 
     if (_metrics->numValues() == 1 && _scale.numSteps() && status() >= 0) {
 	add();
@@ -74,7 +75,7 @@ ColorMod::refresh(bool fetchFlag)
 
     if (metric.error(0) <= 0) {
 	if (_state != Modulate::error) {
-	    _color->rgb.setValue(_errorColor.getValue());
+	    setColor(_color, _errorColor);
 	    _state = Modulate::error;
 	}
     }
@@ -82,14 +83,14 @@ ColorMod::refresh(bool fetchFlag)
 	double value = metric.value(0) * theScale;
 	if (value > theNormError) {
 	    if (_state != Modulate::saturated) {
-		_color->rgb.setValue(Modulate::_saturatedColor);
+		setColor(_color, Modulate::_saturatedColor);
 		_state = Modulate::saturated;
 	    }
 	}
 	else {
 	    if (_state != Modulate::normal)
 		_state = Modulate::normal;
-	    _color->rgb.setValue(_scale.step(value).color().getValue());
+	    setColor(_color, _scale.step(value).color());
 	}
     }
 }
@@ -113,8 +113,10 @@ ModList::add(Modulate *obj)
 void 
 ModList::refresh(bool fetchFlag)
 {
-    for (int i = 0; i < _list.size(); i++)
+    for (int i = 0; i < _list.size(); i++) {
 	_list[i]->refresh(fetchFlag);
+	_list[i]->flush();
+    }
     for (int n=elementalNodeList.getLength()-1; n >= 0; n--) {
 	elementalNodeList[n]->doAction(_viewer->getGLRenderAction());
     }
@@ -12,8 +12,12 @@
  * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
  * for more details.
  */
+#include <math.h>
+#include <Inventor/nodes/SoBaseColor.h>
+#include <Inventor/nodes/SoScale.h>
 #include <Inventor/nodes/SoSeparator.h>
 #include <Inventor/nodes/SoSelection.h>
+#include <Inventor/nodes/SoTranslation.h>
 #include "modulate.h"
 #include "modlist.h"
 
@@ -27,6 +31,8 @@ const QString	Modulate::theStartText = "Metric has not been fetched from source"
 const float	Modulate::theDefErrorColor[] = {0.2, 0.2, 0.2};
 const float	Modulate::theDefSaturatedColor[] = {1.0, 1.0, 1.0};
 const double	Modulate::theMinScale = 0.01;
+const float	Modulate::theMinDelta = 0.001;		// of current size
+const float	Modulate::theMinColorDelta = 1.0 / 512.0;	// below 8 bits
 
 Modulate::~Modulate()
 {
@@ -34,7 +40,7 @@ Modulate::~Modulate()
 
 Modulate::Modulate(const char *metric, double scale,
 			   MetricList::AlignColor align)
-: _sts(0), _metrics(0), _root(0)
+: _sts(0), _changes(0), _metrics(0), _root(0)
 {
     _metrics = new MetricList();
     _sts = _metrics->add(metric, scale);
@@ -48,7 +54,7 @@ Modulate::Modulate(const char *metric, double scale,
 Modulate::Modulate(const char *metric, double scale, 
 			   const SbColor &color,
 			   MetricList::AlignColor align)
-:  _sts(0), _metrics(0), _root(0)
+:  _sts(0), _changes(0), _metrics(0), _root(0)
 {
     _metrics = new MetricList();
     _sts = _metrics->add(metric, scale);
@@ -61,7 +67,7 @@ Modulate::Modulate(const char *metric, double scale,
 }
 
 Modulate::Modulate(MetricList *list)
-:  _sts(0), _metrics(list), _root(0)
+:  _sts(0), _changes(0), _metrics(list), _root(0)
 {
     _saturatedColor.setValue(theDefSaturatedColor);
     _errorColor.setValue(theDefErrorColor);
@@ -75,6 +81,97 @@ Modulate::add()
     return str;
 }
 
+//
+// With hundreds or thousands of bars in a scene, notifying the scene
+// graph of every individual change costs far more than the changes
+// themselves.  Modulated nodes are made quiet, and the separators
+// holding them do not cache (they would never see the changes); the
+// whole modulated subtree is touched once per refresh instead.
+//
+void
+Modulate::quiet(SoNode *node)
+{
+    node->enableNotify(FALSE);
+}
+
+void
+Modulate::quiet(SoSeparator *sep)
+{
+    sep->renderCaching.setValue(SoSeparator::OFF);
+    sep->boundingBoxCaching.setValue(SoSeparator::OFF);
+}
+
+static inline bool
+closeTo(float a, float b, float delta)
+{
+    float diff = a > b ? a - b : b - a;
+    return diff <= delta;
+}
+
+// within the given fraction of the larger magnitude
+static inline bool
+closeToScale(float a, float b, float fraction)
+{
+    float size = fabsf(a) > fabsf(b) ? fabsf(a) : fabsf(b);
+    return closeTo(a, b, size * fraction);
+}
+
+void
+Modulate::setColor(SoBaseColor *node, const SbColor &color)
+{
+    const SbColor &now = node->rgb[0];
+
+    if (node->rgb.getNum() == 1 &&
+	closeTo(now[0], color[0], theMinColorDelta) &&
+	closeTo(now[1], color[1], theMinColorDelta) &&
+	closeTo(now[2], color[2], theMinColorDelta))
+	return;
+    node->rgb.setValue(color);
+    _changes++;
+}
+
+void
+Modulate::setScale(SoScale *node, float x, float y, float z)
+{
+    const SbVec3f &now = node->scaleFactor.getValue();
+
+    if (closeToScale(now[0], x, theMinDelta) &&
+	closeToScale(now[1], y, theMinDelta) &&
+	closeToScale(now[2], z, theMinDelta))
+	return;
+    node->scaleFactor.setValue(x, y, z);
+    _changes++;
+}
+
+void
+Modulate::setTranslation(SoTranslation *node, float x, float y, float z)
+{
+    const SbVec3f &now = node->translation.getValue();
+
+    if (closeToScale(now[0], x, theMinDelta) &&
+	closeToScale(now[1], y, theMinDelta) &&
+	closeToScale(now[2], z, theMinDelta))
+	return;
+    node->translation.setValue(x, y, z);
+    _changes++;
+}
+
+void
+Modulate::flush()
+{
+    if (_changes == 0 || _root == NULL)
+	return;
+
+#ifdef PCP_DEBUG
+    if (pmDebug & DBG_TRACE_APPL2)
+	cerr << "Modulate::flush: " << _changes << " changes to "
+	     << _root->getName().getString() << endl;
+#endif
+
+    _root->touch();
+    _changes = 0;
+}
+
 QTextStream &
 operator<<(QTextStream & os, const Modulate &rhs)
 {
@@ -19,6 +19,10 @@
 #include "metriclist.h"
 
 class SoSeparator;
+class SoNode;
+class SoBaseColor;
+class SoScale;
+class SoTranslation;
 class SoPath;
 class Launch;
 class Record;
@@ -39,8 +43,11 @@ protected:
     static const float		theDefErrorColor[];
     static const float		theDefSaturatedColor[];
     static const double		theMinScale;
+    static const float		theMinDelta;
+    static const float		theMinColorDelta;
 
     int				_sts;
+    int				_changes;
     MetricList			*_metrics;
     SoSeparator			*_root;
     SbColor			_errorColor;
@@ -77,6 +84,9 @@ public:
 
     virtual void refresh(bool fetchFlag) = 0;
 
+    // Notify the scene graph once of all changes made by refresh()
+    void flush();
+
     // Return the number of objects still selected
     virtual void selectAll();
     virtual int select(SoPath *)
@@ -106,6 +116,15 @@ protected:
 
     static void add(Modulate *obj);
 
+    // Nodes modulated by refresh() do not notify the scene graph of
+    // each change, changes below display resolution are not applied,
+    // and flush() notifies once for all those that were
+    static void quiet(SoNode *node);
+    static void quiet(SoSeparator *sep);
+    void setColor(SoBaseColor *node, const SbColor &color);
+    void setScale(SoScale *node, float x, float y, float z);
+    void setTranslation(SoTranslation *node, float x, float y, float z);
+
 private:
 
     Modulate();
@@ -55,6 +55,10 @@ ScaleMod::ScaleMod(const char *str,
         _root->addChild(_scale);
         _root->addChild(obj);
 
+	// refresh() changes are batched, see Modulate::flush()
+	quiet(_color);
+	quiet(_scale);
+
 	add();
 
 #ifdef PCP_DEBUG
@@ -82,10 +86,10 @@ ScaleMod::refresh(bool fetchFlag)
 
     if (metric.error(0) <= 0) {
         if (_state != Modulate::error) {
-            _color->rgb.setValue(_errorColor.getValue());
-            _scale->scaleFactor.setValue((_xScale==0.0f ? 1.0 : theMinScale),
-					 (_yScale==0.0f ? 1.0 : theMinScale),
-					 (_zScale==0.0f ? 1.0 : theMinScale));
+            setColor(_color, _errorColor);
+            setScale(_scale, (_xScale==0.0f ? 1.0 : theMinScale),
+		     (_yScale==0.0f ? 1.0 : theMinScale),
+		     (_zScale==0.0f ? 1.0 : theMinScale));
             _state = Modulate::error;
         }
     }
@@ -93,23 +97,23 @@ ScaleMod::refresh(bool fetchFlag)
         double value = metric.value(0) * theScale;
         if (value > theNormError) {
             if (_state != Modulate::saturated) {
-                _color->rgb.setValue(_saturatedColor.getValue());
-                _scale->scaleFactor.setValue(1.0, 1.0, 1.0);
+                setColor(_color, _saturatedColor);
+                setScale(_scale, 1.0, 1.0, 1.0);
                 _state = Modulate::saturated;
             }
         }
         else {
             if (_state != Modulate::normal) {
-                _color->rgb.setValue(_metrics->color(0).getValue());
+                setColor(_color, _metrics->color(0));
                 _state = Modulate::normal;
             }
             if (value < Modulate::theMinScale)
                 value = Modulate::theMinScale;
             else if (value > 1.0)
                 value = 1.0;
-            _scale->scaleFactor.setValue((_xScale==0.0f ? 1.0 : _xScale*value),
-					 (_yScale==0.0f ? 1.0 : _yScale*value),
-					 (_zScale==0.0f ? 1.0 : _zScale*value));
+            setScale(_scale, (_xScale==0.0f ? 1.0 : _xScale*value),
+		     (_yScale==0.0f ? 1.0 : _yScale*value),
+		     (_zScale==0.0f ? 1.0 : _zScale*value));
         }
     }
 }
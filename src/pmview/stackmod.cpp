@@ -102,10 +102,16 @@ StackMod::StackMod(MetricList *metrics, SoNode *obj, StackMod::Height height)
 		    block._tran = new SoTranslation();
 		    block._tran->translation.setValue(0.0, initScale, 0.0);
 		    _root->addChild(block._tran);
+		    quiet(block._tran);
 		}
 		else {
 		    block._tran = NULL;
 		}
+
+		// refresh() changes are batched, see Modulate::flush()
+		quiet(block._sep);
+		quiet(block._color);
+		quiet(block._scale);
 		_blocks[v] = block;
 	    }
 	}
@@ -133,6 +139,9 @@ StackMod::StackMod(MetricList *metrics, SoNode *obj, StackMod::Height height)
 	    _switch->addChild(block._scale);
 
 	    _switch->addChild(obj);
+	    quiet(block._sep);
+	    quiet(block._color);
+	    quiet(block._scale);
 	    _blocks[v] = block;
 	}
 
@@ -189,7 +198,7 @@ StackMod::refresh(bool fetchFlag)
 
 	    if (metric.error(i) <= 0) {
 		if (block._state != Modulate::error) {
-		    block._color->rgb.setValue(_errorColor.getValue());
+		    setColor(block._color, _errorColor);
 		    block._state = Modulate::error;
 		}
 		value = Modulate::theMinScale;
@@ -205,9 +214,9 @@ StackMod::refresh(bool fetchFlag)
 		     block._state == Modulate::start) {
 		block._state = Modulate::normal;
 		if (numMetrics == 1)
-		    block._color->rgb.setValue(_metrics->color(v).getValue());
+		    setColor(block._color, _metrics->color(v));
 		else
-		    block._color->rgb.setValue(_metrics->color(m).getValue());
+		    setColor(block._color, _metrics->color(m));
 		value = metric.value(i) * theScale;
 		if (value < theMinScale)
 		    value = theMinScale;
@@ -242,7 +251,7 @@ StackMod::refresh(bool fetchFlag)
 	    for (v = 0; v < numValues; v++) {
 		StackBlock &block = _blocks[v];
 		if (block._state != Modulate::error) {
-		    block._color->rgb.setValue(Modulate::_saturatedColor);
+		    setColor(block._color, Modulate::_saturatedColor);
 		    block._state = Modulate::saturated;
 		}
 	    }
@@ -256,9 +265,9 @@ StackMod::refresh(bool fetchFlag)
 		if (block._state == Modulate::saturated) {
 		    block._state = Modulate::normal;
 		    if (numMetrics == 1)
-			block._color->rgb.setValue(_metrics->color(v).getValue());
+			setColor(block._color, _metrics->color(v));
 		    else
-			block._color->rgb.setValue(_metrics->color(m).getValue());
+			setColor(block._color, _metrics->color(m));
 		}
 	    }
 	}
@@ -296,21 +305,21 @@ StackMod::refresh(bool fetchFlag)
 	    cerr << '[' << v << "] scale = " << value << endl;
 #endif
 
-	block._scale->scaleFactor.setValue(1.0, value, 1.0);
+	setScale(block._scale, 1.0, value, 1.0);
 	
 	if (v < numValues-1 || _height == fixed)
-	    block._tran->translation.setValue(0.0, value, 0.0);
+	    setTranslation(block._tran, 0.0, value, 0.0);
     }
 
     if (_height == fixed) {
 	sum = 1.0 - sum;
 	if (sum >= theMinScale) {
 	    _switch->whichChild.setValue(SO_SWITCH_ALL);
-	    _blocks[v]._scale->scaleFactor.setValue(1.0, sum, 1.0);
+	    setScale(_blocks[v]._scale, 1.0, sum, 1.0);
 	}
 	else {
 	    _switch->whichChild.setValue(SO_SWITCH_NONE);
-	    _blocks[v]._scale->scaleFactor.setValue(1.0, theMinScale, 1.0);
+	    setScale(_blocks[v]._scale, 1.0, theMinScale, 1.0);
 	}
     }
 }
@@ -80,6 +80,7 @@ MOD_INIT(cmmv)
     dict_add(dict, "MMV_TYPE_DOUBLE", MMV_TYPE_DOUBLE);
     dict_add(dict, "MMV_TYPE_STRING", MMV_TYPE_STRING);
     dict_add(dict, "MMV_TYPE_ELAPSED", MMV_TYPE_ELAPSED);
+    dict_add(dict, "MMV_TYPE_HISTOGRAM", MMV_TYPE_HISTOGRAM);
 
     dict_add(dict, "MMV_SEM_COUNTER", MMV_SEM_COUNTER);
     dict_add(dict, "MMV_SEM_INSTANT", MMV_SEM_INSTANT);
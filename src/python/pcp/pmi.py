@@ -51,11 +51,13 @@
         del log
 """
 
-from pcp.pmapi import pmID, pmInDom, pmUnits, pmResult
-from cpmi import pmiErrSymDict, PMI_MAXERRMSGLEN
+from pcp.pmapi import pmID, pmInDom, pmUnits, pmResult, pmAtomValue, timeval
+from cpmi import pmiErrSymDict, PMI_MAXERRMSGLEN, PMI_ERR_BADHANDLE
+import cpmapi as c_api
 
 import ctypes
-from ctypes import cast, c_int, c_char_p, POINTER
+from ctypes import cast, c_int, c_uint, c_longlong, c_ulonglong
+from ctypes import c_float, c_double, c_char_p, c_void_p, POINTER, sizeof
 
 # Performance Co-Pilot PMI library (C)
 LIBPCP_IMPORT = ctypes.CDLL(ctypes.util.find_library("pcp_import"))
@@ -117,6 +119,36 @@ LIBPCP_IMPORT.pmiWrite.argtypes = [c_int, c_int]
 LIBPCP_IMPORT.pmiPutResult.restype = c_int
 LIBPCP_IMPORT.pmiPutResult.argtypes = [POINTER(pmResult)]
 
+LIBPCP_IMPORT.pmiPutAtomValues.restype = c_int
+LIBPCP_IMPORT.pmiPutAtomValues.argtypes = [
+        c_int, POINTER(c_int), POINTER(pmAtomValue)]
+
+LIBPCP_IMPORT.pmiWriteColumns.restype = c_int
+LIBPCP_IMPORT.pmiWriteColumns.argtypes = [
+        c_int, POINTER(timeval), c_int, POINTER(c_int), POINTER(c_void_p)]
+
+# pmAtomValue field holding a value of each metric type
+PMI_ATOM_FIELDS = {
+        c_api.PM_TYPE_32 : "l",
+        c_api.PM_TYPE_U32 : "ul",
+        c_api.PM_TYPE_64 : "ll",
+        c_api.PM_TYPE_U64 : "ull",
+        c_api.PM_TYPE_FLOAT : "f",
+        c_api.PM_TYPE_DOUBLE : "d",
+        c_api.PM_TYPE_STRING : "cp",
+}
+
+# C type of the values in a pmiWriteColumns column, for each metric type
+PMI_COLUMN_TYPES = {
+        c_api.PM_TYPE_32 : c_int,
+        c_api.PM_TYPE_U32 : c_uint,
+        c_api.PM_TYPE_64 : c_longlong,
+        c_api.PM_TYPE_U64 : c_ulonglong,
+        c_api.PM_TYPE_FLOAT : c_float,
+        c_api.PM_TYPE_DOUBLE : c_double,
+        c_api.PM_TYPE_STRING : c_char_p,
+}
+
 #
 # definition of exception classes
 #
@@ -171,6 +203,8 @@ class pmiLogImport(object):
         if type(path) != type(b''):
             path = path.encode('utf-8')
         self._path = path        # the archive path (file name)
+        self._types = {}         # metric name to type, for handles
+        self._htypes = {}        # handle to metric type, for bulk values
         self._ctx = LIBPCP_IMPORT.pmiStart(c_char_p(path), inherit)
         if self._ctx < 0:
             raise pmiErr(self._ctx)
@@ -239,6 +273,7 @@ class pmiLogImport(object):
                                         pmid, typed, indom, sem, units)
         if status < 0:
             raise pmiErr(status)
+        self._types[name] = typed
         return status
 
     def pmiAddInstance(self, indom, instance, instid):
@@ -282,6 +317,8 @@ class pmiLogImport(object):
         status = LIBPCP_IMPORT.pmiGetHandle(c_char_p(name), c_char_p(inst))
         if status < 0:
             raise pmiErr(status)
+        if name in self._types:
+            self._htypes[status] = self._types[name]
         return status
 
     def pmiPutValueHandle(self, handle, value):
@@ -306,6 +343,86 @@ class pmiLogImport(object):
             raise pmiErr(status)
         return status
 
+    def _handletype(self, handle):
+        """ Metric type for a handle from pmiGetHandle """
+        if handle not in self._htypes:
+            raise pmiErr(PMI_ERR_BADHANDLE)
+        return self._htypes[handle]
+
+    def pmiPutAtomValues(self, handles, values):
+        """PMI - add values for several metric-instance pairs via handles,
+           each value is of the type of the metric (not a string)
+        """
+        status = LIBPCP_IMPORT.pmiUseContext(self._ctx)
+        if status < 0:
+            raise pmiErr(status)
+        count = len(handles)
+        atoms = (pmAtomValue * count)()
+        for i in range(count):
+            typed = self._handletype(handles[i])
+            value = values[i]
+            if typed == c_api.PM_TYPE_STRING and type(value) != type(b''):
+                value = value.encode('utf-8')
+            setattr(atoms[i], PMI_ATOM_FIELDS[typed], value)
+        hdls = (c_int * count)(*handles)
+        status = LIBPCP_IMPORT.pmiPutAtomValues(count, hdls, atoms)
+        if status < 0:
+            raise pmiErr(status)
+        return status
+
+    def _column(self, handle, column, nrow):
+        """ ctypes array of the values in one pmiWriteColumns column """
+        typed = self._handletype(handle)
+        ctype = PMI_COLUMN_TYPES[typed]
+        if len(column) != nrow:
+            raise ValueError("column length differs from number of timestamps")
+        if typed == c_api.PM_TYPE_STRING:
+            column = [value if value is None or type(value) == type(b'')
+                      else value.encode('utf-8') for value in column]
+        else:
+            # use the caller's memory when it already holds the C type
+            try:
+                view = memoryview(column)
+                if view.itemsize == sizeof(ctype) and not view.readonly and \
+                   (view.format[-1:] in ('f', 'd')) == \
+                   (ctype in (c_float, c_double)):
+                    return (ctype * nrow).from_buffer(column)
+            except (TypeError, ValueError):
+                pass
+        return (ctype * nrow)(*column)
+
+    def pmiWriteColumns(self, stamps, handles, columns):
+        """PMI - write one record per timestamp to a Log Import archive,
+           with values taken from one column per handle (a sequence of
+           values of the type of the metric, None for a missing string)
+
+           Values already added to the current record are included in the
+           first record.  If pmiErr is raised for a bad handle or for
+           timestamps out of order, nothing has been written and those
+           values are kept; if a value is rejected or a record cannot be
+           written, the record in error is discarded.
+        """
+        status = LIBPCP_IMPORT.pmiUseContext(self._ctx)
+        if status < 0:
+            raise pmiErr(status)
+        nrow = len(stamps)
+        ncol = len(handles)
+        tvs = (timeval * nrow)()
+        for i in range(nrow):
+            if isinstance(stamps[i], timeval):
+                tvs[i] = stamps[i]
+            else:
+                usec = int(round(stamps[i] * 1e6))
+                tvs[i].tv_sec, tvs[i].tv_usec = divmod(usec, 1000000)
+        arrays = [self._column(handles[c], columns[c], nrow)
+                  for c in range(ncol)]
+        cols = (c_void_p * ncol)(*[cast(a, c_void_p) for a in arrays])
+        hdls = (c_int * ncol)(*handles)
+        status = LIBPCP_IMPORT.pmiWriteColumns(nrow, tvs, ncol, hdls, cols)
+        if status < 0:
+            raise pmiErr(status)
+        return status
+
     def put_result(self, result):
         """PMI - add a data record to a Log Import archive """
         status = LIBPCP_IMPORT.pmiUseContext(self._ctx)
@@ -1253,6 +1253,7 @@ MOD_INIT(cpmda)
     pmda_dict_add(dict, "PMDA_CACHE_SYNC", PMDA_CACHE_SYNC);
     pmda_dict_add(dict, "PMDA_CACHE_DUMP", PMDA_CACHE_DUMP);
     pmda_dict_add(dict, "PMDA_CACHE_DUMP_ALL", PMDA_CACHE_DUMP_ALL);
+    pmda_dict_add(dict, "PMDA_CACHE_JOURNAL", PMDA_CACHE_JOURNAL);
 
     return MOD_SUCCESS_VAL(module);
 }